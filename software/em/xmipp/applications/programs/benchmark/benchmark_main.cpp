@@ -0,0 +1,311 @@
+/***************************************************************************
+ *
+ * Authors:     agent (agent@local)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <data/xmipp_program.h>
+#include <data/xmipp_funcs.h>
+#include <data/ctf.h>
+#include <data/xmipp_fftw.h>
+#include <reconstruction/symmetrize.h>
+#include <classification/gaussian_kerdensom.h>
+#include <classification/batch_som.h>
+#include <classification/feature_matrix.h>
+#include <dimred/dimred_tools.h>
+
+/* Time some computational kernels with synthetic data. The unit tests check
+ * that the fast versions give the same results, this program only measures
+ * how long they take. */
+class ProgBenchmark: public XmippProgram
+{
+protected:
+    String kernel;
+    int size, repeat, Nthreads;
+
+    void defineParams()
+    {
+        addUsageLine("Time some computational kernels with synthetic data.");
+        addUsageLine("+The results of the kernels are checked by the unit tests, this program only measures their time.");
+        addParamsLine("  --kernel <kernel>        : Kernel to time");
+        addParamsLine("     where <kernel>");
+        addParamsLine("       ctf                 : CTF images with CTFDescription and CTFImageGenerator");
+        addParamsLine("       fftw                : Fourier resize to half the size in double and single precision");
+        addParamsLine("       kerdensom           : KerDenSOM training and best matches of 2000 vectors of --size features");
+        addParamsLine("       knn                 : Exact and approximate 12 nearest neighbours of 5000 vectors of --size features");
+        addParamsLine("       som                 : Batch SOM training of 2000 vectors of --size features");
+        addParamsLine("       symmetrize          : Symmetrization of a volume with the groups c4, d3, t, o and i");
+        addParamsLine("  [--size <n=256>]         : Size of the images or volumes");
+        addParamsLine("  [--repeat <n=100>]       : Number of times the kernel is run");
+        addParamsLine("  [--thr <N=1>]            : Number of threads (for the kernels that use them)");
+        addExampleLine("Time the generation of 200 CTF images of 256x256", false);
+        addExampleLine("xmipp_benchmark --kernel ctf --size 256 --repeat 200");
+        addExampleLine("Time the resize of 100 images from 512x512 to 256x256 in double and single precision", false);
+        addExampleLine("xmipp_benchmark --kernel fftw --size 512 --repeat 100");
+        addExampleLine("Time the KerDenSOM training with 1 and 8 threads on vectors of 1024 features", false);
+        addExampleLine("xmipp_benchmark --kernel kerdensom --size 1024 --repeat 2 --thr 8");
+        addExampleLine("Time the nearest neighbours search with 4 threads on vectors of 64 features", false);
+        addExampleLine("xmipp_benchmark --kernel knn --size 64 --repeat 3 --thr 4");
+        addExampleLine("Time the batch SOM training with 1 and 8 threads on vectors of 1024 features", false);
+        addExampleLine("xmipp_benchmark --kernel som --size 1024 --repeat 2 --thr 8");
+        addExampleLine("Time the symmetrization of volumes of 256^3 and 512^3 with 8 threads", false);
+        addExampleLine("xmipp_benchmark --kernel symmetrize --size 256 --repeat 3 --thr 8");
+        addExampleLine("xmipp_benchmark --kernel symmetrize --size 512 --repeat 1 --thr 8");
+    }
+
+    void readParams()
+    {
+        kernel = getParam("--kernel");
+        size = getIntParam("--size");
+        repeat = getIntParam("--repeat");
+        Nthreads = getIntParam("--thr");
+    }
+
+    void show() const
+    {
+        if (verbose==0)
+            return;
+        std::cout << "Kernel:  " << kernel << std::endl
+                  << "Size:    " << size << std::endl
+                  << "Repeat:  " << repeat << std::endl
+                  << "Threads: " << Nthreads << std::endl;
+    }
+
+    /* Report the time of a kernel in ms and its throughput */
+    void report(const String &name, size_t ms, const String &unit)
+    {
+        double s = std::max(ms, (size_t)1) / 1000.0;
+        std::cout << formatString("%-40s %10.3f s %12.2f %s/s", name.c_str(), s, repeat / s, unit.c_str())
+                  << std::endl;
+    }
+
+    void benchmarkCTF()
+    {
+        CTFDescription ctf;
+        ctf.enable_CTFnoise=false;
+        ctf.Tm=1.5;
+        ctf.kV=300;
+        ctf.DeltafU=12000;
+        ctf.DeltafV=14000;
+        ctf.azimuthal_angle=30;
+        ctf.Cs=2;
+        ctf.Q0=0.1;
+        ctf.alpha=0.5;
+        ctf.DeltaR=3;
+        ctf.produceSideInfo();
+
+        CTFImageGenerator generator;
+        generator.initialize(size, size, ctf.Tm);
+        MultidimArray<double> ctfImg;
+        Timer t;
+
+        t.tic();
+        for (int k=0; k<repeat; ++k)
+            ctf.generateCTF(size, size, ctfImg);
+        report("CTFDescription::generateCTF", t.elapsed(), "images");
+
+        t.tic();
+        for (int k=0; k<repeat; ++k)
+            generator.generateCTF(ctf, ctfImg);
+        report("CTFImageGenerator::generateCTF", t.elapsed(), "images");
+    }
+
+    void benchmarkFFTW()
+    {
+        FourierResizer resizer;
+        FourierResizerFloat resizerFloat;
+        resizer.setOutputSize(1,size/2,size/2);
+        resizerFloat.setOutputSize(1,size/2,size/2);
+        resizer.in.resizeNoCopy(size,size);
+        resizer.in.initRandom(0,1);
+        typeCast(resizer.in,resizerFloat.in);
+        Timer t;
+
+        t.tic();
+        for (int k=0; k<repeat; ++k)
+            resizer.resize();
+        report(formatString("FourierResizer (%lu bytes per image)",
+                            (unsigned long)(MULTIDIM_SIZE(resizer.in)*sizeof(double))),
+               t.elapsed(), "images");
+
+        t.tic();
+        for (int k=0; k<repeat; ++k)
+            resizerFloat.resize();
+        report(formatString("FourierResizerFloat (%lu bytes per image)",
+                            (unsigned long)(MULTIDIM_SIZE(resizerFloat.in)*sizeof(float))),
+               t.elapsed(), "images");
+    }
+
+    /* 2000 vectors of size features in two clusters, so that the maps have
+     * something to learn */
+    void generateVectors(ClassicTrainingVectors &ts)
+    {
+        FeatureVector v(size);
+        for (int n=0; n<2000; ++n)
+        {
+            double center=(n%2==0) ? -1 : 1;
+            for (int j=0; j<size; ++j)
+                v[j]=(floatFeature)rnd_gaus(center,1);
+            ts.add(v);
+        }
+    }
+
+    void benchmarkKerDenSOM()
+    {
+        ClassicTrainingVectors ts(size, false);
+        generateVectors(ts);
+
+        FileName fnRoot, fnConvergence;
+        fnRoot.initUniqueName("/tmp/benchmarkKerDenSOM_XXXXXX");
+        fnConvergence=fnRoot+".xmd";
+        TextualListener listener;
+        listener.setVerbosity() = 0;
+        Timer t;
+        int threads[2]={1, Nthreads};
+        for (int n=0; n<((Nthreads>1) ? 2 : 1); ++n)
+        {
+            t.tic();
+            for (int k=0; k<repeat; ++k)
+            {
+                init_random_generator(1);
+                FuzzyMap map("RECT", 10, 5, ts);
+                GaussianKerDenSOM som(1000, 100, 5, 1e-7, 20);
+                som.setListener(&listener);
+                som.setThreads(threads[n]);
+                som.train(map, ts, fnConvergence);
+            }
+            report(formatString("GaussianKerDenSOM::train (%d threads)", threads[n]), t.elapsed(), "trainings");
+        }
+        fnRoot.deleteFile();
+        fnConvergence.deleteFile();
+
+        FuzzyMap map("RECT", 10, 5, ts);
+        FeatureMatrix codeMatrix, samplesMatrix;
+        codeMatrix.fromVectors(map.theItems);
+        samplesMatrix.fromVectors(ts.theItems);
+        std::vector<unsigned> winners;
+        for (int n=0; n<((Nthreads>1) ? 2 : 1); ++n)
+        {
+            t.tic();
+            for (int k=0; k<repeat; ++k)
+                bestMatches(codeMatrix, samplesMatrix, winners, NULL, threads[n]);
+            report(formatString("bestMatches (%d threads)", threads[n]), t.elapsed(), "sets");
+        }
+    }
+
+    void benchmarkSOM()
+    {
+        ClassicTrainingVectors ts(size, false);
+        generateVectors(ts);
+
+        TextualListener listener;
+        listener.setVerbosity() = 0;
+        Descent radius(3, 1);
+        Timer t;
+        int threads[2]={1, Nthreads};
+        for (int n=0; n<((Nthreads>1) ? 2 : 1); ++n)
+        {
+            t.tic();
+            for (int k=0; k<repeat; ++k)
+            {
+                init_random_generator(1);
+                ClassificationMap map("RECT", 10, 5, ts);
+                BatchSOM som(radius, 20);
+                som.setListener(&listener);
+                som.setThreads(threads[n]);
+                som.train(map, ts);
+            }
+            report(formatString("BatchSOM::train (%d threads)", threads[n]), t.elapsed(), "trainings");
+        }
+    }
+
+    /* The approximate search is timed with 8 trees and the fraction of the
+     * exact neighbours that it finds is shown */
+    void benchmarkKNN()
+    {
+        Matrix2D<double> X(5000, size);
+        for (size_t i=0; i<MAT_YSIZE(X); ++i)
+        {
+            double center=(i%2==0) ? -1 : 1;
+            for (size_t j=0; j<MAT_XSIZE(X); ++j)
+                MAT_ELEM(X,i,j)=rnd_gaus(center,1);
+        }
+
+        const int K=12;
+        Matrix2D<int> idxExact, idxApprox;
+        Matrix2D<double> distance;
+        Timer t;
+
+        t.tic();
+        for (int k=0; k<repeat; ++k)
+            kNearestNeighboursExact(X, K, idxExact, distance, NULL, true, Nthreads);
+        report(formatString("kNearestNeighboursExact (%d threads)", Nthreads), t.elapsed(), "searches");
+
+        t.tic();
+        for (int k=0; k<repeat; ++k)
+            kNearestNeighboursApproximate(X, K, idxApprox, distance, NULL, true, 8, 2, Nthreads);
+        report(formatString("kNearestNeighboursApproximate (%d threads)", Nthreads), t.elapsed(), "searches");
+
+        std::cout << formatString("%-40s %10.4f", "nearestNeighboursRecall",
+                                  nearestNeighboursRecall(idxExact, idxApprox)) << std::endl;
+    }
+
+    void benchmarkSymmetrize()
+    {
+        MultidimArray<double> V(size,size,size), Vsym;
+        V.initRandom(0,1);
+        V.setXmippOrigin();
+
+        const char *groups[]={"c4","d3","t","o","i"};
+        SymList SL;
+        Timer t;
+        for (int g=0; g<5; g++)
+        {
+            SL.readSymmetryFile(groups[g]);
+            t.tic();
+            for (int k=0; k<repeat; ++k)
+                symmetrizeVolume(SL, V, Vsym, BSPLINE3, DONT_WRAP, false, false, false, false, false,
+                                 0.0, 0.0, 0.0, 0.95, NULL, Nthreads);
+            report(formatString("symmetrizeVolume %s (%d operators)", groups[g], SL.symsNo()),
+                   t.elapsed(), "volumes");
+        }
+    }
+
+    void run()
+    {
+        show();
+        if (kernel == "ctf")
+            benchmarkCTF();
+        else if (kernel == "fftw")
+            benchmarkFFTW();
+        else if (kernel == "kerdensom")
+            benchmarkKerDenSOM();
+        else if (kernel == "knn")
+            benchmarkKNN();
+        else if (kernel == "som")
+            benchmarkSOM();
+        else if (kernel == "symmetrize")
+            benchmarkSymmetrize();
+    }
+};
+
+RUN_XMIPP_PROGRAM(ProgBenchmark)
@@ -30,6 +30,7 @@
 #include <data/xmipp_image_generic.h>
 #include <data/metadata.h>
 #include <data/mask.h>
+#include <data/histogram.h>
 
 /* PROGRAM ----------------------------------------------------------------- */
 class ProgStatistics: public XmippMetadataProgram
@@ -54,7 +55,24 @@ protected:
     int max_length;
 
 
-    FileName maskFileName, statsRoot;
+    FileName maskFileName, statsRoot, fnHist;
+
+    /* Statistics of the images of a batch */
+    struct ImageStats
+    {
+        double rot, tilt, psi;
+        double min_val, max_val, avg, stddev;
+    };
+
+    /* The statistics of each image of a batch are computed by one of the
+     * Nthreads threads and they are shown and stored in the input order.
+     * If the histogram or the summary of all pixels are needed, each thread
+     * also accumulates the statistics of its pixels. */
+    int Nthreads;
+    bool accumulatePixels;
+    std::vector<ImageStats> batchStats;
+    std::vector<StatisticsAccumulator> threadStats;
+    StatisticsAccumulator globalStats;
 
     void defineParams()
     {
@@ -69,6 +87,8 @@ protected:
         addParamsLine("[--show_angles]   : Also show angles in the image header.");
         addParamsLine("[--save_mask        <maskFileName>] : Save 2D and 3D masks.");
         addParamsLine("[--save_image_stats <stats_root=\"\">]: Save average and standard deviation images");
+        addParamsLine("[--histogram <fileName>] : Save the histogram of all the pixels of all images");
+        addParamsLine("[--thr <N=1>]      : Number of threads");
         addUsageLine ("           Mask is ignored  for this operation");
         mask.defineParams(this,INT_MASK,NULL,"Statistics restricted to the mask area.");
         addUsageLine ("NOTE: Geometry will NOT be applied to volumes even if apply_geo flag is on");
@@ -87,6 +107,9 @@ protected:
             statsRoot = getParam("--save_image_stats");
 
         show_angles  = checkParam("--show_angles");
+        if (checkParam("--histogram"))
+            fnHist = getParam("--histogram");
+        Nthreads = std::max(getIntParam("--thr"), 1);
         fn_out = (checkParam("-o"))? getParam("-o"): "";
 
         mask.allowed_data_types = INT_MASK;
@@ -131,33 +154,66 @@ protected:
         if (apply_mask)
             mask.generate_mask(zdimOut, ydimOut, xdimOut);
 
+        setupBatch(Nthreads, (size_t)ndimOut * zdimOut * ydimOut * xdimOut * sizeof(double));
+        batchStats.resize(batchSize);
+        accumulatePixels = !fnHist.empty() || (verbose > 0 && mdInSize > 1);
+        threadStats.assign(Nthreads, StatisticsAccumulator());
+        globalStats.clear();
     }
 
     void processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut)
     {
+        addToBatch(fnImg, fnImgOut, rowIn);
+    }
+
+    void readBatchImage(size_t k)
+    {
+        ImageGeneric &image = *batchImg[k];
         if (apply_geo)
-            image.readApplyGeo(fnImg, rowIn);
+            image.readApplyGeo(batchFnImg[k], batchRow[k]);
         else
-            image.read(fnImg, DATA, ALL_IMAGES, true);
+            image.read(batchFnImg[k], DATA, ALL_IMAGES, true);
 
         image().setXmippOrigin();
 
-        double rot, tilt, psi;
         if (show_angles)
-            image.getEulerAngles(rot,tilt,psi);
+            image.getEulerAngles(batchStats[k].rot,batchStats[k].tilt,batchStats[k].psi);
+    }
 
+    /* Statistics of the k-th image of the batch, its pixels are added to the
+     * statistics of the thread if needed */
+    void processBatchImage(size_t k, int thread_id)
+    {
+        ImageGeneric &image = *batchImg[k];
+        ImageStats &stats = batchStats[k];
         if (apply_mask)
         {
-            computeStats_within_binary_mask(mask.get_binary_mask(), image(), min_val, max_val,
-                                            avg, stddev);
+            computeStats_within_binary_mask(mask.get_binary_mask(), image(), stats.min_val, stats.max_val,
+                                            stats.avg, stats.stddev);
+            if (accumulatePixels)
+                threadStats[thread_id].add(image(), &mask.get_binary_mask());
         }
         else
-            image().computeStats(avg, stddev, min_val, max_val);
+        {
+            image().computeStats(stats.avg, stats.stddev, stats.min_val, stats.max_val);
+            if (accumulatePixels)
+                threadStats[thread_id].add(image());
+        }
+    }
+
+    /* Show and store the statistics of the k-th image of the batch */
+    void finishBatchImage(size_t k)
+    {
+        const FileName &fnImg = batchFnImg[k];
+        const MDRow &rowIn = batchRow[k];
+        const ImageStats &stats = batchStats[k];
+        double min_val = stats.min_val, max_val = stats.max_val, avg = stats.avg, stddev = stats.stddev;
+        double rot = stats.rot, tilt = stats.tilt, psi = stats.psi;
 
         if(save_image_stats)
         {
             //copy image from imageGeneric
-            image().getImage( dummyArray );
+            (*batchImg[k])().getImage( dummyArray );
             averageArray     += dummyArray;
             stdArray         += dummyArray * dummyArray;
         }
@@ -203,6 +259,8 @@ protected:
 
     void postProcess()
     {
+        for (size_t t = 0; t < threadStats.size(); ++t)
+            globalStats.merge(threadStats[t]);
 
         if (mdInSize > 1)
         {
@@ -223,6 +281,16 @@ protected:
               else
                   std::cout << formatString("%10f %10f %10f %10f", mean_min_val, mean_max_val, mean_avg, mean_stddev);
               std::cout << std::endl;
+              std::cout << "All pixels: " << stringToString(" ", max_length + 1);
+              if (!short_format)
+                  std::cout << formatString("min=%10f max=%10f avg=%10f stddev=%10f p1=%10f median=%10f p99=%10f",
+                                            globalStats.minVal, globalStats.maxVal, globalStats.avg(), globalStats.stddev(),
+                                            globalStats.percentil(1), globalStats.percentil(50), globalStats.percentil(99));
+              else
+                  std::cout << formatString("%10f %10f %10f %10f %10f %10f %10f",
+                                            globalStats.minVal, globalStats.maxVal, globalStats.avg(), globalStats.stddev(),
+                                            globalStats.percentil(1), globalStats.percentil(50), globalStats.percentil(99));
+              std::cout << std::endl;
             }
 
             if (save_image_stats)
@@ -247,6 +315,8 @@ protected:
         // Save statistics ------------------------------------------------------
         if (fn_out != "")
             DF_stats.write(fn_out,MD_APPEND);
+        if (!fnHist.empty())
+            globalStats.write(fnHist);
 
         //save average and std images
         if(save_image_stats)
@@ -257,6 +327,7 @@ protected:
             dummyImage() = stdArray;
             dummyImage.write(statsRoot + "stddev.xmp");
         }
+        clearBatch();
     }
 };// end of class ProgStatistics
 
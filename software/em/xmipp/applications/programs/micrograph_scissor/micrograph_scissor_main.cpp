@@ -58,6 +58,7 @@ protected:
         addParamsLine("                                      : Use this option to add the new images to the stack");
         addParamsLine("  [--fillBorders]                     : If the box is outside the micrograph, fill the missing pixels");
         addParamsLine("                                      : instead of setting the whole image to blank");
+        addParamsLine("  [--thr <N=1>]                       : Number of threads cutting particles");
 
         addParamsLine(" == Options for tilt pairs == ");
         addParamsLine("  [-t <input_tilted_micrograph>]      : From which the   tilted images will be cutted");
@@ -85,6 +86,7 @@ protected:
     double   down_transform;
     bool     rmStack;
     bool     fillBorders;
+    int      Nthreads;
 
     void readParams()
     {
@@ -116,10 +118,14 @@ protected:
         }
         down_transform = getDoubleParam("--downsampling");
         fillBorders = checkParam("--fillBorders");
+        Nthreads = getIntParam("--thr");
     }
 public:
     void run()
     {
+        Timer timer;
+        timer.tic();
+        size_t nParticles = 0;
         if (!pair_mode)
         {
             Micrograph m;
@@ -139,7 +145,7 @@ public:
               ctfparam.getRow(ctfRow, ctfparam.firstObject());
               m.set_ctfparams(ctfRow);
             }
-            m.produce_all_images(0, -1, fn_out, fn_orig, 0.,0.,0., rmStack, fillBorders);
+            nParticles = m.produce_all_images(0, -1, fn_out, fn_orig, 0.,0.,0., rmStack, fillBorders, Nthreads);
         }
         else
         {
@@ -160,7 +166,7 @@ public:
             m.add_label("");
             m.set_transmitance_flag(compute_transmitance);
             m.set_inverse_flag(compute_inverse);
-            m.produce_all_images(0, -1, fn_out, "", alpha_u,0.,0.,rmStack);
+            nParticles = m.produce_all_images(0, -1, fn_out, "", alpha_u,0.,0.,rmStack, false, Nthreads);
             m.close_micrograph();
 
             // Generate the images for the tilted image
@@ -171,9 +177,17 @@ public:
             mt.add_label("");
             mt.set_transmitance_flag(compute_transmitance);
             mt.set_inverse_flag(compute_inverse);
-            mt.produce_all_images(0, -1, fn_out_tilted, "", 0., tilt_angle, alpha_t, rmStack);
+            nParticles += mt.produce_all_images(0, -1, fn_out_tilted, "", 0., tilt_angle, alpha_t, rmStack, false, Nthreads);
             mt.close_micrograph();
         }
+        if (verbose)
+        {
+            double t = timer.elapsed() / 1000.0;
+            std::cout << nParticles << " particles extracted in " << t << " secs.";
+            if (t > 0)
+                std::cout << " (" << nParticles / t << " particles/sec)";
+            std::cout << std::endl;
+        }
     }
 };
 
@@ -79,6 +79,59 @@ bool CL2DAssignmentComparator(const CL2DAssignment& d1, const CL2DAssignment& d2
   return d1.objId < d2.objId;
 }
 
+/* CL2D thread auxiliary variables ------------------------------------- */
+CL2DThreadAux::CL2DThreadAux()
+{
+    plans = NULL;
+    corrSum = 0;
+}
+
+CL2DThreadAux::~CL2DThreadAux()
+{
+    delete plans;
+}
+
+void CL2DThreadAux::prepareRotationalCorrelation(const Polar<std::complex <double> > &polarFourierP)
+{
+    size_t finalSize = 2 * polarFourierP.getSampleNoOuterRing() - 1;
+    if (XSIZE(rotationalCorr) != finalSize)
+    {
+        rotationalCorr.resize(finalSize);
+        rotAux.local_transformer.setReal(rotationalCorr);
+    }
+}
+
+void CL2DThreadAux::clearUpdates(size_t Q)
+{
+    Pupdate.resize(Q);
+    nextListImg.resize(Q);
+    nextNonClassCorr.resize(Q);
+    for (size_t q = 0; q < Q; q++)
+    {
+        Pupdate[q].initZeros(prm->Ydim, prm->Xdim);
+        Pupdate[q].setXmippOrigin();
+        nextListImg[q].clear();
+        nextNonClassCorr[q].clear();
+    }
+    corrSum = 0;
+}
+
+void CL2DThreadAux::mergeUpdates(std::vector<CL2DClass *> &P) const
+{
+    size_t Q = P.size();
+    for (size_t q = 0; q < Q; q++)
+    {
+        CL2DClass &node = *(P[q]);
+        if (nextListImg[q].size() > 0)
+        {
+            node.Pupdate += Pupdate[q];
+            node.nextListImg.insert(node.nextListImg.end(), nextListImg[q].begin(), nextListImg[q].end());
+        }
+        node.nextNonClassCorr.insert(node.nextNonClassCorr.end(), nextNonClassCorr[q].begin(),
+                                     nextNonClassCorr[q].end());
+    }
+}
+
 /* CL2DClass basics ---------------------------------------------------- */
 CL2DClass::CL2DClass()
 {
@@ -209,8 +262,13 @@ void CL2DClass::transferUpdate(bool centerReference)
 //#define DEBUG
 //#define DEBUG_MORE
 void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
-                         bool reverse)
+                         bool reverse, CL2DThreadAux *aux)
 {
+    // Alignment auxiliaries of the class or of the calling thread
+    CorrelationAux &alignCorrAux = (aux == NULL) ? corrAux : aux->corrAux;
+    RotationalCorrelationAux &alignRotAux = (aux == NULL) ? rotAux : aux->rotAux;
+    Polar_fftw_plans *&alignPlans = (aux == NULL) ? plans : aux->plans;
+
     if (reverse)
     {
         I.selfReverseX();
@@ -240,7 +298,7 @@ void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
 			if (((shiftXSR > SHIFT_THRESHOLD) || (shiftXSR < (-SHIFT_THRESHOLD))) ||
 				((shiftYSR > SHIFT_THRESHOLD) || (shiftYSR < (-SHIFT_THRESHOLD))))
 			{
-				bestShift(P, IauxSR, shiftXSR, shiftYSR, corrAux);
+				bestShift(P, IauxSR, shiftXSR, shiftYSR, alignCorrAux);
 				MAT_ELEM(ASR,0,2) += shiftXSR;
 				MAT_ELEM(ASR,1,2) += shiftYSR;
 				applyGeometry(LINEAR, IauxSR, I, ASR, IS_NOT_INV, WRAP);
@@ -256,9 +314,9 @@ void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
 			if (bestRotSR > ROTATE_THRESHOLD)
 			{
 				normalizedPolarFourierTransform(IauxSR, polarFourierI, true,
-												XSIZE(P) / 5, XSIZE(P) / 2-2, plans, 1);
+												XSIZE(P) / 5, XSIZE(P) / 2-2, alignPlans, 1);
 
-				bestRotSR = best_rotation(polarFourierP, polarFourierI, rotAux);
+				bestRotSR = best_rotation(polarFourierP, polarFourierI, alignRotAux);
 				rotation2DMatrix(bestRotSR, R);
 				M3x3_BY_M3x3(ASR,R,ASR);
 				applyGeometry(LINEAR, IauxSR, I, ASR, IS_NOT_INV, WRAP);
@@ -274,9 +332,9 @@ void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
 			if (bestRotRS > ROTATE_THRESHOLD)
 			{
 				normalizedPolarFourierTransform(IauxRS, polarFourierI, true,
-												XSIZE(P) / 5, XSIZE(P) / 2-2, plans, 1);
+												XSIZE(P) / 5, XSIZE(P) / 2-2, alignPlans, 1);
 
-				bestRotRS = best_rotation(polarFourierP, polarFourierI, rotAux);
+				bestRotRS = best_rotation(polarFourierP, polarFourierI, alignRotAux);
 				rotation2DMatrix(bestRotRS, R);
 				M3x3_BY_M3x3(ARS,R,ARS);
 				applyGeometry(LINEAR, IauxRS, I, ARS, IS_NOT_INV, WRAP);
@@ -291,7 +349,7 @@ void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
 			if (((shiftXRS > SHIFT_THRESHOLD) || (shiftXRS < (-SHIFT_THRESHOLD))) ||
 				((shiftYRS > SHIFT_THRESHOLD) || (shiftYRS < (-SHIFT_THRESHOLD))))
 			{
-				bestShift(P, IauxRS, shiftXRS, shiftYRS, corrAux);
+				bestShift(P, IauxRS, shiftXRS, shiftYRS, alignCorrAux);
 				MAT_ELEM(ARS,0,2) += shiftXRS;
 				MAT_ELEM(ARS,1,2) += shiftYRS;
 				applyGeometry(LINEAR, IauxRS, I, ARS, IS_NOT_INV, WRAP);
@@ -311,7 +369,7 @@ void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
 
     // Compute the correntropy
     double corrRS=0.0, corrSR=0.0;
-    MultidimArray<int> &imask = prm->mask;
+    MultidimArray<int> &imask = (aux == NULL || !prm->useThresholdMask) ? prm->mask : aux->mask;
     if (prm->useThresholdMask)
     {
     	imask.initZeros(IauxRS);
@@ -408,15 +466,17 @@ void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
 #undef DEBUG
 #undef DEBUG_MORE
 
-void CL2DClass::fit(MultidimArray<double> &I, CL2DAssignment &result)
+void CL2DClass::fit(MultidimArray<double> &I, CL2DAssignment &result, CL2DThreadAux *aux)
 {
     if (currentListImg.size() == 0)
         return;
+    if (aux != NULL)
+        aux->prepareRotationalCorrelation(polarFourierP);
 
     // Try this image
     MultidimArray<double> Idirect = I;
     CL2DAssignment resultDirect;
-    fitBasic(Idirect, resultDirect);
+    fitBasic(Idirect, resultDirect, false, aux);
 
     // Try its mirror
 	CL2DAssignment resultMirror;
@@ -424,7 +484,7 @@ void CL2DClass::fit(MultidimArray<double> &I, CL2DAssignment &result)
     if (prm->mirrorImages)
     {
     	Imirror=I;
-		fitBasic(Imirror, resultMirror, true);
+		fitBasic(Imirror, resultMirror, true, aux);
     }
     else
     	resultMirror.corr=-1e38;
@@ -543,75 +603,7 @@ void CL2D::shareAssignments(bool shareAssignment, bool shareUpdates,
     // Share code updates
     if (shareUpdates)
     {
-        std::vector<CL2DAssignment> auxList;
-        std::vector<double> auxList2;
-        int Q = P.size();
-        for (int q = 0; q < Q; q++)
-        {
-            MPI_Allreduce(MPI_IN_PLACE, MULTIDIM_ARRAY(P[q]->Pupdate),
-                          MULTIDIM_SIZE(P[q]->Pupdate), MPI_DOUBLE, MPI_SUM,
-                          MPI_COMM_WORLD);
-
-            // Share nextClassCorr and nextNonClassCorr
-            std::vector<double> receivedNonClassCorr;
-            std::vector<CL2DAssignment> receivedNextListImage;
-            int listSize;
-            for (size_t rank = 0; rank < prm->node->size; rank++)
-            {
-                if (rank == prm->node->rank)
-                {
-                    listSize = P[q]->nextListImg.size();
-                    MPI_Bcast(&listSize, 1, MPI_INT, rank, MPI_COMM_WORLD);
-                    MPI_Bcast(&(P[q]->nextListImg[0]),
-                              P[q]->nextListImg.size() * sizeof(CL2DAssignment),
-                              MPI_CHAR, rank, MPI_COMM_WORLD);
-                    if (shareNonCorr)
-                    {
-                        listSize = P[q]->nextNonClassCorr.size();
-                        MPI_Bcast(&listSize, 1, MPI_INT, rank, MPI_COMM_WORLD);
-                        MPI_Bcast(&(P[q]->nextNonClassCorr[0]),
-                                  P[q]->nextNonClassCorr.size(), MPI_DOUBLE,
-                                  rank, MPI_COMM_WORLD);
-                    }
-                }
-                else
-                {
-                    MPI_Bcast(&listSize, 1, MPI_INT, rank, MPI_COMM_WORLD);
-                    auxList.resize(listSize);
-                    MPI_Bcast(&(auxList[0]), listSize * sizeof(CL2DAssignment),
-                              MPI_CHAR, rank, MPI_COMM_WORLD);
-                    receivedNextListImage.reserve(
-                        receivedNextListImage.size() + listSize);
-                    for (int j = 0; j < listSize; j++)
-                        receivedNextListImage.push_back(auxList[j]);
-                    if (shareNonCorr)
-                    {
-                        MPI_Bcast(&listSize, 1, MPI_INT, rank, MPI_COMM_WORLD);
-                        auxList2.resize(listSize);
-                        MPI_Bcast(&(auxList2[0]), listSize, MPI_DOUBLE, rank,
-                                  MPI_COMM_WORLD);
-                        receivedNonClassCorr.reserve(
-                            receivedNonClassCorr.size() + listSize);
-                        for (int j = 0; j < listSize; j++)
-                            receivedNonClassCorr.push_back(auxList2[j]);
-                    }
-                }
-            }
-            // This is important to ensure that all nodes have all images in the same order
-            std::sort(receivedNextListImage.begin(),receivedNextListImage.end(),CL2DAssignmentComparator);
-
-            // Copy the received elements
-            listSize = receivedNextListImage.size();
-            P[q]->nextListImg.reserve(P[q]->nextListImg.size() + listSize);
-            for (int j = 0; j < listSize; j++)
-                P[q]->nextListImg.push_back(receivedNextListImage[j]);
-            listSize = receivedNonClassCorr.size();
-            P[q]->nextNonClassCorr.reserve(
-                P[q]->nextNonClassCorr.size() + listSize);
-            for (int j = 0; j < listSize; j++)
-                P[q]->nextNonClassCorr.push_back(receivedNonClassCorr[j]);
-        }
-
+        commTime += shareUpdateLists(P, shareNonCorr);
         transferUpdates();
     }
 }
@@ -625,78 +617,121 @@ void CL2D::shareSplitAssignments(Matrix1D<int> &assignment, CL2DClass *node1,
                   MPI_MAX, MPI_COMM_WORLD);
 
     // Share code updates
-    std::vector<CL2DAssignment> auxList;
-    std::vector<double> auxList2;
-    CL2DClass *node = NULL;
-    for (int q = 0; q < 2; q++)
+    std::vector<CL2DClass *> nodes;
+    nodes.push_back(node1);
+    nodes.push_back(node2);
+    shareUpdateLists(nodes, true);
+
+    node1->transferUpdate();
+    node2->transferUpdate();
+}
+
+double CL2D::shareUpdateLists(std::vector<CL2DClass *> &nodes, bool shareNonCorr) const
+{
+    double t0 = MPI_Wtime();
+    int Q = nodes.size();
+    int Nnodes = prm->node->size;
+
+    // Sum the class updates of all nodes in a single reduction, it proceeds
+    // while the lists of images are exchanged
+    MpiPackedReduction reduction;
+    for (int q = 0; q < Q; q++)
+        reduction.add(nodes[q]->Pupdate);
+    reduction.startAllReduce();
+
+    // Number of elements of each list in each node
+    std::vector<int> localSizes(2 * Q), allSizes(2 * Q * Nnodes);
+    for (int q = 0; q < Q; q++)
     {
-        if (q == 0)
-            node = node1;
-        else
-            node = node2;
-        MPI_Allreduce(MPI_IN_PLACE, MULTIDIM_ARRAY(node->Pupdate),
-                      MULTIDIM_SIZE(node->Pupdate), MPI_DOUBLE, MPI_SUM,
-                      MPI_COMM_WORLD);
+        localSizes[2 * q] = nodes[q]->nextListImg.size();
+        localSizes[2 * q + 1] = shareNonCorr ? nodes[q]->nextNonClassCorr.size() : 0;
+    }
+    MPI_Allgather(&(localSizes[0]), 2 * Q, MPI_INT, &(allSizes[0]), 2 * Q, MPI_INT,
+                  MPI_COMM_WORLD);
 
-        // Share nextClassCorr and nextNonClassCorr
-        std::vector<double> receivedNonClassCorr;
-        std::vector<CL2DAssignment> receivedNextListImage;
-        int listSize;
-        for (size_t rank = 0; rank < prm->node->size; rank++)
+    // Pack the local lists of all classes
+    std::vector<CL2DAssignment> localList;
+    std::vector<double> localNonClassCorr;
+    for (int q = 0; q < Q; q++)
+    {
+        localList.insert(localList.end(), nodes[q]->nextListImg.begin(),
+                         nodes[q]->nextListImg.end());
+        if (shareNonCorr)
+            localNonClassCorr.insert(localNonClassCorr.end(),
+                                     nodes[q]->nextNonClassCorr.begin(),
+                                     nodes[q]->nextNonClassCorr.end());
+    }
+
+    // Exchange the lists of all nodes in a single collective call
+    std::vector<int> countList(Nnodes), displList(Nnodes), countCorr(Nnodes), displCorr(Nnodes);
+    size_t totalList = 0, totalCorr = 0;
+    for (int rank = 0; rank < Nnodes; rank++)
+    {
+        size_t nList = 0, nCorr = 0;
+        for (int q = 0; q < Q; q++)
         {
-            if (rank == prm->node->rank)
-            {
-                // Transmit node 1 next list of images
-                listSize = node->nextListImg.size();
-                MPI_Bcast(&listSize, 1, MPI_INT, rank, MPI_COMM_WORLD);
-                MPI_Bcast(&(node->nextListImg[0]),
-                          node->nextListImg.size() * sizeof(CL2DAssignment),
-                          MPI_CHAR, rank, MPI_COMM_WORLD);
-                // Transmit node 1 non class corr
-                listSize = node->nextNonClassCorr.size();
-                MPI_Bcast(&listSize, 1, MPI_INT, rank, MPI_COMM_WORLD);
-                MPI_Bcast(&(node->nextNonClassCorr[0]),
-                          node->nextNonClassCorr.size(), MPI_DOUBLE, rank,
-                          MPI_COMM_WORLD);
-            }
-            else
+            nList += allSizes[2 * (rank * Q + q)];
+            nCorr += allSizes[2 * (rank * Q + q) + 1];
+        }
+        countList[rank] = nList * sizeof(CL2DAssignment);
+        displList[rank] = totalList * sizeof(CL2DAssignment);
+        countCorr[rank] = nCorr;
+        displCorr[rank] = totalCorr;
+        totalList += nList;
+        totalCorr += nCorr;
+    }
+    std::vector<CL2DAssignment> allList(XMIPP_MAX(totalList, 1));
+    MPI_Allgatherv(localList.empty() ? NULL : &(localList[0]), countList[prm->node->rank], MPI_CHAR,
+                   &(allList[0]), &(countList[0]), &(displList[0]), MPI_CHAR, MPI_COMM_WORLD);
+    std::vector<double> allNonClassCorr(XMIPP_MAX(totalCorr, 1));
+    if (shareNonCorr)
+        MPI_Allgatherv(localNonClassCorr.empty() ? NULL : &(localNonClassCorr[0]),
+                       countCorr[prm->node->rank], MPI_DOUBLE, &(allNonClassCorr[0]),
+                       &(countCorr[0]), &(displCorr[0]), MPI_DOUBLE, MPI_COMM_WORLD);
+
+    // Append the elements received from the other nodes
+    std::vector< std::vector<CL2DAssignment> > receivedNextListImage(Q);
+    std::vector< std::vector<double> > receivedNonClassCorr(Q);
+    const CL2DAssignment *ptrList = &(allList[0]);
+    const double *ptrCorr = &(allNonClassCorr[0]);
+    for (int rank = 0; rank < Nnodes; rank++)
+        for (int q = 0; q < Q; q++)
+        {
+            int nList = allSizes[2 * (rank * Q + q)];
+            int nCorr = allSizes[2 * (rank * Q + q) + 1];
+            if (rank != (int)prm->node->rank)
             {
-                // Receive node 1 next list of images
-                MPI_Bcast(&listSize, 1, MPI_INT, rank, MPI_COMM_WORLD);
-                auxList.resize(listSize);
-                MPI_Bcast(&(auxList[0]), listSize * sizeof(CL2DAssignment),
-                          MPI_CHAR, rank, MPI_COMM_WORLD);
-                receivedNextListImage.reserve(
-                    receivedNextListImage.size() + listSize);
-                for (int j = 0; j < listSize; j++)
-                    receivedNextListImage.push_back(auxList[j]);
-                // Receive node 1 non class corr
-                MPI_Bcast(&listSize, 1, MPI_INT, rank, MPI_COMM_WORLD);
-                auxList2.resize(listSize);
-                MPI_Bcast(&(auxList2[0]), listSize, MPI_DOUBLE, rank,
-                          MPI_COMM_WORLD);
-                receivedNonClassCorr.reserve(
-                    receivedNonClassCorr.size() + listSize);
-                for (int j = 0; j < listSize; j++)
-                    receivedNonClassCorr.push_back(auxList2[j]);
+                receivedNextListImage[q].insert(receivedNextListImage[q].end(), ptrList, ptrList + nList);
+                receivedNonClassCorr[q].insert(receivedNonClassCorr[q].end(), ptrCorr, ptrCorr + nCorr);
             }
+            ptrList += nList;
+            ptrCorr += nCorr;
         }
+    for (int q = 0; q < Q; q++)
+    {
         // This is important to ensure that all nodes have all images in the same order
-        std::sort(receivedNextListImage.begin(),receivedNextListImage.end(),CL2DAssignmentComparator);
+        std::sort(receivedNextListImage[q].begin(),receivedNextListImage[q].end(),CL2DAssignmentComparator);
 
         // Copy the received elements
-        listSize = receivedNextListImage.size();
-        node->nextListImg.reserve(node->nextListImg.size() + listSize);
-        for (int j = 0; j < listSize; j++)
-            node->nextListImg.push_back(receivedNextListImage[j]);
-        listSize = receivedNonClassCorr.size();
-        node->nextNonClassCorr.reserve(node->nextNonClassCorr.size() + listSize);
-        for (int j = 0; j < listSize; j++)
-            node->nextNonClassCorr.push_back(receivedNonClassCorr[j]);
+        nodes[q]->nextListImg.insert(nodes[q]->nextListImg.end(),
+                                     receivedNextListImage[q].begin(),
+                                     receivedNextListImage[q].end());
+        nodes[q]->nextNonClassCorr.insert(nodes[q]->nextNonClassCorr.end(),
+                                          receivedNonClassCorr[q].begin(),
+                                          receivedNonClassCorr[q].end());
     }
 
-    node1->transferUpdate();
-    node2->transferUpdate();
+    reduction.wait();
+    return MPI_Wtime() - t0;
+}
+
+/* Constructor -------------------------------------------------------- */
+CL2D::CL2D()
+{
+	commTime=0;
+	thMgr=NULL;
+	taskDistributor=NULL;
+	threadAux=NULL;
 }
 
 /* Destructor --------------------------------------------------------- */
@@ -705,6 +740,9 @@ CL2D::~CL2D()
 	int qmax=P.size();
 	for (int q=0; q<qmax; q++)
 		delete P[q];
+	delete thMgr;
+	delete taskDistributor;
+	delete [] threadAux;
 }
 
 /* Read image --------------------------------------------------------- */
@@ -723,6 +761,14 @@ void CL2D::readImage(Image<double> &I, size_t objId, bool applyGeo) const
     	I().statisticsAdjust(0, 1);
 }
 
+void CL2D::readImageByIndex(Image<double> &I, size_t idx) const
+{
+    I.read(prm->fnImg[idx]);
+    I().setXmippOrigin();
+    if (prm->normalizeImages)
+    	I().statisticsAdjust(0, 1);
+}
+
 /* CL2D initialization ------------------------------------------------ */
 //#define DEBUG
 void CL2D::initialize(MetaData &_SF,
@@ -734,6 +780,17 @@ void CL2D::initialize(MetaData &_SF,
     SF = &_SF;
     Nimgs = SF->size();
 
+    // Images processed by this node and its threads
+    nodeImgIdx.clear();
+    for (size_t idx = 0; idx < Nimgs; idx++)
+        if ((idx+1)%prm->node->size==prm->node->rank)
+            nodeImgIdx.push_back(idx);
+    nodeAssignment.resize(nodeImgIdx.size());
+    thMgr = new ThreadManager(prm->Nthr, this);
+    taskDistributor = new ThreadTaskDistributor(nodeImgIdx.size(),
+                      XMIPP_MAX(1,nodeImgIdx.size()/(10*prm->Nthr)));
+    threadAux = new CL2DThreadAux[prm->Nthr];
+
     // Start with _Ncodes0 codevectors
     CL2DAssignment assignment;
     assignment.corr = 1;
@@ -922,7 +979,7 @@ void CL2D::write(const FileName &fnODir, const FileName &fnRoot, int level) cons
 
 //#define DEBUG
 void CL2D::lookNode(MultidimArray<double> &I, int oldnode, int &newnode,
-                    CL2DAssignment &bestAssignment)
+                    CL2DAssignment &bestAssignment, CL2DThreadAux &aux)
 {
 #ifdef DEBUG
 	std::cout << "Looking for node. Oldnode=" << oldnode << std::endl;
@@ -957,7 +1014,9 @@ void CL2D::lookNode(MultidimArray<double> &I, int oldnode, int &newnode,
 					double threshold = 3.0 * P[oldnode]->currentListImg.size();
 					threshold = XMIPP_MAX(threshold,1000);
 					threshold = (double) (XMIPP_MIN(threshold,Nimgs)) / Nimgs;
+					mutexRnd.lock();
 					proceed = (rnd_unif(0, 1) < threshold);
+					mutexRnd.unlock();
 				}
         	}
         	else
@@ -972,7 +1031,7 @@ void CL2D::lookNode(MultidimArray<double> &I, int oldnode, int &newnode,
 		if (proceed) {
 			// Try this image
 			Iaux = I;
-			P[q]->fit(Iaux, assignment);
+			P[q]->fit(Iaux, assignment, &aux);
 			VEC_ELEM(corrList,q) = assignment.corr;
 #ifdef DEBUG
 	std::cout << "   Proceeding with node " << q << " corr=" << assignment.corr << std::endl;
@@ -998,15 +1057,43 @@ void CL2D::lookNode(MultidimArray<double> &I, int oldnode, int &newnode,
 #endif
     if (newnode != -1)
     {
-        P[newnode]->updateProjection(I, bestAssignment);
+        if (bestAssignment.corr > 0 && bestAssignment.objId != BAD_OBJID)
+        {
+            aux.Pupdate[newnode] += I;
+            aux.nextListImg[newnode].push_back(bestAssignment);
+        }
         if (!prm->classicalMultiref)
             for (int q = 0; q < Q; q++)
                 if (q != newnode && corrList(q) > 0)
-                    P[q]->updateNonProjection(corrList(q));
+                    aux.nextNonClassCorr[q].push_back(corrList(q));
     }
 }
 #undef DEBUG
 
+void threadLookNode(ThreadArgument &thArg)
+{
+    CL2D &vq = *((CL2D *) thArg.workClass);
+    CL2DThreadAux &aux = vq.threadAux[thArg.thread_id];
+    int progressStep = XMIPP_MAX(1,vq.Nimgs/60);
+
+    Image<double> I;
+    CL2DAssignment assignment;
+    int node;
+    size_t first, last;
+    while (vq.taskDistributor->getTasks(first, last))
+        for (size_t i = first; i <= last; ++i)
+        {
+            size_t idx = vq.nodeImgIdx[i];
+            vq.readImageByIndex(I, idx);
+            assignment.objId = prm->objId[idx];
+            vq.lookNode(I(), vq.oldAssignment[idx], node, assignment, aux);
+            vq.nodeAssignment[i] = node;
+            aux.corrSum += assignment.corr;
+            if (prm->node->rank == 1 && thArg.thread_id == 0 && idx % progressStep == 0)
+                progress_bar(idx);
+        }
+}
+
 void CL2D::transferUpdates()
 {
     int Q = P.size();
@@ -1033,14 +1120,11 @@ void CL2D::run(const FileName &fnODir, const FileName &fnOut, int level)
     char c; std::cin >> c;
 #endif
 
-    std::vector<int> oldAssignment, newAssignment;
+    std::vector<int> newAssignment;
 
     int iter = 1;
     bool goOn = true;
     MetaData MDChanges;
-    Image<double> I;
-    int progressStep = XMIPP_MAX(1,Nimgs/60);
-    CL2DAssignment assignment;
     FileName fnResultsDir=formatString("%s/level_%02d",fnODir.c_str(),level);
     fnResultsDir.makePath(0755);
     while (goOn)
@@ -1057,31 +1141,30 @@ void CL2D::run(const FileName &fnODir, const FileName &fnOut, int level)
         for (size_t q = 0; q < Q; q++)
             P[q]->lookForNeighbours(P, K);
 
-        int node;
         double corrSum = 0;
         SF->getColumnValues(MDL_REF, oldAssignment);
         int *ptrOld = &(oldAssignment[0]);
         for (size_t n = 0; n < Nimgs; ++n, ++ptrOld)
             *ptrOld -= 1;
         SF->fillConstant(MDL_REF, "-1");
-        size_t idx=0;
-        FOR_ALL_OBJECTS_IN_METADATA(prm->SF)
-        {
-            if ((idx+1)%prm->node->size==prm->node->rank)
-            {
-                size_t objId = prm->objId[idx];
-                readImage(I, objId, false);
-                LOG(((String)"Processing image: "+I.name()).c_str());
 
-                assignment.objId = objId;
-                lookNode(I(), oldAssignment[idx], node, assignment);
-                SF->setValue(MDL_REF, node + 1, objId);
-                corrSum += assignment.corr;
-                if (prm->node->rank == 1 && idx % progressStep == 0)
-                    progress_bar(idx);
-            }
-            idx++;
+        // Assign the images of this node in parallel
+        for (int t = 0; t < prm->Nthr; t++)
+            threadAux[t].clearUpdates(Q);
+        taskDistributor->clear();
+        thMgr->run(threadLookNode);
+
+        // Merge the results of all threads
+        for (size_t i = 0; i < nodeImgIdx.size(); i++)
+            SF->setValue(MDL_REF, nodeAssignment[i] + 1, prm->objId[nodeImgIdx[i]]);
+        for (int t = 0; t < prm->Nthr; t++)
+        {
+            corrSum += threadAux[t].corrSum;
+            threadAux[t].mergeUpdates(P);
         }
+        // Keep the same order of images independently of the thread scheduling
+        for (size_t q = 0; q < Q; q++)
+            std::sort(P[q]->nextListImg.begin(), P[q]->nextListImg.end(), CL2DAssignmentComparator);
         prm->node->barrierWait();
 
         // Gather all pieces computed by nodes
@@ -1101,6 +1184,7 @@ void CL2D::run(const FileName &fnODir, const FileName &fnOut, int level)
             	MPI_Abort(MPI_COMM_WORLD,ERR_UNCLASSIFIED);
             }
             std::cout << "\nAverage correlation with input vectors=" << avgSimilarity << std::endl;
+            std::cout << "Accumulated time sharing class updates=" << commTime << " s" << std::endl;
             idMdChanges = MDChanges.addObject();
             MDChanges.setValue(MDL_ITER, iter, idMdChanges);
             MDChanges.setValue(MDL_CL2D_SIMILARITY, avgSimilarity, idMdChanges);
@@ -1645,6 +1729,7 @@ void ProgClassifyCL2D::readParams()
 	if (useThresholdMask)
 		threshold=getDoubleParam("--useThresholdMask");
 	alignImages = !checkParam("--dontAlign");
+	Nthr = getIntParam("--thr");
 }
 
 void ProgClassifyCL2D::show() const {
@@ -1667,6 +1752,7 @@ void ProgClassifyCL2D::show() const {
 			<< "Normalize images:        " << normalizeImages << std::endl
 			<< "Mirror images:           " << mirrorImages << std::endl
 			<< "Align images:            " << alignImages << std::endl
+			<< "Number of threads:       " << Nthr << std::endl
 	;
 	if (useThresholdMask)
 		std::cout << "Threshold mask:          " << threshold << std::endl;
@@ -1711,7 +1797,10 @@ void ProgClassifyCL2D::defineParams()
 	addParamsLine("   [--dontMirrorImages]      : By default, input images are studied unmirrored and mirrored");
 	addParamsLine("   [--useThresholdMask <t>]  : Use a mask to compare images. Remove pixels whose value is smaller or equal t");
 	addParamsLine("   [--dontAlign]             : Do not center the class representatives");
+	addParamsLine("   [--thr <N=1>]             : Number of threads in each MPI process");
     addExampleLine("mpirun -np 3 `which xmipp_mpi_classify_CL2D` -i images.stk --nref 256 --oroot class --odir CL2Dresults --iter 10");
+    addExampleLine("Hybrid MPI+threads: one process per computer, each one with 8 threads",false);
+    addExampleLine("mpirun -np 4 -bynode `which xmipp_mpi_classify_CL2D` -i images.stk --nref 256 --oroot class --odir CL2Dresults --iter 10 --thr 8");
 }
 
 void ProgClassifyCL2D::produceSideInfo()
@@ -1732,6 +1821,9 @@ void ProgClassifyCL2D::produceSideInfo()
 
     // Prepare the Task distributor
     SF.findObjects(objId);
+    fnImg.resize(objId.size());
+    for (size_t idx = 0; idx < objId.size(); idx++)
+        SF.getValue(MDL_IMAGE, fnImg[idx], objId[idx]);
     // size_t Nimgs = objId.size();
 
     // Prepare mask for evaluating the noise outside
@@ -36,6 +36,7 @@ public:
     double       sam;
     double       max_sam, min_sam;
     bool        do_dpr, do_set_of_images, do_o, do_rfactor;
+    int         nThreads;
 
     FileName    fn_sel;
     bool        apply_geo;
@@ -87,6 +88,7 @@ public:
         addParamsLine("   [--do_rfactor]            : compute R-factor for input volumes");
         addParamsLine("   [--min_sam <min_sr=-1>]   : minimum frequency may use for calculating R-factor (Angstrom)");
         addParamsLine("                             : --min_sam = 10A -> frequencies smaller than 0.1 A^-1 =0");
+        addParamsLine("   [--thr <N=1>]             : Number of threads");
 
         addExampleLine("Resolution of subset2.vol volume with respect to subset1.vol reference volume using 5.6 pixel size (in Angstrom):", false);
         addExampleLine("xmipp_resolution_fsc --ref subset1.vol  -i subset2.vol --sampling_rate 5.6 ");
@@ -106,6 +108,7 @@ public:
         //for calculating r-factor
         min_sam = getDoubleParam("--min_sam");
         do_rfactor = checkParam("--do_rfactor");
+        nThreads = getIntParam("--thr");
 
         if(do_set_of_images)
         {
@@ -199,7 +202,7 @@ public:
         if (max_sam <0)
 		   max_sam = 2 * sam;
 
-        frc_dpr(refI(), img(), sam, freq, frc, frc_noise, dpr, error_l2, do_dpr, do_rfactor, min_samp, sam/max_sam, &rFactor);
+        frc_dpr(refI(), img(), sam, freq, frc, frc_noise, dpr, error_l2, do_dpr, do_rfactor, min_samp, sam/max_sam, &rFactor, nThreads);
 
         writeFiles((fn_root.empty())?img.name():fn_root, freq, frc, frc_noise, dpr, error_l2, max_sam, do_dpr, rFactor);
         return true;
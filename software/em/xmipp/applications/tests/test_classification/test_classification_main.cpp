@@ -0,0 +1,166 @@
+#include <data/xmipp_funcs.h>
+#include <classification/code_book.h>
+#include <classification/batch_som.h>
+#include <classification/gaussian_kerdensom.h>
+#include <classification/feature_matrix.h>
+#include <classification/vector_ops.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class ClassificationTest : public ::testing::Test
+{
+protected:
+    // Small code book and training set with a number of features that is
+    // not a multiple of the row alignment of FeatureMatrix
+    virtual void SetUp()
+    {
+        init_random_generator(1);
+        codeBook = new CodeBook(12, 13, (floatFeature)0, (floatFeature)1);
+        ts = new ClassicTrainingVectors(13, false);
+        FeatureVector v(13);
+        for (int n=0; n<200; ++n)
+        {
+            for (int j=0; j<13; ++j)
+                v[j]=(floatFeature)rnd_unif(0,1);
+            ts->add(v);
+        }
+    }
+
+    virtual void TearDown()
+    {
+        delete codeBook;
+        delete ts;
+    }
+
+    CodeBook *codeBook;
+    ClassicTrainingVectors *ts;
+};
+
+TEST_F( ClassificationTest, featureMatrix)
+{
+    FeatureMatrix M;
+    M.fromVectors(ts->theItems);
+    ASSERT_EQ(M.rows(),ts->size());
+    ASSERT_EQ(M.cols(),(size_t)13);
+    for (size_t i=0; i<M.rows(); ++i)
+        for (size_t j=0; j<M.cols(); ++j)
+            ASSERT_EQ(M.row(i)[j],ts->theItems[i][j]);
+
+    // Refill with the same shape
+    M.fromVectors(codeBook->theItems);
+    M.fromVectors(ts->theItems);
+    for (size_t i=0; i<M.rows(); ++i)
+        for (size_t j=0; j<M.cols(); ++j)
+            ASSERT_EQ(M.row(i)[j],ts->theItems[i][j]);
+}
+
+TEST_F( ClassificationTest, squaredDistance)
+{
+    FeatureMatrix code, samples;
+    code.fromVectors(codeBook->theItems);
+    samples.fromVectors(ts->theItems);
+    for (size_t i=0; i<samples.rows(); ++i)
+        for (size_t c=0; c<code.rows(); ++c)
+        {
+            double d=euclideanDistance(codeBook->theItems[c],ts->theItems[i]);
+            ASSERT_NEAR(squaredDistance(code.row(c),samples.row(i),code.cols()),d*d,1e-6);
+        }
+}
+
+TEST_F( ClassificationTest, bestMatch)
+{
+    FeatureMatrix code, samples;
+    code.fromVectors(codeBook->theItems);
+    samples.fromVectors(ts->theItems);
+    for (size_t i=0; i<samples.rows(); ++i)
+    {
+        double d2;
+        ASSERT_EQ(bestMatch(code,samples.row(i),d2),codeBook->testIndex(ts->theItems[i]));
+    }
+}
+
+TEST_F( ClassificationTest, bestMatches)
+{
+    FeatureMatrix code, samples;
+    code.fromVectors(codeBook->theItems);
+    samples.fromVectors(ts->theItems);
+    for (int Nthreads=1; Nthreads<=4; Nthreads+=3)
+    {
+        std::vector<unsigned> winners;
+        std::vector<double> dist2;
+        bestMatches(code, samples, winners, &dist2, Nthreads);
+        ASSERT_EQ(winners.size(),ts->size());
+        for (size_t i=0; i<ts->size(); ++i)
+        {
+            ASSERT_EQ(winners[i],codeBook->testIndex(ts->theItems[i]));
+            double d=euclideanDistance(codeBook->theItems[winners[i]],ts->theItems[i]);
+            ASSERT_NEAR(dist2[i],d*d,1e-6);
+        }
+    }
+}
+
+TEST_F( ClassificationTest, classifyThreaded)
+{
+    codeBook->classifyThreaded(ts, 4);
+    size_t total=0;
+    for (unsigned c=0; c<codeBook->size(); ++c)
+    {
+        const std::vector<unsigned> &assigned=codeBook->classifAt(c);
+        total+=assigned.size();
+        for (size_t n=0; n<assigned.size(); ++n)
+            ASSERT_EQ(codeBook->testIndex(ts->theItems[assigned[n]]),c);
+    }
+    ASSERT_EQ(total,ts->size());
+}
+
+TEST_F( ClassificationTest, batchSOMThreads)
+{
+    // The threads only look for the best matching units, the maps must be
+    // identical
+    TextualListener listener;
+    listener.setVerbosity() = 0;
+    Descent radius(2, 1);
+    init_random_generator(1);
+    ClassificationMap map1("RECT", 4, 3, *ts);
+    ClassificationMap map4(map1);
+    BatchSOM som1(radius, 10), som4(radius, 10);
+    som1.setListener(&listener);
+    som4.setListener(&listener);
+    som4.setThreads(4);
+    som1.train(map1, *ts);
+    som4.train(map4, *ts);
+    for (unsigned c=0; c<map1.size(); ++c)
+        for (size_t j=0; j<map1.theItems[c].size(); ++j)
+            ASSERT_EQ(map1.theItems[c][j],map4.theItems[c][j]);
+}
+
+TEST_F( ClassificationTest, kerDenSOMThreads)
+{
+    // The partial sums of the threads are added in a different order, the
+    // maps may only differ by rounding
+    FileName fnConvergence;
+    fnConvergence.initUniqueName("/tmp/testKerDenSOM_XXXXXX");
+    fnConvergence.deleteFile();
+    fnConvergence=fnConvergence+".xmd";
+    TextualListener listener;
+    listener.setVerbosity() = 0;
+    init_random_generator(1);
+    FuzzyMap map1("RECT", 4, 3, *ts);
+    FuzzyMap map4(map1);
+    GaussianKerDenSOM som1(1000, 100, 2, 1e-7, 5), som4(1000, 100, 2, 1e-7, 5);
+    som1.setListener(&listener);
+    som4.setListener(&listener);
+    som4.setThreads(4);
+    som1.train(map1, *ts, fnConvergence);
+    som4.train(map4, *ts, fnConvergence);
+    fnConvergence.deleteFile();
+    for (unsigned c=0; c<map1.size(); ++c)
+        for (size_t j=0; j<map1.theItems[c].size(); ++j)
+            ASSERT_NEAR(map1.theItems[c][j],map4.theItems[c][j],1e-4);
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -143,6 +143,61 @@ TEST_F( CtfTest, errorMaxFreqCTFs2D)
     XMIPP_CATCH
 }
 
+TEST_F( CtfTest, ctfImageGenerator)
+{
+    XMIPP_TRY
+    CTFDescription ctf;
+    ctf.enable_CTFnoise=false;
+    ctf.Tm=1.5;
+    ctf.kV=300;
+    ctf.DeltafU=12000;
+    ctf.DeltafV=14000;
+    ctf.azimuthal_angle=30;
+    ctf.Cs=2;
+    ctf.Q0=0.1;
+    ctf.alpha=0.5;
+    ctf.DeltaR=3;
+    ctf.produceSideInfo();
+
+    CTFImageGenerator generator;
+    generator.initialize(128, 96, ctf.Tm);
+    MultidimArray<double> ctfGeneric, ctfFast;
+
+    // Pure CTF
+    ctf.generateCTF(128, 96, ctfGeneric);
+    generator.generateCTF(ctf, ctfFast);
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(ctfGeneric)
+    EXPECT_NEAR(DIRECT_MULTIDIM_ELEM(ctfGeneric,n),DIRECT_MULTIDIM_ELEM(ctfFast,n),1e-9);
+
+    // Without damping
+    ctf.generateCTFWithoutDamping(128, 96, ctfGeneric);
+    generator.generateCTF(ctf, ctfFast, false);
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(ctfGeneric)
+    EXPECT_NEAR(DIRECT_MULTIDIM_ELEM(ctfGeneric,n),DIRECT_MULTIDIM_ELEM(ctfFast,n),1e-9);
+
+    // Batch of defoci, squared
+    std::vector<CTFDescription> ctfs;
+    for (int k=0; k<4; ++k)
+    {
+        ctf.DeltafU=8000+1000*k;
+        ctf.DeltafV=9000+1500*k;
+        ctf.produceSideInfo();
+        ctfs.push_back(ctf);
+    }
+    MultidimArray<double> ctfStack, ctfImg;
+    generator.generateCTFs(ctfs, ctfStack, true, true);
+    for (size_t k=0; k<ctfs.size(); ++k)
+    {
+        ctfs[k].generateCTF(128, 96, ctfGeneric);
+        ctfImg.aliasImageInStack(ctfStack,k);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(ctfGeneric)
+        EXPECT_NEAR(DIRECT_MULTIDIM_ELEM(ctfGeneric,n)*DIRECT_MULTIDIM_ELEM(ctfGeneric,n),
+                    DIRECT_MULTIDIM_ELEM(ctfImg,n),1e-9);
+    }
+
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
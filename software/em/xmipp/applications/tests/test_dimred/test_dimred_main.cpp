@@ -161,6 +161,127 @@ TEST_F( DimRedTest, nca)
 	ASSERT_TRUE(expectedY.equal(Y,1e-4));
 }
 
+TEST_F( DimRedTest, approximateNeighbours)
+{
+	GenerateData generator;
+	generator.generateNewDataset("swiss",4000,0);
+	const int K=12;
+
+	// Exact search, the threaded version must give the same neighbours
+	Matrix2D<int> idxExact, idxExactThr, idxApprox, idxApproxThr;
+	Matrix2D<double> dExact, dExactThr, dApprox, dApproxThr;
+	kNearestNeighboursExact(generator.X,K,idxExact,dExact);
+	kNearestNeighboursExact(generator.X,K,idxExactThr,dExactThr,NULL,true,4);
+	ASSERT_TRUE(idxExact.equal(idxExactThr));
+	ASSERT_TRUE(dExact.equal(dExactThr,1e-10));
+
+	// Approximate search, independent of the number of threads
+	init_random_generator(1);
+	kNearestNeighboursApproximate(generator.X,K,idxApprox,dApprox);
+	init_random_generator(1);
+	kNearestNeighboursApproximate(generator.X,K,idxApproxThr,dApproxThr,NULL,true,8,2,4);
+	ASSERT_TRUE(idxApprox.equal(idxApproxThr));
+
+	EXPECT_GT(nearestNeighboursRecall(idxExact,idxApprox),0.95);
+
+	// The distances must be the true distances of the neighbours found
+	for (size_t i=0; i<MAT_YSIZE(idxApprox); ++i)
+		for (size_t k=0; k<MAT_XSIZE(idxApprox); ++k)
+		{
+			int j=MAT_ELEM(idxApprox,i,k);
+			ASSERT_GE(j,0);
+			ASSERT_NE(j,(int)i);
+			double d2=0;
+			for (size_t c=0; c<MAT_XSIZE(generator.X); ++c)
+			{
+				double diff=MAT_ELEM(generator.X,i,c)-MAT_ELEM(generator.X,j,c);
+				d2+=diff*diff;
+			}
+			EXPECT_NEAR(MAT_ELEM(dApprox,i,k),sqrt(d2),1e-10);
+			if (k>0)
+			{
+				EXPECT_LE(MAT_ELEM(dApprox,i,k-1),MAT_ELEM(dApprox,i,k));
+			}
+		}
+}
+
+// Largest relative residual of the least squares fit of the columns of A with
+// the columns of B and a constant. The sparse and the dense solvers may give
+// different bases of the same subspace (signs, scales, degenerate eigenvalues).
+double subspaceResidual(const Matrix2D<double> &A, const Matrix2D<double> &B)
+{
+	size_t N=MAT_YSIZE(B), d=MAT_XSIZE(B);
+	Matrix2D<double> B1(N,d+1), BtB, iBtB;
+	for (size_t i=0; i<N; ++i)
+	{
+		MAT_ELEM(B1,i,0)=1;
+		for (size_t j=0; j<d; ++j)
+			MAT_ELEM(B1,i,j+1)=MAT_ELEM(B,i,j);
+	}
+	Matrix2D<double> B1t=B1.transpose();
+	BtB=B1t*B1;
+	BtB.inv(iBtB);
+	double maxResidual=0;
+	Matrix1D<double> a;
+	for (size_t c=0; c<MAT_XSIZE(A); ++c)
+	{
+		A.getCol(c,a);
+		Matrix1D<double> r=a-B1*(iBtB*(B1t*a));
+		double mean=a.computeMean(), norm2=0;
+		FOR_ALL_ELEMENTS_IN_MATRIX1D(a)
+			norm2+=(VEC_ELEM(a,i)-mean)*(VEC_ELEM(a,i)-mean);
+		maxResidual=XMIPP_MAX(maxResidual,r.module()/sqrt(norm2));
+	}
+	return maxResidual;
+}
+
+// The sparse graph and eigensolver must give the embedding of the dense path
+TEST_F( DimRedTest, sparseVsDense)
+{
+	GenerateData generator;
+	generator.generateNewDataset("helix",400,0);
+	Matrix2D<double> Xdense, Xsparse;
+
+	Xdense=Xsparse=generator.X;
+	LaplacianEigenmap leDense, leSparse;
+	leDense.setInputData(Xdense);
+	leSparse.setInputData(Xsparse);
+	leDense.setOutputDimensionality(2);
+	leSparse.setOutputDimensionality(2);
+	leDense.setSpecificParameters(1.0,7,false);
+	leSparse.setSpecificParameters(1.0,7,true);
+	leDense.reduceDimensionality();
+	leSparse.reduceDimensionality();
+	EXPECT_LT(subspaceResidual(leSparse.getReducedData(),leDense.getReducedData()),1e-3) << "LE";
+
+	Xdense=Xsparse=generator.X;
+	LPP lppDense, lppSparse;
+	lppDense.setInputData(Xdense);
+	lppSparse.setInputData(Xsparse);
+	lppDense.setOutputDimensionality(2);
+	lppSparse.setOutputDimensionality(2);
+	lppDense.setSpecificParameters(12,1.0,false);
+	lppSparse.setSpecificParameters(12,1.0,true);
+	lppDense.reduceDimensionality();
+	lppSparse.reduceDimensionality();
+	EXPECT_LT(subspaceResidual(lppSparse.getReducedData(),lppDense.getReducedData()),1e-5) << "LPP";
+
+	// With all the samples as neighbours, the sparse kernel is the full one.
+	// For t=1 the dense path divides the kernel by p(i) and the sparse one by
+	// p(i)p(j), so that their embeddings differ; they are compared for t=2.
+	Xdense=Xsparse=generator.X;
+	DiffusionMaps dmDense, dmSparse;
+	dmDense.setInputData(Xdense);
+	dmSparse.setInputData(Xsparse);
+	dmDense.setOutputDimensionality(2);
+	dmSparse.setOutputDimensionality(2);
+	dmDense.setSpecificParameters(2.0,0.3,0);
+	dmSparse.setSpecificParameters(2.0,0.3,MAT_YSIZE(generator.X)-1);
+	dmDense.reduceDimensionality();
+	dmSparse.reduceDimensionality();
+	EXPECT_LT(subspaceResidual(dmSparse.getReducedData(),dmDense.getReducedData()),1e-3) << "DM";
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
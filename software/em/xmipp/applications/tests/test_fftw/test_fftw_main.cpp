@@ -108,6 +108,50 @@ TEST_F( FftwTest, fft_IDX2DIGFREQ)
     EXPECT_EQ(-1.0/256.0,w);
 }
 
+TEST_F( FftwTest, fourierResizer)
+{
+    // The resizer must give the same result as scaleToSizeFourier for
+    // all the images, also after the input size changes
+    FourierResizer resizer;
+    resizer.setOutputSize(1,32,32);
+    MultidimArray<double> I, expected;
+    for (int n=0; n<4; ++n)
+    {
+        int Xdim=(n<3) ? 64 : 48;
+        I.resizeNoCopy(Xdim,Xdim);
+        I.initRandom(0,1);
+        resizer.in=I;
+        resizer.resize();
+        scaleToSizeFourier(1,32,32,I,expected);
+        ASSERT_TRUE(expected.equal(resizer.out,1e-10));
+    }
+}
+
+TEST_F( FftwTest, fourierResizerFloat)
+{
+    // The single precision resizer must agree with the double one
+    FourierResizer resizer;
+    FourierResizerFloat resizerFloat;
+    resizer.setOutputSize(1,128,128);
+    resizerFloat.setOutputSize(1,128,128);
+    MultidimArray<double> I;
+    I.resizeNoCopy(256,256);
+    I.initRandom(0,1);
+    resizer.in=I;
+    typeCast(I,resizerFloat.in);
+
+    resizer.resize();
+    resizerFloat.resize();
+
+    MultidimArray<double> outFloat;
+    typeCast(resizerFloat.out,outFloat);
+    ASSERT_TRUE(resizer.out.equal(outFloat,1e-4));
+
+    MultidimArray<float> expected;
+    scaleToSizeFourier(1,128,128,resizerFloat.in,expected);
+    ASSERT_TRUE(expected.equal(resizerFloat.out,1e-6));
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -1,6 +1,7 @@
 #include <data/xmipp_image.h>
 #include <data/filters.h>
 #include <data/xmipp_fftw.h>
+#include <reconstruction/fourier_filter.h>
 #include <iostream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
@@ -198,6 +199,32 @@ TEST_F( FiltersTest, regionGrowing3DEqualValue)
     EXPECT_DOUBLE_EQ(result,1.);
 
 }
+
+TEST_F( FiltersTest, fourierFilterFloat)
+{
+    // The single precision filter must only differ by rounding from the
+    // double precision one, for images and volumes
+    for (int zdim=1; zdim<=32; zdim+=31)
+    {
+        MultidimArray<double> Vd(zdim,32,32);
+        MultidimArray<float> Vf;
+        Vd.initRandom(0,1);
+        typeCast(Vd,Vf);
+
+        FourierFilter filter;
+        filter.FilterBand=BANDPASS;
+        filter.w1=0.1;
+        filter.w2=0.3;
+        filter.raised_w=0.02;
+        filter.do_generate_3dmask=(zdim>1);
+        filter.generateMask(Vd);
+        filter.applyMaskSpace(Vd);
+        filter.applyMaskSpace(Vf);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Vd)
+        ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(Vf,n),DIRECT_MULTIDIM_ELEM(Vd,n),1e-5) << "zdim=" << zdim;
+    }
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -168,6 +168,51 @@ TEST_F( GeometryTest, normalize_ramp)
     XMIPP_CATCH
 }
 
+TEST_F( GeometryTest, normalizationBackground)
+{
+    XMIPP_TRY
+    // The precomputed background must give the same result as the binary mask
+    MultidimArray<double> img, imgMask, imgBg;
+    img.resize(32,32);
+    img.setXmippOrigin();
+    img.initRandom(0,1);
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(img)
+    A2D_ELEM(img, i,j) += 0.1*i-0.05*j+2;
+    MultidimArray<int> mask;
+    mask.resize(img);
+    mask.setXmippOrigin();
+    BinaryCircularMask(mask, 12, OUTSIDE_MASK);
+    NormalizationBackground bg;
+    bg.initialize(mask);
+    EXPECT_EQ(bg.size(),(size_t)mask.sum());
+
+    imgMask=imgBg=img;
+    normalize_NewXmipp(imgMask, mask);
+    normalize_NewXmipp(imgBg, bg);
+    EXPECT_TRUE(imgMask.equal(imgBg,1e-10));
+
+    imgMask=imgBg=img;
+    normalize_NewXmipp2(imgMask, mask);
+    normalize_NewXmipp2(imgBg, bg);
+    EXPECT_TRUE(imgMask.equal(imgBg,1e-10));
+
+    imgMask=imgBg=img;
+    normalize_Near_OldXmipp(imgMask, mask);
+    normalize_Near_OldXmipp(imgBg, bg);
+    EXPECT_TRUE(imgMask.equal(imgBg,1e-10));
+
+    imgMask=imgBg=img;
+    normalize_Michael(imgMask, mask);
+    normalize_Michael(imgBg, bg);
+    EXPECT_TRUE(imgMask.equal(imgBg,1e-10));
+
+    imgMask=imgBg=img;
+    normalize_ramp(imgMask, &mask);
+    normalize_ramp(imgBg, bg);
+    EXPECT_TRUE(imgMask.equal(imgBg,1e-10));
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
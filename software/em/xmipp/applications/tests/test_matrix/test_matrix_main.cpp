@@ -1,4 +1,5 @@
 #include <data/matrix2d.h>
+#include <data/sparse_matrix2d.h>
 #include <iostream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
@@ -246,6 +247,37 @@ TEST_F( MatrixTest, firstEigsTest)
     EXPECT_EQ(expectedP,P) << "firstEigsTest failed";
 }
 
+TEST_F( MatrixTest, sparseFirstEigsTest)
+{
+    // Banded symmetric matrix
+    const int N=300, band=4;
+    Matrix2D<double> A(N,N), P, Psparse;
+    Matrix1D<double> D, Dsparse;
+    std::vector<SparseElement> elements;
+    SparseElement e;
+    for (int i=0; i<N; ++i)
+        for (int j=XMIPP_MAX(i-band,0); j<=XMIPP_MIN(i+band,N-1); ++j)
+        {
+            int ii=XMIPP_MIN(i,j), jj=XMIPP_MAX(i,j);
+            A(i,j)=e.value=(i==j) ? 1+sin(0.1*i) : cos(1.7*ii+0.3*jj)/(1+jj-ii);
+            e.i=i;
+            e.j=j;
+            elements.push_back(e);
+        }
+    SparseMatrix2D Asparse(elements,N);
+
+    firstEigs(A,4,D,P);
+    firstEigs(Asparse,4,Dsparse,Psparse);
+    for (int k=0; k<4; ++k)
+    {
+        EXPECT_NEAR(D(k),Dsparse(k),1e-8) << "sparseFirstEigsTest failed";
+        double dot=0;
+        for (int i=0; i<N; ++i)
+            dot+=P(i,k)*Psparse(i,k);
+        EXPECT_NEAR(fabs(dot),1,1e-6) << "sparseFirstEigsTest failed";
+    }
+}
+
 TEST_F( MatrixTest, lastEigsTest)
 {
     Matrix2D<double> A(3,3), P;
@@ -1,5 +1,6 @@
 #include <data/multidim_array.h>
 #include <data/matrix2d.h>
+#include <data/histogram.h>
 #include <iostream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
@@ -354,6 +355,57 @@ TEST( MultidimTest, window2D)
     XMIPP_CATCH
 }
 
+TEST( MultidimTest, StatisticsAccumulator)
+{
+    // Two accumulators merged must give the statistics of all the values,
+    // the histogram must not lose any value when its range grows
+    MultidimArray<double> A(1000), B(1000);
+    A.initRandom(0,1);
+    B.initRandom(-50,50);
+    StatisticsAccumulator statsA, statsB, statsAll;
+    statsA.add(A);
+    statsB.add(B);
+    statsA.merge(statsB);
+    for (size_t n=0; n<MULTIDIM_SIZE(A); ++n)
+        statsAll.addValue(DIRECT_MULTIDIM_ELEM(A,n));
+    for (size_t n=0; n<MULTIDIM_SIZE(B); ++n)
+        statsAll.addValue(DIRECT_MULTIDIM_ELEM(B,n));
+
+    MultidimArray<double> AB(2000);
+    memcpy(MULTIDIM_ARRAY(AB),MULTIDIM_ARRAY(A),MULTIDIM_SIZE(A)*sizeof(double));
+    memcpy(MULTIDIM_ARRAY(AB)+MULTIDIM_SIZE(A),MULTIDIM_ARRAY(B),MULTIDIM_SIZE(B)*sizeof(double));
+    double avg, stddev, minval, maxval;
+    AB.computeStats(avg, stddev, minval, maxval);
+    EXPECT_EQ(2000.0, statsA.N);
+    EXPECT_NEAR(avg, statsA.avg(), 1e-10);
+    EXPECT_NEAR(avg, statsAll.avg(), 1e-10);
+    EXPECT_NEAR(stddev*sqrt(2000.0/1999.0), statsA.stddev(), 1e-8);
+    EXPECT_NEAR(stddev*sqrt(2000.0/1999.0), statsAll.stddev(), 1e-8);
+    EXPECT_EQ(minval, statsA.minVal);
+    EXPECT_EQ(maxval, statsA.maxVal);
+
+    double total=0;
+    for (size_t j=0; j<statsA.bins.size(); ++j)
+        total+=statsA.bins[j];
+    EXPECT_EQ(2000.0, total);
+
+    // The median is within one bin of the exact one
+    std::sort(MULTIDIM_ARRAY(AB),MULTIDIM_ARRAY(AB)+MULTIDIM_SIZE(AB));
+    double median=0.5*(DIRECT_MULTIDIM_ELEM(AB,999)+DIRECT_MULTIDIM_ELEM(AB,1000));
+    EXPECT_NEAR(median, statsA.percentil(50), statsA.binWidth);
+    EXPECT_NEAR(median, statsAll.percentil(50), statsAll.binWidth);
+    EXPECT_EQ(minval, statsA.percentil(0));
+    EXPECT_EQ(maxval, statsA.percentil(100));
+
+    // Only the values within the mask are counted
+    MultidimArray<int> mask(1000);
+    for (size_t n=0; n<500; ++n)
+        DIRECT_MULTIDIM_ELEM(mask,n)=1;
+    StatisticsAccumulator statsMask;
+    statsMask.add(A,&mask);
+    EXPECT_EQ(500.0, statsMask.N);
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
 
@@ -0,0 +1,126 @@
+#include <data/basic_pca.h>
+#include <data/metadata.h>
+#include <data/xmipp_image.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class PCATest : public ::testing::Test
+{
+protected:
+    // Stack of images with two principal components of very different
+    // variance plus a small amount of noise
+    virtual void SetUp()
+    {
+        init_random_generator(1);
+        const int N=60, Xdim=16;
+        MultidimArray<double> B1(Xdim,Xdim), B2(Xdim,Xdim), avg(Xdim,Xdim);
+        B1.initRandom(0,1,RND_GAUSSIAN);
+        B2.initRandom(0,1,RND_GAUSSIAN);
+        avg.initRandom(0,1);
+        Image<double> stack(Xdim,Xdim,1,N);
+        MultidimArray<double> &mStack=stack();
+        for (int l=0; l<N; ++l)
+        {
+            double a1=rnd_gaus(0,3), a2=rnd_gaus(0,1);
+            FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(avg)
+            DIRECT_NZYX_ELEM(mStack,l,0,i,j)=DIRECT_A2D_ELEM(avg,i,j)+a1*DIRECT_A2D_ELEM(B1,i,j)+
+                                             a2*DIRECT_A2D_ELEM(B2,i,j)+rnd_gaus(0,0.01);
+        }
+
+        fnStack.initUniqueName("/tmp/testStreamingPCA_XXXXXX");
+        fnStack.deleteFile();
+        fnStack=fnStack+".stk";
+        stack.write(fnStack);
+        FileName fnImg;
+        for (int n=0; n<N; ++n)
+        {
+            fnImg.compose(n+1,fnStack);
+            MD.setValue(MDL_IMAGE,fnImg,MD.addObject());
+        }
+        mask.resizeNoCopy(Xdim,Xdim);
+        mask.initConstant(1);
+
+        // In memory analyzer
+        MultidimArray<float> v(Xdim*Xdim);
+        Image<double> img;
+        FOR_ALL_OBJECTS_IN_METADATA(MD)
+        {
+            MD.getValue(MDL_IMAGE,fnImg,__iter.objId);
+            img.read(fnImg);
+            const MultidimArray<double> &mImg=img();
+            FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mImg)
+            DIRECT_MULTIDIM_ELEM(v,n)=(float)DIRECT_MULTIDIM_ELEM(mImg,n);
+            analyzer.addVector(v);
+        }
+        analyzer.subtractAvg();
+        analyzer.learnPCABasis(2,100);
+        analyzer.projectOnPCABasis(projInMemory);
+    }
+
+    virtual void TearDown()
+    {
+        fnStack.deleteFile();
+    }
+
+    FileName fnStack;
+    MetaData MD;
+    MultidimArray<int> mask;
+    PCAMahalanobisAnalyzer analyzer;
+    Matrix2D<double> projInMemory;
+};
+
+TEST_F( PCATest, streamingPCA)
+{
+    // The basis and the projections must be those of the in memory analyzer
+    // (up to the sign), whatever the chunk size and the number of threads
+    for (int Nthreads=1; Nthreads<=4; Nthreads+=3)
+        for (size_t chunkSize=7; chunkSize<=100; chunkSize+=93)
+        {
+            StreamingPCA streaming;
+            streaming.chunkSize=chunkSize;
+            streaming.Nthreads=Nthreads;
+            streaming.learnPCABasis(MD,mask,2,2);
+            Matrix2D<double> proj;
+            streaming.projectOnPCABasis(MD,mask,proj);
+            ASSERT_EQ(streaming.PCAbasis.size(),(size_t)2);
+            ASSERT_EQ(MAT_YSIZE(proj),MD.size());
+            for (int k=0; k<2; ++k)
+            {
+                // The in memory analyzer does not sort its basis, look for
+                // the component most correlated with k
+                const MultidimArray<double> &bS=streaming.PCAbasis[k];
+                double corr=0;
+                int kM=0;
+                for (int kk=0; kk<2; ++kk)
+                {
+                    const MultidimArray<double> &bM=analyzer.PCAbasis[kk];
+                    double dot=0, norm2S=0, norm2M=0;
+                    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(bS)
+                    {
+                        dot+=DIRECT_MULTIDIM_ELEM(bS,n)*DIRECT_MULTIDIM_ELEM(bM,n);
+                        norm2S+=DIRECT_MULTIDIM_ELEM(bS,n)*DIRECT_MULTIDIM_ELEM(bS,n);
+                        norm2M+=DIRECT_MULTIDIM_ELEM(bM,n)*DIRECT_MULTIDIM_ELEM(bM,n);
+                    }
+                    double corrkk=dot/sqrt(norm2S*norm2M);
+                    if (fabs(corrkk)>fabs(corr))
+                    {
+                        corr=corrkk;
+                        kM=kk;
+                    }
+                }
+                EXPECT_GT(fabs(corr),0.999) << "component=" << k << " chunk=" << chunkSize
+                                            << " threads=" << Nthreads;
+                double sign=(corr>0) ? 1 : -1;
+                for (size_t i=0; i<MAT_YSIZE(proj); ++i)
+                    EXPECT_NEAR(MAT_ELEM(proj,i,k),sign*MAT_ELEM(projInMemory,kM,i),
+                                0.01*(1+fabs(MAT_ELEM(projInMemory,kM,i))));
+            }
+        }
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
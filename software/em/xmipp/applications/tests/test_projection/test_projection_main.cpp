@@ -0,0 +1,43 @@
+#include <data/projection.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class ProjectionTest : public ::testing::Test
+{
+protected:
+    // Random volume with a size that is not a multiple of the number of threads
+    virtual void SetUp()
+    {
+        init_random_generator(1);
+        V.resize(30,34,38);
+        V.initRandom(0,1);
+        V.setXmippOrigin();
+    }
+
+    MultidimArray<double> V;
+};
+
+TEST_F( ProjectionTest, projectVolumeThreads)
+{
+    // Each pixel is computed independently of the others, the projections
+    // must be identical for any number of threads
+    double angles[3][3]={{0,0,0},{23,47,-112},{-80,130,35}};
+    Matrix1D<double> offset(3);
+    VECTOR_R3(offset,1.3,-0.7,2.1);
+    Projection Pserial, Pthreads;
+    for (int a=0; a<3; a++)
+        for (int useOffset=0; useOffset<2; useOffset++)
+        {
+            const Matrix1D<double> *roffset=useOffset ? &offset : NULL;
+            projectVolume(V, Pserial, 41, 37, angles[a][0], angles[a][1], angles[a][2], roffset, 1);
+            projectVolume(V, Pthreads, 41, 37, angles[a][0], angles[a][1], angles[a][2], roffset, 4);
+            EXPECT_EQ(Pserial(),Pthreads()) << "angles=" << a << " offset=" << useOffset;
+        }
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
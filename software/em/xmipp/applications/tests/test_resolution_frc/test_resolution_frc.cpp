@@ -146,6 +146,128 @@ TEST_F( ResolutionFSCTest, copy)
     ASSERT_TRUE( fabs(Rfactor-rFactor) < 0.00001);
 }
 
+// FSC computed coefficient by coefficient, independently of FourierShellIndex.
+// The coefficients beyond maxFreq or beyond the last shell are not used.
+void bruteForceFSC(const MultidimArray<double> &V1, const MultidimArray<double> &V2,
+                   MultidimArray<double> &fsc, double maxFreq=0.5)
+{
+    MultidimArray< std::complex<double> > FT1, FT2;
+    FourierTransformer transformer1, transformer2;
+    transformer1.FourierTransform((MultidimArray<double> &)V1, FT1, true);
+    transformer2.FourierTransform((MultidimArray<double> &)V2, FT2, true);
+
+    int Nshells=XSIZE(V1)/2+1;
+    MultidimArray<double> num, den1, den2;
+    num.initZeros(Nshells);
+    den1.initZeros(Nshells);
+    den2.initZeros(Nshells);
+    for (size_t k=0; k<ZSIZE(FT1); k++)
+        for (size_t i=0; i<YSIZE(FT1); i++)
+            for (size_t j=0; j<XSIZE(FT1); j++)
+            {
+                double fx, fy, fz;
+                FFT_IDX2DIGFREQ(j,XSIZE(V1),fx);
+                FFT_IDX2DIGFREQ(i,YSIZE(V1),fy);
+                FFT_IDX2DIGFREQ(k,ZSIZE(V1),fz);
+                double R=sqrt(fx*fx+fy*fy+fz*fz);
+                if (R>maxFreq)
+                    continue;
+                int idx=(int)round(R*XSIZE(V1));
+                if (idx>=Nshells)
+                    continue;
+                std::complex<double> z1=DIRECT_A3D_ELEM(FT1,k,i,j);
+                std::complex<double> z2=DIRECT_A3D_ELEM(FT2,k,i,j);
+                A1D_ELEM(num,idx)+=real(conj(z1)*z2);
+                A1D_ELEM(den1,idx)+=norm(z1);
+                A1D_ELEM(den2,idx)+=norm(z2);
+            }
+    fsc.initZeros(Nshells);
+    FOR_ALL_ELEMENTS_IN_ARRAY1D(fsc)
+    A1D_ELEM(fsc,i)=A1D_ELEM(num,i)/sqrt(A1D_ELEM(den1,i)*A1D_ELEM(den2,i));
+}
+
+TEST_F( ResolutionFSCTest, shellIndexBatch)
+{
+    // Random pairs of volumes, the second one is a noisy version of the first
+    const int Npairs=3;
+    std::vector< MultidimArray<double> > V1(Npairs), V2(Npairs);
+    std::vector< MultidimArray< std::complex<double> > > FT1(Npairs), FT2(Npairs);
+    std::vector< const MultidimArray< std::complex<double> > * > pFT1, pFT2;
+    std::vector< MultidimArray<double> > expectedFSC(Npairs);
+    init_random_generator(1);
+    for (int p=0; p<Npairs; p++)
+    {
+        V1[p].resize(24,20,22);
+        V1[p].initRandom(0,1);
+        V2[p]=V1[p];
+        V2[p].addNoise(0,p+0.5,"gaussian");
+
+        // FSC of each pair, frc_dpr with and without threads must give it
+        bruteForceFSC(V1[p], V2[p], expectedFSC[p]);
+        MultidimArray<double> aux1=V1[p], aux2=V2[p];
+        MultidimArray<double> freq, frc, frc_noise, dpr, error_l2;
+        frc_dpr(aux1, aux2, 1, freq, frc, frc_noise, dpr, error_l2);
+        ASSERT_TRUE(expectedFSC[p].equal(frc,1e-10));
+        aux1=V1[p];
+        aux2=V2[p];
+        frc_dpr(aux1, aux2, 1, freq, frc, frc_noise, dpr, error_l2, false, false, -1, 0.5, NULL, 3);
+        ASSERT_TRUE(expectedFSC[p].equal(frc,1e-10));
+
+        FourierTransformer transformer1, transformer2;
+        transformer1.FourierTransform(V1[p], FT1[p], true);
+        transformer2.FourierTransform(V2[p], FT2[p], true);
+    }
+    for (int p=0; p<Npairs; p++)
+    {
+        pFT1.push_back(&FT1[p]);
+        pFT2.push_back(&FT2[p]);
+    }
+
+    // All FSCs at once with a shared shell index
+    FourierShellIndex shells;
+    shells.initialize(22,20,24);
+    std::vector< MultidimArray<double> > fsc;
+    for (int nThreads=1; nThreads<=4; nThreads+=3)
+    {
+        fourierShellCorrelation(shells, pFT1, pFT2, fsc, nThreads);
+        ASSERT_EQ(fsc.size(),(size_t)Npairs);
+        for (int p=0; p<Npairs; p++)
+            ASSERT_TRUE(expectedFSC[p].equal(fsc[p],1e-10));
+    }
+}
+
+TEST_F( ResolutionFSCTest, shellIndexCorners)
+{
+    // With an odd Xdim the frequencies up to 0.5 reach the shell Xdim/2+1,
+    // and with a maximum frequency beyond 0.5 the corners of the box land
+    // past the last shell. Those coefficients must not be used.
+    init_random_generator(1);
+    size_t sizes[2][3]={{21,20,24},{16,18,20}};
+    double maxFreqs[2]={0.5,0.8};
+    for (int c=0; c<2; c++)
+    {
+        MultidimArray<double> V1(sizes[c][2],sizes[c][1],sizes[c][0]), V2;
+        V1.initRandom(0,1);
+        V2=V1;
+        V2.addNoise(0,1,"gaussian");
+        MultidimArray<double> expectedFSC;
+        bruteForceFSC(V1, V2, expectedFSC, maxFreqs[c]);
+
+        FourierShellIndex shells;
+        shells.initialize(sizes[c][0],sizes[c][1],sizes[c][2],maxFreqs[c]);
+        ASSERT_GT(A1D_ELEM(shells.count,shells.Nshells),0);
+
+        MultidimArray< std::complex<double> > FT1, FT2;
+        FourierTransformer transformer1, transformer2;
+        transformer1.FourierTransform(V1, FT1, true);
+        transformer2.FourierTransform(V2, FT2, true);
+        std::vector< const MultidimArray< std::complex<double> > * > pFT1(1,&FT1), pFT2(1,&FT2);
+        std::vector< MultidimArray<double> > fsc;
+        fourierShellCorrelation(shells, pFT1, pFT2, fsc, 2);
+        ASSERT_TRUE(expectedFSC.equal(fsc[0],1e-10));
+    }
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
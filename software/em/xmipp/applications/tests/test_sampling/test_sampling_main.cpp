@@ -194,6 +194,46 @@ TEST_F(SamplingTest, computeNeighborsC1)
     XMIPP_CATCH
 }
 
+TEST_F(SamplingTest, sphereDirectionIndex)
+{
+    XMIPP_TRY
+    // The index must give the same answers as the exhaustive search
+    SphereDirectionIndex index;
+    index.build(mysampling.sampling_points_vector);
+    const std::vector< Matrix1D<double> > &points=mysampling.sampling_points_vector;
+    const std::vector< Matrix1D<double> > &queries=mysampling.exp_data_projection_direction_by_L_R;
+    std::vector<size_t> within, withinRef;
+    double cosRadius[]={cos(DEG2RAD(5.)), cos(DEG2RAD(20.)), cos(DEG2RAD(90.))};
+    for (size_t q=0; q<queries.size(); ++q)
+    {
+        const Matrix1D<double> &v=queries[q];
+        double bestDot, bestDotRef=-2;
+        int best=index.findClosest(v,bestDot), bestRef=-1;
+        for (size_t n=0; n<points.size(); ++n)
+        {
+            double dot=dotProduct(points[n],v);
+            if (dot>bestDotRef)
+            {
+                bestDotRef=dot;
+                bestRef=(int)n;
+            }
+        }
+        ASSERT_EQ(bestRef,best);
+        ASSERT_EQ(bestDotRef,bestDot);
+
+        for (int r=0; r<3; ++r)
+        {
+            index.findWithin(v,cosRadius[r],within);
+            withinRef.clear();
+            for (size_t n=0; n<points.size(); ++n)
+                if (dotProduct(points[n],v)>cosRadius[r])
+                    withinRef.push_back(n);
+            ASSERT_EQ(withinRef,within);
+        }
+    }
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
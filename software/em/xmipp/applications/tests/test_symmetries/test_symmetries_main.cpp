@@ -1,4 +1,6 @@
 #include "data/sampling.h"
+#include "data/transformations.h"
+#include "reconstruction/symmetrize.h"
 
 #include <iostream>
 #include <gtest/gtest.h>
@@ -123,6 +125,55 @@ TEST_F(SamplingTest, computeDistanceMetadata)
     XMIPP_CATCH
 }
 
+TEST_F(SamplingTest, symmetrizeVolume)
+{
+    XMIPP_TRY
+    MultidimArray<double> V(32,32,32), Vsym, Vref, Vaux, Vmask(32,32,32);
+    V.initRandom(0,1);
+    V.setXmippOrigin();
+    Vmask.initConstant(1.);
+    Vmask.setXmippOrigin();
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(Vmask)
+    if (k<0 && i<0)
+        A3D_ELEM(Vmask,k,i,j)=0.;
+
+    const char *groups[]={"c4","d3","t","o","i"};
+    Matrix2D<double> L(4, 4), R(4, 4);
+    for (int g=0; g<5; g++)
+    {
+        SL.readSymmetryFile(groups[g]);
+        for (int spline=1; spline<=3; spline+=2)
+            for (int useMask=0; useMask<2; useMask++)
+            {
+                // Reference: one applyGeometry per symmetry operator
+                const MultidimArray<double> *mask=useMask ? &Vmask : NULL;
+                Vref=V;
+                for (int n=0; n<SL.symsNo(); n++)
+                {
+                    SL.getMatrices(n, L, R);
+                    applyGeometry(spline, Vaux, V, R.transpose(), IS_NOT_INV, DONT_WRAP);
+                    if (mask==NULL)
+                        Vref+=Vaux;
+                    else
+                        selfArrayByArrayMask(V, Vaux, Vref, '+', mask);
+                }
+                Vref/=SL.symsNo()+1.0;
+
+                for (int Nthr=1; Nthr<=4; Nthr+=3)
+                {
+                    symmetrizeVolume(SL, V, Vsym, spline, DONT_WRAP, false, false, false, false, false,
+                                     0.0, 0.0, 0.0, 0.95, mask, Nthr);
+                    ASSERT_TRUE(Vsym.sameShape(Vref));
+                    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY3D(Vref)
+                    ASSERT_NEAR(DIRECT_A3D_ELEM(Vsym,k,i,j),DIRECT_A3D_ELEM(Vref,k,i,j),1e-9)
+                    << "group=" << groups[g] << " spline=" << spline << " mask=" << useMask
+                    << " threads=" << Nthr;
+                }
+            }
+    }
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -112,6 +112,28 @@ TEST_F(TransformationTest, selfApplyGeometry)
     EXPECT_EQ(volref,volout);
 }
 
+TEST_F(TransformationTest, applyGeometry3DThreads)
+{
+    MultidimArray<double> V(40,48,56), Vserial, Vthreads;
+    V.initRandom(0,1);
+    V.setXmippOrigin();
+    Matrix2D<double> A;
+    Euler_angles2matrix(23.,47.,-112.,A,true);
+    MAT_ELEM(A,0,3)=1.7;
+    MAT_ELEM(A,1,3)=-2.3;
+    MAT_ELEM(A,2,3)=0.4;
+
+    for (int spline=0; spline<=3; spline++)
+        for (int wrap=0; wrap<2; wrap++)
+        {
+            Vserial.clear();
+            applyGeometry(spline, Vserial, V, A, IS_NOT_INV, wrap, 0.3, NULL, 1);
+            Vthreads.clear();
+            applyGeometry(spline, Vthreads, V, A, IS_NOT_INV, wrap, 0.3, NULL, 4);
+            EXPECT_EQ(Vserial,Vthreads) << "spline=" << spline << " wrap=" << wrap;
+        }
+}
+
 TEST_F(TransformationTest, scaleToSizeNearest)
 {
     MultidimArray<double> imOut, auxMul;
@@ -34,11 +34,20 @@
  * Construct a BatchSOM from the code vectors in a stream
  * Parameter: _is  The stream
  */
-BatchSOM::BatchSOM(std::istream& _is): SOM(_is)
+BatchSOM::BatchSOM(std::istream& _is): SOM(_is), Nthreads(1)
 {
     readSelf(_is);
 }
 
+/**
+ * Sets the number of threads
+ * Parameter: _Nthreads  Number of threads
+ */
+void BatchSOM::setThreads(int _Nthreads)
+{
+    Nthreads = XMIPP_MAX(_Nthreads, 1);
+}
+
 /**
  * Trains the SOM
  * Parameter: _som  The som to train
@@ -56,37 +65,52 @@ void BatchSOM::train(ClassificationMap& _som, const ClassicTrainingVectors& _ts)
     if (verbosity == 1 || verbosity == 3)
         listener->OnInitOperation(somNSteps);
 
-    SomIn aveVector(_som.theItems[0].size());
-    std::vector<unsigned> tmpVector;
+    size_t dim = _som.theItems[0].size();
+    size_t Nunits = _som.size();
+    std::vector<double> unitSum(Nunits * dim), aveVector(dim);
+    std::vector<size_t> unitCount(Nunits);
 
     while (t < somNSteps)
     {
-        _som.classify(&_ts);
+        // Best matching unit of all input vectors (distributed among threads)
+        _som.classifyThreaded(&_ts, Nthreads);
+
+        // Sum of the input vectors assigned to each unit, computed once per
+        // epoch and shared by all the neighborhoods that contain the unit
+        for (size_t it = 0; it < Nunits; it++)
+        {
+            double *ptrUnitSum = &unitSum[it * dim];
+            memset(ptrUnitSum, 0, dim * sizeof(double));
+            const std::vector<unsigned> &assigned = _som.classifAt(it);
+            for (size_t j = 0; j < assigned.size(); j++)
+            {
+                const floatFeature *ptrV = &(_ts.theItems[assigned[j]][0]);
+                for (size_t a = 0; a < dim; a++)
+                    ptrUnitSum[a] += ptrV[a];
+            }
+            unitCount[it] = assigned.size();
+        }
+
         // Check for each SOM unit
-        for (unsigned it = 0; it < _som.size(); it++)
+        for (unsigned it = 0; it < Nunits; it++)
         {
-            for (unsigned a = 0; a < aveVector.size(); a++)
+            for (size_t a = 0; a < dim; a++)
                 aveVector[a] = 0.;
-            long total = 0;
-            // Collects a list of the input vectors assigned to the neighborhood
+            size_t total = 0;
+            // Collects the input vectors assigned to the neighborhood
             std::vector<unsigned> neig = _som.neighborhood(_som.indexToPos(it), ceil(somRadius(t, somNSteps)));
             for (std::vector<unsigned>::iterator itt = neig.begin();itt < neig.end();itt++)
             {
-                tmpVector =  _som.classifAt(*itt);
-                for (unsigned j = 0 ; j < tmpVector.size() ; j++)
-                {
-                    SomIn v = _ts.theItems[tmpVector[j]];
-                    for (unsigned a = 0; a < v.size(); a++)
-                        aveVector[a] += v[a];
-                    total++;
-                }
-
+                const double *ptrUnitSum = &unitSum[(*itt) * dim];
+                for (size_t a = 0; a < dim; a++)
+                    aveVector[a] += ptrUnitSum[a];
+                total += unitCount[*itt];
             }
             if (total != 0)
             {
-                for (unsigned a = 0; a < aveVector.size(); a++)
-                    aveVector[a] /= (floatFeature) total;
-                _som.theItems[it] = aveVector;
+                FeatureVector &codeVector = _som.theItems[it];
+                for (size_t a = 0; a < dim; a++)
+                    codeVector[a] = (floatFeature)(aveVector[a] / total);
             }
         }
 
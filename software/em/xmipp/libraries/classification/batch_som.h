@@ -52,7 +52,7 @@ public:
      * Parameter: _nSteps     Number of training steps
      */
     BatchSOM(Descent& _radius,  unsigned long _nSteps)
-            : SOM(_radius, _radius, BUBBLE, _nSteps)
+            : SOM(_radius, _radius, BUBBLE, _nSteps), Nthreads(1)
     {};
 
     /**
@@ -68,6 +68,12 @@ public:
     virtual ~BatchSOM()
     {};
 
+    /**
+     * Sets the number of threads used to classify the training set
+     * Parameter: _Nthreads  Number of threads
+     */
+    void setThreads(int _Nthreads);
+
     /**
      * Trains the SOM
      * Parameter: _som  The som to train
@@ -81,6 +87,9 @@ public:
      * Parameter: _ts   The training set
      */
     // virtual void train (ClassificationMap& _som, const TS& _ts) const {};
+
+protected:
+    int Nthreads;        // number of threads
 };
 
 //@}
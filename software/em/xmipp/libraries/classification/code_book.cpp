@@ -234,19 +234,37 @@ unsigned CodeBook::winner(const ClassicTrainingVectors& _ts, unsigned _in) const
  * Parameter: _ts  Sample list to classify
  */
 void CodeBook::classify(const ClassicTrainingVectors* _ts)
+{
+    classifyThreaded(_ts, 1);
+}
+
+/**
+ * Fills the classifVectors with the list of the best input vectors associated to it.
+ * Parameter: _ts        Sample list to classify
+ * Parameter: _Nthreads  Number of threads
+ */
+void CodeBook::classifyThreaded(const ClassicTrainingVectors* _ts, int _Nthreads)
 {
     classifVectors.clear(); // clear previous classification.
     classifVectors.resize(size());
     aveDistances.clear(); // clear previous classification.
     aveDistances.resize(size());
+
+    // Best matching code vector of all samples using contiguous copies
+    FeatureMatrix codeMatrix, samplesMatrix;
+    codeMatrix.fromVectors(theItems);
+    samplesMatrix.fromVectors(_ts->theItems);
+    std::vector<unsigned> winners;
+    std::vector<double> dist2;
+    bestMatches(codeMatrix, samplesMatrix, winners, &dist2, _Nthreads);
     for (unsigned j = 0 ; j < _ts->size() ; j++)
-        classifVectors[testIndex(_ts->theItems[j])].push_back(j);
+        classifVectors[winners[j]].push_back(j);
 
     for (unsigned i = 0 ; i < size() ; i++)
     {
         double aveDist = 0;
         for (unsigned j = 0 ; j < classifVectors[i].size() ; j++)
-            aveDist += euclideanDistance(theItems[i], _ts->theItems[classifVectors[i][j]]);
+            aveDist += sqrt(dist2[classifVectors[i][j]]);
         if (classifVectors[i].size() != 0)
             aveDist /= (double) classifVectors[i].size();
         aveDistances[i] = (double) aveDist;
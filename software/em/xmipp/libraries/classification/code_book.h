@@ -37,6 +37,7 @@
 #include "data_types.h"
 #include "training_vector.h"
 #include "vector_ops.h"
+#include "feature_matrix.h"
 #include "uniform.h"
 
 /**@defgroup CodeBook Code book
@@ -147,6 +148,16 @@ public:
 
     virtual void classify(const ClassicTrainingVectors* _ts);
 
+    /**
+     * Fills the classifVectors with the list of the best input vectors associated to it.
+     * The best matching code vectors are searched with Nthreads threads.
+     * This is the crisp assignment also for the derived classes that
+     * redefine classify.
+     * Parameter: _ts        Sample list to classify
+     * Parameter: _Nthreads  Number of threads
+     */
+    void classifyThreaded(const ClassicTrainingVectors* _ts, int _Nthreads);
+
 
     /**
      * Returns the list of input vectors associated to this code vector.
@@ -0,0 +1,173 @@
+/***************************************************************************
+ *
+ * Authors:     agent (agent@local)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdint.h>
+#include "feature_matrix.h"
+#include <data/xmipp_error.h>
+#include <data/xmipp_macros.h>
+#include <data/xmipp_threads.h>
+
+// Alignment of the rows (in features)
+#define FEATURE_ALIGN 8
+
+FeatureMatrix::FeatureMatrix()
+{
+    Nrows = Ncols = stride = 0;
+    data = NULL;
+}
+
+FeatureMatrix::FeatureMatrix(const FeatureMatrix &other)
+{
+    Nrows = Ncols = stride = 0;
+    data = NULL;
+    *this = other;
+}
+
+FeatureMatrix & FeatureMatrix::operator=(const FeatureMatrix &other)
+{
+    if (this != &other)
+    {
+        resize(other.Nrows, other.Ncols);
+        if (Nrows > 0)
+            memcpy(data, other.data, Nrows * stride * sizeof(floatFeature));
+    }
+    return *this;
+}
+
+void FeatureMatrix::resize(size_t _Nrows, size_t _Ncols)
+{
+    Nrows = _Nrows;
+    Ncols = _Ncols;
+    stride = ((Ncols + FEATURE_ALIGN - 1) / FEATURE_ALIGN) * FEATURE_ALIGN;
+    storage.assign(Nrows * stride + FEATURE_ALIGN, 0);
+
+    // Align the first row to FEATURE_ALIGN features
+    uintptr_t addr = (uintptr_t)&storage[0];
+    uintptr_t alignment = FEATURE_ALIGN * sizeof(floatFeature);
+    size_t offset = ((alignment - addr % alignment) % alignment) / sizeof(floatFeature);
+    data = &storage[0] + offset;
+}
+
+void FeatureMatrix::fromVectors(const std::vector<FeatureVector> &vectors)
+{
+    size_t N = vectors.size();
+    size_t n = N > 0 ? vectors[0].size() : 0;
+    // The storage is reused when the shape does not change, the padding
+    // features are still 0 because setRow only writes the first Ncols
+    if (N != Nrows || n != Ncols || data == NULL)
+        resize(N, n);
+    for (size_t i = 0; i < N; i++)
+        setRow(i, vectors[i]);
+}
+
+void FeatureMatrix::setRow(size_t i, const FeatureVector &v)
+{
+    if (v.size() != Ncols)
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, "FeatureMatrix: vector of different size");
+    if (Ncols > 0)
+        memcpy(row(i), &v[0], Ncols * sizeof(floatFeature));
+}
+
+size_t bestMatch(const FeatureMatrix &M, const floatFeature *x, double &bestDist2)
+{
+    if (M.rows() == 0)
+        REPORT_ERROR(ERR_VALUE_EMPTY, "bestMatch: the matrix is empty");
+    size_t best = 0;
+    size_t n = M.cols();
+    bestDist2 = squaredDistance(M.row(0), x, n);
+    for (size_t i = 1; i < M.rows(); i++)
+    {
+        double dist2 = squaredDistance(M.row(i), x, n);
+        if (dist2 < bestDist2)
+        {
+            bestDist2 = dist2;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* Data shared by the threads looking for the best matches */
+struct BestMatchesData
+{
+    const FeatureMatrix *codeVectors;
+    const FeatureMatrix *samples;
+    std::vector<unsigned> *winners;
+    std::vector<double> *dist2;
+    ThreadTaskDistributor *td;
+};
+
+static void bestMatchesRange(const BestMatchesData &data, size_t first, size_t last)
+{
+    for (size_t i = first; i <= last; i++)
+    {
+        double d2;
+        (*data.winners)[i] = (unsigned)bestMatch(*data.codeVectors, data.samples->row(i), d2);
+        if (data.dist2 != NULL)
+            (*data.dist2)[i] = d2;
+    }
+}
+
+static void threadBestMatches(ThreadArgument &thArg)
+{
+    BestMatchesData &data = *((BestMatchesData *)thArg.workClass);
+    size_t first, last;
+    while (data.td->getTasks(first, last))
+        bestMatchesRange(data, first, last);
+}
+
+void bestMatches(const FeatureMatrix &codeVectors, const FeatureMatrix &samples,
+                 std::vector<unsigned> &winners, std::vector<double> *dist2,
+                 int Nthreads)
+{
+    size_t N = samples.rows();
+    if (codeVectors.rows() == 0)
+        REPORT_ERROR(ERR_VALUE_EMPTY, "bestMatches: there are no code vectors");
+    if (codeVectors.cols() != samples.cols())
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, "bestMatches: code vectors and samples of different size");
+    winners.resize(N);
+    if (dist2 != NULL)
+        dist2->resize(N);
+    if (N == 0)
+        return;
+
+    BestMatchesData data;
+    data.codeVectors = &codeVectors;
+    data.samples = &samples;
+    data.winners = &winners;
+    data.dist2 = dist2;
+    data.td = NULL;
+    if (Nthreads <= 1)
+        bestMatchesRange(data, 0, N - 1);
+    else
+    {
+        ThreadTaskDistributor td(N, XMIPP_MAX(N / (50 * Nthreads), 1));
+        data.td = &td;
+        ThreadManager thMgr(Nthreads, &data);
+        thMgr.run(threadBestMatches);
+    }
+}
+#undef FEATURE_ALIGN
@@ -0,0 +1,144 @@
+/***************************************************************************
+ *
+ * Authors:     agent (agent@local)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+//-----------------------------------------------------------------------------
+// FeatureMatrix.h
+//-----------------------------------------------------------------------------
+
+#ifndef XMIPPFEATUREMATRIX_H
+#define XMIPPFEATUREMATRIX_H
+
+#include <vector>
+#include "data_types.h"
+
+/**@defgroup FeatureMatrix Contiguous storage of feature vectors
+   @ingroup ClassificationLibrary */
+//@{
+/**
+ * Set of feature vectors stored contiguously by rows.
+ *
+ * Each row is a feature vector. Rows start at 32-byte boundaries and are
+ * padded with zeros up to a multiple of 8 features, so that the distance
+ * kernels below can be vectorized by the compiler. Training sets and code
+ * books keep their FeatureVector storage; this matrix is a copy made for
+ * the distance intensive parts of the algorithms.
+ */
+class FeatureMatrix
+{
+public:
+    /// Empty constructor
+    FeatureMatrix();
+
+    /// Copy constructor
+    FeatureMatrix(const FeatureMatrix &other);
+
+    /// Assignment
+    FeatureMatrix & operator=(const FeatureMatrix &other);
+
+    /// Resize to Nrows x Ncols, all features are set to 0
+    void resize(size_t _Nrows, size_t _Ncols);
+
+    /** Copy a set of feature vectors (all of them of the same size).
+     * The memory is not reallocated if the shape of the matrix does not change.
+     */
+    void fromVectors(const std::vector<FeatureVector> &vectors);
+
+    /// Copy the feature vector v into row i
+    void setRow(size_t i, const FeatureVector &v);
+
+    /// Number of rows
+    inline size_t rows() const
+    {
+        return Nrows;
+    }
+
+    /// Number of features per row
+    inline size_t cols() const
+    {
+        return Ncols;
+    }
+
+    /// Pointer to row i
+    inline const floatFeature * row(size_t i) const
+    {
+        return data + i * stride;
+    }
+
+    /// Pointer to row i
+    inline floatFeature * row(size_t i)
+    {
+        return data + i * stride;
+    }
+
+private:
+    size_t Nrows, Ncols, stride;
+    std::vector<floatFeature> storage;
+    floatFeature *data;
+};
+
+/** Squared euclidean distance between two rows of n features.
+ * The sum is split in 4 independent accumulators so that it can be
+ * vectorized.
+ */
+inline double squaredDistance(const floatFeature * __restrict__ a,
+                              const floatFeature * __restrict__ b, size_t n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        double d0 = (double)a[j] - (double)b[j];
+        double d1 = (double)a[j+1] - (double)b[j+1];
+        double d2 = (double)a[j+2] - (double)b[j+2];
+        double d3 = (double)a[j+3] - (double)b[j+3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; j < n; j++)
+    {
+        double d = (double)a[j] - (double)b[j];
+        s0 += d * d;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/** Best matching row.
+ * Returns the index of the row of M closest to x (the first one in case of
+ * ties) and its squared distance in bestDist2. M cannot be empty.
+ */
+size_t bestMatch(const FeatureMatrix &M, const floatFeature *x, double &bestDist2);
+
+/** Best matching rows of a set of samples.
+ * For each row of samples, winners[i] is the index of the closest row of
+ * codeVectors. If dist2 is not NULL, the squared distances are returned as
+ * well. The samples are distributed among Nthreads threads.
+ */
+void bestMatches(const FeatureMatrix &codeVectors, const FeatureMatrix &samples,
+                 std::vector<unsigned> &winners, std::vector<double> *dist2 = NULL,
+                 int Nthreads = 1);
+//@}
+#endif
@@ -60,6 +60,9 @@ void GaussianKerDenSOM::train(FuzzyMap& _som, TS& _examples, FileName& _fn,
         tmpMap[i].resize(dim, 0.);
     tmpD.resize(numNeurons);
     tmpD1.resize(numNeurons);
+    // The training set may have changed since the last call
+    examplesSource = NULL;
+    setExamplesMatrix(&_examples);
     double stopError;
 
     int verbosity = listener->getVerbosity();
@@ -234,6 +237,9 @@ void GaussianKerDenSOM::train(FuzzyMap& _som, TS& _examples, FileName& _fn,
     tmpMap.clear();
     tmpD.clear();
     tmpD1.clear();
+    examplesMatrix.resize(0, 0);
+    codeMatrix.resize(0, 0);
+    examplesSource = NULL;
 
 }
 
@@ -244,59 +250,117 @@ void GaussianKerDenSOM::train(FuzzyMap& _som, TS& _examples, FileName& _fn,
 double GaussianKerDenSOM::updateU(FuzzyMap* _som, const TS* _examples,
 		                          const double& _sigma, double& _alpha)
 {
-    // Create auxiliar stuff
+    setExamplesMatrix(_examples);
+    codeMatrix.fromVectors(_som->theItems);
+
+    // Update Membership matrix
+    std::vector<double> alphaK;
+    processExamples(_som, _sigma, 0, alphaK);
+
+    // The contributions are added in the same order whatever the number of threads
+    _alpha = 0;
+    for (size_t k = 0; k < numVectors; k++)
+        _alpha += alphaK[k];
+    return 0.0;
+}
+
+/**
+ * Update the memberships of a single example
+ */
+double GaussianKerDenSOM::updateUk(FuzzyMap* _som, size_t k, double _sigma,
+                                   double* ptrTmpD, double* ptrTmpD1) const
+{
     double auxDist;
     double rr2, max1, d1, tmp, r1;
 
     double irr1 =1.0/( 2.0 * _sigma);
-    _alpha = 0;
-
-    // Update Membership matrix
-    double *ptrTmpD=&tmpD[0];
-    double *ptrTmpD1=&tmpD1[0];
     double idim=1.0/dim;
-    for (size_t k = 0; k < numVectors; k++)
+    max1 = -MAXFLOAT;
+    const floatFeature *ptrExample=examplesMatrix.row(k);
+    for (size_t i = 0; i < numNeurons; i ++)
     {
-        max1 = -MAXFLOAT;
-        const floatFeature *ptrExample=&(_examples->theItems[k][0]);
-        for (size_t i = 0; i < numNeurons; i ++)
-        {
-            auxDist = 0;
-            const floatFeature *ptrCodeVector=&(_som->theItems[i][0]);
-            for (size_t j = 0; j < dim; j++)
-            {
-                double tmp=((double)ptrExample[j] - (double)ptrCodeVector[j]);
-                auxDist += tmp * tmp;
-            }
-            auxDist*=idim;
-            ptrTmpD[i] = auxDist;
-            rr2 = -auxDist * irr1;
-            ptrTmpD1[i] = rr2;
-            if (max1 < rr2)
-                max1 = rr2;
-        }
-        r1 = 0;
-        for (size_t j = 0; j < numNeurons; j ++)
-        {
-            rr2 = ptrTmpD1[j] - max1;
-            if (rr2 < MAXZ)
-                d1 = 0;
-            else
-                d1 = (double)exp(rr2);
-            r1 += d1;
-            ptrTmpD1[j] = d1;
-        }
-        double ir1=1.0/r1;
+        auxDist = squaredDistance(ptrExample, codeMatrix.row(i), dim) * idim;
+        ptrTmpD[i] = auxDist;
+        rr2 = -auxDist * irr1;
+        ptrTmpD1[i] = rr2;
+        if (max1 < rr2)
+            max1 = rr2;
+    }
+    r1 = 0;
+    for (size_t j = 0; j < numNeurons; j ++)
+    {
+        rr2 = ptrTmpD1[j] - max1;
+        if (rr2 < MAXZ)
+            d1 = 0;
+        else
+            d1 = (double)exp(rr2);
+        r1 += d1;
+        ptrTmpD1[j] = d1;
+    }
+    double ir1=1.0/r1;
 
-        floatFeature *ptrSomMembK=&(_som->memb[k][0]);
-        for (size_t j = 0; j < numNeurons; j ++)
-        {
-            tmp = ptrTmpD1[j] * ir1;
-            ptrSomMembK[j] = (floatFeature) tmp;
-            _alpha += tmp * ptrTmpD[j];
-        }
-    } // for k
-    return 0.0;
+    double alpha = 0;
+    floatFeature *ptrSomMembK=&(_som->memb[k][0]);
+    for (size_t j = 0; j < numNeurons; j ++)
+    {
+        tmp = ptrTmpD1[j] * ir1;
+        ptrSomMembK[j] = (floatFeature) tmp;
+        alpha += tmp * ptrTmpD[j];
+    }
+    return alpha;
+}
+
+/* Data shared by the threads of processExamples */
+struct GaussianKerDenSOMThreadData
+{
+    GaussianKerDenSOM *self;
+    FuzzyMap *som;
+    double sigma;
+    int mode;
+    std::vector<double> *result;
+    ThreadTaskDistributor *td;
+};
+
+void GaussianKerDenSOM::threadProcessExamples(ThreadArgument &thArg)
+{
+    GaussianKerDenSOMThreadData &data=*((GaussianKerDenSOMThreadData *)thArg.workClass);
+    size_t first, last;
+    while (data.td->getTasks(first, last))
+        data.self->processExampleRange(data.som, data.sigma, data.mode, *data.result, first, last);
+}
+
+void GaussianKerDenSOM::processExampleRange(FuzzyMap* _som, double _sigma, int _mode,
+                                            std::vector<double>& _result, size_t _first, size_t _last) const
+{
+    std::vector<double> auxD(numNeurons), auxD1(numNeurons);
+    for (size_t k = _first; k <= _last; k++)
+        if (_mode == 0)
+            _result[k] = updateUk(_som, k, _sigma, &auxD[0], &auxD1[0]);
+        else
+            _result[k] = codeDensK(k, _sigma);
+}
+
+void GaussianKerDenSOM::processExamples(FuzzyMap* _som, double _sigma, int _mode,
+                                        std::vector<double>& _result)
+{
+    _result.resize(numVectors);
+    if (numVectors == 0)
+        return;
+    if (Nthreads <= 1)
+        processExampleRange(_som, _sigma, _mode, _result, 0, numVectors - 1);
+    else
+    {
+        GaussianKerDenSOMThreadData data;
+        data.self = this;
+        data.som = _som;
+        data.sigma = _sigma;
+        data.mode = _mode;
+        data.result = &_result;
+        ThreadTaskDistributor td(numVectors, XMIPP_MAX(numVectors / (50 * Nthreads), 1));
+        data.td = &td;
+        ThreadManager thMgr(Nthreads, &data);
+        thMgr.run(threadProcessExamples);
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -353,6 +417,28 @@ double GaussianKerDenSOM::codeDens(const FuzzyMap* _som, const FeatureVector* _e
 
 //-----------------------------------------------------------------------------
 
+/**
+ * Estimate the PD at the example k (Method 1: Using the code vectors)
+ */
+double GaussianKerDenSOM::codeDensK(size_t k, double _sigma) const
+{
+    double s = 0;
+    double K=-1.0/(2*_sigma);
+    const floatFeature *ptrExample=examplesMatrix.row(k);
+    for (size_t cc = 0; cc < numNeurons; cc++)
+    {
+        double t = squaredDistance(ptrExample, codeMatrix.row(cc), dim) * K;
+        if (t < MAXZ)
+            t = 0;
+        else
+            t = exp(t);
+        s += t;
+    }
+    return std::pow(2*PI*_sigma, -0.5*dim)*s / numNeurons;
+}
+
+//-----------------------------------------------------------------------------
+
 /**
  * Estimate the PD (Method 2: Using the data)
  */
@@ -390,9 +476,13 @@ double GaussianKerDenSOM::functional(const TS* _examples, const FuzzyMap* _som,
     unsigned j, vv, cc;
     double t;
     _likelihood = 0;
+    setExamplesMatrix(_examples);
+    codeMatrix.fromVectors(_som->theItems);
+    std::vector<double> dens;
+    processExamples(NULL, _sigma, 1, dens);
     for (vv = 0; vv < numVectors; vv++)
     {
-        t = codeDens(_som, &(_examples->theItems[vv]), _sigma);
+        t = dens[vv];
         if (t == 0)
         {
             t = 1e-300;
@@ -33,6 +33,7 @@
 #define XMIPPTGAUSSIANKERDENSOM_H
 
 #include "kerdensom.h"
+#include <data/xmipp_threads.h>
 
 /**@defgroup SmoothlyGaussianStudent Smoothly Distributed Gaussian Kernel Probability Density Estimator Self Organizing Map
    @ingroup ClassificationLibrary */
@@ -98,6 +99,22 @@ protected:
     // Estimate the PD (Method 2: Using the data)
     virtual double dataDens(const TS* _examples, const FeatureVector* _example, double _sigma) const;
 
+    // Update the memberships of the example k (using the contiguous copies).
+    // Returns its contribution to alpha
+    double updateUk(FuzzyMap* _som, size_t k, double _sigma, double* _tmpD, double* _tmpD1) const;
+
+    // Estimate the PD at the example k with the code vectors (using the contiguous copies)
+    double codeDensK(size_t k, double _sigma) const;
+
+    // Compute updateUk (_mode=0) or codeDensK (_mode=1) for the examples _first to _last
+    void processExampleRange(FuzzyMap* _som, double _sigma, int _mode, std::vector<double>& _result,
+                             size_t _first, size_t _last) const;
+
+    // Compute updateUk (_mode=0) or codeDensK (_mode=1) for all examples with threads
+    void processExamples(FuzzyMap* _som, double _sigma, int _mode, std::vector<double>& _result);
+
+    // Thread function of processExamples
+    static void threadProcessExamples(ThreadArgument &thArg);
 };
 
 //@}
@@ -51,6 +51,31 @@ double KerDenSOM::getSigma()
 }
 
 
+//-----------------------------------------------------------------------------
+
+/**
+ * Sets the number of threads
+ * Parameter: _Nthreads  Number of threads
+ */
+void KerDenSOM::setThreads(int _Nthreads)
+{
+    Nthreads = XMIPP_MAX(_Nthreads, 1);
+}
+
+//-----------------------------------------------------------------------------
+
+/**
+ * Copy the training vectors in examplesMatrix if they are not there yet
+ */
+void KerDenSOM::setExamplesMatrix(const TS* _examples)
+{
+    if (examplesSource != _examples || examplesMatrix.rows() != _examples->size())
+    {
+        examplesMatrix.fromVectors(_examples->theItems);
+        examplesSource = _examples;
+    }
+}
+
 //-----------------------------------------------------------------------------
 
 /**
@@ -117,24 +142,7 @@ void KerDenSOM::updateV(FuzzyMap* _som, const TS* _examples, const double& _reg)
     unsigned t2 = 0;  // Iteration index
 
     // Calculate Temporal scratch values
-    for (size_t cc = 0; cc < numNeurons; cc++)
-    {
-    	double *ptrTmpMap_cc=&(tmpMap[cc][0]);
-    	memset(ptrTmpMap_cc,0,dim*sizeof(double));
-    	double &tmpDens_cc=tmpDens[cc];
-        if (_reg != 0)
-        	tmpDens_cc = _reg * _som->getLayout().numNeig(_som, (SomPos) _som->indexToPos(cc));
-        else
-        	tmpDens_cc = 0.;
-        for (size_t vv = 0; vv < numVectors; vv++)
-        {
-            double tmpU = (double) _som->memb[vv][cc];
-            tmpDens_cc += tmpU;
-            const floatFeature * ptrExample=&(_examples->theItems[vv][0]);
-            for (size_t j = 0; j < dim; j++)
-            	ptrTmpMap_cc[j] +=  tmpU * ptrExample[j];
-        }
-    }
+    weightedSums(_som, _examples, _reg);
 
     // Update Code vectors using a sort of Gauss-Seidel iterative algorithm.
     // Usually 100 iterations are enough.
@@ -166,6 +174,100 @@ void KerDenSOM::updateV(FuzzyMap* _som, const TS* _examples, const double& _reg)
 
 //-----------------------------------------------------------------------------
 
+/* Data shared by the threads of weightedSums */
+struct KerDenSOMWeightedSumsData
+{
+    const KerDenSOM *self;
+    const FuzzyMap *som;
+    const KerDenSOM::TS *examples;
+    size_t numVectors, numNeurons, dim;
+    std::vector< std::vector<double> > *shardMap;
+    std::vector< std::vector<double> > *shardDens;
+};
+
+void KerDenSOM::threadWeightedSums(ThreadArgument &thArg)
+{
+    KerDenSOMWeightedSumsData &data=*((KerDenSOMWeightedSumsData *)thArg.workClass);
+    size_t Nshards=data.shardMap->size();
+    size_t shard=thArg.thread_id;
+    size_t first=(shard*data.numVectors)/Nshards;
+    size_t last=((shard+1)*data.numVectors)/Nshards;
+    std::vector<double> &map=(*data.shardMap)[shard];
+    std::vector<double> &dens=(*data.shardDens)[shard];
+    map.assign(data.numNeurons*data.dim, 0.);
+    dens.assign(data.numNeurons, 0.);
+    if (last>first)
+        data.self->weightedSumsRange(data.som, data.examples, first, last-1, &map[0], &dens[0]);
+}
+
+void KerDenSOM::weightedSumsRange(const FuzzyMap* _som, const TS* _examples, size_t _first, size_t _last,
+                                  double* _map, double* _dens) const
+{
+    for (size_t vv = _first; vv <= _last; vv++)
+    {
+        const floatFeature *ptrMemb=&(_som->memb[vv][0]);
+        const floatFeature *ptrExample=&(_examples->theItems[vv][0]);
+        double *ptrMap_cc=_map;
+        for (size_t cc = 0; cc < numNeurons; cc++, ptrMap_cc+=dim)
+        {
+            double tmpU = (double) ptrMemb[cc];
+            _dens[cc] += tmpU;
+            for (size_t j = 0; j < dim; j++)
+                ptrMap_cc[j] += tmpU * ptrExample[j];
+        }
+    }
+}
+
+void KerDenSOM::weightedSums(const FuzzyMap* _som, const TS* _examples, double _reg)
+{
+    for (size_t cc = 0; cc < numNeurons; cc++)
+        if (_reg != 0)
+            tmpDens[cc] = _reg * _som->getLayout().numNeig(_som, (SomPos) _som->indexToPos(cc));
+        else
+            tmpDens[cc] = 0.;
+
+    size_t Nshards = XMIPP_MIN((size_t)Nthreads, numVectors);
+    if (Nshards <= 1)
+    {
+        // A single shard, the examples are added in their natural order
+        std::vector<double> map(numNeurons*dim, 0.);
+        if (numVectors > 0)
+            weightedSumsRange(_som, _examples, 0, numVectors - 1, &map[0], &tmpDens[0]);
+        for (size_t cc = 0; cc < numNeurons; cc++)
+            memcpy(&(tmpMap[cc][0]), &map[cc*dim], dim*sizeof(double));
+        return;
+    }
+
+    std::vector< std::vector<double> > shardMap(Nshards), shardDens(Nshards);
+    KerDenSOMWeightedSumsData data;
+    data.self = this;
+    data.som = _som;
+    data.examples = _examples;
+    data.numVectors = numVectors;
+    data.numNeurons = numNeurons;
+    data.dim = dim;
+    data.shardMap = &shardMap;
+    data.shardDens = &shardDens;
+    ThreadManager thMgr(Nshards, &data);
+    thMgr.run(threadWeightedSums);
+
+    // Reduce the partial sums always in the same order
+    for (size_t cc = 0; cc < numNeurons; cc++)
+    {
+        double *ptrTmpMap_cc=&(tmpMap[cc][0]);
+        memset(ptrTmpMap_cc,0,dim*sizeof(double));
+        for (size_t s = 0; s < Nshards; s++)
+        {
+            tmpDens[cc] += shardDens[s][cc];
+            const double *ptrShardMap_cc=&shardMap[s][cc*dim];
+            for (size_t j = 0; j < dim; j++)
+                ptrTmpMap_cc[j] += ptrShardMap_cc[j];
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
 // Main iterations
 double KerDenSOM::mainIterations(FuzzyMap* _som, const TS* _examples, double& _sigma, const double& _reg)
 {
@@ -240,27 +342,7 @@ double KerDenSOM::updateSigmaI(FuzzyMap* _som, const TS* _examples)
  */
 void KerDenSOM::updateV1(FuzzyMap* _som, const TS* _examples)
 {
-    for (size_t cc = 0; cc < numNeurons; cc++)
-    {
-    	std::vector<double> &tmpMap_cc=tmpMap[cc];
-    	double *ptrTmpMap_cc0=&tmpMap_cc[0];
-    	memset(ptrTmpMap_cc0,0,dim*sizeof(double));
-        double &tmpDens_cc=tmpDens[cc];
-        tmpDens_cc = 0.0;
-        for (size_t vv = 0; vv < numVectors; vv++)
-        {
-            double tmpU = _som->memb[vv][cc];
-            tmpDens_cc += tmpU;
-            const floatFeature *ptrExample=&(_examples->theItems[vv][0]);
-            double *ptrTmpMap_cc=ptrTmpMap_cc0;
-            for (size_t j = 0; j < dim; j++)
-            {
-            	*ptrTmpMap_cc += tmpU * (*ptrExample);
-            	++ptrExample;
-            	++ptrTmpMap_cc;
-            }
-        }
-    }
+    weightedSums(_som, _examples, 0);
 
     for (size_t cc = 0; cc < numNeurons; cc++)
     {
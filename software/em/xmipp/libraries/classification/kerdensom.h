@@ -34,6 +34,8 @@
 
 #include "base_algorithm.h"
 #include "map.h"
+#include "feature_matrix.h"
+#include <data/xmipp_threads.h>
 
 /**@defgroup Kendersom Kendersom: Smoothly Distributed Kernel Probability Density Estimator Self Organizing Map
    @ingroup ClassificationLibrary */
@@ -56,7 +58,7 @@ public:
     KerDenSOM(double _reg0, double _reg1, unsigned long _annSteps,
                    double _epsilon, unsigned long _nSteps)
             : ClassificationAlgorithm<FuzzyMap>(), annSteps(_annSteps), reg0(_reg0), reg1(_reg1),
-            epsilon(_epsilon), somNSteps(_nSteps)
+            epsilon(_epsilon), somNSteps(_nSteps), Nthreads(1), examplesSource(NULL)
     {};
 
     /**
@@ -83,6 +85,12 @@ public:
      */
     void setAnnSteps(const unsigned long& _annSteps);
 
+    /**
+     * Sets the number of threads used to compute the memberships
+     * and the functional
+     */
+    void setThreads(int _Nthreads);
+
 
     /**
      * Trains the KerDenSOM
@@ -123,6 +131,7 @@ protected:
     double reg0, reg1;   // Regularization factors
     double epsilon;      // Stopping criterion Error < epsilon
     size_t somNSteps;   // number of steps
+    int Nthreads;        // number of threads
 
 
     // Internal Scratch
@@ -133,6 +142,14 @@ protected:
     std::vector < std::vector<double> > tmpMap;
     std::vector<double> tmpD, tmpD1, tmpDens, tmpV;
 
+    // Contiguous copies of the training vectors and the code vectors
+    FeatureMatrix examplesMatrix, codeMatrix;
+    // Training set copied in examplesMatrix
+    const TS* examplesSource;
+
+    // Copy the training vectors in examplesMatrix if they are not there yet
+    void setExamplesMatrix(const TS* _examples);
+
 
     /** Declaration of virtual method */
     virtual void train(FuzzyMap& _som, const TS& _examples) const
@@ -158,6 +175,18 @@ protected:
     // Update Code vectors
     virtual void updateV(FuzzyMap* _som, const TS* _examples, const double& _sigma);
 
+    // Membership weighted sums of the examples (tmpMap) and memberships (tmpDens)
+    // of each code vector. The examples are split in Nthreads shards whose
+    // partial sums are added in shard order.
+    void weightedSums(const FuzzyMap* _som, const TS* _examples, double _reg);
+
+    // Add the contributions of the examples _first to _last to _map and _dens
+    void weightedSumsRange(const FuzzyMap* _som, const TS* _examples, size_t _first, size_t _last,
+                           double* _map, double* _dens) const;
+
+    // Thread function of weightedSums
+    static void threadWeightedSums(ThreadArgument &thArg);
+
     // Main iterations
     virtual double mainIterations(FuzzyMap* _som, const TS* _examples, double& _sigma, const double& _reg);
 
@@ -236,6 +236,14 @@ public:
         return _is;
     };
 
+    /**
+    * Copy constructor
+    * Parameter: op1 ClassificationMap
+    */
+    ClassificationMap(const ClassificationMap &op1)
+            : CodeBook(op1), somLayout(op1.somLayout), somWidth(op1.somWidth), somHeight(op1.somHeight)
+    {}
+
     /**
     * Operator "="
     * Parameter: op1 ClassificationMap
@@ -492,6 +500,14 @@ public:
     };
 
 
+    /**
+    * Copy constructor
+    * Parameter: op1 FuzzyMap
+    */
+    FuzzyMap(const FuzzyMap &op1)
+            : FuzzyCodeBook(op1), somLayout(op1.somLayout), somWidth(op1.somWidth), somHeight(op1.somHeight)
+    {}
+
     /**
     * Operator "="
     * Parameter: op1 FuzzyMap
@@ -25,6 +25,9 @@
 
 #include "basic_pca.h"
 #include "matrix2d.h"
+#include "metadata.h"
+#include "xmipp_image.h"
+#include "xmipp_threads.h"
 
 /* Subtract average ------------------------------------------------------- */
 void PCAMahalanobisAnalyzer::subtractAvg()
@@ -536,3 +539,314 @@ void PCAonline::addVector(MultidimArray<double> &y)
 		N++;
 	}
 }
+
+/* Streaming PCA ---------------------------------------------------------- */
+/* Data shared by the threads of the streaming PCA */
+struct StreamingPCAThreadData
+{
+    // Chunk of vectors (by rows) and number of valid rows
+    const MultidimArray<double> *X;
+    size_t n;
+    // Set of vectors (by rows) on which X is projected
+    const MultidimArray<double> *Q;
+    // T=X*Q^t
+    MultidimArray<double> *T;
+    // Y+=T^t*X
+    MultidimArray<double> *Y;
+    ThreadTaskDistributor *td;
+};
+
+// T(i,:)=X(i,:)*Q^t for the rows first to last of X
+static void streamingPCAProject(const StreamingPCAThreadData &data, size_t first, size_t last)
+{
+    const MultidimArray<double> &X=*data.X;
+    const MultidimArray<double> &Q=*data.Q;
+    size_t d=XSIZE(X);
+    size_t l=YSIZE(Q);
+    for (size_t i=first; i<=last; ++i)
+    {
+        const double *ptrX=&DIRECT_A2D_ELEM(X,i,0);
+        for (size_t k=0; k<l; ++k)
+        {
+            const double *ptrQ=&DIRECT_A2D_ELEM(Q,k,0);
+            double dot=0;
+            for (size_t p=0; p<d; ++p)
+                dot+=ptrX[p]*ptrQ[p];
+            DIRECT_A2D_ELEM(*data.T,i,k)=dot;
+        }
+    }
+}
+
+// Y(:,p)+=T^t*X(:,p) for the pixels first to last.
+// Every pixel adds the images in the same order whatever the number of threads
+static void streamingPCAAccumulate(const StreamingPCAThreadData &data, size_t first, size_t last)
+{
+    const MultidimArray<double> &X=*data.X;
+    const MultidimArray<double> &T=*data.T;
+    MultidimArray<double> &Y=*data.Y;
+    size_t l=YSIZE(Y);
+    for (size_t k=0; k<l; ++k)
+    {
+        double *ptrY=&DIRECT_A2D_ELEM(Y,k,0);
+        for (size_t i=0; i<data.n; ++i)
+        {
+            double t=DIRECT_A2D_ELEM(T,i,k);
+            const double *ptrX=&DIRECT_A2D_ELEM(X,i,0);
+            for (size_t p=first; p<=last; ++p)
+                ptrY[p]+=t*ptrX[p];
+        }
+    }
+}
+
+static void threadStreamingPCAProject(ThreadArgument &thArg)
+{
+    StreamingPCAThreadData &data=*((StreamingPCAThreadData *)thArg.workClass);
+    size_t first, last;
+    while (data.td->getTasks(first, last))
+        streamingPCAProject(data, first, last);
+}
+
+static void threadStreamingPCAAccumulate(ThreadArgument &thArg)
+{
+    StreamingPCAThreadData &data=*((StreamingPCAThreadData *)thArg.workClass);
+    size_t first, last;
+    while (data.td->getTasks(first, last))
+        streamingPCAAccumulate(data, first, last);
+}
+
+// T=X*Q^t for the first n rows of X
+static void streamingPCAProjectChunk(StreamingPCAThreadData &data, int Nthreads)
+{
+    if (data.n==0)
+        return;
+    if (Nthreads<=1)
+        streamingPCAProject(data, 0, data.n-1);
+    else
+    {
+        ThreadTaskDistributor td(data.n, XMIPP_MAX(data.n/(4*Nthreads),1));
+        data.td=&td;
+        ThreadManager thMgr(Nthreads, &data);
+        thMgr.run(threadStreamingPCAProject);
+    }
+}
+
+// Y+=T^t*X for the first n rows of X
+static void streamingPCAAccumulateChunk(StreamingPCAThreadData &data, int Nthreads)
+{
+    size_t d=XSIZE(*data.X);
+    if (data.n==0 || d==0)
+        return;
+    if (Nthreads<=1)
+        streamingPCAAccumulate(data, 0, d-1);
+    else
+    {
+        ThreadTaskDistributor td(d, XMIPP_MAX(d/(4*Nthreads),1));
+        data.td=&td;
+        ThreadManager thMgr(Nthreads, &data);
+        thMgr.run(threadStreamingPCAAccumulate);
+    }
+}
+
+// Orthonormalize the rows of Q (modified Gram-Schmidt).
+// Rows linearly dependent on the previous ones are set to 0.
+static void orthonormalizeRows(MultidimArray<double> &Q)
+{
+    size_t l=YSIZE(Q), d=XSIZE(Q);
+    for (size_t k=0; k<l; ++k)
+    {
+        double *ptrQk=&DIRECT_A2D_ELEM(Q,k,0);
+        double norm0=0;
+        for (size_t p=0; p<d; ++p)
+            norm0+=ptrQk[p]*ptrQk[p];
+        for (size_t kk=0; kk<k; ++kk)
+        {
+            const double *ptrQkk=&DIRECT_A2D_ELEM(Q,kk,0);
+            double dot=0;
+            for (size_t p=0; p<d; ++p)
+                dot+=ptrQk[p]*ptrQkk[p];
+            for (size_t p=0; p<d; ++p)
+                ptrQk[p]-=dot*ptrQkk[p];
+        }
+        double norm=0;
+        for (size_t p=0; p<d; ++p)
+            norm+=ptrQk[p]*ptrQk[p];
+        if (norm<=1e-20*norm0 || norm==0)
+            memset(ptrQk,0,d*sizeof(double));
+        else
+        {
+            double inorm=1.0/sqrt(norm);
+            for (size_t p=0; p<d; ++p)
+                ptrQk[p]*=inorm;
+        }
+    }
+}
+
+StreamingPCA::StreamingPCA()
+{
+    chunkSize=100;
+    oversampling=10;
+    Nthreads=1;
+}
+
+size_t StreamingPCA::readChunk(const MetaData &MD, const std::vector<size_t> &ids, size_t first,
+                               const MultidimArray<int> &mask, bool center, MultidimArray<double> &X)
+{
+    size_t Nread=XMIPP_MIN(chunkSize, ids.size()-first);
+    FileName fnImg;
+    Image<double> I;
+    for (size_t i=0; i<Nread; ++i)
+    {
+        MD.getValue(MDL_IMAGE,fnImg,ids[first+i]);
+        I.read(fnImg);
+        const MultidimArray<double> &mI=I();
+        if (MULTIDIM_SIZE(mI)!=MULTIDIM_SIZE(mask))
+            REPORT_ERROR(ERR_MULTIDIM_SIZE,formatString("StreamingPCA: %s is not of the same size as the mask",
+                         fnImg.c_str()));
+        double *ptrX=&DIRECT_A2D_ELEM(X,i,0);
+        size_t idx=0;
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mI)
+        if (DIRECT_MULTIDIM_ELEM(mask,n))
+            ptrX[idx++]=DIRECT_MULTIDIM_ELEM(mI,n);
+        if (center)
+            for (size_t p=0; p<idx; ++p)
+                ptrX[p]-=DIRECT_MULTIDIM_ELEM(avg,p);
+    }
+    return Nread;
+}
+
+void StreamingPCA::multiplyCovariance(const MetaData &MD, const std::vector<size_t> &ids,
+                                      const MultidimArray<int> &mask, const MultidimArray<double> &Q,
+                                      MultidimArray<double> &Y)
+{
+    size_t d=XSIZE(Q), l=YSIZE(Q);
+    MultidimArray<double> X(XMIPP_MIN(chunkSize,ids.size()),d), T(YSIZE(X),l);
+    Y.initZeros(l,d);
+    StreamingPCAThreadData data;
+    data.X=&X;
+    data.Q=&Q;
+    data.T=&T;
+    data.Y=&Y;
+    data.td=NULL;
+    for (size_t first=0; first<ids.size(); first+=chunkSize)
+    {
+        data.n=readChunk(MD,ids,first,mask,true,X);
+        streamingPCAProjectChunk(data,Nthreads);
+        streamingPCAAccumulateChunk(data,Nthreads);
+    }
+}
+
+void StreamingPCA::learnPCABasis(const MetaData &MD, const MultidimArray<int> &mask, size_t NPCA, size_t Niter)
+{
+    std::vector<size_t> ids;
+    MD.findObjects(ids);
+    size_t N=ids.size();
+    size_t d=0;
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mask)
+    if (DIRECT_MULTIDIM_ELEM(mask,n))
+        ++d;
+    if (N==0 || d==0)
+        REPORT_ERROR(ERR_VALUE_EMPTY,"StreamingPCA: there are no vectors to analyze");
+    if (chunkSize==0)
+        chunkSize=1;
+    size_t l=XMIPP_MIN(NPCA+oversampling,XMIPP_MIN(d,N));
+    NPCA=XMIPP_MIN(NPCA,l);
+
+    // Pass 1: average
+    avg.initZeros(d);
+    MultidimArray<double> X(XMIPP_MIN(chunkSize,N),d);
+    for (size_t first=0; first<N; first+=chunkSize)
+    {
+        size_t n=readChunk(MD,ids,first,mask,false,X);
+        for (size_t i=0; i<n; ++i)
+        {
+            const double *ptrX=&DIRECT_A2D_ELEM(X,i,0);
+            for (size_t p=0; p<d; ++p)
+                DIRECT_MULTIDIM_ELEM(avg,p)+=ptrX[p];
+        }
+    }
+    avg/=(double)N;
+    X.clear();
+
+    // Random starting subspace and power iterations
+    MultidimArray<double> Q(l,d), Y;
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Q)
+    DIRECT_MULTIDIM_ELEM(Q,n)=rnd_gaus();
+    orthonormalizeRows(Q);
+    for (size_t iter=0; iter<=Niter; ++iter)
+    {
+        multiplyCovariance(MD,ids,mask,Q,Y);
+        if (iter<Niter)
+        {
+            Q=Y;
+            orthonormalizeRows(Q);
+        }
+    }
+
+    // Rayleigh-Ritz: eigenvectors of the covariance restricted to the subspace of Q
+    Matrix2D<double> B(l,l);
+    for (size_t k=0; k<l; ++k)
+        for (size_t kk=k; kk<l; ++kk)
+        {
+            const double *ptrQ=&DIRECT_A2D_ELEM(Q,k,0);
+            const double *ptrY=&DIRECT_A2D_ELEM(Y,kk,0);
+            const double *ptrQ2=&DIRECT_A2D_ELEM(Q,kk,0);
+            const double *ptrY2=&DIRECT_A2D_ELEM(Y,k,0);
+            double dot=0, dot2=0;
+            for (size_t p=0; p<d; ++p)
+            {
+                dot+=ptrQ[p]*ptrY[p];
+                dot2+=ptrQ2[p]*ptrY2[p];
+            }
+            MAT_ELEM(B,k,kk)=MAT_ELEM(B,kk,k)=0.5*(dot+dot2);
+        }
+    Matrix2D<double> U;
+    firstEigs(B,NPCA,eigenvalues,U);
+    if (N>1)
+        eigenvalues/=(double)(N-1);
+
+    PCAbasis.resize(NPCA);
+    for (size_t j=0; j<NPCA; ++j)
+    {
+        MultidimArray<double> &Ipca=PCAbasis[j];
+        Ipca.initZeros(d);
+        for (size_t k=0; k<l; ++k)
+        {
+            double u=MAT_ELEM(U,k,j);
+            const double *ptrQ=&DIRECT_A2D_ELEM(Q,k,0);
+            for (size_t p=0; p<d; ++p)
+                DIRECT_MULTIDIM_ELEM(Ipca,p)+=u*ptrQ[p];
+        }
+    }
+}
+
+void StreamingPCA::projectOnPCABasis(const MetaData &MD, const MultidimArray<int> &mask, Matrix2D<double> &proj)
+{
+    std::vector<size_t> ids;
+    MD.findObjects(ids);
+    size_t N=ids.size();
+    size_t NPCA=PCAbasis.size();
+    size_t d=XSIZE(avg);
+    proj.initZeros(N,NPCA);
+    if (N==0 || NPCA==0)
+        return;
+    if (chunkSize==0)
+        chunkSize=1;
+
+    MultidimArray<double> Q(NPCA,d);
+    for (size_t k=0; k<NPCA; ++k)
+        memcpy(&DIRECT_A2D_ELEM(Q,k,0),MULTIDIM_ARRAY(PCAbasis[k]),d*sizeof(double));
+    MultidimArray<double> X(XMIPP_MIN(chunkSize,N),d), T(YSIZE(X),NPCA);
+    StreamingPCAThreadData data;
+    data.X=&X;
+    data.Q=&Q;
+    data.T=&T;
+    data.Y=NULL;
+    data.td=NULL;
+    for (size_t first=0; first<N; first+=chunkSize)
+    {
+        data.n=readChunk(MD,ids,first,mask,true,X);
+        streamingPCAProjectChunk(data,Nthreads);
+        for (size_t i=0; i<data.n; ++i)
+            memcpy(&MAT_ELEM(proj,first+i,0),&DIRECT_A2D_ELEM(T,i,0),NPCA*sizeof(double));
+    }
+}
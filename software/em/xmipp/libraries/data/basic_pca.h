@@ -30,6 +30,8 @@
 #include <vector>
 #include "multidim_array.h"
 
+class MetaData;
+
 
 /**@defgroup BasicPCA Basic PCA class
    @ingroup DataLibrary */
@@ -180,5 +182,75 @@ public:
 		return zn;
 	}
 };
+
+/** Streaming PCA.
+ *  PCA of a set of images (or volumes) that does not fit in memory. The images
+ *  are read from a metadata a chunk at a time and the principal components
+ *  are computed with a randomized range finder on the covariance matrix
+ *  (see Halko, Martinsson, Tropp, "Finding structure with randomness",
+ *  SIAM Review 53:217-288 (2011)). The covariance matrix is never built,
+ *  each pass over the images multiplies it by a small set of vectors.
+ *  Only the pixels within the mask are analyzed. learnPCABasis makes
+ *  Niter+2 passes over the images and projectOnPCABasis one more.
+ *  Each chunk is processed by Nthreads threads; the result does not depend
+ *  on the number of threads nor on the chunk size.
+ *
+ *  Example of use:
+ *  @code
+ *  StreamingPCA analyzer;
+ *  analyzer.Nthreads=4;
+ *  analyzer.learnPCABasis(MD, mask, 3, 2); // 3 PCA components, 2 power iterations
+ *  Matrix2D<double> proj;
+ *  analyzer.projectOnPCABasis(MD, mask, proj);
+ *  @endcode
+ */
+class StreamingPCA
+{
+public:
+    /// Number of images read at once
+    size_t chunkSize;
+
+    /// Number of random vectors in addition to the number of PCA components
+    size_t oversampling;
+
+    /// Number of threads
+    int Nthreads;
+
+    // The average of the vectors
+    MultidimArray<double> avg;
+
+    // Set of basis functions, sorted by decreasing eigenvalue
+    std::vector< MultidimArray<double> > PCAbasis;
+
+    // Eigenvalues of the covariance matrix
+    Matrix1D<double> eigenvalues;
+public:
+    /// Empty constructor
+    StreamingPCA();
+
+    /** Learn basis.
+     * The images are taken from the MDL_IMAGE column of MD. The mask must be of
+     * the same size as the images. Niter is the number of power iterations
+     * (typically, 2).
+     */
+    void learnPCABasis(const MetaData &MD, const MultidimArray<int> &mask, size_t NPCA, size_t Niter);
+
+    /** Project on basis.
+     * Row i of proj has the projections of the i-th image of MD.
+     */
+    void projectOnPCABasis(const MetaData &MD, const MultidimArray<int> &mask, Matrix2D<double> &proj);
+
+private:
+    // Read the chunk of images starting at first, the pixels within the mask are
+    // stored in the rows of X. If center, the average is subtracted.
+    // Returns the number of images read
+    size_t readChunk(const MetaData &MD, const std::vector<size_t> &ids, size_t first,
+                     const MultidimArray<int> &mask, bool center, MultidimArray<double> &X);
+
+    // Y+=X^t*X*Q^t for all the images in MD (the rows of Q and Y are vectors)
+    void multiplyCovariance(const MetaData &MD, const std::vector<size_t> &ids,
+                            const MultidimArray<int> &mask, const MultidimArray<double> &Q,
+                            MultidimArray<double> &Y);
+};
 //@}
 #endif
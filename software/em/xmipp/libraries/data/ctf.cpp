@@ -433,6 +433,159 @@ void CTFDescription::precomputeValues(const MultidimArray<double> &cont_x_freq,
     }
 }
 
+/* CTF image generator --------------------------------------------------- */
+CTFImageGenerator::CTFImageGenerator()
+{
+    Ydim=Xdim=0;
+    Ts=0;
+    envelopeK3=envelopeK5=envelopeDeltaR=-1;
+}
+
+void CTFImageGenerator::initialize(int _Ydim, int _Xdim, double _Ts)
+{
+    Ydim=_Ydim;
+    Xdim=_Xdim;
+    Ts=_Ts;
+    size_t N=(size_t)Ydim*Xdim;
+    u.resize(N);
+    u2.resize(N);
+    u3.resize(N);
+    u4.resize(N);
+    cos2ang.resize(N);
+    sin2ang.resize(N);
+    deltaf.resize(N);
+    sine.resize(N);
+    cosine.resize(N);
+    envelope.clear();
+    envelopeK3=envelopeK5=envelopeDeltaR=-1;
+
+    double iTs=1.0/Ts;
+    size_t n=0;
+    for (int i=0; i<Ydim; ++i)
+    {
+        double wy;
+        FFT_IDX2DIGFREQ(i, Ydim, wy);
+        double fy=wy*iTs;
+        for (int j=0; j<Xdim; ++j, ++n)
+        {
+            double wx;
+            FFT_IDX2DIGFREQ(j, Xdim, wx);
+            double fx=wx*iTs;
+            double fu2=fx*fx+fy*fy;
+            u2[n]=fu2;
+            u[n]=sqrt(fu2);
+            u3[n]=fu2*u[n];
+            u4[n]=fu2*fu2;
+            // The defocus at the origin is irrelevant because the frequency is 0
+            if (fabs(fx) < XMIPP_EQUAL_ACCURACY && fabs(fy) < XMIPP_EQUAL_ACCURACY)
+                cos2ang[n]=sin2ang[n]=0;
+            else
+            {
+                double ang=atan2(fy,fx);
+                sincos(2*ang,&sin2ang[n],&cos2ang[n]);
+            }
+        }
+    }
+}
+
+void CTFImageGenerator::generateCTF(CTFDescription &ctf, MultidimArray<double> &CTF,
+                                    bool withDamping, bool squared)
+{
+    CTF.resizeNoCopy(Ydim, Xdim);
+    if (ctf.enable_CTFnoise || !ctf.enable_CTF)
+    {
+        // Generic computation
+        if (withDamping)
+            ctf.generateCTF(Ydim, Xdim, CTF, Ts);
+        else
+            ctf.generateCTFWithoutDamping(Ydim, Xdim, CTF, Ts);
+        if (squared)
+            FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(CTF)
+            DIRECT_MULTIDIM_ELEM(CTF,n)*=DIRECT_MULTIDIM_ELEM(CTF,n);
+        return;
+    }
+
+    size_t N=u.size();
+    const double *ptrU=&u[0], *ptrU2=&u2[0], *ptrU3=&u3[0], *ptrU4=&u4[0];
+    const double *ptrCos2ang=&cos2ang[0], *ptrSin2ang=&sin2ang[0];
+    double *ptrDeltaf=&deltaf[0], *ptrSine=&sine[0], *ptrCosine=&cosine[0];
+    double *ptrCTF=MULTIDIM_ARRAY(CTF);
+
+    // Defocus and phase of each pixel
+    // cos(2*(ang-azimuth))=cos(2*ang)*cos(2*azimuth)+sin(2*ang)*sin(2*azimuth)
+    double cos2az, sin2az;
+    sincos(2*ctf.rad_azimuth,&sin2az,&cos2az);
+    double defocusAvg=ctf.defocus_average;
+    double defocusDev=ctf.defocus_deviation;
+    double K1=ctf.K1, K2=ctf.K2;
+    for (size_t n=0; n<N; ++n)
+        ptrDeltaf[n]=defocusAvg+defocusDev*(ptrCos2ang[n]*cos2az+ptrSin2ang[n]*sin2az);
+    for (size_t n=0; n<N; ++n)
+        ptrSine[n]=K1*ptrDeltaf[n]*ptrU2[n]+K2*ptrU4[n];
+    for (size_t n=0; n<N; ++n)
+        sincos(ptrSine[n],&ptrSine[n],&ptrCosine[n]);
+
+    double Ksin=ctf.Ksin, Kcos=ctf.Kcos;
+    if (!withDamping)
+    {
+        for (size_t n=0; n<N; ++n)
+            ptrCTF[n]=Kcos*ptrCosine[n]-Ksin*ptrSine[n];
+    }
+    else
+    {
+        // Envelope terms that do not depend on the defocus
+        if (envelope.size()!=N || ctf.K3!=envelopeK3 || ctf.K5!=envelopeK5 || ctf.DeltaR!=envelopeDeltaR)
+        {
+            envelope.resize(N);
+            envelopeK3=ctf.K3;
+            envelopeK5=ctf.K5;
+            envelopeDeltaR=ctf.DeltaR;
+            for (size_t n=0; n<N; ++n)
+            {
+                double Eespr = exp(-envelopeK3 * ptrU4[n]);
+                double EdeltaF = bessj0(envelopeK5 * ptrU2[n]);
+                double EdeltaR = SINC(ptrU[n] * envelopeDeltaR);
+                envelope[n]=Eespr*EdeltaF*EdeltaR;
+            }
+        }
+        const double *ptrEnvelope=&envelope[0];
+        double K=ctf.K, K6=ctf.K6, K7=ctf.K7;
+        double envR0=ctf.envR0, envR1=ctf.envR1, envR2=ctf.envR2;
+        for (size_t n=0; n<N; ++n)
+        {
+            double aux=K7*ptrU3[n]+ptrDeltaf[n]*ptrU[n];
+            ptrDeltaf[n]=-K6*aux*aux;
+        }
+        if (K6!=0)
+            for (size_t n=0; n<N; ++n)
+                ptrDeltaf[n]=exp(ptrDeltaf[n]);
+        else
+            for (size_t n=0; n<N; ++n)
+                ptrDeltaf[n]=1;
+        for (size_t n=0; n<N; ++n)
+        {
+            double E=ptrEnvelope[n]*ptrDeltaf[n]+envR0+envR1*ptrU[n]+envR2*ptrU2[n];
+            ptrCTF[n]=K*(Kcos*ptrCosine[n]-Ksin*ptrSine[n])*E;
+        }
+    }
+
+    if (squared)
+        for (size_t n=0; n<N; ++n)
+            ptrCTF[n]*=ptrCTF[n];
+}
+
+void CTFImageGenerator::generateCTFs(std::vector<CTFDescription> &ctfs, MultidimArray<double> &CTFs,
+                                     bool withDamping, bool squared)
+{
+    CTFs.resizeNoCopy(ctfs.size(), 1, Ydim, Xdim);
+    MultidimArray<double> CTF;
+    for (size_t k=0; k<ctfs.size(); ++k)
+    {
+        CTF.aliasImageInStack(CTFs,k);
+        generateCTF(ctfs[k], CTF, withDamping, squared);
+    }
+}
+
 /* Look for zeroes, maxima or minima ------------------------------------------------------------ */
 //#define DEBUG
 void CTFDescription::lookFor(int n, const Matrix1D<double> &u, Matrix1D<double> &freq, int iwhat)
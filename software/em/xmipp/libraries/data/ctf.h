@@ -761,6 +761,66 @@ public:
     void forcePhysicalMeaning();
 };
 
+/** Fast generation of whole CTF images.
+ * The frequency geometry of the image (modulus and angle of every pixel) is
+ * computed once and stored as separate arrays (structure of arrays). Then,
+ * CTF images of the same size can be generated for many defocus sets
+ * with simple loops over these arrays, which the compiler can vectorize.
+ * The part of the envelope that does not depend on the defocus is also
+ * kept while the microscope parameters do not change.
+ *
+ * Only the pure CTF is computed this way; if the noise of the CTF is
+ * enabled, the generic (and slower) CTFDescription::generateCTF is used.
+ * The result is the same as the one of CTFDescription::generateCTF.
+ * @code
+ * CTFImageGenerator generator;
+ * generator.initialize(Ydim, Xdim, Ts);
+ * FOR_ALL_OBJECTS_IN_METADATA(MD)
+ * {
+ *     ctf.readFromMetadataRow(MD,__iter.objId);
+ *     ctf.produceSideInfo();
+ *     generator.generateCTF(ctf, ctfImage);
+ *     ...
+ * }
+ * @endcode
+ */
+class CTFImageGenerator
+{
+public:
+    /// Image size
+    int Ydim, Xdim;
+    /// Sampling rate (A/pixel)
+    double Ts;
+    /// Modulus of the continuous frequency of each pixel and its powers
+    std::vector<double> u, u2, u3, u4;
+    /// Cosine and sine of twice the angle of the frequency of each pixel
+    std::vector<double> cos2ang, sin2ang;
+    /// Envelope terms that do not depend on the defocus
+    std::vector<double> envelope;
+    /// Microscope constants with which the envelope was computed
+    double envelopeK3, envelopeK5, envelopeDeltaR;
+    /// Auxiliary vectors
+    std::vector<double> deltaf, sine, cosine;
+public:
+    /// Empty constructor
+    CTFImageGenerator();
+
+    /// Precompute the frequency tables for images of this size and sampling rate
+    void initialize(int _Ydim, int _Xdim, double _Ts);
+
+    /** Generate the CTF image.
+        The CTF must have its side info produced. If withDamping is false, the
+        envelope is not applied (as in generateCTFWithoutDamping). If squared is true,
+        the square of the CTF is returned. */
+    void generateCTF(CTFDescription &ctf, MultidimArray<double> &CTF,
+                     bool withDamping=true, bool squared=false);
+
+    /** Generate the CTF images of a set of CTFs.
+        The output is a stack with one CTF image per CTF description. */
+    void generateCTFs(std::vector<CTFDescription> &ctfs, MultidimArray<double> &CTFs,
+                      bool withDamping=true, bool squared=false);
+};
+
 /** Generate CTF 2D image with two CTFs.
  * The two CTFs are in fn1 and fn2. The output image is written to the file fnOut and has size Xdim x Xdim. */
 void generateCTFImageWith2CTFs(const MetaData &MD1, const MetaData &MD2, int Xdim, MultidimArray<double> &imgOut);
@@ -602,6 +602,19 @@ double alignImages(const MultidimArray< double >& Iref,
                    CorrelationAux &aux2,
                    RotationalCorrelationAux &aux3);
 
+/** Fast version of align two images.
+ * The transforms of Iref are presumed to be precomputed in IrefTransforms.
+ * @ingroup Filters
+ */
+double alignImages(const MultidimArray< double >& Iref,
+                   const AlignmentTransforms& IrefTransforms,
+                   MultidimArray< double >& I,
+                   Matrix2D< double >&M,
+                   bool wrap,
+                   AlignmentAux &aux,
+                   CorrelationAux &aux2,
+                   RotationalCorrelationAux &aux3);
+
 /** Auxiliary class for fast volume alignment */
 class VolumeAlignmentAux
 {
@@ -583,3 +583,184 @@ void compute_hist(const MultidimArrayGeneric& v, Histogram1D& hist, double min,
     SWITCHDATATYPE(v.datatype,COMPUTEHIST)
 #undef COMPUTEHIST
 }
+
+/* ------------------------------------------------------------------------- */
+/* STREAMING STATISTICS                                                      */
+/* ------------------------------------------------------------------------- */
+StatisticsAccumulator::StatisticsAccumulator(int _Nbins)
+{
+    if (_Nbins<0 || (_Nbins>0 && _Nbins<4))
+        REPORT_ERROR(ERR_ARG_INCORRECT,"StatisticsAccumulator: the histogram needs at least 4 bins");
+    Nbins=_Nbins;
+    clear();
+}
+
+void StatisticsAccumulator::clear()
+{
+    N=mean=M2=0;
+    minVal=maxVal=0;
+    binWidth=k0=0;
+    bins.clear();
+}
+
+void StatisticsAccumulator::addValue(double val)
+{
+    addMoments(1, val, 0, val, val);
+    if (Nbins>0)
+    {
+        reserveRange();
+        bins[(size_t)(floor(val/binWidth)-k0)]+=1;
+    }
+}
+
+void StatisticsAccumulator::add(const MultidimArrayGeneric &v, const MultidimArray<int> *mask)
+{
+#define ADDSTATS(type) add(MULTIDIM_ARRAY_TYPE(v,type),mask);
+
+    SWITCHDATATYPE(v.datatype,ADDSTATS)
+#undef ADDSTATS
+}
+
+void StatisticsAccumulator::addMoments(double n, double meanB, double M2B, double minB, double maxB)
+{
+    if (N==0)
+    {
+        minVal=minB;
+        maxVal=maxB;
+    }
+    else
+    {
+        minVal=std::min(minVal,minB);
+        maxVal=std::max(maxVal,maxB);
+    }
+    // Chan et al. formula for the union of two sets
+    double Ntotal=N+n;
+    double delta=meanB-mean;
+    mean+=delta*n/Ntotal;
+    M2+=M2B+delta*delta*N*n/Ntotal;
+    N=Ntotal;
+}
+
+void StatisticsAccumulator::reserveRange()
+{
+    if (binWidth==0)
+    {
+        // Smallest power of 2 with which the range fits in half of the bins
+        double range=maxVal-minVal;
+        if (range==0)
+            range=std::max(fabs(maxVal),1.0)*1e-6;
+        int e;
+        frexp(range/(Nbins/2),&e);
+        binWidth=ldexp(1.0,e);
+        bins.assign(Nbins,0.0);
+        k0=floor(minVal/binWidth)-Nbins/4;
+        return;
+    }
+
+    while (floor(maxVal/binWidth)-floor(minVal/binWidth)>=Nbins)
+        joinBins();
+    double kmin=floor(minVal/binWidth);
+    double kmax=floor(maxVal/binWidth);
+    if (kmin<k0 || kmax>=k0+Nbins)
+    {
+        // Leave the same margin at both sides
+        double newK0=kmin-floor((Nbins-1-(kmax-kmin))/2);
+        std::vector<double> newBins(Nbins,0.0);
+        for (int j=0; j<Nbins; ++j)
+            if (bins[j]!=0)
+                newBins[(size_t)(k0+j-newK0)]=bins[j];
+        bins.swap(newBins);
+        k0=newK0;
+    }
+}
+
+void StatisticsAccumulator::joinBins()
+{
+    double newK0=floor(k0/2);
+    std::vector<double> newBins(Nbins,0.0);
+    for (int j=0; j<Nbins; ++j)
+        if (bins[j]!=0)
+            newBins[(size_t)(floor((k0+j)/2)-newK0)]+=bins[j];
+    bins.swap(newBins);
+    k0=newK0;
+    binWidth*=2;
+}
+
+void StatisticsAccumulator::merge(const StatisticsAccumulator &other)
+{
+    if (other.N==0)
+        return;
+    if (Nbins!=other.Nbins)
+        REPORT_ERROR(ERR_ARG_INCORRECT,"StatisticsAccumulator: the accumulators have different number of bins");
+    addMoments(other.N, other.mean, other.M2, other.minVal, other.maxVal);
+    if (Nbins==0)
+        return;
+    if (binWidth==0)
+    {
+        binWidth=other.binWidth;
+        k0=other.k0;
+        bins=other.bins;
+        return;
+    }
+
+    // Bring both histograms to the same bin width
+    StatisticsAccumulator aux(other);
+    while (binWidth<aux.binWidth)
+        joinBins();
+    reserveRange();
+    while (aux.binWidth<binWidth)
+        aux.joinBins();
+    for (int j=0; j<Nbins; ++j)
+        if (aux.bins[j]!=0)
+            bins[(size_t)(aux.k0+j-k0)]+=aux.bins[j];
+}
+
+double StatisticsAccumulator::stddev() const
+{
+    if (N>1)
+        return sqrt(M2/(N-1));
+    return 0;
+}
+
+double StatisticsAccumulator::percentil(double percent_mass) const
+{
+    if (percent_mass<0 || percent_mass>100)
+        REPORT_ERROR(ERR_VALUE_INCORRECT, "Asked for a percentil outside [0,100]");
+    if (Nbins==0)
+        REPORT_ERROR(ERR_VALUE_INCORRECT, "StatisticsAccumulator: the histogram has not been computed");
+    if (N==0)
+        return 0;
+
+    // Interpolate linearly within the bin where the required mass is reached
+    double requiredMass=N*percent_mass/100.0;
+    double acc=0;
+    for (int j=0; j<Nbins; ++j)
+    {
+        double count=bins[j];
+        if (count>0 && acc+count>=requiredMass)
+        {
+            double val=(k0+j+(requiredMass-acc)/count)*binWidth;
+            return CLIP(val,minVal,maxVal);
+        }
+        acc+=count;
+    }
+    return maxVal;
+}
+
+void StatisticsAccumulator::write(const FileName &fn, MDLabel mdlValue, MDLabel mdlCount) const
+{
+    MetaData auxMD;
+    if (N>0 && Nbins>0)
+    {
+        MDRow row;
+        int jmin=(int)(floor(minVal/binWidth)-k0);
+        int jmax=(int)(floor(maxVal/binWidth)-k0);
+        for (int j=jmin; j<=jmax; ++j)
+        {
+            row.setValue(mdlValue,(k0+j)*binWidth);
+            row.setValue(mdlCount,(size_t)bins[j]);
+            auxMD.addRow(row);
+        }
+    }
+    auxMD.write(fn);
+}
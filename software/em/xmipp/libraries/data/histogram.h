@@ -676,6 +676,154 @@ void histogram_equalization(MultidimArray<T>
         }
     }
 }
+
+/** Streaming statistics
+ *
+ * This class accumulates the number of values, average, standard deviation,
+ * minimum, maximum and histogram of values that are seen only once, for
+ * instance, all the pixels of the images of a stack. The histogram has a fixed
+ * number of bins whose width is a power of 2 and which are aligned to the
+ * multiples of their width. When the values do not fit, the bins are shifted
+ * or joined by pairs, so that no value is lost and no previous pass over the
+ * data is needed to compute the range. The percentils are approximated within
+ * one bin width.
+ *
+ * Two accumulators can be merged, for instance those of different threads.
+ * The moments, minimum and maximum are those of all the values and the
+ * histogram is the one of all the values with the coarser bin width. The
+ * result only depends on the order in which the values and accumulators are
+ * added.
+ *
+ * @code
+ * StatisticsAccumulator stats;
+ * for (size_t n=0; n<Nimg; n++)
+ * {
+ *     I.read(fnImg[n]);
+ *     stats.add(I());
+ * }
+ * std::cout << "avg=" << stats.avg() << " stddev=" << stats.stddev()
+ *           << " median=" << stats.percentil(50) << std::endl;
+ * @endcode
+ */
+class StatisticsAccumulator
+{
+public:
+    /// Number of values
+    double N;
+    /// Average
+    double mean;
+    /// Sum of the squared differences to the average
+    double M2;
+    /// Minimum and maximum values
+    double minVal, maxVal;
+    /// Number of histogram bins (0 if the histogram is not computed)
+    int Nbins;
+    /// Width of the bins (0 until the first value is added)
+    double binWidth;
+    /// The bin j counts the values in [(k0+j)*binWidth,(k0+j+1)*binWidth)
+    double k0;
+    /// Histogram counts
+    std::vector<double> bins;
+public:
+    /** Empty constructor.
+     * If _Nbins is 0, only the moments, minimum and maximum are computed.
+     */
+    StatisticsAccumulator(int _Nbins=1024);
+
+    /// Remove all values
+    void clear();
+
+    /// Add a single value
+    void addValue(double val);
+
+    /** Add the values of an array.
+     * If a mask is given, only the values with a positive mask value are added.
+     * The mask must have the size of the array.
+     */
+    template<typename T>
+    void add(const MultidimArray<T> &v, const MultidimArray<int> *mask=NULL)
+    {
+        if (mask!=NULL && MULTIDIM_SIZE(*mask)!=MULTIDIM_SIZE(v))
+            REPORT_ERROR(ERR_MULTIDIM_SIZE,"StatisticsAccumulator: the mask and the array have different sizes");
+        const T *ptr=MULTIDIM_ARRAY(v);
+        const int *ptrMask=(mask==NULL) ? NULL : MULTIDIM_ARRAY(*mask);
+        size_t nmax=MULTIDIM_SIZE(v);
+
+        // Moments with respect to the first value, for numerical stability
+        double n=0, sum=0, sum2=0, shift=0, vmin=0, vmax=0;
+        for (size_t i=0; i<nmax; ++i)
+        {
+            if (ptrMask!=NULL && ptrMask[i]<=0)
+                continue;
+            double val=ptr[i];
+            if (n==0)
+                shift=vmin=vmax=val;
+            else if (val<vmin)
+                vmin=val;
+            else if (val>vmax)
+                vmax=val;
+            double diff=val-shift;
+            sum+=diff;
+            sum2+=diff*diff;
+            n+=1;
+        }
+        if (n==0)
+            return;
+        addMoments(n, shift+sum/n, std::max(sum2-sum*sum/n,0.0), vmin, vmax);
+
+        if (Nbins>0)
+        {
+            // All the values fit in the bins after reserveRange
+            reserveRange();
+            double iBinWidth=1.0/binWidth;
+            double *ptrBins=&bins[0];
+            for (size_t i=0; i<nmax; ++i)
+            {
+                if (ptrMask!=NULL && ptrMask[i]<=0)
+                    continue;
+                double val=ptr[i];
+                ptrBins[(size_t)(floor(val*iBinWidth)-k0)]+=1;
+            }
+        }
+    }
+
+    /// Add the values of a MultidimArrayGeneric
+    void add(const MultidimArrayGeneric &v, const MultidimArray<int> *mask=NULL);
+
+    /// Add the values of another accumulator with the same number of bins
+    void merge(const StatisticsAccumulator &other);
+
+    /// Average
+    double avg() const
+    {
+        return mean;
+    }
+
+    /// Standard deviation (normalized by N-1)
+    double stddev() const;
+
+    /** Approximate percentil.
+     * Value below which there is the given percent of the values. The
+     * histogram must have been computed.
+     */
+    double percentil(double percent_mass) const;
+
+    /** Write the histogram.
+     * As in Histogram1D, each row is the beginning of a bin and its count.
+     * Only the bins between the minimum and maximum are written.
+     */
+    void write(const FileName& fn, MDLabel mdlValue=MDL_X, MDLabel mdlCount=MDL_COUNT) const;
+
+protected:
+    /// Add the moments of a set of n values
+    void addMoments(double n, double meanB, double M2B, double minB, double maxB);
+
+    /// Shift or join the bins so that the range [minVal,maxVal] fits
+    void reserveRange();
+
+    /// Join the bins by pairs, doubling the bin width
+    void joinBins();
+};
 //@}
 
 /** Histograms with 2 parameters
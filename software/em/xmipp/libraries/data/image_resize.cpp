@@ -29,7 +29,19 @@ ProgImageResize::ProgImageResize()
 {}
 
 ProgImageResize::~ProgImageResize()
-{}
+{
+    clearResizers();
+}
+
+void ProgImageResize::clearResizers()
+{
+    for (size_t k = 0; k < resizers.size(); ++k)
+        delete resizers[k];
+    for (size_t k = 0; k < resizersFloat.size(); ++k)
+        delete resizersFloat[k];
+    resizers.clear();
+    resizersFloat.clear();
+}
 
 void ProgImageResize::defineParams()
 {
@@ -57,9 +69,13 @@ void ProgImageResize::defineParams()
     addParamsLine("or --dim <x> <y=x> <z=x>         : New x,y and z dimensions");
     addParamsLine(" alias -d;");
     addParamsLine("or --fourier <x> <y=x> <z=x> <thr=1>   : Use padding/windowing in Fourier Space to resize. thr=number of threads");
+    addParamsLine("                                 :+For a single image the threads compute its Fourier transform,");
+    addParamsLine("                                 :+for stacks each thread resizes a different image.");
     addParamsLine(" alias -f;");
     addParamsLine("or --pyramid <levels=1>          : Use positive value to expand and negative to reduce");
     addParamsLine(" alias -p;");
+    addParamsLine(" [--float]                       : Fourier resizing in single precision.");
+    addParamsLine("                                 :+It needs half the memory and it is faster, the error is about 1e-6 of the image range.");
     addParamsLine(" [--interp <interpolation_type=spline>] : Interpolation type to be used. ");
     addParamsLine("      where <interpolation_type>");
     addParamsLine("        spline          : Use spline interpolation");
@@ -76,6 +92,7 @@ void ProgImageResize::readParams()
     else if (degree == "linear")
         splineDegree = LINEAR;
 
+    useFloat = checkParam("--float");
     scale_type = RESIZE_NONE;
 }
 
@@ -157,6 +174,24 @@ void ProgImageResize::preProcess()
         YY(resizeFactor) = (double)ydimOut / oydim;
         if (isVol)
         	ZZ(resizeFactor) = (double)zdimOut / ozdim;
+
+        // Stacks are resized in batches
+        if (mdInSize > 1 && fourier_threads > 1)
+        {
+            size_t imageSize = (size_t)oxdim * oydim * ozdim * (useFloat ? sizeof(float) : sizeof(double));
+            setupBatch(fourier_threads, imageSize);
+            for (int t = 0; t < fourier_threads; ++t)
+                if (useFloat)
+                {
+                    resizersFloat.push_back(new FourierResizerFloat);
+                    resizersFloat[t]->setOutputSize(zdimOut, ydimOut, xdimOut);
+                }
+                else
+                {
+                    resizers.push_back(new FourierResizer);
+                    resizers[t]->setOutputSize(zdimOut, ydimOut, xdimOut);
+                }
+        }
         //Do not think this is true
         //            if (oxdim < xdimOut || oydim < ydimOut)
         //                REPORT_ERROR(ERR_PARAM_INCORRECT, "The 'fourier' scaling type can only be used for reducing size");
@@ -195,6 +230,12 @@ void ProgImageResize::processImage(const FileName &fnImg, const FileName &fnImgO
     else
         rowOut.resetGeo(false);
 
+    if (batchSize > 0)
+    {
+        addToBatch(fnImg, fnImgOut, rowIn);
+        return;
+    }
+
     img.read(fnImg);
     img().setXmippOrigin();
     imgOut.setDatatype(img.getDatatype());
@@ -214,7 +255,15 @@ void ProgImageResize::processImage(const FileName &fnImg, const FileName &fnImgO
         //selfPyramidReduce(splineDegree, img(), pyramid_level);
         break;
     case RESIZE_FOURIER:
-        selfScaleToSizeFourier(zdimOut, ydimOut, xdimOut, img(), fourier_threads);
+        if (useFloat)
+        {
+            MultidimArray<float> mIn, mOut;
+            img().getImage(mIn);
+            scaleToSizeFourier(zdimOut, ydimOut, xdimOut, mIn, mOut, fourier_threads);
+            img().setImage(mOut);
+        }
+        else
+            selfScaleToSizeFourier(zdimOut, ydimOut, xdimOut, img(), fourier_threads);
         img.write(fnImgOut);
         return;
     case RESIZE_NONE:
@@ -223,8 +272,27 @@ void ProgImageResize::processImage(const FileName &fnImg, const FileName &fnImgO
     imgOut.write(fnImgOut);
 }
 
+template<typename Resizer>
+void resizeImage(Resizer &resizer, MultidimArrayGeneric &I)
+{
+    I.getImage(resizer.in);
+    resizer.resize();
+    I.setImage(resizer.out);
+}
+
+void ProgImageResize::processBatchImage(size_t k, int thread_id)
+{
+    MultidimArrayGeneric &I = (*batchImg[k])();
+    if (useFloat)
+        resizeImage(*resizersFloat[thread_id], I);
+    else
+        resizeImage(*resizers[thread_id], I);
+}
+
 void ProgImageResize::postProcess()
 {
+    clearBatch();
+    clearResizers();
     if (temporaryOutput)
         std::rename(fn_out.c_str(),fn_in.c_str());
 }
@@ -49,16 +49,26 @@ protected:
     ScaleType scale_type;
 
     int             splineDegree, dim, pyramid_level, fourier_threads;
-    bool            isVol, temporaryOutput;
+    bool            isVol, temporaryOutput, useFloat;
     //Matrix2D<double> R, T, S, A, B;
     Matrix1D<double>   resizeFactor;
     ImageGeneric img, imgOut;
 
+    /* Fourier resizing of stacks: the images are resized in batches by
+     * fourier_threads threads, each one with its own resizer.
+     * With useFloat the resizers work in single precision. */
+    std::vector<FourierResizer *> resizers;
+    std::vector<FourierResizerFloat *> resizersFloat;
+
     void defineParams();
     void readParams();
     void preProcess();
     void postProcess();
     void processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut);
 
+    /// Resize the k-th image of the batch with the resizer of the thread
+    void processBatchImage(size_t k, int thread_id);
+    void clearResizers();
+
 };
 #endif //IMAGE_RESIZE_H
@@ -28,8 +28,10 @@
 #include "metadata.h"
 #include "mask.h"
 #include "geometry.h"
+#include "xmipp_threads.h"
 
 #include <fstream>
+#include <algorithm>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -337,13 +339,50 @@ int Micrograph::scissor(const Particle_coords &P, MultidimArray<double> &result,
 
 }
 
+/* Particles cut by a group of threads ------------------------------------ */
+struct ScissorThreadData
+{
+    Micrograph *M;
+    const std::vector<Particle_coords> *coords;
+    // Coordinate index of each particle of the block
+    std::vector<int> particles;
+    // Particles of the block sorted by Y (Y, position in the block)
+    std::vector< std::pair<double,size_t> > band;
+    MultidimArray<double> *block;
+    std::vector<int> valid;
+    double Dmin, Dmax, scaleX, scaleY;
+    bool fillBorders;
+};
+
+// Thread thread_id cuts the thread_id-th band of rows of the block
+void scissorBand(ScissorThreadData &data, int thread_id, int Nthreads)
+{
+    size_t N=data.band.size();
+    size_t k0=(thread_id*N)/Nthreads;
+    size_t kF=((thread_id+1)*N)/Nthreads;
+    MultidimArray<double> I;
+    for (size_t k=k0; k<kF; ++k)
+    {
+        size_t slot=data.band[k].second;
+        I.aliasImageInStack(*data.block,slot);
+        const Particle_coords &P=(*data.coords)[data.particles[slot]];
+        data.valid[slot]=data.M->scissor(P, I, data.Dmin, data.Dmax,
+                                         data.scaleX, data.scaleY, false, data.fillBorders);
+    }
+}
+
+void threadScissorBand(ThreadArgument &thArg)
+{
+    ScissorThreadData *data=(ScissorThreadData *) thArg.workClass;
+    scissorBand(*data,thArg.thread_id,thArg.getNumberOfThreads());
+}
+
 /* Produce all images ------------------------------------------------------ */
-void Micrograph::produce_all_images(int label, double minCost,
-                                    const FileName &fn_rootIn, const FileName &fn_image, double ang,
-                                    double tilt, double psi, bool rmStack, bool fillBorders)
+size_t Micrograph::produce_all_images(int label, double minCost,
+                                      const FileName &fn_rootIn, const FileName &fn_image, double ang,
+                                      double tilt, double psi, bool rmStack, bool fillBorders, int Nthreads)
 {
     MetaData SF;
-    Image<double> I;
     Micrograph *M;
 
     // Set Source image
@@ -396,11 +435,56 @@ void Micrograph::produce_all_images(int label, double minCost,
 
     if (rmStack)
         fn_out.deleteFile();
-    size_t ii = 0;
-    size_t id;
+
+    // Particles to cut, in the order of the output stack
+    std::vector<int> selected;
     for (int n = 0; n < nmax; n++)
         if (coords[n].valid && coords[n].cost > minCost && coords[n].label == label)
+            selected.push_back(n);
+
+    // Blocks of about 64 Mb, and at least one particle per thread
+    size_t nParticles = selected.size();
+    size_t imageSize = (size_t)X_window_size * Y_window_size * sizeof(double);
+    size_t blockSize = std::max((size_t)Nthreads, (size_t)64 * 1024 * 1024 / imageSize);
+
+    ScissorThreadData data;
+    data.M = M;
+    data.coords = &coords;
+    data.Dmin = Dmin;
+    data.Dmax = Dmax;
+    data.scaleX = scaleX;
+    data.scaleY = scaleY;
+    data.fillBorders = fillBorders;
+    ThreadManager *thMgr = NULL;
+    if (Nthreads > 1)
+        thMgr = new ThreadManager(Nthreads, &data);
+
+    size_t ii = 0;
+    size_t id;
+    for (size_t first = 0; first < nParticles; first += blockSize)
+    {
+        size_t last = std::min(first + blockSize, nParticles);
+        size_t nBlock = last - first;
+        Image<double> Iblock(X_window_size, Y_window_size, 1, nBlock);
+        data.block = &Iblock();
+        data.particles.assign(selected.begin() + first, selected.begin() + last);
+        data.valid.resize(nBlock);
+        data.band.resize(nBlock);
+        for (size_t k = 0; k < nBlock; ++k)
         {
+            data.band[k].first = coords[data.particles[k]].Y;
+            data.band[k].second = k;
+        }
+        std::sort(data.band.begin(), data.band.end());
+
+        if (thMgr != NULL)
+            thMgr->run(threadScissorBand);
+        else
+            scissorBand(data, 0, 1);
+
+        for (size_t k = 0; k < nBlock; ++k)
+        {
+            const Particle_coords &P = coords[data.particles[k]];
             fn_aux.compose(++ii, fn_out);
             id = SF.addObject();
             // If the ctfRow was set, copy the info to images metadata
@@ -408,10 +492,9 @@ void Micrograph::produce_all_images(int label, double minCost,
                 SF.setRow(ctfRow, id);
             SF.setValue(MDL_IMAGE, fn_aux, id);
             SF.setValue(MDL_MICROGRAPH, M->fn_micrograph, id);
-            SF.setValue(MDL_XCOOR, coords[n].X, id);
-            SF.setValue(MDL_YCOOR, coords[n].Y, id);
-            bool t = M->scissor(coords[n], I(), Dmin, Dmax, scaleX, scaleY, false, fillBorders);
-            if (!t)
+            SF.setValue(MDL_XCOOR, P.X, id);
+            SF.setValue(MDL_YCOOR, P.Y, id);
+            if (!data.valid[k])
             {
                 std::cout << "Particle " << fn_aux
                 << " is very near the border, "
@@ -420,9 +503,11 @@ void Micrograph::produce_all_images(int label, double minCost,
             }
             else
                 SF.setValue(MDL_ENABLED, 1, id);
-            //  if (ang!=0) I().rotate(-ang);
-            I.write(fn_out, ii, true, WRITE_APPEND);
         }
+        //  if (ang!=0) I().rotate(-ang);
+        Iblock.write(fn_out, ALL_IMAGES, true, WRITE_APPEND);
+    }
+    delete thMgr;
     SF.write(fn_out.withoutExtension() + ".xmd");
 
 
@@ -432,6 +517,7 @@ void Micrograph::produce_all_images(int label, double minCost,
         M->close_micrograph();
         delete M;
     }
+    return nParticles;
 }
 
 /* Search coordinate near a position --------------------------------------- */
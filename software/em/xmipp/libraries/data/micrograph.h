@@ -520,11 +520,18 @@ public:
         The file fn_micrograph+".sel" is also generated. The angle is the angle
         from the Y axis to the tilt axis, angles are positive clockwise.
         Images are rotated by -ang.
-        If this angle is 0 no rotation is applied.*/
-    void produce_all_images(int label, double minCost, const FileName &fn_root,
-                            const FileName &fn_image = "", double ang = 0,
-                            double gamma = 0., double psi = 0., bool rmStack=false,
-							bool fillBorders=false);
+        If this angle is 0 no rotation is applied.
+
+        The particles are cut in blocks that are appended to the output stack
+        with a single write. Within a block, the particles are sorted by their
+        Y coordinate and each of the Nthreads threads cuts a band of consecutive
+        rows, so that only those rows of the micrograph are accessed.
+        The order of the particles in the stack is the one of the coordinates.
+        Returns the number of particles written.*/
+    size_t produce_all_images(int label, double minCost, const FileName &fn_root,
+                              const FileName &fn_image = "", double ang = 0,
+                              double gamma = 0., double psi = 0., bool rmStack=false,
+                              bool fillBorders=false, int Nthreads=1);
 
     /** Search coordinate near a position.
         By default the precission is set to 3 pixels. The index of the coordinate
@@ -5659,6 +5659,14 @@ double MultidimArray< std::complex< double > >::computeAvg() const;
 template<>
 void MultidimArray< std::complex< double > >::maxIndex(size_t &lmax, int& kmax, int& imax, int& jmax) const;
 template<>
+void MultidimArray< std::complex< float > >::computeDoubleMinMax(double& minval, double& maxval) const;
+template<>
+void MultidimArray< std::complex< float > >::computeDoubleMinMaxRange(double& minval, double& maxval, size_t pos, size_t size) const;
+template<>
+double MultidimArray< std::complex< float > >::computeAvg() const;
+template<>
+void MultidimArray< std::complex< float > >::maxIndex(size_t &lmax, int& kmax, int& imax, int& jmax) const;
+template<>
 void MultidimArray<double>::computeAvgStdev(double& avg, double& stddev) const;
 template<>
 bool operator==(const MultidimArray< std::complex< double > >& op1,
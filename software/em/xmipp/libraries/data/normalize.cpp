@@ -429,6 +429,161 @@ void normalize_remove_neighbours(MultidimArray<double> &I,
     I /= newstddev;
 }
 
+/* Precomputed background ------------------------------------------------- */
+NormalizationBackground::NormalizationBackground()
+{
+    Xdim=Ydim=Zdim=0;
+    D=E=F=G=H=I=denom=0;
+}
+
+void NormalizationBackground::initialize(const MultidimArray<int> &bg_mask)
+{
+    Xdim=XSIZE(bg_mask);
+    Ydim=YSIZE(bg_mask);
+    Zdim=ZSIZE(bg_mask);
+    idx.clear();
+    x.clear();
+    y.clear();
+    D=E=F=G=H=I=denom=0;
+
+    // Same coordinates as normalize_ramp, that sets the Xmipp origin
+    bool is2D=(Zdim==1);
+    int i0=FIRST_XMIPP_INDEX(Ydim);
+    int j0=FIRST_XMIPP_INDEX(Xdim);
+    size_t n=0;
+    for (size_t k=0; k<Zdim; ++k)
+        for (size_t i=0; i<Ydim; ++i)
+            for (size_t j=0; j<Xdim; ++j, ++n)
+                if (DIRECT_MULTIDIM_ELEM(bg_mask,n)!=0)
+                {
+                    idx.push_back(n);
+                    if (is2D)
+                    {
+                        double xj=(int)j+j0;
+                        double yi=(int)i+i0;
+                        x.push_back(xj);
+                        y.push_back(yi);
+                        D+=xj*xj;
+                        E+=xj*yi;
+                        F+=xj;
+                        G+=yi*yi;
+                        H+=yi;
+                        I+=1;
+                    }
+                }
+    if (is2D)
+        denom=F*F*G-2*E*F*H+D*H*H+E*E*I-D*G*I;
+}
+
+void NormalizationBackground::checkSize(const MultidimArray<double> &img) const
+{
+    if (XSIZE(img)!=Xdim || YSIZE(img)!=Ydim || ZSIZE(img)!=Zdim)
+        REPORT_ERROR(ERR_MULTIDIM_SIZE,"NormalizationBackground: the image and the background mask are of different size");
+}
+
+void NormalizationBackground::computeAvgStdev(const MultidimArray<double> &img, double &avg, double &stddev) const
+{
+    checkSize(img);
+    const double *ptr=MULTIDIM_ARRAY(img);
+    size_t N=idx.size();
+    double sum1=0, sum2=0;
+    for (size_t n=0; n<N; ++n)
+    {
+        double aux=ptr[idx[n]];
+        sum1+=aux;
+        sum2+=aux*aux;
+    }
+    avg=sum1/N;
+    if (N>1)
+        stddev=sqrt(fabs(sum2/N-avg*avg)*N/(N-1));
+    else
+        stddev=0;
+}
+
+// I=(I-b)*a in a single pass
+static void subtractAndScale(MultidimArray<double> &I, double b, double a)
+{
+    double *ptr=MULTIDIM_ARRAY(I);
+    size_t nmax=MULTIDIM_SIZE(I);
+    for (size_t n=0; n<nmax; ++n)
+        ptr[n]=(ptr[n]-b)*a;
+}
+
+void normalize_Near_OldXmipp(MultidimArray<double> &I, const NormalizationBackground &bg)
+{
+    double avgbg, stddevbg;
+    bg.computeAvgStdev(I, avgbg, stddevbg);
+    subtractAndScale(I, I.computeAvg(), 1.0/stddevbg);
+}
+
+void normalize_Michael(MultidimArray<double> &I, const NormalizationBackground &bg)
+{
+    double avgbg, stddevbg;
+    bg.computeAvgStdev(I, avgbg, stddevbg);
+    if (avgbg > 0)
+        subtractAndScale(I, avgbg, 1.0/avgbg);
+    else
+    { // To avoid the contrast inversion
+        double b=avgbg-I.computeMin();
+        subtractAndScale(I, b, 1.0/b);
+    }
+}
+
+void normalize_NewXmipp(MultidimArray<double> &I, const NormalizationBackground &bg)
+{
+    double avgbg, stddevbg;
+    bg.computeAvgStdev(I, avgbg, stddevbg);
+    subtractAndScale(I, avgbg, 1.0/stddevbg);
+}
+
+void normalize_NewXmipp2(MultidimArray<double> &I, const NormalizationBackground &bg)
+{
+    double avgbg, stddevbg;
+    bg.computeAvgStdev(I, avgbg, stddevbg);
+    subtractAndScale(I, avgbg, 1.0/fabs(I.computeAvg()-avgbg));
+}
+
+void normalize_ramp(MultidimArray<double> &I, const NormalizationBackground &bg)
+{
+    I.checkDimension(2);
+    bg.checkSize(I);
+
+    // Least squares plane through the background, see least_squares_plane_fit
+    const double *ptr=MULTIDIM_ARRAY(I);
+    size_t N=bg.size();
+    double J=0, K=0, L=0;
+    for (size_t n=0; n<N; ++n)
+    {
+        double z=ptr[bg.idx[n]];
+        J+=bg.x[n]*z;
+        K+=bg.y[n]*z;
+        L+=z;
+    }
+    double D=bg.D, E=bg.E, F=bg.F, G=bg.G, H=bg.H, Ibg=bg.I;
+    double pA=(H*H*J-G*Ibg*J+E*Ibg*K+F*G*L-H*(F*K+E*L))/bg.denom;
+    double pB=(E*Ibg*J+F*F*K-D*Ibg*K+D*H*L-F*(H*J+E*L))/bg.denom;
+    double pC=(F*G*J-E*H*J-E*F*K+D*H*K+E*E*L-D*G*L)/bg.denom;
+
+    // Subtract the plane from the image and compute stddev within mask
+    I.setXmippOrigin();
+    double *ref=MULTIDIM_ARRAY(I);
+    for (int i=STARTINGY(I); i<=FINISHINGY(I); i++)
+    {
+        double aux=pB * i + pC;
+        for (int j=STARTINGX(I); j<=FINISHINGX(I); j++)
+            *(ref++) -= pA * j + aux;
+    }
+    double avgbg, stddevbg;
+    bg.computeAvgStdev(I, avgbg, stddevbg);
+    if (stddevbg>1e-6)
+        I *= 1.0/stddevbg;
+}
+
+ProgNormalize::ProgNormalize()
+{
+    Nthreads=1;
+}
+
 void ProgNormalize::defineParams()
 {
     each_image_produces_an_output = true;
@@ -473,6 +628,8 @@ void ProgNormalize::defineParams()
     addParamsLine("           frame <r>              : Rectangular background of r pixels.");
     addParamsLine("           circle <r>             : Circular background outside radius r.");
     mask_prm.defineParams(this,INT_MASK, "or", "Use an alternative type of background mask.");
+    addParamsLine(" [--thr <N=1>]                    : Number of threads normalizing the images of a stack.");
+    addParamsLine("                                  :+Not used with --apply_geo, dust removal, Random, Neighbour or Tomography");
     addExampleLine("Normalize using OldXmipp method",false);
     addExampleLine("xmipp_transform_normalize -i images.sel --method OldXmipp",true);
     addExampleLine("Normalize 64x64 images using NewXmipp method",false);
@@ -530,6 +687,7 @@ void ProgNormalize::readParams()
     thresh_black_dust = getDoubleParam("--thr_black_dust");
     thresh_white_dust = getDoubleParam("--thr_white_dust");
     thresh_neigh      = getDoubleParam("--thr_neigh");
+    Nthreads          = getIntParam("--thr");
 
     // Get background mask
     background_mode = NOBACKGROUND;
@@ -687,6 +845,15 @@ void ProgNormalize::preProcess()
     }
     // backup a copy of the mask for apply_geo mode
     bg_mask_bck = bg_mask;
+    if (enable_mask || background_mode != NOBACKGROUND)
+        background.initialize(bg_mask);
+
+    // Normalize stacks in batches
+    bool deterministic = method == OLDXMIPP || method == NEAR_OLDXMIPP || method == NEWXMIPP ||
+                         method == NEWXMIPP2 || method == MICHAEL || method == RAMP || method == NONE;
+    if (Nthreads > 1 && mdInSize > 1 && deterministic && !apply_geo &&
+        !remove_black_dust && !remove_white_dust)
+        setupBatch(Nthreads, (size_t)xdimOut * ydimOut * zdimOut * sizeof(double));
 
     //#define DEBUG
 #ifdef DEBUG
@@ -736,20 +903,23 @@ void ProgNormalize::preProcess()
 
 void ProgNormalize::processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut)
 {
+    if (batchSize > 0)
+    {
+        addToBatch(fnImg, fnImgOut, rowIn);
+        return;
+    }
+
     Image<double> I;
     if (apply_geo)
         I.readApplyGeo(fnImg, rowIn);
     else
         I.read(fnImg);
-    I().setXmippOrigin();
-
-    MultidimArray<double> &img=I();
 
     if (apply_geo)
     {
         Matrix2D<double> A;
         // Applygeo only valid for 2D images for now...
-        img.checkDimension(2);
+        I().checkDimension(2);
 
         MultidimArray< double > tmp;
         // get copy of the mask
@@ -764,8 +934,19 @@ void ProgNormalize::processImage(const FileName &fnImg, const FileName &fnImgOut
 
         FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(bg_mask)
         dAi(bg_mask,n)=(int)round(dAi(tmp,n));
+        background.initialize(bg_mask);
     }
 
+    normalize(I);
+    I.write(fnImgOut);
+}
+
+void ProgNormalize::normalize(Image<double> &I) const
+{
+    I().setXmippOrigin();
+
+    MultidimArray<double> &img=I();
+
     double a, b;
     if (invert_contrast)
         img *= -1.;
@@ -803,16 +984,16 @@ void ProgNormalize::processImage(const FileName &fnImg, const FileName &fnImgOut
         normalize_OldXmipp(img);
         break;
     case NEAR_OLDXMIPP:
-        normalize_Near_OldXmipp(img, bg_mask);
+        normalize_Near_OldXmipp(img, background);
         break;
     case NEWXMIPP:
-        normalize_NewXmipp(img, bg_mask);
+        normalize_NewXmipp(img, background);
         break;
     case NEWXMIPP2:
-        normalize_NewXmipp2(img, bg_mask);
+        normalize_NewXmipp2(img, background);
         break;
     case RAMP:
-        normalize_ramp(img, &bg_mask);
+        normalize_ramp(img, background);
         break;
     case NEIGHBOUR:
         normalize_remove_neighbours(img, bg_mask, thresh_neigh);
@@ -825,7 +1006,7 @@ void ProgNormalize::processImage(const FileName &fnImg, const FileName &fnImgOut
                              true, mu0, sigma0);
         break;
     case MICHAEL:
-        normalize_Michael(img, bg_mask);
+        normalize_Michael(img, background);
         break;
     case RANDOM:
         a = rnd_unif(a0, aF);
@@ -836,5 +1017,20 @@ void ProgNormalize::processImage(const FileName &fnImg, const FileName &fnImgOut
     case NONE:
     	break;
     }
-    I.write(fnImgOut);
+}
+
+void ProgNormalize::readBatchImage(size_t k)
+{
+    batchImg[k]->setDatatype(DT_Double);
+    batchImg[k]->image->read(batchFnImg[k]);
+}
+
+void ProgNormalize::processBatchImage(size_t k, int thread_id)
+{
+    normalize(*(Image<double> *) batchImg[k]->image);
+}
+
+void ProgNormalize::postProcess()
+{
+    clearBatch();
 }
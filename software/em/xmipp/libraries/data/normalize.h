@@ -194,6 +194,68 @@ void normalize_ramp(MultidimArray<double> &I, MultidimArray<int> *bg_mask=NULL);
 void normalize_remove_neighbours(MultidimArray<double> &I,
                                  const MultidimArray<int> &bg_mask,
                                  const double &threshold);
+
+/** Background of the images of a stack.
+    @ingroup NormalizationProcedures
+    The background pixels (those with a non-zero mask value) and the terms of
+    the least squares plane through them that only depend on their
+    coordinates are computed once for all the images of the same size. The
+    normalizations using it only visit the background pixels to compute its
+    statistics and then make a single pass over the image. Their results are
+    the same as those of the functions with a binary mask.
+    An object can be shared among threads. */
+class NormalizationBackground
+{
+public:
+    /// Size of the images
+    size_t Xdim, Ydim, Zdim;
+    /// Direct index of the background pixels (in memory order)
+    std::vector<size_t> idx;
+    /// Logical coordinates (with the Xmipp origin) of the background pixels (only for 2D)
+    std::vector<double> x, y;
+    /** Sums of x*x, x*y, x, y*y, y and 1 over the background, and the
+        determinant of the normal equations of the plane fit (only for 2D) */
+    double D, E, F, G, H, I, denom;
+public:
+    /// Empty constructor
+    NormalizationBackground();
+
+    /// Set the background mask
+    void initialize(const MultidimArray<int> &bg_mask);
+
+    /// Number of background pixels
+    size_t size() const
+    {
+        return idx.size();
+    }
+
+    /// Check that the image has the size of the mask
+    void checkSize(const MultidimArray<double> &img) const;
+
+    /// Average and standard deviation of the image within the background
+    void computeAvgStdev(const MultidimArray<double> &img, double &avg, double &stddev) const;
+};
+
+/** Near_OldXmipp normalization with a precomputed background.
+    @ingroup NormalizationProcedures */
+void normalize_Near_OldXmipp(MultidimArray<double> &I, const NormalizationBackground &bg);
+
+/** Michael's normalization with a precomputed background.
+    @ingroup NormalizationProcedures */
+void normalize_Michael(MultidimArray<double> &I, const NormalizationBackground &bg);
+
+/** NewXmipp normalization with a precomputed background.
+    @ingroup NormalizationProcedures */
+void normalize_NewXmipp(MultidimArray<double> &I, const NormalizationBackground &bg);
+
+/** NewXmipp2 normalization with a precomputed background.
+    @ingroup NormalizationProcedures */
+void normalize_NewXmipp2(MultidimArray<double> &I, const NormalizationBackground &bg);
+
+/** Ramp removal with a precomputed background.
+    @ingroup NormalizationProcedures
+    Only for 2D images. */
+void normalize_ramp(MultidimArray<double> &I, const NormalizationBackground &bg);
 //@}
 
 /* Normalize program
@@ -283,6 +345,15 @@ protected:
     MultidimArray<int> bg_mask, bg_mask_bck;
     bool enable_mask;
 
+    /** Background pixels of bg_mask */
+    NormalizationBackground background;
+
+    /** Number of threads.
+     * The images of a stack are normalized in batches, each thread
+     * normalizes different images and they are written in order.
+     */
+    int Nthreads;
+
     /* Mask parameter
      */
     Mask mask_prm;
@@ -296,7 +367,21 @@ protected:
     void readParams();
     void show();
     void preProcess();
+    void postProcess();
     void processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut);
+
+    /** Normalize an image with the current background */
+    void normalize(Image<double> &I) const;
+
+    /** The images of the batch are read in double precision */
+    void readBatchImage(size_t k);
+
+    /** Normalize the k-th image of the batch */
+    void processBatchImage(size_t k, int thread_id);
+
+public:
+    /** Constructor */
+    ProgNormalize();
 };
 //@}
 #endif
@@ -25,6 +25,7 @@
 
 #include "pdb.h"
 #include "fstream"
+#include <string.h>
 #include "args.h"
 #include "matrix2d.h"
 #include "mask.h"
@@ -94,6 +95,65 @@ double atomRadius(const std::string &atom)
     }
 }
 
+/* Atom table -------------------------------------------------------------- */
+// Value of the columns [start,start+width) of a PDB record. Returns false
+// if the columns are not present or do not contain a number
+static bool pdbColumn(const std::string &line, size_t start, size_t width, double &value)
+{
+    value=0;
+    if (start>=line.size())
+        return false;
+    char buffer[16];
+    size_t n=XMIPP_MIN(width,line.size()-start);
+    memcpy(buffer,line.c_str()+start,n);
+    buffer[n]='\0';
+    char *end;
+    value=strtod(buffer,&end);
+    return end!=buffer;
+}
+
+void PDBAtomTable::read(const FileName &fnPDB)
+{
+    std::ifstream fh_pdb;
+    fh_pdb.open(fnPDB.c_str());
+    if (!fh_pdb)
+        REPORT_ERROR(ERR_IO_NOTEXIST, fnPDB);
+
+    x.clear(); y.clear(); z.clear();
+    occupancy.clear(); bfactor.clear();
+    type0.clear(); type1.clear();
+    hetero.clear();
+
+    // Typical line:
+    // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
+    std::string line;
+    while (getline(fh_pdb, line))
+    {
+        if (line.size()<4)
+            continue;
+        const char *ptr=line.c_str();
+        bool isAtom=strncmp(ptr,"ATOM",4)==0;
+        bool isHetero=strncmp(ptr,"HETA",4)==0;
+        if (!isAtom && !isHetero)
+            continue;
+
+        double xi, yi, zi, occupancyi, bfactori;
+        if (!pdbColumn(line,30,8,xi) || !pdbColumn(line,38,8,yi) || !pdbColumn(line,46,8,zi))
+            REPORT_ERROR(ERR_VALUE_INCORRECT,(std::string)"Cannot read the coordinates of the PDB line: "+line);
+        pdbColumn(line,54,6,occupancyi);
+        pdbColumn(line,60,6,bfactori);
+        x.push_back(xi);
+        y.push_back(yi);
+        z.push_back(zi);
+        occupancy.push_back(occupancyi);
+        bfactor.push_back(bfactori);
+        type0.push_back(line.size()>13 ? ptr[13] : ' ');
+        type1.push_back(line.size()>14 ? ptr[14] : ' ');
+        hetero.push_back(isHetero);
+    }
+    fh_pdb.close();
+}
+
 /* Compute geometry -------------------------------------------------------- */
 void computePDBgeometry(const std::string &fnPDB,
                         Matrix1D<double> &centerOfMass,
@@ -177,6 +237,57 @@ void computePDBgeometry(const std::string &fnPDB,
     fh_pdb.close();
 }
 
+void computePDBgeometry(const PDBAtomTable &atoms,
+                        Matrix1D<double> &centerOfMass,
+                        Matrix1D<double> &limit0, Matrix1D<double> &limitF,
+                        const std::string &intensityColumn)
+{
+    // Initialization
+    centerOfMass.initZeros(3);
+    limit0.initZeros(3);
+    limitF.initZeros(3);
+    limit0.initConstant(1e30);
+    limitF.initConstant(-1e30);
+    double total_mass = 0;
+
+    const std::vector<double> &weightColumn=(intensityColumn=="Bfactor") ? atoms.bfactor : atoms.occupancy;
+    for (size_t n=0; n<atoms.size(); n++)
+    {
+        double x=atoms.x[n], y=atoms.y[n], z=atoms.z[n];
+
+        // Update center of mass and limits
+        if (x < XX(limit0))
+            XX(limit0) = x;
+        else if (x > XX(limitF))
+            XX(limitF) = x;
+        if (y < YY(limit0))
+            YY(limit0) = y;
+        else if (y > YY(limitF))
+            YY(limitF) = y;
+        if (z < ZZ(limit0))
+            ZZ(limit0) = z;
+        else if (z > ZZ(limitF))
+            ZZ(limitF) = z;
+        double weight;
+        if (atoms.type0[n]=='E' && atoms.type1[n]=='N')
+            weight=weightColumn[n];
+        else
+        {
+            if (atoms.hetero[n])
+                continue;
+            char atom_type[3]={atoms.type0[n],atoms.type1[n],'\0'};
+            weight=(double) atomCharge(atom_type);
+        }
+        total_mass += weight;
+        XX(centerOfMass) += weight * x;
+        YY(centerOfMass) += weight * y;
+        ZZ(centerOfMass) += weight * z;
+    }
+
+    // Finish calculations
+    centerOfMass /= total_mass;
+}
+
 /* Apply geometry ---------------------------------------------------------- */
 void applyGeometryToPDBFile(const std::string &fn_in, const std::string &fn_out,
                    const Matrix2D<double> &A, bool centerPDB,
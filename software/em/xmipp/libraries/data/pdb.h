@@ -50,6 +50,35 @@ int atomCharge(const std::string &atom);
     radius. */
 double atomRadius(const std::string &atom);
 
+/** Atoms of a PDB file.
+    The ATOM and HETATM records are parsed once and stored as a structure
+    of arrays. The fixed columns of the format are read in place, without
+    creating substrings. */
+class PDBAtomTable
+{
+public:
+    /// Position (in Angstroms)
+    std::vector<double> x, y, z;
+
+    /// Occupancy and temperature factor (0 if not present)
+    std::vector<double> occupancy, bfactor;
+
+    /// Atom type (columns 14 and 15 of the record, e.g., "CA" or "EN" for pseudoatoms)
+    std::vector<char> type0, type1;
+
+    /// HETATM record
+    std::vector<bool> hetero;
+public:
+    /// Read the atoms of a PDB file
+    void read(const FileName &fnPDB);
+
+    /// Number of atoms
+    size_t size() const
+    {
+        return x.size();
+    }
+};
+
 /** Compute the center of mass and limits of a PDB file.
     The intensity column is used only for the pseudoatoms. It specifies
     from which column we should read the intensity. Valid columns are
@@ -60,6 +89,13 @@ void computePDBgeometry(const std::string &fnPDB,
                         Matrix1D<double> &limit0, Matrix1D<double> &limitF,
                         const std::string &intensityColumn);
 
+/** Compute the center of mass and limits of the atoms of a PDB file.
+    Same as above for a PDB file that has already been read. */
+void computePDBgeometry(const PDBAtomTable &atoms,
+                        Matrix1D<double> &centerOfMass,
+                        Matrix1D<double> &limit0, Matrix1D<double> &limitF,
+                        const std::string &intensityColumn);
+
 /** Apply geometry transformation to an input PDB.
     The result is written in the output PDB. Set centerPDB if you
     want to compute the center of mass first and apply the transformation
@@ -374,16 +374,29 @@ void ParametersProjectionTomography::calculateProjectionAngles(Projection &P, do
 
 // Projection from a voxel volume ==========================================
 /* Project a voxel volume -------------------------------------------------- */
+/* Data shared by the threads projecting a voxel volume */
+class ProjectVolumeData
+{
+public:
+    const MultidimArray<double> *V;
+    MultidimArray<double> *mP;
+    const Matrix2D<double> *eulert;
+    const Matrix1D<double> *direction;
+    const Matrix1D<double> *roffset;
+    ThreadTaskDistributor *td;
+};
+
+/* Ray casting of the rows i0 to iF (logical indexes) of the projection.
+   Each pixel is computed independently of the rest. */
 //#define DEBUG
-void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
-                   double rot, double tilt, double psi,
-                   const Matrix1D<double> *roffset)
+static void projectVolumeRows(const ProjectVolumeData &data, int i0, int iF)
 {
     SPEED_UP_temps012;
-
-    // Initialise projection
-    P.reset(Ydim, Xdim);
-    P.setAngles(rot, tilt, psi);
+    const MultidimArray<double> &V=*data.V;
+    MultidimArray<double> &mP=*data.mP;
+    const Matrix2D<double> &eulert=*data.eulert;
+    const Matrix1D<double> &direction=*data.direction;
+    const Matrix1D<double> *roffset=data.roffset;
 
     // Compute the distance for this line crossing one voxel
     int x_0 = STARTINGX(V), x_F = FINISHINGX(V);
@@ -394,26 +407,17 @@ void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
     // computed and each computed ray
     double step = 1.0 / 3.0;
 
-    // Avoids divisions by zero and allows orthogonal rays computation
-    if (XX(P.direction) == 0)
-        XX(P.direction) = XMIPP_EQUAL_ACCURACY;
-    if (YY(P.direction) == 0)
-        YY(P.direction) = XMIPP_EQUAL_ACCURACY;
-    if (ZZ(P.direction) == 0)
-        ZZ(P.direction) = XMIPP_EQUAL_ACCURACY;
-
     // Some precalculated variables
-    int x_sign = SGN(XX(P.direction));
-    int y_sign = SGN(YY(P.direction));
-    int z_sign = SGN(ZZ(P.direction));
+    int x_sign = SGN(XX(direction));
+    int y_sign = SGN(YY(direction));
+    int z_sign = SGN(ZZ(direction));
     double half_x_sign = 0.5 * x_sign;
     double half_y_sign = 0.5 * y_sign;
     double half_z_sign = 0.5 * z_sign;
-    double iXXP_direction=1.0/XX(P.direction);
-    double iYYP_direction=1.0/YY(P.direction);
-    double iZZP_direction=1.0/ZZ(P.direction);
+    double iXXP_direction=1.0/XX(direction);
+    double iYYP_direction=1.0/YY(direction);
+    double iZZP_direction=1.0/ZZ(direction);
 
-    MultidimArray<double> &mP = P();
     Matrix1D<double>  v(3);
     Matrix1D<double> r_p(3); // r_p are the coordinates of the
     // pixel being projected in the
@@ -422,215 +426,263 @@ void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
     Matrix1D<double> p1(3);  // coordinates of the pixel in the
     // universal space
     Matrix1D<double> p1_shifted(3); // shifted half a pixel
-    FOR_ALL_ELEMENTS_IN_ARRAY2D(mP)
-    {
-        double ray_sum = 0.0;    // Line integral value
-
-        // Computes 4 different rays for each pixel.
-        for (int rays_per_pixel = 0; rays_per_pixel < 4; rays_per_pixel++)
+    for (int i=i0; i<=iF; i++)
+        for (int j=STARTINGX(mP); j<=FINISHINGX(mP); j++)
         {
-            // universal coordinate system
-            switch (rays_per_pixel)
-            {
-            case 0:
-                VECTOR_R3(r_p, j - step, i - step, 0);
-                break;
-            case 1:
-                VECTOR_R3(r_p, j - step, i + step, 0);
-                break;
-            case 2:
-                VECTOR_R3(r_p, j + step, i - step, 0);
-                break;
-            case 3:
-                VECTOR_R3(r_p, j + step, i + step, 0);
-                break;
-            }
+            double ray_sum = 0.0;    // Line integral value
 
-            // Express r_p in the universal coordinate system
-            if (roffset!=NULL)
-                r_p-=*roffset;
-            M3x3_BY_V3x1(p1, P.eulert, r_p);
-            XX(p1_shifted)=XX(p1)-half_x_sign;
-            YY(p1_shifted)=YY(p1)-half_y_sign;
-            ZZ(p1_shifted)=ZZ(p1)-half_z_sign;
-
-            // Compute the minimum and maximum alpha for the ray
-            // intersecting the given volume
-            double alpha_xmin = (x_0 - 0.5 - XX(p1))* iXXP_direction;
-            double alpha_xmax = (x_F + 0.5 - XX(p1))* iXXP_direction;
-            double alpha_ymin = (y_0 - 0.5 - YY(p1))* iYYP_direction;
-            double alpha_ymax = (y_F + 0.5 - YY(p1))* iYYP_direction;
-            double alpha_zmin = (z_0 - 0.5 - ZZ(p1))* iZZP_direction;
-            double alpha_zmax = (z_F + 0.5 - ZZ(p1))* iZZP_direction;
-
-            double auxMin, auxMax;
-            if (alpha_xmin<alpha_xmax)
-            {
-                auxMin=alpha_xmin;
-                auxMax=alpha_xmax;
-            }
-            else
-            {
-                auxMin=alpha_xmax;
-                auxMax=alpha_xmin;
-            }
-            double alpha_min=auxMin;
-            double alpha_max=auxMax;
-            if (alpha_ymin<alpha_ymax)
-            {
-                auxMin=alpha_ymin;
-                auxMax=alpha_ymax;
-            }
-            else
-            {
-                auxMin=alpha_ymax;
-                auxMax=alpha_ymin;
-            }
-            alpha_min=fmax(auxMin,alpha_min);
-            alpha_max=fmin(auxMax,alpha_max);
-            if (alpha_zmin<alpha_zmax)
-            {
-                auxMin=alpha_zmin;
-                auxMax=alpha_zmax;
-            }
-            else
+            // Computes 4 different rays for each pixel.
+            for (int rays_per_pixel = 0; rays_per_pixel < 4; rays_per_pixel++)
             {
-                auxMin=alpha_zmax;
-                auxMax=alpha_zmin;
-            }
-            alpha_min=fmax(auxMin,alpha_min);
-            alpha_max=fmin(auxMax,alpha_max);
-            if (alpha_max - alpha_min < XMIPP_EQUAL_ACCURACY)
-                continue;
+                // universal coordinate system
+                switch (rays_per_pixel)
+                {
+                case 0:
+                    VECTOR_R3(r_p, j - step, i - step, 0);
+                    break;
+                case 1:
+                    VECTOR_R3(r_p, j - step, i + step, 0);
+                    break;
+                case 2:
+                    VECTOR_R3(r_p, j + step, i - step, 0);
+                    break;
+                case 3:
+                    VECTOR_R3(r_p, j + step, i + step, 0);
+                    break;
+                }
+
+                // Express r_p in the universal coordinate system
+                if (roffset!=NULL)
+                    r_p-=*roffset;
+                M3x3_BY_V3x1(p1, eulert, r_p);
+                XX(p1_shifted)=XX(p1)-half_x_sign;
+                YY(p1_shifted)=YY(p1)-half_y_sign;
+                ZZ(p1_shifted)=ZZ(p1)-half_z_sign;
+
+                // Compute the minimum and maximum alpha for the ray
+                // intersecting the given volume
+                double alpha_xmin = (x_0 - 0.5 - XX(p1))* iXXP_direction;
+                double alpha_xmax = (x_F + 0.5 - XX(p1))* iXXP_direction;
+                double alpha_ymin = (y_0 - 0.5 - YY(p1))* iYYP_direction;
+                double alpha_ymax = (y_F + 0.5 - YY(p1))* iYYP_direction;
+                double alpha_zmin = (z_0 - 0.5 - ZZ(p1))* iZZP_direction;
+                double alpha_zmax = (z_F + 0.5 - ZZ(p1))* iZZP_direction;
+
+                double auxMin, auxMax;
+                if (alpha_xmin<alpha_xmax)
+                {
+                    auxMin=alpha_xmin;
+                    auxMax=alpha_xmax;
+                }
+                else
+                {
+                    auxMin=alpha_xmax;
+                    auxMax=alpha_xmin;
+                }
+                double alpha_min=auxMin;
+                double alpha_max=auxMax;
+                if (alpha_ymin<alpha_ymax)
+                {
+                    auxMin=alpha_ymin;
+                    auxMax=alpha_ymax;
+                }
+                else
+                {
+                    auxMin=alpha_ymax;
+                    auxMax=alpha_ymin;
+                }
+                alpha_min=fmax(auxMin,alpha_min);
+                alpha_max=fmin(auxMax,alpha_max);
+                if (alpha_zmin<alpha_zmax)
+                {
+                    auxMin=alpha_zmin;
+                    auxMax=alpha_zmax;
+                }
+                else
+                {
+                    auxMin=alpha_zmax;
+                    auxMax=alpha_zmin;
+                }
+                alpha_min=fmax(auxMin,alpha_min);
+                alpha_max=fmin(auxMax,alpha_max);
+                if (alpha_max - alpha_min < XMIPP_EQUAL_ACCURACY)
+                    continue;
 
 #ifdef DEBUG
 
-            std::cout << "Pixel:  " << r_p.transpose() << std::endl
-            << "Univ:   " << p1.transpose() << std::endl
-            << "Dir:    " << P.direction.transpose() << std::endl
-            << "Alpha x:" << alpha_xmin << " " << alpha_xmax << std::endl
-            << "   " << (p1 + alpha_xmin*P.direction).transpose() << std::endl
-            << "   " << (p1 + alpha_xmax*P.direction).transpose() << std::endl
-            << "Alpha y:" << alpha_ymin << " " << alpha_ymax << std::endl
-            << "   " << (p1 + alpha_ymin*P.direction).transpose() << std::endl
-            << "   " << (p1 + alpha_ymax*P.direction).transpose() << std::endl
-            << "Alpha z:" << alpha_zmin << " " << alpha_zmax << std::endl
-            << "   " << (p1 + alpha_zmin*P.direction).transpose() << std::endl
-            << "   " << (p1 + alpha_zmax*P.direction).transpose() << std::endl
-            << "alpha  :" << alpha_min  << " " << alpha_max  << std::endl
-            << std::endl;
+                std::cout << "Pixel:  " << r_p.transpose() << std::endl
+                << "Univ:   " << p1.transpose() << std::endl
+                << "Dir:    " << direction.transpose() << std::endl
+                << "Alpha x:" << alpha_xmin << " " << alpha_xmax << std::endl
+                << "   " << (p1 + alpha_xmin*direction).transpose() << std::endl
+                << "   " << (p1 + alpha_xmax*direction).transpose() << std::endl
+                << "Alpha y:" << alpha_ymin << " " << alpha_ymax << std::endl
+                << "   " << (p1 + alpha_ymin*direction).transpose() << std::endl
+                << "   " << (p1 + alpha_ymax*direction).transpose() << std::endl
+                << "Alpha z:" << alpha_zmin << " " << alpha_zmax << std::endl
+                << "   " << (p1 + alpha_zmin*direction).transpose() << std::endl
+                << "   " << (p1 + alpha_zmax*direction).transpose() << std::endl
+                << "alpha  :" << alpha_min  << " " << alpha_max  << std::endl
+                << std::endl;
 #endif
 
-            // Compute the first point in the volume intersecting the ray
-            double zz_idxd, yy_idxd, xx_idxd;
-            int    zz_idx , yy_idx , xx_idx;
-            V3_BY_CT(v, P.direction, alpha_min);
-            V3_PLUS_V3(v, p1, v);
+                // Compute the first point in the volume intersecting the ray
+                double zz_idxd, yy_idxd, xx_idxd;
+                int    zz_idx , yy_idx , xx_idx;
+                V3_BY_CT(v, direction, alpha_min);
+                V3_PLUS_V3(v, p1, v);
 
-            // Compute the index of the first voxel
-            xx_idx = ROUND(XX(v));
-            yy_idx = ROUND(YY(v));
-            zz_idx = ROUND(ZZ(v));
+                // Compute the index of the first voxel
+                xx_idx = ROUND(XX(v));
+                yy_idx = ROUND(YY(v));
+                zz_idx = ROUND(ZZ(v));
 
-            xx_idxd = xx_idx = CLIP(xx_idx, x_0, x_F);
-            yy_idxd = yy_idx = CLIP(yy_idx, y_0, y_F);
-            zz_idxd = zz_idx = CLIP(zz_idx, z_0, z_F);
+                xx_idxd = xx_idx = CLIP(xx_idx, x_0, x_F);
+                yy_idxd = yy_idx = CLIP(yy_idx, y_0, y_F);
+                zz_idxd = zz_idx = CLIP(zz_idx, z_0, z_F);
 
 #ifdef DEBUG
 
-            std::cout << "First voxel: " << v.transpose() << std::endl;
-            std::cout << "   First index: " << idx.transpose() << std::endl;
-            std::cout << "   Alpha_min: " << alpha_min << std::endl;
+                std::cout << "First voxel: " << v.transpose() << std::endl;
+                std::cout << "   First index: " << idx.transpose() << std::endl;
+                std::cout << "   Alpha_min: " << alpha_min << std::endl;
 #endif
 
-            // Follow the ray
-            double alpha = alpha_min;
-            do
-            {
+                // Follow the ray
+                double alpha = alpha_min;
+                do
+                {
 #ifdef DEBUG
-                std::cout << " \n\nCurrent Value: " << V(zz_idx, yy_idx, xx_idx) << std::endl;
+                    std::cout << " \n\nCurrent Value: " << V(zz_idx, yy_idx, xx_idx) << std::endl;
 #endif
 
-                double alpha_x = (xx_idxd - XX(p1_shifted))* iXXP_direction;
-                double alpha_y = (yy_idxd - YY(p1_shifted))* iYYP_direction;
-                double alpha_z = (zz_idxd - ZZ(p1_shifted))* iZZP_direction;
-
-                // Which dimension will ray move next step into?, it isn't necessary to be only
-                // one.
-                double diffx = fabs(alpha-alpha_x);
-                double diffy = fabs(alpha-alpha_y);
-                double diffz = fabs(alpha-alpha_z);
-                int diff_source=0;
-                double diff_alpha=diffx;
-                if (diffy<diff_alpha)
-                {
-                    diff_source=1;
-                    diff_alpha=diffy;
-                }
-                if (diffz<diff_alpha)
-                {
-                    diff_source=2;
-                    diff_alpha=diffz;
-                }
-                ray_sum += diff_alpha * A3D_ELEM(V, zz_idx, yy_idx, xx_idx);
-
-                switch (diff_source)
-                {
-                case 0:
-                    alpha = alpha_x;
-                    xx_idx += x_sign;
-                    xx_idxd = xx_idx;
-                    break;
-                case 1:
-                    alpha = alpha_y;
-                    yy_idx += y_sign;
-                    yy_idxd = yy_idx;
-                    break;
-                default:
-                    alpha = alpha_z;
-                    zz_idx += z_sign;
-                    zz_idxd = zz_idx;
-                }
+                    double alpha_x = (xx_idxd - XX(p1_shifted))* iXXP_direction;
+                    double alpha_y = (yy_idxd - YY(p1_shifted))* iYYP_direction;
+                    double alpha_z = (zz_idxd - ZZ(p1_shifted))* iZZP_direction;
+
+                    // Which dimension will ray move next step into?, it isn't necessary to be only
+                    // one.
+                    double diffx = fabs(alpha-alpha_x);
+                    double diffy = fabs(alpha-alpha_y);
+                    double diffz = fabs(alpha-alpha_z);
+                    int diff_source=0;
+                    double diff_alpha=diffx;
+                    if (diffy<diff_alpha)
+                    {
+                        diff_source=1;
+                        diff_alpha=diffy;
+                    }
+                    if (diffz<diff_alpha)
+                    {
+                        diff_source=2;
+                        diff_alpha=diffz;
+                    }
+                    ray_sum += diff_alpha * A3D_ELEM(V, zz_idx, yy_idx, xx_idx);
+
+                    switch (diff_source)
+                    {
+                    case 0:
+                        alpha = alpha_x;
+                        xx_idx += x_sign;
+                        xx_idxd = xx_idx;
+                        break;
+                    case 1:
+                        alpha = alpha_y;
+                        yy_idx += y_sign;
+                        yy_idxd = yy_idx;
+                        break;
+                    default:
+                        alpha = alpha_z;
+                        zz_idx += z_sign;
+                        zz_idxd = zz_idx;
+                    }
 
 #ifdef DEBUG
-                std::cout << "Alpha x,y,z: " << alpha_x << " " << alpha_y
-                << " " << alpha_z << " ---> " << alpha << std::endl;
-
-                XX(v) += diff_alpha * XX(P.direction);
-                YY(v) += diff_alpha * YY(P.direction);
-                ZZ(v) += diff_alpha * ZZ(P.direction);
-
-                std::cout << "    Next entry point: " << v.transpose() << std::endl
-                << "    Index: " << idx.transpose() << std::endl
-                << "    diff_alpha: " << diff_alpha << std::endl
-                << "    ray_sum: " << ray_sum << std::endl
-                << "    Alfa tot: " << alpha << "alpha_max: " << alpha_max <<
-                std::endl;
+                    std::cout << "Alpha x,y,z: " << alpha_x << " " << alpha_y
+                    << " " << alpha_z << " ---> " << alpha << std::endl;
+
+                    XX(v) += diff_alpha * XX(direction);
+                    YY(v) += diff_alpha * YY(direction);
+                    ZZ(v) += diff_alpha * ZZ(direction);
+
+                    std::cout << "    Next entry point: " << v.transpose() << std::endl
+                    << "    Index: " << idx.transpose() << std::endl
+                    << "    diff_alpha: " << diff_alpha << std::endl
+                    << "    ray_sum: " << ray_sum << std::endl
+                    << "    Alfa tot: " << alpha << "alpha_max: " << alpha_max <<
+                    std::endl;
 #endif
 
-            }
-            while ((alpha_max - alpha) > XMIPP_EQUAL_ACCURACY);
-        } // for
+                }
+                while ((alpha_max - alpha) > XMIPP_EQUAL_ACCURACY);
+            } // for
 
-        A2D_ELEM(IMGMATRIX(P), i, j) = ray_sum * 0.25;
+            A2D_ELEM(mP, i, j) = ray_sum * 0.25;
 #ifdef DEBUG
 
-        std::cout << "Assigning P(" << i << "," << j << ")=" << ray_sum << std::endl;
+            std::cout << "Assigning P(" << i << "," << j << ")=" << ray_sum << std::endl;
 #endif
 
-    }
+        }
 }
 #undef DEBUG
 
+static void threadProjectVolume(ThreadArgument &thArg)
+{
+    ProjectVolumeData &data=*((ProjectVolumeData *)thArg.workClass);
+    int firstRow=STARTINGY(*data.mP);
+    size_t first, last;
+    while (data.td->getTasks(first, last))
+        projectVolumeRows(data, firstRow+(int)first, firstRow+(int)last);
+}
+
+void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
+                   double rot, double tilt, double psi,
+                   const Matrix1D<double> *roffset, int Nthreads)
+{
+    // Initialise projection
+    P.reset(Ydim, Xdim);
+    P.setAngles(rot, tilt, psi);
+
+    // Avoids divisions by zero and allows orthogonal rays computation
+    if (XX(P.direction) == 0)
+        XX(P.direction) = XMIPP_EQUAL_ACCURACY;
+    if (YY(P.direction) == 0)
+        YY(P.direction) = XMIPP_EQUAL_ACCURACY;
+    if (ZZ(P.direction) == 0)
+        ZZ(P.direction) = XMIPP_EQUAL_ACCURACY;
+
+    ProjectVolumeData data;
+    data.V=&V;
+    data.mP=&P();
+    data.eulert=&P.eulert;
+    data.direction=&P.direction;
+    data.roffset=roffset;
+    data.td=NULL;
+
+    // The rows of the projection are distributed among the threads
+    MultidimArray<double> &mP = P();
+    Nthreads=XMIPP_MIN(Nthreads,(int)YSIZE(mP));
+    if (Nthreads<=1)
+        projectVolumeRows(data, STARTINGY(mP), FINISHINGY(mP));
+    else
+    {
+        ThreadTaskDistributor td(YSIZE(mP), 1);
+        data.td=&td;
+        ThreadManager thMgr(Nthreads, &data);
+        thMgr.run(threadProjectVolume);
+    }
+}
+
 /* Project a voxel volume with respect to an offcentered axis -------------- */
 //#define DEBUG
 void projectVolumeOffCentered(MultidimArray<double> &V, Projection &P,
-                              int Ydim, int Xdim)
+                              int Ydim, int Xdim, int Nthreads)
 {
     Matrix1D<double> roffset(3);
     P.getShifts(XX(roffset), YY(roffset), ZZ(roffset));
 
-    projectVolume(V, P, Ydim, Xdim, P.rot(), P.tilt(), P.psi(), &roffset);
+    projectVolume(V, P, Ydim, Xdim, P.rot(), P.tilt(), P.psi(), &roffset, Nthreads);
 }
 
 // Perform a backprojection ================================================
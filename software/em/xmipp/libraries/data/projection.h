@@ -257,10 +257,13 @@ void project_SimpleGrid(Image<T> *vol, const SimpleGrid *grid,
     rproj=E*r+roffset => r=E^t (rproj-roffset)
 
     Set it to NULL if you don't want to use it
+
+    The rows of the projection can be computed by Nthreads threads, the
+    result does not depend on the number of threads.
  */
 void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
                    double rot, double tilt, double psi,
-                   const Matrix1D<double> *roffset=NULL);
+                   const Matrix1D<double> *roffset=NULL, int Nthreads=1);
 
 /** From voxel volumes, off-centered tilt axis.
     This routine projects a volume that is rotating (angle) degrees
@@ -278,7 +281,7 @@ void projectVolume(MultidimArray<double> &V, Projection &P, int Ydim, int Xdim,
     the angle.
 */
 void projectVolumeOffCentered(MultidimArray<double> &V, Projection &P,
-                              int Ydim, int Xdim);
+                              int Ydim, int Xdim, int Nthreads=1);
 
 /** Single Weighted Back Projection.
    Projects a single particle into a voxels volume by updating its components this way:
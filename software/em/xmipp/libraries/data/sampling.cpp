@@ -24,6 +24,169 @@
  ***************************************************************************/
 #include "sampling.h"
 #include "matrix2d.h"
+#include <algorithm>
+
+/* Sphere direction index ------------------------------------------------- */
+// Safety margin (in chord distance) for the cell pruning, the final decision
+// is always taken with the exact dot product. It covers the deviation from
+// unit length allowed to the directions (SPHERE_INDEX_NORM_TOL)
+#define SPHERE_INDEX_MARGIN 1e-4
+#define SPHERE_INDEX_NORM_TOL 1e-10
+
+static inline bool isUnitDirection(const Matrix1D<double> &d)
+{
+    return VEC_XSIZE(d)==3 && fabs(d.module()-1.0)<=SPHERE_INDEX_NORM_TOL;
+}
+
+SphereDirectionIndex::SphereDirectionIndex()
+{
+    directions=NULL;
+    Ncells=1;
+    cellSize=2;
+    exhaustive=true;
+}
+
+void SphereDirectionIndex::build(const std::vector< Matrix1D<double> > &_directions)
+{
+    directions=&_directions;
+    size_t N=directions->size();
+
+    // The cell pruning is only valid for unit vectors
+    exhaustive=false;
+    for (size_t n=0; n<N && !exhaustive; ++n)
+    {
+        if (!isUnitDirection((*directions)[n]))
+            exhaustive=true;
+    }
+
+    // About 2 directions per occupied cell (the sphere surface
+    // intersects roughly 2*Ncells^2 cells)
+    Ncells=(int)XMIPP_MIN(XMIPP_MAX(sqrt(N/4.0),1.0),64.0);
+    cellSize=2.0/Ncells;
+    size_t Ncells3=(size_t)Ncells*Ncells*Ncells;
+    cellStart.assign(Ncells3+1,0);
+    cellPoints.resize(exhaustive ? 0 : N);
+    if (exhaustive)
+        return;
+
+    // Counting sort of the directions by cell, keeping the ascending
+    // order of the indexes within each cell
+    std::vector<size_t> cellOf(N);
+    for (size_t n=0; n<N; ++n)
+    {
+        const Matrix1D<double> &d=(*directions)[n];
+        cellOf[n]=((size_t)cellCoord(ZZ(d))*Ncells+cellCoord(YY(d)))*Ncells+cellCoord(XX(d));
+        cellStart[cellOf[n]+1]++;
+    }
+    for (size_t c=0; c<Ncells3; ++c)
+        cellStart[c+1]+=cellStart[c];
+    std::vector<size_t> fill(cellStart.begin(),cellStart.end()-1);
+    for (size_t n=0; n<N; ++n)
+        cellPoints[fill[cellOf[n]]++]=n;
+}
+
+void SphereDirectionIndex::findWithin(const Matrix1D<double> &v, double cosRadius,
+                                      std::vector<size_t> &result) const
+{
+    result.clear();
+    size_t N=directions->size();
+    double radius=sqrt(XMIPP_MAX(2.0-2.0*cosRadius,0.0))+SPHERE_INDEX_MARGIN;
+    int c0x=cellCoord(XX(v)-radius), cFx=cellCoord(XX(v)+radius);
+    int c0y=cellCoord(YY(v)-radius), cFy=cellCoord(YY(v)+radius);
+    int c0z=cellCoord(ZZ(v)-radius), cFz=cellCoord(ZZ(v)+radius);
+    if (exhaustive || !isUnitDirection(v) || (size_t)(cFx-c0x+1)*(cFy-c0y+1)*(cFz-c0z+1)>=N)
+    {
+        for (size_t n=0; n<N; ++n)
+            if (dotProduct((*directions)[n],v)>cosRadius)
+                result.push_back(n);
+        return;
+    }
+
+    for (int cz=c0z; cz<=cFz; ++cz)
+        for (int cy=c0y; cy<=cFy; ++cy)
+        {
+            size_t cRow=((size_t)cz*Ncells+cy)*Ncells;
+            for (size_t idx=cellStart[cRow+c0x]; idx<cellStart[cRow+cFx+1]; ++idx)
+            {
+                size_t n=cellPoints[idx];
+                if (dotProduct((*directions)[n],v)>cosRadius)
+                    result.push_back(n);
+            }
+        }
+    std::sort(result.begin(),result.end());
+}
+
+void SphereDirectionIndex::closestInCell(int cz, int cy, int cx, const Matrix1D<double> &v,
+        int &best, double &bestDot) const
+{
+    size_t c=((size_t)cz*Ncells+cy)*Ncells+cx;
+    for (size_t idx=cellStart[c]; idx<cellStart[c+1]; ++idx)
+    {
+        int n=(int)cellPoints[idx];
+        double dot=dotProduct((*directions)[n],v);
+        if (best<0 || dot>bestDot || (dot==bestDot && n<best))
+        {
+            best=n;
+            bestDot=dot;
+        }
+    }
+}
+
+int SphereDirectionIndex::findClosest(const Matrix1D<double> &v, double &bestDot) const
+{
+    int best=-1;
+    bestDot=-2;
+    size_t N=directions->size();
+    if (exhaustive || !isUnitDirection(v))
+    {
+        for (size_t n=0; n<N; ++n)
+        {
+            double dot=dotProduct((*directions)[n],v);
+            if (dot>bestDot)
+            {
+                bestDot=dot;
+                best=(int)n;
+            }
+        }
+        return best;
+    }
+
+    // Visit the cells in rings of increasing Chebyshev distance around the
+    // cell of v. After visiting ring m, the remaining directions are at a
+    // distance of at least m*cellSize from v.
+    int cx=cellCoord(XX(v)), cy=cellCoord(YY(v)), cz=cellCoord(ZZ(v));
+    for (int m=0; m<Ncells; ++m)
+    {
+        if (best>=0)
+        {
+            double bestDistance=sqrt(XMIPP_MAX(2.0-2.0*bestDot,0.0));
+            if (bestDistance+SPHERE_INDEX_MARGIN<(m-1)*cellSize)
+                break;
+        }
+        int z0=XMIPP_MAX(cz-m,0), zF=XMIPP_MIN(cz+m,Ncells-1);
+        int y0=XMIPP_MAX(cy-m,0), yF=XMIPP_MIN(cy+m,Ncells-1);
+        int x0=XMIPP_MAX(cx-m,0), xF=XMIPP_MIN(cx+m,Ncells-1);
+        for (int z=z0; z<=zF; ++z)
+            for (int y=y0; y<=yF; ++y)
+            {
+                bool inner=abs(z-cz)<m && abs(y-cy)<m;
+                if (inner)
+                {
+                    // Only the two cells of the ring in this row
+                    if (cx-m>=0)
+                        closestInCell(z,y,cx-m,v,best,bestDot);
+                    if (cx+m<Ncells)
+                        closestInCell(z,y,cx+m,v,best,bestDot);
+                }
+                else
+                    for (int x=x0; x<=xF; ++x)
+                        closestInCell(z,y,x,v,best,bestDot);
+            }
+    }
+    return best;
+}
+#undef SPHERE_INDEX_MARGIN
+#undef SPHERE_INDEX_NORM_TOL
 
 /* Default Constructor */
 Sampling::Sampling()
@@ -1712,7 +1875,11 @@ void Sampling::computeNeighbors(bool only_winner)
 
     // calculate some sizes only once
     size_t exp_data_projection_direction_by_L_R_size = exp_data_projection_direction_by_L_R.size();
-    size_t no_redundant_sampling_points_vector_size = no_redundant_sampling_points_vector.size();
+
+    // spatial index of the sampling points
+    SphereDirectionIndex samplingIndex;
+    samplingIndex.build(no_redundant_sampling_points_vector);
+    std::vector<size_t> candidates;
 
     if (verbose)
     {
@@ -1744,8 +1911,13 @@ void Sampling::computeNeighbors(bool only_winner)
 			for (size_t k = 0; k < R_repository.size(); k++,j++)
 			{
 				winner_dotProduct = -1.;
-				for (size_t i = 0; i < no_redundant_sampling_points_vector_size; ++i)
+				// Only the sampling points within the neighbourhood, in ascending order
+				samplingIndex.findWithin(exp_data_projection_direction_by_L_R[j],
+										 cos_neighborhood_radius, candidates);
+				size_t candidates_size = candidates.size();
+				for (size_t c = 0; c < candidates_size; ++c)
 				{
+					size_t i = candidates[c];
 					my_dotProduct = dotProduct(no_redundant_sampling_points_vector[i],
 											   exp_data_projection_direction_by_L_R[j]);
 
@@ -1991,6 +2163,10 @@ void Sampling::findClosestSamplingPoint(MetaData &DFi,
 
     DFo.setComment("Original rot, tilt, psi, Xoff, Yoff are stored as comments");
 
+    // spatial index of the sampling points
+    SphereDirectionIndex samplingIndex;
+    samplingIndex.build(no_redundant_sampling_points_vector);
+
     //#define DEBUG3
 #ifdef  DEBUG3
 
@@ -2014,23 +2190,19 @@ void Sampling::findClosestSamplingPoint(MetaData &DFi,
                 <<  " .019"      << std::endl;
             }
 #endif
-            for(size_t j=0;j< no_redundant_sampling_points_vector.size();j++)
+            // closest sampling point (the first one in case of ties)
+            int j = samplingIndex.findClosest(exp_data_projection_direction_by_L_R[i],
+                                              my_dotProduct_aux);
+            if (j >= 0 && my_dotProduct_aux > my_dotProduct)
             {
-                my_dotProduct_aux =
-                    dotProduct(exp_data_projection_direction_by_L_R[i],
-                               no_redundant_sampling_points_vector[j]);
-
-                if ( my_dotProduct_aux > my_dotProduct)
-                {
-                    my_dotProduct = my_dotProduct_aux;
-                    winner_sampling = j;
+                my_dotProduct = my_dotProduct_aux;
+                winner_sampling = j;
 #if defined(CHIMERA) || defined(MYPSI)
 
-                    winner_exp_L_R  = i;
+                winner_exp_L_R  = i;
 #endif
 
-                }
-            }//for j
+            }
         }//for k
 #ifdef  DEBUG3
         if( i==  ((exp_image+1)*R_repository.size()) )
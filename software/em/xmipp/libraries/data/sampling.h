@@ -45,6 +45,60 @@
     of Baumgardner (1995). http://www.wmo.int/pages/prog/www/DPS/Icosah.pdf
 
 */
+
+/** Spatial index of directions on the unit sphere.
+    The directions are binned in a regular grid of cubic cells covering
+    [-1,1]^3, so that the directions close to a given one are found by
+    visiting only the neighbouring cells. The queries return exactly the
+    same points as comparing the given direction against all directions
+    with dotProduct (ties are resolved in favour of the lowest index).
+    If the directions are not unit vectors, the index falls back to the
+    exhaustive comparison.
+*/
+class SphereDirectionIndex
+{
+public:
+    /** Empty constructor */
+    SphereDirectionIndex();
+
+    /** Build the index. The directions are not copied and must not change
+        while the index is in use. */
+    void build(const std::vector< Matrix1D<double> > &directions);
+
+    /** Indexes of the directions whose dot product with v is larger than cosRadius.
+        They are returned in ascending order. */
+    void findWithin(const Matrix1D<double> &v, double cosRadius,
+                    std::vector<size_t> &result) const;
+
+    /** Index of the direction with the largest dot product with v.
+        -1 is returned if there are no directions. The largest dot product is
+        returned in bestDot. */
+    int findClosest(const Matrix1D<double> &v, double &bestDot) const;
+
+private:
+    // Directions
+    const std::vector< Matrix1D<double> > *directions;
+    // Number of cells in each dimension
+    int Ncells;
+    // Cell side
+    double cellSize;
+    // Compare against all directions
+    bool exhaustive;
+    // The directions in cell c are cellPoints[cellStart[c]...cellStart[c+1]-1]
+    std::vector<size_t> cellStart, cellPoints;
+
+    // Cell coordinate of a value in [-1,1]
+    inline int cellCoord(double x) const
+    {
+        int c=(int)floor((x+1.0)/cellSize);
+        return XMIPP_MIN(XMIPP_MAX(c,0),Ncells-1);
+    }
+
+    // Visit the directions in cell (cz,cy,cx) updating the best one
+    void closestInCell(int cz, int cy, int cx, const Matrix1D<double> &v,
+                       int &best, double &bestDot) const;
+};
+
 class Sampling
 {
 public:
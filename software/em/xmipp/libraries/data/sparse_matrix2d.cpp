@@ -42,7 +42,7 @@ SparseMatrix2D::SparseMatrix2D(std::vector<SparseElement> &_elements, int _Nelem
 
 	values.resizeNoCopy(ln);
 	jIdx.resizeNoCopy(ln);
-	iIdx.resizeNoCopy(N);
+	iIdx.initZeros(N);
 
 	int actualRow = -1;
 	int i         =  0; // Iterator for the vectors "values" and "jIdx"
@@ -69,6 +69,13 @@ SparseMatrix2D::SparseMatrix2D(std::vector<SparseElement> &_elements, int _Nelem
 			++i;
 		}
 	}
+
+	// Remove the space of the zero values
+	if (i<(int)ln)
+	{
+		values.resize(i);
+		jIdx.resize(i);
+	}
 }
 
 /*
@@ -125,30 +132,28 @@ SparseMatrix2D &SparseMatrix2D::operator =(const SparseMatrix2D &X)
 /**
  * It computes y <- this*x
  */
-void SparseMatrix2D::multMv(double* x, double* y)
+void SparseMatrix2D::multMv(const double* x, double* y) const
 {
-	int col, rowEnd, rowBeg;
-	double val;
 	memset(y,0,N*sizeof(double));
 
-	size_t nnz=XSIZE(values);
-    for(int i = 0; i< N; i++)
-    {
-    	// We get the gap where are the elements of the row i in value's vector
-		rowBeg = DIRECT_MULTIDIM_ELEM(iIdx,i) -1;
-		if( i != N-1 )
-			rowEnd = DIRECT_MULTIDIM_ELEM(iIdx,i+1) -1;
-		else
-			rowEnd = nnz;
+	// The rows are visited backwards so that the end of each row is the
+	// beginning of the next non-empty one (empty rows have iIdx=0)
+	int rowEnd = XSIZE(values);
+	for(int i = N-1; i >= 0; i--)
+	{
+		int rowBeg = DIRECT_MULTIDIM_ELEM(iIdx,i) -1;
+		if (rowBeg < 0)
+			continue;
 
-		val = 0.0;
+		double val = 0.0;
 		for(int j = rowBeg; j < rowEnd ; j++)
 		{
-			col = DIRECT_MULTIDIM_ELEM(jIdx,j) -1;// Column with a nonzero element in this row of the matrix
+			int col = DIRECT_MULTIDIM_ELEM(jIdx,j) -1;// Column with a nonzero element in this row of the matrix
 			val += DIRECT_MULTIDIM_ELEM(values,j) * x[col];
 		}
 		y[i] = val;
-    }
+		rowEnd = rowBeg;
+	}
 }
 
 /*
@@ -295,3 +300,142 @@ void SparseMatrix2D::loadMatrix(const FileName &fn)
 	sparseMatrix2DFromVector(elems);
 }
 
+
+/* Sparse eigenvectors ---------------------------------------------------- */
+// Orthogonalize the vector w (length N) with respect to the rows 0 to k-1 of V.
+// If h is not NULL, the projections of w are stored in h.
+static void orthogonalizeToRows(const Matrix2D<double> &V, size_t k, double *w, double *h)
+{
+	size_t N=MAT_XSIZE(V);
+	for (size_t i=0; i<k; ++i)
+	{
+		const double *ptrV=&MAT_ELEM(V,i,0);
+		double dot=0;
+		for (size_t n=0; n<N; ++n)
+			dot+=ptrV[n]*w[n];
+		for (size_t n=0; n<N; ++n)
+			w[n]-=dot*ptrV[n];
+		if (h!=NULL)
+			h[i]=dot;
+	}
+}
+
+void firstEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P,
+               size_t krylovSize, double tol, int maxRestarts)
+{
+	size_t N=A.nrows();
+	M=XMIPP_MIN(M,N);
+	if (M==0)
+		REPORT_ERROR(ERR_VALUE_INCORRECT,"firstEigs: no eigenvectors requested");
+
+	// Number of Ritz vectors kept at each restart and size of the Krylov space
+	size_t Nkeep=XMIPP_MIN(M+XMIPP_MAX(M,(size_t)10),N);
+	size_t m=krylovSize;
+	if (m==0)
+		m=2*Nkeep+20;
+	m=XMIPP_MIN(XMIPP_MAX(m,Nkeep+1),N);
+	Nkeep=XMIPP_MIN(Nkeep,m-1);
+
+	// Basis of the Krylov space (by rows) and projection of A onto it
+	Matrix2D<double> V(m+1,N), H(m,m), S;
+	Matrix1D<double> theta, w(N), h(m+1);
+	double *ptrW=MATRIX1D_ARRAY(w);
+
+	// Random starting vector
+	FOR_ALL_ELEMENTS_IN_MATRIX1D(w)
+		VEC_ELEM(w,i)=rnd_gaus();
+	double beta=w.module();
+	for (size_t n=0; n<N; ++n)
+		MAT_ELEM(V,0,n)=ptrW[n]/beta;
+
+	size_t j0=0, mEff=m;
+	bool converged=false;
+	for (int restart=0; !converged; ++restart)
+	{
+		// Extend the basis up to m vectors. H is built explicitly from the products,
+		// so that the arrowhead structure after a restart needs no special treatment
+		mEff=m;
+		for (size_t j=j0; j<m; ++j)
+		{
+			A.multMv(&MAT_ELEM(V,j,0),ptrW);
+			orthogonalizeToRows(V,j+1,ptrW,MATRIX1D_ARRAY(h));
+			for (size_t i=0; i<=j; ++i)
+				MAT_ELEM(H,i,j)=MAT_ELEM(H,j,i)=VEC_ELEM(h,i);
+			orthogonalizeToRows(V,j+1,ptrW,NULL); // Second pass for numerical stability
+			beta=w.module();
+			if (beta<1e-12*XMIPP_MAX(fabs(MAT_ELEM(H,j,j)),1.0))
+			{
+				// Invariant subspace, the Ritz values are exact
+				mEff=j+1;
+				break;
+			}
+			for (size_t n=0; n<N; ++n)
+				MAT_ELEM(V,j+1,n)=ptrW[n]/beta;
+		}
+
+		// Ritz values and vectors
+		Matrix2D<double> Hm(mEff,mEff);
+		for (size_t i=0; i<mEff; ++i)
+			memcpy(&MAT_ELEM(Hm,i,0),&MAT_ELEM(H,i,0),mEff*sizeof(double));
+		size_t Nritz=(mEff<m || mEff==N) ? XMIPP_MIN(M,mEff) : Nkeep;
+		firstEigs(Hm,Nritz,theta,S);
+
+		// Convergence: the residual of the i-th Ritz vector is beta*|S(mEff-1,i)|
+		double thetaMax=XMIPP_MAX(fabs(VEC_ELEM(theta,0)),1e-300);
+		converged=mEff<m || mEff==N;
+		if (!converged)
+		{
+			converged=true;
+			for (size_t i=0; i<M; ++i)
+				if (beta*fabs(MAT_ELEM(S,mEff-1,i))>tol*thetaMax)
+				{
+					converged=false;
+					break;
+				}
+		}
+		if (!converged && restart>=maxRestarts)
+		{
+			std::cerr << "Warning: firstEigs did not converge after " << maxRestarts
+			<< " restarts, the eigenvectors are not accurate" << std::endl;
+			converged=true;
+		}
+
+		// Ritz vectors
+		Matrix2D<double> Y(Nritz,N);
+		for (size_t i=0; i<Nritz; ++i)
+		{
+			double *ptrY=&MAT_ELEM(Y,i,0);
+			for (size_t l=0; l<mEff; ++l)
+			{
+				double s=MAT_ELEM(S,l,i);
+				const double *ptrV=&MAT_ELEM(V,l,0);
+				for (size_t n=0; n<N; ++n)
+					ptrY[n]+=s*ptrV[n];
+			}
+		}
+
+		if (converged)
+		{
+			// If the invariant subspace is smaller than M, the missing vectors are 0
+			D.initZeros(M);
+			P.initZeros(N,M);
+			for (size_t i=0; i<Nritz && i<M; ++i)
+			{
+				VEC_ELEM(D,i)=VEC_ELEM(theta,i);
+				for (size_t n=0; n<N; ++n)
+					MAT_ELEM(P,n,i)=MAT_ELEM(Y,i,n);
+			}
+		}
+		else
+		{
+			// Thick restart: the basis starts with the Ritz vectors followed by the last residual
+			for (size_t i=0; i<Nkeep; ++i)
+				memcpy(&MAT_ELEM(V,i,0),&MAT_ELEM(Y,i,0),N*sizeof(double));
+			memcpy(&MAT_ELEM(V,Nkeep,0),&MAT_ELEM(V,m,0),N*sizeof(double));
+			H.initZeros();
+			for (size_t i=0; i<Nkeep; ++i)
+				MAT_ELEM(H,i,i)=VEC_ELEM(theta,i);
+			j0=Nkeep;
+		}
+	}
+}
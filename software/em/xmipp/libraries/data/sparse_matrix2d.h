@@ -103,7 +103,7 @@ public:
     /** Computes y=this*x
      * y and x are vectors of size Nx1
      */
-    void multMv(double* x, double* y);
+    void multMv(const double* x, double* y) const;
 
     /// Computes Y=this*X
     void multMM(const SparseMatrix2D &X, SparseMatrix2D &Y);
@@ -134,6 +134,21 @@ public:
      */
     void loadMatrix(const FileName &fn);
 };
+
+/** First eigenvectors of a real, symmetric, sparse matrix.
+ * Solves the problem Av=dv. Only the eigenvectors of the largest M eigenvalues
+ * are returned as columns of P (sorted by decreasing eigenvalue, as firstEigs).
+ * The matrix is only accessed through products with vectors, so that the memory
+ * is proportional to the number of non-zero elements plus N*krylovSize.
+ * The method is a Lanczos iteration with full reorthogonalization and thick
+ * restarts (Wu and Simon, SIAM J. Matrix Anal. Appl. 22:602-616 (2000)).
+ * krylovSize=0 selects a default size from M. The iterations stop when the
+ * residual of all eigenvectors is below tol times the largest eigenvalue, or
+ * after maxRestarts restarts. In the latter case a warning is shown and the
+ * current approximation is returned.
+ */
+void firstEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P,
+               size_t krylovSize=0, double tol=1e-10, int maxRestarts=200);
 //@}
 
 #endif /* SPARSE_MATRIX2D_H_ */
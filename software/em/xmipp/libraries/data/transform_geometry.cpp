@@ -73,6 +73,7 @@ void ProgTransformGeometry::defineParams()
     addParamsLine("                                    : and the alignment information is stored in metadata");
     addParamsLine("[--dont_wrap]                       : By default, the image/volume is wrapped");
     addParamsLine("[--write_matrix]                    : Print transformation matrix to screen");
+    addParamsLine("[--thr <N=1>]                       : Number of threads for transforming volumes");
     //examples
     addExampleLine("Write a metadata with geometrical transformations keeping the reference to original images:", false);
     addExampleLine("xmipp_transform_geometry -i mD1.xmd --shift 2 3 4 --scale 1.2 --rotate 23 -o newGeo.xmd");
@@ -101,6 +102,7 @@ void ProgTransformGeometry::readParams()
     else if (degree == "linear")
         splineDegree = LINEAR;
     flip = checkParam("--flip");
+    Nthreads = getIntParam("--thr");
 
     /** In most cases output "-o" is a metadata with the new geometry keeping the names of input images
      *  so we set the flags to keep the same image names in the output metadata
@@ -225,7 +227,7 @@ void ProgTransformGeometry::processImage(const FileName &fnImg, const FileName &
         imgOut.setDatatype(img.getDatatype());
         imgOut().resize(1, zdimOut, ydimOut, xdimOut, false);
         imgOut().setXmippOrigin();
-        applyGeometry(splineDegree, imgOut(), img(), T, IS_NOT_INV, wrap, 0.);
+        applyGeometry(splineDegree, imgOut(), img(), T, IS_NOT_INV, wrap, 0., Nthreads);
         imgOut.write(fnImgOut);
         rowOut.resetGeo(false);
     }
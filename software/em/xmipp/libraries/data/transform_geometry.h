@@ -43,7 +43,7 @@ public:
     ~ProgTransformGeometry();
 
 protected:
-    int             splineDegree, dim;
+    int             splineDegree, dim, Nthreads;
     bool            applyTransform, inverse, wrap, isVol, flip, mdVol;
     Matrix2D<double> R, A, B, T;
     ImageGeneric img, imgOut;
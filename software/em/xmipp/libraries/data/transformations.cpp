@@ -487,7 +487,8 @@ void applyGeometry(int SplineDegree,
                    MultidimArray< std::complex<double> >& V2,
                    const MultidimArray< std::complex<double> >& V1,
                    const Matrix2D< double > &A, bool inv,
-                   bool wrap, std::complex<double> outside, MultidimArray<double> *BcoeffsPtr)
+                   bool wrap, std::complex<double> outside, MultidimArray<double> *BcoeffsPtr,
+                   int Nthreads)
 {
 
     if (SplineDegree > 1)
@@ -503,8 +504,8 @@ void applyGeometry(int SplineDegree,
         Complex2RealImag(MULTIDIM_ARRAY(oneImg),
                          MULTIDIM_ARRAY(re), MULTIDIM_ARRAY(im),
                          MULTIDIM_SIZE(oneImg));
-        applyGeometry(SplineDegree, rotre, re, A, inv, wrap, outre);
-        applyGeometry(SplineDegree, rotim, im, A, inv, wrap, outim);
+        applyGeometry(SplineDegree, rotre, re, A, inv, wrap, outre, (MultidimArray<double> *)NULL, Nthreads);
+        applyGeometry(SplineDegree, rotim, im, A, inv, wrap, outim, (MultidimArray<double> *)NULL, Nthreads);
         V2.resize(oneImg);
         RealImag2Complex(MULTIDIM_ARRAY(rotre), MULTIDIM_ARRAY(rotim),
                          MULTIDIM_ARRAY(V2), MULTIDIM_SIZE(re));
@@ -531,9 +532,9 @@ void applyGeometry(int SplineDegree,
                    MultidimArrayGeneric &V2,
                    const MultidimArrayGeneric &V1,
                    const Matrix2D< double > &A, bool inv,
-                   bool wrap, double outside)
+                   bool wrap, double outside, int Nthreads)
 {
-#define APPLYGEO(type)  applyGeometry(SplineDegree,(*(MultidimArray<type>*)(V2.im)), (*(MultidimArray<type>*)(V1.im)), A, inv, wrap, (type) outside);
+#define APPLYGEO(type)  applyGeometry(SplineDegree,(*(MultidimArray<type>*)(V2.im)), (*(MultidimArray<type>*)(V1.im)), A, inv, wrap, (type) outside, (MultidimArray<double> *)NULL, Nthreads);
     SWITCHDATATYPE(V1.datatype, APPLYGEO)
 #undef APPLYGEO
 
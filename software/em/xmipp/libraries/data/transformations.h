@@ -37,6 +37,7 @@
 #include "multidim_array_generic.h"
 #include "geometry.h"
 #include "metadata.h"
+#include "xmipp_threads.h"
 #define IS_INV true
 #define IS_NOT_INV false
 #define DONT_WRAP false
@@ -201,6 +202,268 @@ void scale3DMatrix(const Matrix1D< double >& sc, Matrix2D< double > &m,
 #define BSPLINE3 3
 #define BSPLINE4 4
 
+/** Data shared by the threads applying a 3D geometrical transformation.
+ * @ingroup GeometricalTransformations
+ */
+template<typename T1,typename T>
+class ApplyGeometry3DData
+{
+public:
+    int SplineDegree;
+    MultidimArray<T> *V2;
+    const MultidimArray<T1> *V1;
+    // Matrix from output to input coordinates
+    const Matrix2D<double> *Aref;
+    // B-spline coefficients of V1 (only for SplineDegree>1)
+    const MultidimArray<double> *Bcoeffs;
+    bool wrap;
+    T outside;
+    ThreadTaskDistributor *td;
+};
+
+/** Apply a 3D geometrical transformation to the slices k0 to kF of the output volume.
+ * @ingroup GeometricalTransformations
+ *
+ * This is the kernel of the 3D applyGeometry. Different slices can be
+ * processed simultaneously by different threads.
+ */
+template<typename T1,typename T>
+void applyGeometry3DSlices(const ApplyGeometry3DData<T1,T> &data, size_t k0, size_t kF)
+{
+    int SplineDegree=data.SplineDegree;
+    MultidimArray<T> &V2=*data.V2;
+    const MultidimArray<T1> &V1=*data.V1;
+    const Matrix2D<double> &Aref=*data.Aref;
+    const MultidimArray<double> *Bcoeffs=data.Bcoeffs;
+    bool wrap=data.wrap;
+    T outside=data.outside;
+
+    size_t m1, n1, o1, m2, n2, o2;
+    double x, y, z, xp, yp, zp;
+    double wx, wy, wz;
+    double Aref00=MAT_ELEM(Aref,0,0);
+    double Aref10=MAT_ELEM(Aref,1,0);
+    double Aref20=MAT_ELEM(Aref,2,0);
+
+    // Find center of MultidimArray
+    double cen_z = (int)(V2.zdim / 2);
+    double cen_y = (int)(V2.ydim / 2);
+    double cen_x = (int)(V2.xdim / 2);
+    double cen_zp = (int)(V1.zdim / 2);
+    double cen_yp = (int)(V1.ydim / 2);
+    double cen_xp = (int)(V1.xdim / 2);
+    double minxp = -cen_xp;
+    double minyp = -cen_yp;
+    double minzp = -cen_zp;
+    double maxxp = V1.xdim - cen_xp - 1;
+    double maxyp = V1.ydim - cen_yp - 1;
+    double maxzp = V1.zdim - cen_zp - 1;
+
+    // Now we go from the output MultidimArray to the input MultidimArray, ie, for any
+    // voxel in the output MultidimArray we calculate which are the corresponding
+    // ones in the original MultidimArray, make an interpolation with them and put
+    // this value at the output voxel
+
+    // V2 is not initialised to 0 because all its pixels are rewritten
+    for (size_t k = k0; k <= kF; k++)
+        for (size_t i = 0; i < V2.ydim; i++)
+        {
+            // Calculate position of the beginning of the row in the output
+            // MultidimArray
+            x = -cen_x;
+            y = i - cen_y;
+            z = k - cen_z;
+
+            // Calculate this position in the input image according to the
+            // geometrical transformation they are related by
+            // coords_output(=x,y) = A * coords_input (=xp,yp)
+            xp = x * MAT_ELEM(Aref, 0, 0) + y * MAT_ELEM(Aref, 0, 1) + z * MAT_ELEM(Aref, 0, 2) + MAT_ELEM(Aref, 0, 3);
+            yp = x * MAT_ELEM(Aref, 1, 0) + y * MAT_ELEM(Aref, 1, 1) + z * MAT_ELEM(Aref, 1, 2) + MAT_ELEM(Aref, 1, 3);
+            zp = x * MAT_ELEM(Aref, 2, 0) + y * MAT_ELEM(Aref, 2, 1) + z * MAT_ELEM(Aref, 2, 2) + MAT_ELEM(Aref, 2, 3);
+
+            for (size_t j = 0; j < V2.xdim; j++)
+            {
+                bool interp;
+                double tmp;
+
+#ifdef DEBUG
+
+                bool show_debug = false;
+                if ((i == 0 && j == 0 && k == 0) ||
+                    (i == V2.ydim - 1 && j == V2.xdim - 1 && k == V2.zdim - 1))
+                    show_debug = true;
+
+                if (show_debug)
+                    std::cout << "(x,y,z)-->(xp,yp,zp)= "
+                    << "(" << x  << "," << y  << "," << z  << ") "
+                    << "(" << xp << "," << yp << "," << zp << ")\n";
+#endif
+
+                // If the point is outside the volume, apply a periodic
+                // extension of the volume, what exits by one side enters by
+                // the other
+                interp  = true;
+                bool x_isOut = XMIPP_RANGE_OUTSIDE(xp, minxp, maxxp);
+                bool y_isOut = XMIPP_RANGE_OUTSIDE(yp, minyp, maxyp);
+                bool z_isOut = XMIPP_RANGE_OUTSIDE(zp, minzp, maxzp);
+
+                if (wrap)
+                {
+                    if (x_isOut)
+                        xp = realWRAP(xp, minxp - 0.5, maxxp + 0.5);
+
+                    if (y_isOut)
+                        yp = realWRAP(yp, minyp - 0.5, maxyp + 0.5);
+
+                    if (z_isOut)
+                        zp = realWRAP(zp, minzp - 0.5, maxzp + 0.5);
+                }
+                else if (x_isOut || y_isOut || z_isOut)
+                    interp = false;
+
+                if (interp)
+                {
+                    if (SplineDegree == 1)
+                    {
+                        // Linear interpolation
+
+                        // Calculate the integer position in input volume, be
+                        // careful that it is not the nearest but the one at the
+                        // top left corner of the interpolation square. Ie,
+                        // (0.7,0.7) would give (0,0)
+                        // Calculate also weights for point m1+1,n1+1
+                        wx = xp + cen_xp;
+                        m1 = (int) wx;
+                        wx = wx - m1;
+                        m2 = m1 + 1;
+                        wy = yp + cen_yp;
+                        n1 = (int) wy;
+                        wy = wy - n1;
+                        n2 = n1 + 1;
+                        wz = zp + cen_zp;
+                        o1 = (int) wz;
+                        wz = wz - o1;
+                        o2 = o1 + 1;
+
+#ifdef DEBUG
+
+                        if (show_debug)
+                        {
+                            std::cout << "After wrapping(xp,yp,zp)= "
+                            << "(" << xp << "," << yp << "," << zp << ")\n";
+                            std::cout << "(m1,n1,o1)-->(m2,n2,o2)="
+                            << "(" << m1 << "," << n1 << "," << o1 << ") "
+                            << "(" << m2 << "," << n2 << "," << o2 << ")\n";
+                            std::cout << "(wx,wy,wz)="
+                            << "(" << wx << "," << wy << "," << wz << ")\n";
+                        }
+#endif
+
+                        // Perform interpolation
+                        // if wx == 0 means that the rightest point is useless for
+                        // this interpolation, and even it might not be defined if
+                        // m1=xdim-1
+                        // The same can be said for wy.
+                        double wx_1=1-wx;
+                        double wy_1=1-wy;
+                        double wz_1=1-wz;
+
+                        double aux1=wz_1 * wy_1;
+                        double aux2=aux1*wx_1;
+                        tmp  =  aux2 * DIRECT_A3D_ELEM(V1, o1, n1, m1);
+
+                        if (wx != 0 && m2 < V1.xdim)
+                            tmp += (aux1-aux2)* DIRECT_A3D_ELEM(V1, o1, n1, m2);
+
+                        if (wy != 0 && n2 < V1.ydim)
+                        {
+                            aux1=wz_1 * wy;
+                            aux2=aux1*wx_1;
+                            tmp += aux2 * DIRECT_A3D_ELEM(V1, o1, n2, m1);
+                            if (wx != 0 && m2 < V1.xdim)
+                                tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o1, n2, m2);
+                        }
+
+                        if (wz != 0 && o2 < V1.zdim)
+                        {
+                            aux1=wz * wy_1;
+                            aux2=aux1*wx_1;
+                            tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n1, m1);
+                            if (wx != 0 && m2 < V1.xdim)
+                                tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n1, m2);
+                            if (wy != 0 && n2 < V1.ydim)
+                            {
+                                aux1=wz * wy;
+                                aux2=aux1*wx_1;
+                                tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n2, m1);
+                                if (wx != 0 && m2 < V1.xdim)
+                                    tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n2, m2);
+                            }
+                        }
+
+#ifdef DEBUG
+                        if (show_debug)
+                            std::cout <<
+                            "tmp1=" << DIRECT_A3D_ELEM(V1, o1, n1, m1) << " "
+                            << (T)(wz_1 *wy_1 *wx_1 * DIRECT_A3D_ELEM(V1, o1, n1, m1))
+                            << std::endl <<
+                            "tmp2=" << DIRECT_A3D_ELEM(V1, o1, n1, m2) << " "
+                            << (T)(wz_1 *wy_1 * wx * DIRECT_A3D_ELEM(V1, o1, n1, m2))
+                            << std::endl <<
+                            "tmp3=" << DIRECT_A3D_ELEM(V1, o1, n2, m1) << " "
+                            << (T)(wz_1 * wy *wx_1 * DIRECT_A3D_ELEM(V1, o1, n2, m1))
+                            << std::endl <<
+                            "tmp4=" << DIRECT_A3D_ELEM(V1, o1, n2, m2) << " "
+                            << (T)(wz_1 * wy * wx * DIRECT_A3D_ELEM(V1, o2, n1, m1))
+                            << std::endl <<
+                            "tmp6=" << DIRECT_A3D_ELEM(V1, o2, n1, m2) << " "
+                            << (T)(wz * wy_1 * wx * DIRECT_A3D_ELEM(V1, o2, n1, m2))
+                            << std::endl <<
+                            "tmp7=" << DIRECT_A3D_ELEM(V1, o2, n2, m1) << " "
+                            << (T)(wz * wy *wx_1 * DIRECT_A3D_ELEM(V1, o2, n2, m1))
+                            << std::endl <<
+                            "tmp8=" << DIRECT_A3D_ELEM(V1, o2, n2, m2) << " "
+                            << (T)(wz * wy * wx * DIRECT_A3D_ELEM(V1, o2, n2, m2))
+                            << std::endl <<
+                            "tmp= " << tmp << std::endl;
+#endif
+
+                        dAkij(V2 , k, i, j) = (T)tmp;
+                    }
+                    else if (SplineDegree==0)
+						{
+							dAkij(V2, k, i, j)=(T)A3D_ELEM(V1,(int)trunc(zp),(int)trunc(yp),(int)trunc(xp));
+						}
+                    else
+                    {
+                        // B-spline interpolation
+                        dAkij(V2, k, i, j) =
+                            (T) Bcoeffs->interpolatedElementBSpline3D(xp, yp, zp, SplineDegree);
+                    }
+                }
+                else
+                    dAkij(V2, k, i, j) = outside;
+
+                // Compute new point inside input image
+                xp += Aref00;
+                yp += Aref10;
+                zp += Aref20;
+            }
+        }
+}
+
+/** Thread function for the 3D applyGeometry.
+ * @ingroup GeometricalTransformations
+ */
+template<typename T1,typename T>
+void threadApplyGeometry3D(ThreadArgument &thArg)
+{
+    const ApplyGeometry3DData<T1,T> &data=*((ApplyGeometry3DData<T1,T> *)thArg.workClass);
+    size_t first, last;
+    while (data.td->getTasks(first, last))
+        applyGeometry3DSlices(data, first, last);
+}
+
 /** Applies a geometrical transformation.
  * @ingroup GeometricalTransformations
  *
@@ -268,6 +531,10 @@ void scale3DMatrix(const Matrix1D< double >& sc, Matrix2D< double > &m,
  *
  * Although you can also use the constants IS_INV, or WRAP.
  *
+ * The slices of 3D transformations are shared among Nthreads threads. By
+ * default only one thread is used, callers that already run several
+ * transformations in parallel should leave it to 1.
+ *
  * @code
  * Matrix2D< double > A(4,4);
  * A.initIdentity;
@@ -279,7 +546,8 @@ void applyGeometry(int SplineDegree,
                    MultidimArray<T>& V2,
                    const MultidimArray<T1>& V1,
                    const Matrix2D< double > &A, bool inv,
-                   bool wrap, T outside = 0, MultidimArray<double> *BcoeffsPtr=NULL)
+                   bool wrap, T outside = 0, MultidimArray<double> *BcoeffsPtr=NULL,
+                   int Nthreads=1)
 {
 #ifndef RELEASE_MODE
     if (&V1 == (MultidimArray<T1>*)&V2)
@@ -555,39 +823,18 @@ void applyGeometry(int SplineDegree,
     else
     {
         // 3D transformation
-    	size_t m1, n1, o1, m2, n2, o2;
-        double x, y, z, xp, yp, zp;
-        double minxp, minyp, maxxp, maxyp, minzp, maxzp;
-        double cen_x, cen_y, cen_z, cen_xp, cen_yp, cen_zp;
-        double wx, wy, wz;
-        double Aref00=MAT_ELEM(Aref,0,0);
-        double Aref10=MAT_ELEM(Aref,1,0);
-        double Aref20=MAT_ELEM(Aref,2,0);
-
-        // Find center of MultidimArray
-        cen_z = (int)(V2.zdim / 2);
-        cen_y = (int)(V2.ydim / 2);
-        cen_x = (int)(V2.xdim / 2);
-        cen_zp = (int)(V1.zdim / 2);
-        cen_yp = (int)(V1.ydim / 2);
-        cen_xp = (int)(V1.xdim / 2);
-        minxp = -cen_xp;
-        minyp = -cen_yp;
-        minzp = -cen_zp;
-        maxxp = V1.xdim - cen_xp - 1;
-        maxyp = V1.ydim - cen_yp - 1;
-        maxzp = V1.zdim - cen_zp - 1;
+        double minxp = -(int)(V1.xdim / 2);
+        double minyp = -(int)(V1.ydim / 2);
+        double minzp = -(int)(V1.zdim / 2);
 
 #ifdef DEBUG
 
         std::cout << "Geometry 2 center=("
-        << cen_z  << "," << cen_y  << "," << cen_x  << ")\n"
+        << (int)(V2.zdim / 2)  << "," << (int)(V2.ydim / 2)  << "," << (int)(V2.xdim / 2)  << ")\n"
         << "Geometry 1 center=("
-        << cen_zp << "," << cen_yp << "," << cen_xp << ")\n"
+        << -minzp << "," << -minyp << "," << -minxp << ")\n"
         << "           min=("
         << minzp  << "," << minyp  << "," << minxp  << ")\n"
-        << "           max=("
-        << maxzp  << "," << maxyp  << "," << maxxp  << ")\n"
         ;
 #endif
 
@@ -606,197 +853,28 @@ void applyGeometry(int SplineDegree,
             STARTINGZ(*BcoeffsToUse) = (int) minzp;
         }
 
-        // Now we go from the output MultidimArray to the input MultidimArray, ie, for any
-        // voxel in the output MultidimArray we calculate which are the corresponding
-        // ones in the original MultidimArray, make an interpolation with them and put
-        // this value at the output voxel
-
-        // V2 is not initialised to 0 because all its pixels are rewritten
-        for (size_t k = 0; k < V2.zdim; k++)
-            for (size_t i = 0; i < V2.ydim; i++)
-            {
-                // Calculate position of the beginning of the row in the output
-                // MultidimArray
-                x = -cen_x;
-                y = i - cen_y;
-                z = k - cen_z;
-
-                // Calculate this position in the input image according to the
-                // geometrical transformation they are related by
-                // coords_output(=x,y) = A * coords_input (=xp,yp)
-                xp = x * MAT_ELEM(Aref, 0, 0) + y * MAT_ELEM(Aref, 0, 1) + z * MAT_ELEM(Aref, 0, 2) + MAT_ELEM(Aref, 0, 3);
-                yp = x * MAT_ELEM(Aref, 1, 0) + y * MAT_ELEM(Aref, 1, 1) + z * MAT_ELEM(Aref, 1, 2) + MAT_ELEM(Aref, 1, 3);
-                zp = x * MAT_ELEM(Aref, 2, 0) + y * MAT_ELEM(Aref, 2, 1) + z * MAT_ELEM(Aref, 2, 2) + MAT_ELEM(Aref, 2, 3);
-
-                for (size_t j = 0; j < V2.xdim; j++)
-                {
-                    bool interp;
-                    double tmp;
-
-#ifdef DEBUG
-
-                    bool show_debug = false;
-                    if ((i == 0 && j == 0 && k == 0) ||
-                        (i == V2.ydim - 1 && j == V2.xdim - 1 && k == V2.zdim - 1))
-                        show_debug = true;
-
-                    if (show_debug)
-                        std::cout << "(x,y,z)-->(xp,yp,zp)= "
-                        << "(" << x  << "," << y  << "," << z  << ") "
-                        << "(" << xp << "," << yp << "," << zp << ")\n";
-#endif
-
-                    // If the point is outside the volume, apply a periodic
-                    // extension of the volume, what exits by one side enters by
-                    // the other
-                    interp  = true;
-                    bool x_isOut = XMIPP_RANGE_OUTSIDE(xp, minxp, maxxp);
-                    bool y_isOut = XMIPP_RANGE_OUTSIDE(yp, minyp, maxyp);
-                    bool z_isOut = XMIPP_RANGE_OUTSIDE(zp, minzp, maxzp);
-
-                    if (wrap)
-                    {
-                        if (x_isOut)
-                            xp = realWRAP(xp, minxp - 0.5, maxxp + 0.5);
-
-                        if (y_isOut)
-                            yp = realWRAP(yp, minyp - 0.5, maxyp + 0.5);
-
-                        if (z_isOut)
-                            zp = realWRAP(zp, minzp - 0.5, maxzp + 0.5);
-                    }
-                    else if (x_isOut || y_isOut || z_isOut)
-                        interp = false;
-
-                    if (interp)
-                    {
-                        if (SplineDegree == 1)
-                        {
-                            // Linear interpolation
-
-                            // Calculate the integer position in input volume, be
-                            // careful that it is not the nearest but the one at the
-                            // top left corner of the interpolation square. Ie,
-                            // (0.7,0.7) would give (0,0)
-                            // Calculate also weights for point m1+1,n1+1
-                            wx = xp + cen_xp;
-                            m1 = (int) wx;
-                            wx = wx - m1;
-                            m2 = m1 + 1;
-                            wy = yp + cen_yp;
-                            n1 = (int) wy;
-                            wy = wy - n1;
-                            n2 = n1 + 1;
-                            wz = zp + cen_zp;
-                            o1 = (int) wz;
-                            wz = wz - o1;
-                            o2 = o1 + 1;
-
-#ifdef DEBUG
-
-                            if (show_debug)
-                            {
-                                std::cout << "After wrapping(xp,yp,zp)= "
-                                << "(" << xp << "," << yp << "," << zp << ")\n";
-                                std::cout << "(m1,n1,o1)-->(m2,n2,o2)="
-                                << "(" << m1 << "," << n1 << "," << o1 << ") "
-                                << "(" << m2 << "," << n2 << "," << o2 << ")\n";
-                                std::cout << "(wx,wy,wz)="
-                                << "(" << wx << "," << wy << "," << wz << ")\n";
-                            }
-#endif
-
-                            // Perform interpolation
-                            // if wx == 0 means that the rightest point is useless for
-                            // this interpolation, and even it might not be defined if
-                            // m1=xdim-1
-                            // The same can be said for wy.
-                            double wx_1=1-wx;
-                            double wy_1=1-wy;
-                            double wz_1=1-wz;
-
-                            double aux1=wz_1 * wy_1;
-                            double aux2=aux1*wx_1;
-                            tmp  =  aux2 * DIRECT_A3D_ELEM(V1, o1, n1, m1);
-
-                            if (wx != 0 && m2 < V1.xdim)
-                                tmp += (aux1-aux2)* DIRECT_A3D_ELEM(V1, o1, n1, m2);
-
-                            if (wy != 0 && n2 < V1.ydim)
-                            {
-                                aux1=wz_1 * wy;
-                                aux2=aux1*wx_1;
-                                tmp += aux2 * DIRECT_A3D_ELEM(V1, o1, n2, m1);
-                                if (wx != 0 && m2 < V1.xdim)
-                                    tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o1, n2, m2);
-                            }
-
-                            if (wz != 0 && o2 < V1.zdim)
-                            {
-                                aux1=wz * wy_1;
-                                aux2=aux1*wx_1;
-                                tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n1, m1);
-                                if (wx != 0 && m2 < V1.xdim)
-                                    tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n1, m2);
-                                if (wy != 0 && n2 < V1.ydim)
-                                {
-                                    aux1=wz * wy;
-                                    aux2=aux1*wx_1;
-                                    tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n2, m1);
-                                    if (wx != 0 && m2 < V1.xdim)
-                                        tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n2, m2);
-                                }
-                            }
-
-#ifdef DEBUG
-                            if (show_debug)
-                                std::cout <<
-                                "tmp1=" << DIRECT_A3D_ELEM(V1, o1, n1, m1) << " "
-                                << (T)(wz_1 *wy_1 *wx_1 * DIRECT_A3D_ELEM(V1, o1, n1, m1))
-                                << std::endl <<
-                                "tmp2=" << DIRECT_A3D_ELEM(V1, o1, n1, m2) << " "
-                                << (T)(wz_1 *wy_1 * wx * DIRECT_A3D_ELEM(V1, o1, n1, m2))
-                                << std::endl <<
-                                "tmp3=" << DIRECT_A3D_ELEM(V1, o1, n2, m1) << " "
-                                << (T)(wz_1 * wy *wx_1 * DIRECT_A3D_ELEM(V1, o1, n2, m1))
-                                << std::endl <<
-                                "tmp4=" << DIRECT_A3D_ELEM(V1, o1, n2, m2) << " "
-                                << (T)(wz_1 * wy * wx * DIRECT_A3D_ELEM(V1, o2, n1, m1))
-                                << std::endl <<
-                                "tmp6=" << DIRECT_A3D_ELEM(V1, o2, n1, m2) << " "
-                                << (T)(wz * wy_1 * wx * DIRECT_A3D_ELEM(V1, o2, n1, m2))
-                                << std::endl <<
-                                "tmp7=" << DIRECT_A3D_ELEM(V1, o2, n2, m1) << " "
-                                << (T)(wz * wy *wx_1 * DIRECT_A3D_ELEM(V1, o2, n2, m1))
-                                << std::endl <<
-                                "tmp8=" << DIRECT_A3D_ELEM(V1, o2, n2, m2) << " "
-                                << (T)(wz * wy * wx * DIRECT_A3D_ELEM(V1, o2, n2, m2))
-                                << std::endl <<
-                                "tmp= " << tmp << std::endl;
-#endif
-
-                            dAkij(V2 , k, i, j) = (T)tmp;
-                        }
-                        else if (SplineDegree==0)
-						{
-							dAkij(V2, k, i, j)=(T)A3D_ELEM(V1,(int)trunc(zp),(int)trunc(yp),(int)trunc(xp));
-						}
-                        else
-                        {
-                            // B-spline interpolation
-                            dAkij(V2, k, i, j) =
-                                (T) BcoeffsToUse->interpolatedElementBSpline3D(xp, yp, zp, SplineDegree);
-                        }
-                    }
-                    else
-                        dAkij(V2, k, i, j) = outside;
-
-                    // Compute new point inside input image
-                    xp += Aref00;
-                    yp += Aref10;
-                    zp += Aref20;
-                }
-            }
+        // The output slices are shared among the threads, the B-spline
+        // coefficients are computed only once and shared by all of them
+        ApplyGeometry3DData<T1,T> data;
+        data.SplineDegree=SplineDegree;
+        data.V2=&V2;
+        data.V1=&V1;
+        data.Aref=&Aref;
+        data.Bcoeffs=BcoeffsToUse;
+        data.wrap=wrap;
+        data.outside=outside;
+        data.td=NULL;
+
+        Nthreads=XMIPP_MIN(Nthreads,(int)V2.zdim);
+        if (Nthreads<=1 || MULTIDIM_SIZE(V2)<32768)
+            applyGeometry3DSlices(data, 0, V2.zdim-1);
+        else
+        {
+            ThreadTaskDistributor td(V2.zdim, 1);
+            data.td=&td;
+            ThreadManager thMgr(Nthreads, &data);
+            thMgr.run(threadApplyGeometry3D<T1,T>);
+        }
     }
 }
 
@@ -806,9 +884,9 @@ void applyGeometry(int SplineDegree,
                    MultidimArray<T>& V2,
                    const MultidimArrayGeneric& V1,
                    const Matrix2D< double > &A, bool inv,
-                   bool wrap, T outside = 0)
+                   bool wrap, T outside = 0, int Nthreads=1)
 {
-#define APPLYGEO(type)  applyGeometry(SplineDegree,V2, (*(MultidimArray<type>*)(V1.im)), A, inv, wrap, outside);
+#define APPLYGEO(type)  applyGeometry(SplineDegree,V2, (*(MultidimArray<type>*)(V1.im)), A, inv, wrap, outside, (MultidimArray<double> *)NULL, Nthreads);
     SWITCHDATATYPE(V1.datatype, APPLYGEO)
 #undef APPLYGEO
 }
@@ -835,7 +913,8 @@ void applyGeometry(int SplineDegree,
                    MultidimArray< std::complex<double> >& V2,
                    const MultidimArray< std::complex<double> >& V1,
                    const Matrix2D< double > &A, bool inv,
-                   bool wrap, std::complex<double> outside, MultidimArray<double> *BcoeffsPtr);
+                   bool wrap, std::complex<double> outside, MultidimArray<double> *BcoeffsPtr,
+                   int Nthreads);
 
 //Special cases for complex arrays
 template<>
@@ -849,7 +928,7 @@ void applyGeometry(int SplineDegree,
                    MultidimArrayGeneric &V2,
                    const MultidimArrayGeneric &V1,
                    const Matrix2D< double > &A, bool inv,
-                   bool wrap, double outside);
+                   bool wrap, double outside, int Nthreads=1);
 
 
 /** Produce spline coefficients.
@@ -28,6 +28,7 @@
 #include "args.h"
 #include <string.h>
 #include <pthread.h>
+#include "xmipp_threads.h"
 
 static pthread_mutex_t fftw_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
 bool	planCreated=false;
@@ -322,6 +323,143 @@ void FourierTransformer::inverseFourierTransform()
     Transform(FFTW_BACKWARD);
 }
 
+// Single precision transformer -------------------------------------------
+static bool fftwfThreadsInitialized=false;
+
+FourierTransformerFloat::FourierTransformerFloat()
+{
+    fReal=NULL;
+    fPlanForward=NULL;
+    fPlanBackward=NULL;
+    dataPtr=NULL;
+    nthreads=1;
+}
+
+FourierTransformerFloat::FourierTransformerFloat(const FourierTransformerFloat& fTransform)
+{
+    REPORT_ERROR(ERR_UNCLASSIFIED,"Fourier transformers should not be copied");
+}
+
+FourierTransformerFloat & FourierTransformerFloat::operator= (const FourierTransformerFloat & other)
+{
+    REPORT_ERROR(ERR_UNCLASSIFIED,"Fourier transformers should not be copied");
+}
+
+FourierTransformerFloat::~FourierTransformerFloat()
+{
+    clear();
+}
+
+void FourierTransformerFloat::clear()
+{
+    fFourier.clear();
+    pthread_mutex_lock(&fftw_plan_mutex);
+    if (fPlanForward !=NULL)
+        fftwf_destroy_plan(fPlanForward);
+    if (fPlanBackward!=NULL)
+        fftwf_destroy_plan(fPlanBackward);
+    pthread_mutex_unlock(&fftw_plan_mutex);
+    fReal=NULL;
+    fPlanForward=NULL;
+    fPlanBackward=NULL;
+    dataPtr=NULL;
+}
+
+void FourierTransformerFloat::setThreadsNumber(int tNumber)
+{
+    nthreads=tNumber;
+    if (nthreads>1)
+    {
+        pthread_mutex_lock(&fftw_plan_mutex);
+        if (!fftwfThreadsInitialized)
+        {
+            if (fftwf_init_threads()==0)
+            {
+                pthread_mutex_unlock(&fftw_plan_mutex);
+                REPORT_ERROR(ERR_THREADS_NOTINIT, (std::string)"FFTW cannot init threads (setThreadsNumber)");
+            }
+            fftwfThreadsInitialized=true;
+        }
+        pthread_mutex_unlock(&fftw_plan_mutex);
+    }
+}
+
+void FourierTransformerFloat::setReal(MultidimArray<float> &input)
+{
+    bool recomputePlan=fReal==NULL || dataPtr!=MULTIDIM_ARRAY(input) || !(fReal->sameShape(input));
+    fFourier.resizeNoCopy(ZSIZE(input),YSIZE(input),XSIZE(input)/2+1);
+    fReal=&input;
+
+    if (recomputePlan)
+    {
+        int ndim=3;
+        if (ZSIZE(input)==1)
+        {
+            ndim=2;
+            if (YSIZE(input)==1)
+                ndim=1;
+        }
+        int N[3];
+        switch (ndim)
+        {
+        case 1:
+            N[0]=XSIZE(input);
+            break;
+        case 2:
+            N[0]=YSIZE(input);
+            N[1]=XSIZE(input);
+            break;
+        case 3:
+            N[0]=ZSIZE(input);
+            N[1]=YSIZE(input);
+            N[2]=XSIZE(input);
+            break;
+        }
+
+        pthread_mutex_lock(&fftw_plan_mutex);
+        if (fftwfThreadsInitialized)
+            fftwf_plan_with_nthreads(nthreads);
+        if (fPlanForward!=NULL)
+            fftwf_destroy_plan(fPlanForward);
+        fPlanForward = fftwf_plan_dft_r2c(ndim, N, MULTIDIM_ARRAY(*fReal),
+                                          (fftwf_complex*) MULTIDIM_ARRAY(fFourier), FFTW_ESTIMATE);
+        if (fPlanBackward!=NULL)
+            fftwf_destroy_plan(fPlanBackward);
+        fPlanBackward = fftwf_plan_dft_c2r(ndim, N,
+                                           (fftwf_complex*) MULTIDIM_ARRAY(fFourier), MULTIDIM_ARRAY(*fReal),
+                                           FFTW_ESTIMATE);
+        pthread_mutex_unlock(&fftw_plan_mutex);
+        if (fPlanForward == NULL || fPlanBackward == NULL)
+            REPORT_ERROR(ERR_PLANS_NOCREATE, "FFTW plans cannot be created");
+        dataPtr=MULTIDIM_ARRAY(*fReal);
+    }
+}
+
+void FourierTransformerFloat::Transform(int sign)
+{
+    if (sign == FFTW_FORWARD)
+    {
+        fftwf_execute(fPlanForward);
+        float isize=1.0f/MULTIDIM_SIZE(*fReal);
+        float *ptr=(float*)MULTIDIM_ARRAY(fFourier);
+        size_t nmax=2*MULTIDIM_SIZE(fFourier);
+        for (size_t n=0; n<nmax; ++n)
+            ptr[n]*=isize;
+    }
+    else if (sign == FFTW_BACKWARD)
+        fftwf_execute(fPlanBackward);
+}
+
+void FourierTransformerFloat::FourierTransform()
+{
+    Transform(FFTW_FORWARD);
+}
+
+void FourierTransformerFloat::inverseFourierTransform()
+{
+    Transform(FFTW_BACKWARD);
+}
+
 // Inforce Hermitian symmetry ---------------------------------------------
 void FourierTransformer::enforceHermitianSymmetry()
 {
@@ -467,6 +605,212 @@ void convolutionFFT(MultidimArray<double> &img,
 
 // Fourier ring correlation -----------------------------------------------
 //#define SAVE_REAL_PART
+FourierShellIndex::FourierShellIndex()
+{
+    Xdim=Ydim=Zdim=0;
+    Nshells=0;
+    maxFreq=0.5;
+}
+
+void FourierShellIndex::initialize(size_t _Xdim, size_t _Ydim, size_t _Zdim, double _maxFreq)
+{
+    Xdim=_Xdim;
+    Ydim=_Ydim;
+    Zdim=_Zdim;
+    maxFreq=_maxFreq;
+    Nshells=Xdim/2+1;
+    int XdimFT=Xdim/2+1;
+    shell.resizeNoCopy(Zdim,Ydim,XdimFT);
+    freq.resizeNoCopy(shell);
+    count.initZeros(Nshells+1);
+
+    // Signed sizes for the negative frequencies
+    int sizeX = Xdim, sizeY = Ydim, sizeZ = Zdim;
+    int sizeZ_2 = sizeZ/2;
+    if (sizeZ_2==0)
+        sizeZ_2=1;
+    double isizeZ = 1.0/sizeZ;
+    int sizeY_2 = sizeY/2;
+    double iysize = 1.0/sizeY;
+    int sizeX_2 = sizeX/2;
+    double ixsize = 1.0/sizeX;
+    double maxFreq_2 = maxFreq * maxFreq;
+    double fx, fy, fz;
+    size_t n=0;
+    for (int k=0; k<sizeZ; k++)
+    {
+        FFT_IDX2DIGFREQ_FAST(k,sizeZ,sizeZ_2,isizeZ,fz);
+        double fz2=fz*fz;
+        for (int i=0; i<sizeY; i++)
+        {
+            FFT_IDX2DIGFREQ_FAST(i,sizeY,sizeY_2,iysize,fy);
+            double fz2_fy2=fz2 + fy*fy;
+            for (int j=0; j<XdimFT; j++, n++)
+            {
+                FFT_IDX2DIGFREQ_FAST(j,sizeX,sizeX_2,ixsize,fx);
+                double R2 =fz2_fy2 + fx*fx;
+                double R = sqrt(R2);
+                DIRECT_MULTIDIM_ELEM(freq,n) = R;
+                if (R2>maxFreq_2)
+                {
+                    DIRECT_MULTIDIM_ELEM(shell,n) = -1;
+                    continue;
+                }
+                int idx = XMIPP_MIN((int)round(R * sizeX),Nshells);
+                DIRECT_MULTIDIM_ELEM(shell,n) = idx;
+                DIRECT_A1D_ELEM(count,idx)++;
+            }
+        }
+    }
+}
+
+bool FourierShellIndex::sameSize(const MultidimArray< std::complex<double> > &FT) const
+{
+    return ZSIZE(FT)==Zdim && YSIZE(FT)==Ydim && XSIZE(FT)==(size_t)(Xdim/2+1);
+}
+
+// Accumulators of each shell
+#define SHELL_NUM 0
+#define SHELL_DEN1 1
+#define SHELL_DEN2 2
+#define SHELL_ERROR 3
+#define SHELL_DPR 4
+#define SHELL_DENDPR 5
+
+struct ShellAccumulationData
+{
+    const FourierShellIndex *shells;
+    const std::vector< const MultidimArray< std::complex<double> > * > *FT1, *FT2;
+    // Number of accumulators per shell (3 for the FSC, 6 for frc_dpr)
+    int Nfields;
+    bool dodpr;
+    double minFreq, maxFreq;
+    // Accumulators of each thread: pair, shell, field and then the R-factor numerator and denominator
+    std::vector< std::vector<double> > partial;
+    int nThreads;
+};
+
+// Accumulate the Fourier coefficients of rows r0 to rF-1 (a row is a (k,i) pair)
+static void accumulateShells(ShellAccumulationData &data, size_t r0, size_t rF, std::vector<double> &acc)
+{
+    const FourierShellIndex &shells=*data.shells;
+    size_t XdimFT=XSIZE(shells.shell);
+    size_t Nshells1=shells.Nshells+1;
+    size_t Npairs=data.FT1->size();
+    int Nfields=data.Nfields;
+    size_t Nacc=Npairs*Nshells1*Nfields;
+    acc.assign(Nacc+2,0.);
+    double &rFactorNumerator=acc[Nacc];
+    double &rFactorDenominator=acc[Nacc+1];
+    for (size_t n=r0*XdimFT; n<rF*XdimFT; ++n)
+    {
+        int idx=DIRECT_MULTIDIM_ELEM(shells.shell,n);
+        if (idx<0)
+            continue;
+        for (size_t p=0; p<Npairs; ++p)
+        {
+            double *accShell=&acc[(p*Nshells1+idx)*Nfields];
+            const std::complex<double> &z1 = DIRECT_MULTIDIM_ELEM(*((*data.FT1)[p]),n);
+            const std::complex<double> &z2 = DIRECT_MULTIDIM_ELEM(*((*data.FT2)[p]),n);
+            double z1r=z1.real(), z1i=z1.imag(), z2r=z2.real(), z2i=z2.imag();
+            double absz1_2=z1r*z1r+z1i*z1i;
+            double absz2_2=z2r*z2r+z2i*z2i;
+            accShell[SHELL_NUM] += z1r*z2r+z1i*z2i;
+            accShell[SHELL_DEN1] += absz1_2;
+            accShell[SHELL_DEN2] += absz2_2;
+            if (Nfields>3)
+            {
+                double absz1 = sqrt(absz1_2);
+                double absz2 = sqrt(absz2_2);
+                accShell[SHELL_ERROR] += abs(z1-z2);
+                //for calculating r-factor
+                double R=DIRECT_MULTIDIM_ELEM(shells.freq,n);
+                if ( R > data.minFreq && R < data.maxFreq)
+                {
+                    rFactorNumerator += fabs(absz1 - absz2);
+                    rFactorDenominator += absz1;
+                }
+                if (data.dodpr) //this takes to long for a huge volume
+                {
+                    double phaseDiff=atan2(z1i,z1r) - atan2(z2i,z2r);
+                    phaseDiff = RAD2DEG(phaseDiff);
+                    phaseDiff = realWRAP(phaseDiff,-180, 180);
+                    accShell[SHELL_DPR] += ((absz1+absz2)*phaseDiff*phaseDiff);
+                    accShell[SHELL_DENDPR] += (absz1+absz2);
+                }
+            }
+        }
+    }
+}
+
+static void threadAccumulateShells(ThreadArgument &thArg)
+{
+    ShellAccumulationData &data=*((ShellAccumulationData *)thArg.workClass);
+    size_t Nrows=YSIZE(data.shells->shell)*ZSIZE(data.shells->shell);
+    size_t id=thArg.thread_id;
+    size_t r0=(id*Nrows)/data.nThreads;
+    size_t rF=((id+1)*Nrows)/data.nThreads;
+    accumulateShells(data,r0,rF,data.partial[id]);
+}
+
+// Accumulate all shells. The partial sums of the threads are added in thread order
+static void accumulateShells(ShellAccumulationData &data, std::vector<double> &acc)
+{
+    const FourierShellIndex &shells=*data.shells;
+    for (size_t p=0; p<data.FT1->size(); ++p)
+        if (!shells.sameSize(*((*data.FT1)[p])) || !shells.sameSize(*((*data.FT2)[p])))
+            REPORT_ERROR(ERR_MULTIDIM_SIZE,"Fourier transforms of a size different from the shell index");
+    size_t Nrows=YSIZE(shells.shell)*ZSIZE(shells.shell);
+    if (data.nThreads<=1)
+    {
+        accumulateShells(data,0,Nrows,acc);
+        return;
+    }
+    data.partial.resize(data.nThreads);
+    ThreadManager thMgr(data.nThreads,&data);
+    thMgr.run(threadAccumulateShells);
+    acc=data.partial[0];
+    for (int t=1; t<data.nThreads; ++t)
+    {
+        const std::vector<double> &partial=data.partial[t];
+        for (size_t n=0; n<acc.size(); ++n)
+            acc[n]+=partial[n];
+    }
+}
+
+void fourierShellCorrelation(const FourierShellIndex &shells,
+                             const std::vector< const MultidimArray< std::complex<double> > * > &FT1,
+                             const std::vector< const MultidimArray< std::complex<double> > * > &FT2,
+                             std::vector< MultidimArray<double> > &fsc,
+                             int nThreads)
+{
+    if (FT1.size()!=FT2.size())
+        REPORT_ERROR(ERR_ARG_INCORRECT,"fourierShellCorrelation: there must be the same number of maps in both sets");
+    ShellAccumulationData data;
+    data.shells=&shells;
+    data.FT1=&FT1;
+    data.FT2=&FT2;
+    data.Nfields=3;
+    data.dodpr=false;
+    data.minFreq=data.maxFreq=0;
+    data.nThreads=nThreads;
+    std::vector<double> acc;
+    accumulateShells(data,acc);
+
+    size_t Nshells1=shells.Nshells+1;
+    fsc.resize(FT1.size());
+    for (size_t p=0; p<FT1.size(); ++p)
+    {
+        MultidimArray<double> &fscp=fsc[p];
+        fscp.initZeros(shells.Nshells);
+        FOR_ALL_ELEMENTS_IN_ARRAY1D(fscp)
+        {
+            const double *accShell=&acc[(p*Nshells1+i)*3];
+            dAi(fscp,i) = accShell[SHELL_NUM]/sqrt(accShell[SHELL_DEN1]*accShell[SHELL_DEN2]);
+        }
+    }
+}
+
 void frc_dpr(MultidimArray< double > & m1,
              MultidimArray< double > & m2,
              double sampling_rate,
@@ -479,7 +823,8 @@ void frc_dpr(MultidimArray< double > & m1,
 			 bool doRfactor,
 			 double minFreq,
 			 double maxFreq,
-                         double * rFactor)
+                         double * rFactor,
+                         int nThreads)
 {
     if (!m1.sameShape(m2))
         REPORT_ERROR(ERR_MULTIDIM_SIZE,"MultidimArrays have different shapes!");
@@ -488,15 +833,9 @@ void frc_dpr(MultidimArray< double > & m1,
 
     MultidimArray< std::complex< double > > FT1;
     FourierTransformer transformer1(FFTW_BACKWARD);
+    if (nThreads>1)
+        transformer1.setThreadsNumber(nThreads);
     transformer1.FourierTransform(m1, FT1, false);
-
-//#define DEBUG
-#ifdef DEBUG
-     std::cerr << "FT1" << FT1 << std::endl; 
-#endif
-#undef DEBUG
-
-
     m1.clear(); // Free memory
 
     MultidimArray< std::complex< double > > FT2;
@@ -504,135 +843,58 @@ void frc_dpr(MultidimArray< double > & m1,
     transformer2.FourierTransform(m2, FT2, false);
     m2.clear(); // Free memory
 
-    MultidimArray< int > radial_count(m1sizeX/2+1);
-    MultidimArray<double> num, den1, den2, den_dpr;
-    Matrix1D<double> f(3);
-    //to calculate r-factor
-    double rFactorNumerator=0;
-    double rFactorDenominator=0;
-
-
-    num.initZeros(radial_count);
-    den1.initZeros(radial_count);
-    den2.initZeros(radial_count);
+    FourierShellIndex shells;
+    shells.initialize(m1sizeX,m1sizeY,m1sizeZ,maxFreq);
 
     //dpr calculation takes for ever in large volumes
     //since atan2 is called many times
     //until atan2 is changed by a table let us make dpr an option
+    std::vector< const MultidimArray< std::complex<double> > * > vFT1(1,&FT1), vFT2(1,&FT2);
+    ShellAccumulationData data;
+    data.shells=&shells;
+    data.FT1=&vFT1;
+    data.FT2=&vFT2;
+    data.Nfields=6;
+    data.dodpr=dodpr;
+    data.minFreq=minFreq;
+    data.maxFreq=maxFreq;
+    data.nThreads=nThreads;
+    std::vector<double> acc;
+    accumulateShells(data,acc);
+
+    freq.initZeros(shells.Nshells);
+    frc.initZeros(shells.Nshells);
+    frc_noise.initZeros(shells.Nshells);
+    error_l2.initZeros(shells.Nshells);
     if (dodpr)
-    {
-        dpr.initZeros(radial_count);
-        den_dpr.initZeros(radial_count);
-    }
-    freq.initZeros(radial_count);
-    frc.initZeros(radial_count);
-    frc_noise.initZeros(radial_count);
-    error_l2.initZeros(radial_count);
-#ifdef SAVE_REAL_PART
-
-    std::vector<double> *realPart=
-        new std::vector<double>[XSIZE(radial_count)];
-#endif
+        dpr.initZeros(shells.Nshells);
 
-    int sizeZ_2 = m1sizeZ/2;
-    if (sizeZ_2==0)
-        sizeZ_2=1;
-    double isizeZ = 1.0/m1sizeZ;
-    int sizeY_2 = m1sizeY/2;
-    double iysize = 1.0/m1sizeY;
-    int sizeX_2 = m1sizeX/2;
-    double ixsize = 1.0/m1sizeX;
-    double R;
-
-    int ZdimFT1=(int)ZSIZE(FT1);
-    int YdimFT1=(int)YSIZE(FT1);
-    int XdimFT1=(int)XSIZE(FT1);
-
-    double maxFreq_2 =0.;
-    maxFreq_2 = maxFreq * maxFreq;
-    for (int k=0; k<ZdimFT1; k++)
-    {
-        FFT_IDX2DIGFREQ_FAST(k,m1sizeZ,sizeZ_2,isizeZ,ZZ(f));
-        double fz2=ZZ(f)*ZZ(f);
-        for (int i=0; i<YdimFT1; i++)
-        {
-            FFT_IDX2DIGFREQ_FAST(i,YSIZE(m1),sizeY_2, iysize, YY(f));
-            double fz2_fy2=fz2 + YY(f)*YY(f);
-            for (int j=0; j<XdimFT1; j++)
-            {
-                FFT_IDX2DIGFREQ_FAST(j,m1sizeX, sizeX_2, ixsize, XX(f));
-
-                double R2 =fz2_fy2 + XX(f)*XX(f);
-                if (R2>maxFreq_2)
-                    continue;
-
-                R = sqrt(R2);
-                int idx = (int)round(R * m1sizeX);
-                std::complex<double> &z1 = dAkij(FT1, k, i, j);
-                std::complex<double> &z2 = dAkij(FT2, k, i, j);
-                double absz1 = abs(z1);
-                double absz2 = abs(z2);
-                dAi(num,idx) += real(conj(z1) * z2);
-                dAi(den1,idx) += absz1*absz1;
-                dAi(den2,idx) += absz2*absz2;
-                dAi(error_l2,idx) += abs(z1-z2);
-                //for calculating r-factor
-                if ( R > minFreq && R < maxFreq)
-                {
-                	rFactorNumerator += fabs(absz1 - absz2);
-                	rFactorDenominator += absz1;
-                }
-
-                if (dodpr) //this takes to long for a huge volume
-                {
-                    double phaseDiff=atan2(z1.imag(),z1.real()) - atan2(z2.imag(),z2.real());
-                    phaseDiff = RAD2DEG(phaseDiff);
-                    phaseDiff = realWRAP(phaseDiff,-180, 180);
-                    dAi(dpr,idx) += ((absz1+absz2)*phaseDiff*phaseDiff);
-                    dAi(den_dpr,idx) += (absz1+absz2);
-#ifdef SAVE_REAL_PART
-
-                    realPart[idx].push_back(z1.real());
-#endif
-
-                }
-                dAi(radial_count,idx)++;
-            }
-        }
-    }
     //to calculate r-factor
     if (doRfactor)
     {
-    	//std::cout << "rFactorNumerator = " << rFactorNumerator << std::endl;
-    	//std::cout << "rFactorDenominator = " << rFactorDenominator << std::endl;
-    	*rFactor = rFactorNumerator / rFactorDenominator;
-        
-        //std::cout << "R-factor = " << rFactorValue << std::endl;
-        //*rFactor = rFactorValue;
-        //std::cout << "R-rFactor = " << *rFactor << std::endl;
+        size_t Nacc=acc.size()-2;
+        *rFactor = acc[Nacc] / acc[Nacc+1];
     }
 
     FOR_ALL_ELEMENTS_IN_ARRAY1D(freq)
     {
+        const double *accShell=&acc[i*6];
+        double radial_count=dAi(shells.count,i);
         dAi(freq,i) = (double) i / (m1sizeX * sampling_rate);
-        dAi(frc,i) = dAi(num,i)/sqrt(dAi(den1,i)*dAi(den2,i));
-        dAi(frc_noise,i) = 2 / sqrt((double) dAi(radial_count,i));
-        dAi(error_l2,i) /= dAi(radial_count,i);
+        dAi(frc,i) = accShell[SHELL_NUM]/sqrt(accShell[SHELL_DEN1]*accShell[SHELL_DEN2]);
+        dAi(frc_noise,i) = 2 / sqrt(radial_count);
+        dAi(error_l2,i) = accShell[SHELL_ERROR]/radial_count;
 
         if (dodpr)
-            dAi(dpr,i) = sqrt(dAi(dpr,i) / dAi(den_dpr,i));
-#ifdef SAVE_REAL_PART
-
-        std::ofstream fhOut;
-        fhOut.open(((std::string)"PPP_RealPart_"+integerToString(i)+".txt").
-                   c_str());
-        for (int j=0; j<realPart[i].size(); j++)
-            fhOut << realPart[i][j] << std::endl;
-        fhOut.close();
-#endif
-
+            dAi(dpr,i) = sqrt(accShell[SHELL_DPR] / accShell[SHELL_DENDPR]);
     }
 }
+#undef SHELL_NUM
+#undef SHELL_DEN1
+#undef SHELL_DEN2
+#undef SHELL_ERROR
+#undef SHELL_DPR
+#undef SHELL_DENDPR
 
 void scaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArray<double> &mdaIn, MultidimArray<double> &mdaOut, int nThreads)
 {
@@ -650,46 +912,25 @@ void scaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArray<double> &mda
     FourierTransformer transformerMp;
     transformerMp.setReal(mdaOut);
     transformerMp.getFourierAlias(MpmemFourier);
+    copyFourierWindow(MmemFourier, ZSIZE(mdaIn), YSIZE(mdaIn), MpmemFourier, ZSIZE(mdaOut), YSIZE(mdaOut));
 
-    size_t xsize = std::min(XSIZE(MmemFourier),XSIZE(MpmemFourier))*sizeof(std::complex<double>);
-    size_t yhalf = std::min(std::min((YSIZE(mdaIn)+1)/2,(YSIZE(mdaOut)+1)/2),YSIZE(mdaIn)-1);
-    size_t zhalf = std::min(std::min((ZSIZE(mdaIn)+1)/2,(ZSIZE(mdaOut)+1)/2),ZSIZE(mdaIn)-1);
-
-    size_t kp0=0;
-    size_t kpF=zhalf;
-    size_t ip0=0;
-    size_t ipF=yhalf;
-    size_t km0=ZSIZE(MmemFourier)>=ZSIZE(MpmemFourier)?(kpF+1):(ZSIZE(MpmemFourier)-(ZSIZE(MmemFourier)-(zhalf+1)));
-    size_t kmF=ZSIZE(MpmemFourier)-1;
-    size_t im0=YSIZE(MmemFourier)>=YSIZE(MpmemFourier)?(ipF+1):(YSIZE(MpmemFourier)-(YSIZE(MmemFourier)-(yhalf+1)));
-    size_t imF=YSIZE(MpmemFourier)-1;
-
-    //Init with zero
-    MpmemFourier.initZeros();
+    // Transform data
+    transformerMp.inverseFourierTransform();
+}
 
-    for (size_t k = kp0; k<=kpF; ++k)
-    {
-        for (size_t i=ip0; i<=ipF; ++i)
-        	memcpy(&dAkij(MpmemFourier,k,i,0),&dAkij(MmemFourier,k,i,0),xsize);
-        for (size_t i=im0; i<=imF; ++i)
-        {
-            size_t ip = i + YSIZE(MmemFourier)-YSIZE(MpmemFourier) ;
-        	memcpy(&dAkij(MpmemFourier,k,i,0),&dAkij(MmemFourier,k,ip,0),xsize);
-        }
-    }
-    for (size_t k = km0; k<=kmF; ++k)
-    {
-        size_t kp = k + ZSIZE(MmemFourier)-ZSIZE(MpmemFourier) ;
-        for (size_t i=ip0; i<=ipF; ++i)
-        	memcpy(&dAkij(MpmemFourier,k,i,0),&dAkij(MmemFourier,kp,i,0),xsize);
-        for (size_t i=im0; i<=imF; ++i)
-        {
-            size_t ip = i + YSIZE(MmemFourier)-YSIZE(MpmemFourier) ;
-        	memcpy(&dAkij(MpmemFourier,k,i,0),&dAkij(MmemFourier,kp,ip,0),xsize);
-        }
-    }
+void scaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArray<float> &mdaIn, MultidimArray<float> &mdaOut, int nThreads)
+{
+    MultidimArray<std::complex<float> > MmemFourier;
+    FourierTransformerFloat transformerM;
+    transformerM.setThreadsNumber(nThreads);
+    transformerM.FourierTransform(mdaIn, MmemFourier, false);
 
-    // Transform data
+    mdaOut.resizeNoCopy(Zdim, Ydim, Xdim);
+    MultidimArray<std::complex<float> > MpmemFourier;
+    FourierTransformerFloat transformerMp;
+    transformerMp.setReal(mdaOut);
+    transformerMp.getFourierAlias(MpmemFourier);
+    copyFourierWindow(MmemFourier, ZSIZE(mdaIn), YSIZE(mdaIn), MpmemFourier, ZSIZE(mdaOut), YSIZE(mdaOut));
     transformerMp.inverseFourierTransform();
 }
 
@@ -28,6 +28,7 @@
 #define __XmippFFTW_H
 
 #include <complex>
+#include <vector>
 #include "fftw3.h"
 #include "multidim_array.h"
 #include "multidim_array_generic.h"
@@ -406,6 +407,109 @@ public:
 
 };
 
+/** Fourier Transformer in single precision.
+ * @ingroup FourierW
+ *
+ * Same use as FourierTransformer, but for arrays of floats and with the
+ * single precision FFTW library. Images stored as floats need not be
+ * converted to double, and the memory and bandwidth of the transforms are
+ * halved, at the cost of a relative precision of about 1e-6.
+ * The forward transform is normalized.
+ * @code
+ * FourierTransformerFloat transformer;
+ * MultidimArray< std::complex<float> > Vfft;
+ * transformer.FourierTransform(V(),Vfft,false);
+ * ...
+ * transformer.inverseFourierTransform();
+ * @endcode
+ */
+class FourierTransformerFloat
+{
+public:
+    /** Real array, in fact a pointer to the user array is stored. */
+    MultidimArray<float> *fReal;
+
+    /** Fourier array  */
+    MultidimArray< std::complex<float> > fFourier;
+
+    /* fftw Forward plan */
+    fftwf_plan fPlanForward;
+
+    /* fftw Backward plan */
+    fftwf_plan fPlanBackward;
+
+    /* number of threads*/
+    int nthreads;
+
+public:
+    /** Default constructor */
+    FourierTransformerFloat();
+
+    /** Copy constructor */
+    FourierTransformerFloat(const FourierTransformerFloat& fTransform);
+
+    /** Assignment operator */
+    FourierTransformerFloat & operator= (const FourierTransformerFloat & other);
+
+    /** Destructor */
+    ~FourierTransformerFloat();
+
+    /** Set Number of threads.
+     * The plans computed after this call use tNumber threads. */
+    void setThreadsNumber(int tNumber);
+
+    /** Compute the Fourier transform of a MultidimArray, 2D and 3D.
+        If getCopy is false, an alias to the transformed data is returned. */
+    template <typename T, typename T1>
+    void FourierTransform(T& v, T1& V, bool getCopy=true)
+    {
+        setReal(v);
+        Transform(FFTW_FORWARD);
+        if (getCopy)
+            getFourierCopy(V);
+        else
+            getFourierAlias(V);
+    }
+
+    /** Compute the Fourier transform of the array given with setReal. */
+    void FourierTransform();
+
+    /** Compute the inverse Fourier transform.
+        The result is stored in the array given with setReal. */
+    void inverseFourierTransform();
+
+    /** Get Fourier coefficients. */
+    template <typename T>
+    void getFourierAlias(T& V)
+    {
+        V.alias(fFourier);
+    }
+
+    /** Get Fourier coefficients. */
+    template <typename T>
+    void getFourierCopy(T& V)
+    {
+        V.resizeNoCopy(fFourier);
+        memcpy(MULTIDIM_ARRAY(V),MULTIDIM_ARRAY(fFourier),
+               MULTIDIM_SIZE(fFourier)*2*sizeof(float));
+    }
+
+    /** Set a Multidimarray for input.
+        The plans are only recomputed if the data pointer or the size of img
+        change. */
+    void setReal(MultidimArray<float> &img);
+
+    /** Computes the transform in the direction given by sign */
+    void Transform(int sign);
+
+    /** Clear object */
+    void clear();
+
+private:
+    /* Pointer to the array of floats with which the plan was computed */
+    float *dataPtr;
+};
+
 /** FFT Magnitude 1D
  * @ingroup FourierOperations
  */
@@ -604,8 +708,57 @@ void convolutionFFT(MultidimArray<double> &img,
                     MultidimArray<double> &kernel,
                     MultidimArray<double> &result);
 
+/** Shell index of the Fourier coefficients.
+ * @ingroup FourierOperations
+ * The frequency shell (of width 1/Xdim) of each coefficient of the Fourier
+ * transform of a map of a given size is computed once, and it can be shared by
+ * all the FSCs/FRCs of maps of that size.
+ */
+class FourierShellIndex
+{
+public:
+    /// Size of the maps in real space
+    size_t Xdim, Ydim, Zdim;
+    /// Maximum digital frequency
+    double maxFreq;
+    /// Number of shells (Xdim/2+1)
+    int Nshells;
+    /** Shell of each Fourier coefficient.
+     * It is -1 for the coefficients beyond maxFreq and Nshells for those
+     * below maxFreq but beyond the last shell (corners of the box). */
+    MultidimArray<int> shell;
+    /// Digital frequency of each Fourier coefficient
+    MultidimArray<double> freq;
+    /// Number of coefficients in each shell (Nshells+1 elements)
+    MultidimArray<int> count;
+
+public:
+    /// Empty constructor
+    FourierShellIndex();
+
+    /// Compute the shells for maps of size Zdim x Ydim x Xdim
+    void initialize(size_t Xdim, size_t Ydim, size_t Zdim=1, double maxFreq=0.5);
+
+    /// Check that a Fourier transform corresponds to the size of the index
+    bool sameSize(const MultidimArray< std::complex<double> > &FT) const;
+};
+
+/** FSC of a batch of pairs of maps.
+ * @ingroup FourierOperations
+ * FT1[n] and FT2[n] are the Fourier transforms (as given by FourierTransformer)
+ * of the n-th pair of maps, all of them of the size of the shell index. The FSCs
+ * of all pairs are computed in a single pass over the Fourier coefficients,
+ * which is distributed among nThreads threads. fsc[n] has shells.Nshells elements.
+ */
+void fourierShellCorrelation(const FourierShellIndex &shells,
+                             const std::vector< const MultidimArray< std::complex<double> > * > &FT1,
+                             const std::vector< const MultidimArray< std::complex<double> > * > &FT2,
+                             std::vector< MultidimArray<double> > &fsc,
+                             int nThreads=1);
+
 /** Fourier-Ring-Correlation between two multidimArrays using FFT
  * @ingroup FourierOperations
+ * The shells are accumulated in nThreads threads.
  */
 void frc_dpr(MultidimArray< double > & m1,
              MultidimArray< double > & m2,
@@ -619,13 +772,141 @@ void frc_dpr(MultidimArray< double > & m1,
 			 bool doRfactor = false,
 			 double minFreq = -1,
 			 double maxFreq = 0.5,
-                         double * rFactor= NULL);
+                         double * rFactor= NULL,
+                         int nThreads = 1);
 
 /** Scale matrix using Fourier transform
  * @ingroup FourierOperations
  * Ydim and Xdim define the output size, mda is the MultidimArray to scale
  */
 void scaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArray<double> &mdaIn, MultidimArray<double> &mdaOut, int nThreads=1);
+
+/** Copy the low frequencies of a Fourier transform into a smaller or larger one.
+ * @ingroup FourierOperations
+ * Fin is the transform of a map of size Zin x Yin x Xin and Fout that of a
+ * map of size Zout x Yout x Xout, as given by FourierTransformer. The
+ * coefficients of Fout not present in Fin are set to 0.
+ */
+template <typename T>
+void copyFourierWindow(const MultidimArray< std::complex<T> > &Fin, size_t Zin, size_t Yin,
+                       MultidimArray< std::complex<T> > &Fout, size_t Zout, size_t Yout)
+{
+    size_t xsize = std::min(XSIZE(Fin),XSIZE(Fout))*sizeof(std::complex<T>);
+    size_t yhalf = std::min(std::min((Yin+1)/2,(Yout+1)/2),Yin-1);
+    size_t zhalf = std::min(std::min((Zin+1)/2,(Zout+1)/2),Zin-1);
+
+    size_t kp0=0;
+    size_t kpF=zhalf;
+    size_t ip0=0;
+    size_t ipF=yhalf;
+    size_t km0=ZSIZE(Fin)>=ZSIZE(Fout)?(kpF+1):(ZSIZE(Fout)-(ZSIZE(Fin)-(zhalf+1)));
+    size_t kmF=ZSIZE(Fout)-1;
+    size_t im0=YSIZE(Fin)>=YSIZE(Fout)?(ipF+1):(YSIZE(Fout)-(YSIZE(Fin)-(yhalf+1)));
+    size_t imF=YSIZE(Fout)-1;
+
+    //Init with zero
+    Fout.initZeros();
+
+    for (size_t k = kp0; k<=kpF; ++k)
+    {
+        for (size_t i=ip0; i<=ipF; ++i)
+            memcpy(&dAkij(Fout,k,i,0),&dAkij(Fin,k,i,0),xsize);
+        for (size_t i=im0; i<=imF; ++i)
+        {
+            size_t ip = i + YSIZE(Fin)-YSIZE(Fout) ;
+            memcpy(&dAkij(Fout,k,i,0),&dAkij(Fin,k,ip,0),xsize);
+        }
+    }
+    for (size_t k = km0; k<=kmF; ++k)
+    {
+        size_t kp = k + ZSIZE(Fin)-ZSIZE(Fout) ;
+        for (size_t i=ip0; i<=ipF; ++i)
+            memcpy(&dAkij(Fout,k,i,0),&dAkij(Fin,kp,i,0),xsize);
+        for (size_t i=im0; i<=imF; ++i)
+        {
+            size_t ip = i + YSIZE(Fin)-YSIZE(Fout) ;
+            memcpy(&dAkij(Fout,k,i,0),&dAkij(Fin,kp,ip,0),xsize);
+        }
+    }
+}
+
+/** Scale a map of floats using Fourier transform
+ * @ingroup FourierOperations
+ * Single precision version of scaleToSizeFourier.
+ */
+void scaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArray<float> &mdaIn, MultidimArray<float> &mdaOut, int nThreads=1);
+
+/** Scale many maps of the same size using Fourier transform
+ * @ingroup FourierOperations
+ * Same result as scaleToSizeFourier. The map to scale is copied into in, and
+ * resize() leaves the scaled map in out. The FFTW plans are computed for the
+ * first map and reused while the input size does not change. An object must not
+ * be shared among threads, but each thread can use its own resizer.
+ * FourierResizer works in double precision and FourierResizerFloat in single
+ * precision.
+ * @code
+ * FourierResizer resizer;
+ * resizer.setOutputSize(1,64,64);
+ * for (...)
+ * {
+ *    I().getImage(resizer.in);
+ *    resizer.resize();
+ *    I().setImage(resizer.out);
+ * }
+ * @endcode
+ */
+template <typename T, typename Transformer>
+class FourierResizerT
+{
+public:
+    /// Map to scale
+    MultidimArray<T> in;
+    /// Scaled map
+    MultidimArray<T> out;
+public:
+    /// Empty constructor
+    FourierResizerT()
+    {
+        Zout=Yout=Xout=0;
+    }
+
+    /// Number of threads of the transforms
+    void setThreadsNumber(int nThreads)
+    {
+        transformerIn.setThreadsNumber(nThreads);
+        transformerOut.setThreadsNumber(nThreads);
+    }
+
+    /// Set the size of the scaled maps
+    void setOutputSize(int Zdim, int Ydim, int Xdim)
+    {
+        Zout=Zdim;
+        Yout=Ydim;
+        Xout=Xdim;
+        out.resizeNoCopy(Zout, Yout, Xout);
+    }
+
+    /// Scale in into out
+    void resize()
+    {
+        if (Xout==0)
+            REPORT_ERROR(ERR_MULTIDIM_SIZE,"FourierResizer: the output size has not been set");
+        // The plans are only computed for the first map or if the input size changes
+        transformerIn.FourierTransform(in, Fin, false);
+        transformerOut.setReal(out);
+        transformerOut.getFourierAlias(Fout);
+        copyFourierWindow(Fin, ZSIZE(in), YSIZE(in), Fout, ZSIZE(out), YSIZE(out));
+        transformerOut.inverseFourierTransform();
+    }
+private:
+    int Zout, Yout, Xout;
+    Transformer transformerIn, transformerOut;
+    MultidimArray<std::complex<T> > Fin, Fout;
+};
+
+typedef FourierResizerT<double, FourierTransformer> FourierResizer;
+typedef FourierResizerT<float, FourierTransformerFloat> FourierResizerFloat;
+
 void selfScaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArray<double> &mda, int nthreads=1);
 
 void selfScaleToSizeFourier(int Ydim, int Xdim, MultidimArray<double> &mda, int nthreads=1);
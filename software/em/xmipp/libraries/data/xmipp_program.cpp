@@ -25,6 +25,8 @@
 
 #include <stdlib.h>
 #include "xmipp_program.h"
+#include "xmipp_image_generic.h"
+#include "xmipp_threads.h"
 #include "metadata_extension.h"
 #include "args.h"
 void XmippProgram::initComments()
@@ -505,6 +507,8 @@ XmippMetadataProgram::XmippMetadataProgram()
     save_metadata_stack = false;
     keep_input_columns = false;
     track_origin = false;
+    batchSize = nBatch = 0;
+    batchThMgr = NULL;
 }
 
 void XmippMetadataProgram::init()
@@ -753,6 +757,88 @@ void XmippMetadataProgram::setupRowOut(const FileName &fnImgIn, const MDRow &row
         rowOut.setValue(MDL_IMAGE_ORIGINAL, fnImgIn);
 }
 
+void XmippMetadataProgram::setupBatch(int Nthreads, size_t imageSize)
+{
+    clearBatch();
+    batchSize = 1;
+    if (Nthreads > 1)
+    {
+        batchSize = std::max((size_t)Nthreads, (size_t)256 * 1024 * 1024 / std::max(imageSize, (size_t)1));
+        batchSize = std::min(batchSize, std::max(mdInSize, (size_t)1));
+        batchThMgr = new ThreadManager(Nthreads, this);
+    }
+    batchImg.resize(batchSize);
+    batchFnImg.resize(batchSize);
+    batchFnOut.resize(batchSize);
+    batchRow.resize(batchSize);
+    for (size_t k = 0; k < batchSize; ++k)
+        batchImg[k] = new ImageGeneric;
+}
+
+void XmippMetadataProgram::addToBatch(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn)
+{
+    batchFnImg[nBatch] = fnImg;
+    batchFnOut[nBatch] = fnImgOut;
+    batchRow[nBatch] = rowIn;
+    readBatchImage(nBatch++);
+    if (nBatch == batchSize)
+        processBatch();
+}
+
+void XmippMetadataProgram::readBatchImage(size_t k)
+{
+    batchImg[k]->read(batchFnImg[k]);
+}
+
+void XmippMetadataProgram::processBatchImage(size_t k, int thread_id)
+{
+}
+
+void XmippMetadataProgram::finishBatchImage(size_t k)
+{
+    batchImg[k]->write(batchFnOut[k]);
+}
+
+void XmippMetadataProgram::threadProcessBatch(ThreadArgument &thArg)
+{
+    XmippMetadataProgram *self = (XmippMetadataProgram *) thArg.workClass;
+    int Nthreads = thArg.getNumberOfThreads();
+    for (size_t k = thArg.thread_id; k < self->nBatch; k += Nthreads)
+        self->processBatchImage(k, thArg.thread_id);
+}
+
+void XmippMetadataProgram::processBatch()
+{
+    if (nBatch == 0)
+        return;
+    if (batchThMgr != NULL)
+        batchThMgr->run(threadProcessBatch);
+    else
+        for (size_t k = 0; k < nBatch; ++k)
+            processBatchImage(k, 0);
+    for (size_t k = 0; k < nBatch; ++k)
+        finishBatchImage(k);
+    nBatch = 0;
+}
+
+void XmippMetadataProgram::clearBatch()
+{
+    for (size_t k = 0; k < batchImg.size(); ++k)
+        delete batchImg[k];
+    batchImg.clear();
+    batchFnImg.clear();
+    batchFnOut.clear();
+    batchRow.clear();
+    delete batchThMgr;
+    batchThMgr = NULL;
+    batchSize = nBatch = 0;
+}
+
+void XmippMetadataProgram::processPendingImages()
+{
+    processBatch();
+}
+
 void XmippMetadataProgram::wait()
 {
 	// In the serial implementation, we don't have to wait. This will be useful for MPI programs
@@ -835,6 +921,7 @@ void XmippMetadataProgram::run()
 
         showProgress();
     }
+    processPendingImages();
     wait();
 
     //free iterator memory
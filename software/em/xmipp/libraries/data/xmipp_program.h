@@ -47,6 +47,10 @@
  * @{
  */
 
+class ImageGeneric;
+class ThreadManager;
+class ThreadArgument;
+
 /** This class represent an Xmipp Program.
  * It have some of the basic functionalities of
  * the programs like argument parsing, checking, usage printing.
@@ -354,6 +358,17 @@ protected:
     /// Some time bar related counters
     size_t time_bar_step, time_bar_size, time_bar_done;
 
+    /** Images processed in batches by several threads.
+     * The images of a batch are read by readBatchImage, processed by
+     * processBatchImage in the threads and finished by finishBatchImage
+     * in the input order. batchSize is 0 if the program does not use batches.
+     */
+    size_t batchSize, nBatch;
+    std::vector<ImageGeneric *> batchImg;
+    std::vector<FileName> batchFnImg, batchFnOut;
+    std::vector<MDRow> batchRow;
+    ThreadManager *batchThMgr;
+
     virtual void initComments();
     virtual void defineParams();
     virtual void readParams();
@@ -378,6 +393,33 @@ protected:
     /** Define the label param */
     virtual void defineLabelParam();
 
+    /** Prepare the batches, usually in preProcess.
+     * A batch has at least one image per thread and about 256 Mb,
+     * imageSize is the size in bytes of one image. With one thread the
+     * images are processed one by one.
+     */
+    void setupBatch(int Nthreads, size_t imageSize);
+
+    /** Add an image to the batch. The batch is processed when it is full. */
+    void addToBatch(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn);
+
+    /** Process the images of the batch with the threads and finish them in order */
+    void processBatch();
+
+    /** Free the batch */
+    void clearBatch();
+
+    /** Read the k-th image of the batch. By default it is read as it is in the file. */
+    virtual void readBatchImage(size_t k);
+
+    /** Process the k-th image of the batch. It is called from the threads. */
+    virtual void processBatchImage(size_t k, int thread_id);
+
+    /** Finish the k-th image of the batch. By default it is written to its output file. */
+    virtual void finishBatchImage(size_t k);
+
+    static void threadProcessBatch(ThreadArgument &thArg);
+
 public:
     XmippMetadataProgram();
 
@@ -403,6 +445,7 @@ public:
      */
     virtual ~XmippMetadataProgram()
     {
+        clearBatch();
         if (delete_mdIn)
             delete mdIn;
     }
@@ -415,6 +458,13 @@ public:
     /// Prepare rowout
     void setupRowOut(const FileName &fnImgIn, const MDRow &rowIn, const FileName &fnImgOut, MDRow &rowOut) const;
 
+    /** Process the images kept by the program.
+     * By default the last batch is processed here.
+     * It is called by run after the last image and before waiting for the
+     * rest of nodes in the MPI programs.
+     */
+    virtual void processPendingImages();
+
     /// Wait for the distributor to finish
     virtual void wait();
 
@@ -25,11 +25,55 @@
  ***************************************************************************/
 
 #include "diffusionMaps.h"
+#include <data/sparse_matrix2d.h>
 
-void DiffusionMaps::setSpecificParameters(double t, double sigma)
+void DiffusionMaps::setSpecificParameters(double t, double sigma, int kNeighbours)
 {
     this->t=t;
     this->sigma=sigma;
+    this->kNeighbours=kNeighbours;
+}
+
+// Same normalizations as the full kernel, except that the first one is always the
+// symmetric K(i,j)/(p(i)p(j))^t, so that the Lanczos iteration can be used for t=1 too.
+// For the symmetric matrix the singular vectors are the eigenvectors.
+static void sparseDiffusionMaps(const Matrix2D<double> &X, int kNeighbours, double sigma, double t,
+                                DimRedDistance2 distance, int Ntrees, int Nthreads, size_t outputDim, Matrix2D<double> &Y)
+{
+    size_t N=MAT_YSIZE(X);
+    std::vector<SparseElement> W;
+    computeSparseSimilarityMatrix(X,kNeighbours,sigma,W,distance,false,Ntrees,Nthreads);
+    SparseElement e;
+    e.value=1.0;
+    for (size_t i=0; i<N; ++i)
+    {
+        e.i=e.j=i;
+        W.push_back(e);
+    }
+
+    Matrix1D<double> p;
+    sparseRowSum(W,N,p);
+    for (size_t k=0; k<W.size(); ++k)
+        W[k].value/=pow(VEC_ELEM(p,W[k].i)*VEC_ELEM(p,W[k].j),t);
+
+    sparseRowSum(W,N,p);
+    FOR_ALL_ELEMENTS_IN_MATRIX1D(p)
+        VEC_ELEM(p,i)=sqrt(VEC_ELEM(p,i));
+    for (size_t k=0; k<W.size(); ++k)
+        W[k].value/=VEC_ELEM(p,W[k].i)*VEC_ELEM(p,W[k].j);
+    SparseMatrix2D A(W,N);
+
+    Matrix1D<double> S;
+    Matrix2D<double> U;
+    firstEigs(A,outputDim+1,S,U);
+
+    Y.resizeNoCopy(N,outputDim);
+    for (size_t i=0;i<N;++i)
+    {
+        double iK=1/MAT_ELEM(U,i,0);
+        for (size_t j=1;j<=outputDim;++j)
+            MAT_ELEM(Y,i,j-1)=MAT_ELEM(U,i,j)*iK;
+    }
 }
 
 void DiffusionMaps::reduceDimensionality()
@@ -37,6 +81,12 @@ void DiffusionMaps::reduceDimensionality()
     //Normalize data (between 0 and 1)
     normalizeColumnsBetween0and1(*X);
 
+    if (kNeighbours>0)
+    {
+        sparseDiffusionMaps(*X,kNeighbours,sigma,t,distance,knnTrees,knnThreads,outputDim,Y);
+        return;
+    }
+
     // Compute Gaussian Kernel Matrix.
     // First, compute the distance of all vs all.
     Matrix2D<double> L2distance;
@@ -39,9 +39,18 @@ class DiffusionMaps: public DimRedAlgorithm
 public:
 	double t;
 	double sigma;
+	/// Number of neighbours of the sparse kernel (0 for the full kernel)
+	int kNeighbours;
 public:
-	/// Set specific parameters
-	void setSpecificParameters(double t=1.0, double sigma=1.0);
+	/** Set specific parameters.
+	 * If kNeighbours>0, the Gaussian kernel is restricted to the kNeighbours nearest
+	 * neighbours of each sample and stored as a sparse matrix, whose largest
+	 * eigenvectors are computed with a Lanczos iteration.
+	 * The sparse kernel is always normalized by (p(i)p(j))^t, while the full
+	 * kernel is normalized by p(i) for t=1. Thus, for t=1 both embeddings differ
+	 * even if kNeighbours includes all samples.
+	 */
+	void setSpecificParameters(double t=1.0, double sigma=1.0, int kNeighbours=0);
 
 	/// Reduce dimensionality
 	void reduceDimensionality();
@@ -24,6 +24,8 @@
  ***************************************************************************/
 
 #include "dimred_tools.h"
+#include <data/xmipp_threads.h>
+#include <algorithm>
 
 void GenerateData::generateNewDataset(const String& method, int N, double noise)
 {
@@ -189,34 +191,355 @@ void insertNeighbour(Matrix2D<int> &idx, Matrix2D<double> &distance, int i1, int
 	}
 }
 
-void kNearestNeighbours(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
+// Squared distance between the samples i1 and i2
+static inline double sampleDistance2(const Matrix2D<double> &X, size_t i1, size_t i2, DimRedDistance2 f)
 {
-	K=std::min(K,(int)MAT_YSIZE(X)-1);
-	idx.initConstant(MAT_YSIZE(X),K,-1);
-	distance.initConstant(MAT_YSIZE(X),K,1e38);
-	for (size_t i1=0; i1<MAT_YSIZE(X)-1; ++i1)
-		for (size_t i2=i1+1; i2<MAT_YSIZE(X); ++i2)
+	if (f!=NULL)
+		return (*f)(X,i1,i2);
+	double d=0;
+	const double *ptr1=&MAT_ELEM(X,i1,0);
+	const double *ptr2=&MAT_ELEM(X,i2,0);
+	for (size_t j=0; j<MAT_XSIZE(X); ++j)
+	{
+		double diff=ptr1[j]-ptr2[j];
+		d+=diff*diff;
+	}
+	return d;
+}
+
+void kNearestNeighbours(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt,
+                        int Ntrees, int Nthreads)
+{
+	if (Ntrees>0)
+		kNearestNeighboursApproximate(X,K,idx,distance,f,computeSqrt,Ntrees,2,XMIPP_MAX(Nthreads,1));
+	else
+		kNearestNeighboursExact(X,K,idx,distance,f,computeSqrt,XMIPP_MAX(Nthreads,1));
+}
+
+/* Random projection tree. The samples are permuted so that the samples of
+   each leaf are contiguous in perm */
+struct RPTree
+{
+	std::vector<int> perm;      // Samples sorted by leaf
+	std::vector<int> leafStart; // Start of each leaf in perm (plus the end of the last one)
+	std::vector<int> leafOf;    // Leaf of each sample
+};
+
+// Split the samples perm[first..last) with random hyperplanes until there are at most leafSize samples
+static void rpTreeSplit(const Matrix2D<double> &X, RPTree &tree, size_t first, size_t last, size_t leafSize,
+                        std::vector<double> &proj)
+{
+	size_t n=last-first;
+	if (n<=leafSize)
+	{
+		int leaf=tree.leafStart.size();
+		tree.leafStart.push_back(first);
+		for (size_t i=first; i<last; ++i)
+			tree.leafOf[tree.perm[i]]=leaf;
+		return;
+	}
+
+	// Hyperplane bisecting two random samples
+	size_t ia=first+XMIPP_MIN((size_t)(rnd_unif()*n),n-1);
+	size_t ib=first+XMIPP_MIN((size_t)(rnd_unif()*(n-1)),n-2);
+	if (ib>=ia)
+		++ib;
+	const double *ptrA=&MAT_ELEM(X,tree.perm[ia],0);
+	const double *ptrB=&MAT_ELEM(X,tree.perm[ib],0);
+	double threshold=0;
+	for (size_t j=0; j<MAT_XSIZE(X); ++j)
+		threshold+=(ptrA[j]-ptrB[j])*0.5*(ptrA[j]+ptrB[j]);
+	for (size_t i=first; i<last; ++i)
+	{
+		const double *ptrX=&MAT_ELEM(X,tree.perm[i],0);
+		double p=0;
+		for (size_t j=0; j<MAT_XSIZE(X); ++j)
+			p+=(ptrA[j]-ptrB[j])*ptrX[j];
+		proj[tree.perm[i]]=p;
+	}
+
+	// Partition
+	size_t middle=first;
+	for (size_t i=first; i<last; ++i)
+		if (proj[tree.perm[i]]<threshold)
+			std::swap(tree.perm[i],tree.perm[middle++]);
+	if (middle==first || middle==last)
+		middle=first+n/2; // Degenerate split (repeated samples)
+
+	rpTreeSplit(X,tree,first,middle,leafSize,proj);
+	rpTreeSplit(X,tree,middle,last,leafSize,proj);
+}
+
+/* Data shared by the threads of the approximate nearest neighbour search */
+struct KNNThreadData
+{
+	const Matrix2D<double> *X;
+	DimRedDistance2 f;
+	// Random projection trees
+	const std::vector<RPTree> *trees;
+	// Graph to refine, NULL for the search in the trees
+	const Matrix2D<int> *idxIn;
+	Matrix2D<int> *idx;
+	Matrix2D<double> *distance;
+	ThreadTaskDistributor *td;
+};
+
+// Neighbours of the samples first to last
+static void knnRows(const KNNThreadData &data, size_t first, size_t last)
+{
+	const Matrix2D<double> &X=*data.X;
+	Matrix2D<int> &idx=*data.idx;
+	Matrix2D<double> &distance=*data.distance;
+	size_t N=MAT_YSIZE(X);
+	int K=MAT_XSIZE(idx);
+
+	// visited[j]==i+1 if j has already been considered as neighbour of i
+	std::vector<size_t> visited(N,0);
+	for (size_t i=first; i<=last; ++i)
+	{
+		visited[i]=i+1;
+		if (data.idxIn==NULL)
 		{
-			// Compute the distance between i1 and i2
-			double d=0;
-			if (f==NULL)
-				for (int j=0; j<MAT_XSIZE(X); ++j)
+			// Samples in the same leaf of any tree
+			for (size_t t=0; t<data.trees->size(); ++t)
+			{
+				const RPTree &tree=(*data.trees)[t];
+				int leaf=tree.leafOf[i];
+				for (int n=tree.leafStart[leaf]; n<tree.leafStart[leaf+1]; ++n)
 				{
-					double diff=MAT_ELEM(X,i1,j)-MAT_ELEM(X,i2,j);
-					d+=diff*diff;
+					int j=tree.perm[n];
+					if (visited[j]!=i+1)
+					{
+						visited[j]=i+1;
+						insertNeighbour(idx,distance,i,j,sampleDistance2(X,i,j,data.f));
+					}
 				}
-			else
-				d=(*f)(X,i1,i2);
+			}
+		}
+		else
+		{
+			// Neighbours of the neighbours
+			const Matrix2D<int> &idxIn=*data.idxIn;
+			for (int k=0; k<K; ++k)
+			{
+				int j=MAT_ELEM(idxIn,i,k);
+				if (j>=0)
+					visited[j]=i+1;
+			}
+			for (int k=0; k<K; ++k)
+			{
+				int j=MAT_ELEM(idxIn,i,k);
+				if (j<0)
+					continue;
+				for (int kk=0; kk<K; ++kk)
+				{
+					int jj=MAT_ELEM(idxIn,j,kk);
+					if (jj>=0 && visited[jj]!=i+1)
+					{
+						visited[jj]=i+1;
+						insertNeighbour(idx,distance,i,jj,sampleDistance2(X,i,jj,data.f));
+					}
+				}
+			}
+		}
+	}
+}
+
+static void threadKnnRows(ThreadArgument &thArg)
+{
+	KNNThreadData &data=*((KNNThreadData *)thArg.workClass);
+	size_t first, last;
+	while (data.td->getTasks(first, last))
+		knnRows(data, first, last);
+}
+
+static void knnAllRows(KNNThreadData &data, int Nthreads)
+{
+	size_t N=MAT_YSIZE(*data.X);
+	if (Nthreads<=1)
+		knnRows(data,0,N-1);
+	else
+	{
+		ThreadTaskDistributor td(N,XMIPP_MAX(N/(20*Nthreads),1));
+		data.td=&td;
+		ThreadManager thMgr(Nthreads,&data);
+		thMgr.run(threadKnnRows);
+	}
+}
+
+/* Data shared by the threads of the exact search */
+struct KNNPairsData
+{
+	const Matrix2D<double> *X;
+	DimRedDistance2 f;
+	// Neighbours found by each thread
+	std::vector< Matrix2D<int> > idx;
+	std::vector< Matrix2D<double> > distance;
+	ThreadTaskDistributor *td;
+};
+
+// Pairs (i1,i2) with i1 in the tasks of the thread and i2>i1. Within a thread
+// the candidates of a sample are inserted in increasing order
+static void threadKnnPairs(ThreadArgument &thArg)
+{
+	KNNPairsData &data=*((KNNPairsData *)thArg.workClass);
+	const Matrix2D<double> &X=*data.X;
+	Matrix2D<int> &idx=data.idx[thArg.thread_id];
+	Matrix2D<double> &distance=data.distance[thArg.thread_id];
+	size_t N=MAT_YSIZE(X);
+	size_t first, last;
+	while (data.td->getTasks(first, last))
+		for (size_t i1=first; i1<=last; ++i1)
+			for (size_t i2=i1+1; i2<N; ++i2)
+			{
+				double d=sampleDistance2(X,i1,i2,data.f);
+				insertNeighbour(idx,distance,i1,i2,d);
+				insertNeighbour(idx,distance,i2,i1,d);
+			}
+}
+
+// K nearest neighbours among those of all threads. Ties are resolved in
+// favour of the lowest index, as in the sequential search
+static void knnMergePairs(const KNNPairsData &data, Matrix2D<int> &idx, Matrix2D<double> &distance)
+{
+	int K=MAT_XSIZE(idx);
+	std::vector< std::pair<double,int> > candidates;
+	for (size_t i=0; i<MAT_YSIZE(idx); ++i)
+	{
+		candidates.clear();
+		for (size_t t=0; t<data.idx.size(); ++t)
+			for (int k=0; k<K; ++k)
+				if (MAT_ELEM(data.idx[t],i,k)>=0)
+					candidates.push_back(std::make_pair(MAT_ELEM(data.distance[t],i,k),MAT_ELEM(data.idx[t],i,k)));
+		std::sort(candidates.begin(),candidates.end());
+		for (int k=0; k<K && k<(int)candidates.size(); ++k)
+		{
+			MAT_ELEM(distance,i,k)=candidates[k].first;
+			MAT_ELEM(idx,i,k)=candidates[k].second;
+		}
+	}
+}
+
+void kNearestNeighboursExact(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance,
+                             DimRedDistance2 f, bool computeSqrt, int Nthreads)
+{
+	K=std::min(K,(int)MAT_YSIZE(X)-1);
+	idx.initConstant(MAT_YSIZE(X),K,-1);
+	distance.initConstant(MAT_YSIZE(X),K,1e38);
+	if (Nthreads<=1)
+	{
+		for (size_t i1=0; i1<MAT_YSIZE(X)-1; ++i1)
+			for (size_t i2=i1+1; i2<MAT_YSIZE(X); ++i2)
+			{
+				// Compute the distance between i1 and i2
+				double d=sampleDistance2(X,i1,i2,f);
 
-			// Check if they are nearest neighbours
-			insertNeighbour(idx,distance,i1,i2,d);
-			insertNeighbour(idx,distance,i2,i1,d);
+				// Check if they are nearest neighbours
+				insertNeighbour(idx,distance,i1,i2,d);
+				insertNeighbour(idx,distance,i2,i1,d);
+			}
+	}
+	else
+	{
+		// Each pair is computed once as in the loop above, each thread keeps
+		// its own neighbours that are merged at the end
+		KNNPairsData data;
+		data.X=&X;
+		data.f=f;
+		data.idx.resize(Nthreads);
+		data.distance.resize(Nthreads);
+		for (int t=0; t<Nthreads; ++t)
+		{
+			data.idx[t]=idx;
+			data.distance[t]=distance;
 		}
+		size_t N=MAT_YSIZE(X);
+		ThreadTaskDistributor td(N-1,XMIPP_MAX((N-1)/(20*Nthreads),1));
+		data.td=&td;
+		ThreadManager thMgr(Nthreads,&data);
+		thMgr.run(threadKnnPairs);
+		knnMergePairs(data,idx,distance);
+	}
 	if (computeSqrt)
 		FOR_ALL_ELEMENTS_IN_MATRIX2D(distance)
 			MAT_ELEM(distance,i,j)=sqrt(MAT_ELEM(distance,i,j));
 }
 
+void kNearestNeighboursApproximate(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance,
+                                   DimRedDistance2 f, bool computeSqrt, int Ntrees, int Nrefinements, int Nthreads)
+{
+	size_t N=MAT_YSIZE(X);
+	K=std::min(K,(int)N-1);
+	size_t leafSize=XMIPP_MAX(2*(size_t)(K+1),(size_t)16);
+	if (Ntrees<=0 || N<=2*leafSize)
+	{
+		// There are so few samples that the exhaustive search is faster
+		kNearestNeighboursExact(X,K,idx,distance,f,computeSqrt,Nthreads);
+		return;
+	}
+
+	// Build the trees
+	std::vector<RPTree> trees(Ntrees);
+	std::vector<double> proj(N);
+	for (int t=0; t<Ntrees; ++t)
+	{
+		RPTree &tree=trees[t];
+		tree.perm.resize(N);
+		for (size_t i=0; i<N; ++i)
+			tree.perm[i]=i;
+		tree.leafOf.resize(N);
+		rpTreeSplit(X,tree,0,N,leafSize,proj);
+		tree.leafStart.push_back(N);
+	}
+
+	// Candidates from the trees
+	KNNThreadData data;
+	data.X=&X;
+	data.f=f;
+	data.trees=&trees;
+	data.idxIn=NULL;
+	data.idx=&idx;
+	data.distance=&distance;
+	data.td=NULL;
+	idx.initConstant(N,K,-1);
+	distance.initConstant(N,K,1e38);
+	knnAllRows(data,Nthreads);
+
+	// Refinement with the neighbours of the neighbours. The new graph is computed from
+	// the previous one, so that the result does not depend on the order of the rows
+	Matrix2D<int> idxIn;
+	for (int r=0; r<Nrefinements; ++r)
+	{
+		idxIn=idx;
+		data.idxIn=&idxIn;
+		knnAllRows(data,Nthreads);
+	}
+
+	if (computeSqrt)
+		FOR_ALL_ELEMENTS_IN_MATRIX2D(distance)
+			MAT_ELEM(distance,i,j)=sqrt(MAT_ELEM(distance,i,j));
+}
+
+double nearestNeighboursRecall(const Matrix2D<int> &idxExact, const Matrix2D<int> &idxApprox)
+{
+	if (MAT_YSIZE(idxExact)!=MAT_YSIZE(idxApprox) || MAT_XSIZE(idxExact)!=MAT_XSIZE(idxApprox))
+		REPORT_ERROR(ERR_MATRIX_SIZE,"nearestNeighboursRecall: the neighbour matrices are of different size");
+	size_t found=0, total=0;
+	for (size_t i=0; i<MAT_YSIZE(idxExact); ++i)
+		for (size_t k=0; k<MAT_XSIZE(idxExact); ++k)
+		{
+			int j=MAT_ELEM(idxExact,i,k);
+			for (size_t kk=0; kk<MAT_XSIZE(idxApprox); ++kk)
+				if (MAT_ELEM(idxApprox,i,kk)==j)
+				{
+					++found;
+					break;
+				}
+			++total;
+		}
+	return total==0 ? 1.0 : (double)found/total;
+}
+
 void computeRandomPointsDistance(const Matrix2D<double> &X, Matrix1D<double> &distance, Matrix1D<int> ind1, Matrix1D<int> ind2, DimRedDistance2 f, bool computeSqrt)
 {
 	distance.initZeros();
@@ -267,11 +590,12 @@ void computeDistance(const Matrix2D<double> &X, Matrix2D<double> &distance, DimR
 		}
 }
 
-void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
+void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt,
+                                 int Ntrees, int Nthreads)
 {
 	Matrix2D<int> idx;
 	Matrix2D<double> kDistance;
-	kNearestNeighbours(X, K, idx, kDistance, f, computeSqrt);
+	kNearestNeighbours(X, K, idx, kDistance, f, computeSqrt, Ntrees, Nthreads);
 	distance.initZeros(MAT_YSIZE(X),MAT_YSIZE(X));
 	FOR_ALL_ELEMENTS_IN_MATRIX2D(kDistance)
 	{
@@ -280,6 +604,57 @@ void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<doub
 	}
 }
 
+void computeSparseSimilarityMatrix(const Matrix2D<double> &X, int K, double sigma, std::vector<SparseElement> &W,
+                                   DimRedDistance2 f, bool normalize, int Ntrees, int Nthreads)
+{
+	Matrix2D<int> idx;
+	Matrix2D<double> kDistance;
+	kNearestNeighbours(X, K, idx, kDistance, f, false, Ntrees, Nthreads);
+
+	// Symmetric graph
+	W.clear();
+	W.reserve(2*MAT_YSIZE(idx)*MAT_XSIZE(idx));
+	double maxDistance=0;
+	SparseElement e;
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(kDistance)
+	{
+		int idx_ij=MAT_ELEM(idx,i,j);
+		double dij=MAT_ELEM(kDistance,i,j);
+		if (idx_ij<0 || idx_ij==i || dij==0)
+			continue;
+		e.value=dij;
+		e.i=i;
+		e.j=idx_ij;
+		W.push_back(e);
+		e.i=idx_ij;
+		e.j=i;
+		W.push_back(e);
+		maxDistance=XMIPP_MAX(maxDistance,dij);
+	}
+
+	// Remove the pairs that are neighbours of each other (same distance in both directions)
+	std::sort(W.begin(),W.end());
+	size_t n=0;
+	for (size_t k=0; k<W.size(); ++k)
+		if (n==0 || W[k].i!=W[n-1].i || W[k].j!=W[n-1].j)
+			W[n++]=W[k];
+	W.resize(n);
+
+	// Gaussian kernel
+	if (!normalize || maxDistance==0)
+		maxDistance=1.0;
+	double iK=-0.5/(sigma*sigma*maxDistance);
+	for (size_t k=0; k<n; ++k)
+		W[k].value=exp(W[k].value*iK);
+}
+
+void sparseRowSum(const std::vector<SparseElement> &W, size_t N, Matrix1D<double> &d)
+{
+	d.initZeros(N);
+	for (size_t k=0; k<W.size(); ++k)
+		VEC_ELEM(d,W[k].i)+=W[k].value;
+}
+
 void computeSimilarityMatrix(Matrix2D<double> &D2, double sigma, bool skipZeros, bool normalize)
 {
 	double maxDistance=1.0;
@@ -311,7 +686,7 @@ void computeGraphLaplacian(const Matrix2D<double> &G, Matrix2D<double> &L)
 			MAT_ELEM(L,i,j)=-MAT_ELEM(G,i,j);
 }
 
-double intrinsicDimensionalityMLE(const Matrix2D<double> &X, DimRedDistance2 f)
+double intrinsicDimensionalityMLE(const Matrix2D<double> &X, DimRedDistance2 f, int Ntrees, int Nthreads)
 {
 	int k1=5;
 	int k2=12;
@@ -322,7 +697,7 @@ double intrinsicDimensionalityMLE(const Matrix2D<double> &X, DimRedDistance2 f)
 	}
 	Matrix2D<int> idx;
 	Matrix2D<double> distance;
-	kNearestNeighbours(X,k2,idx,distance,f);
+	kNearestNeighbours(X,k2,idx,distance,f,true,Ntrees,Nthreads);
 
 	// Estimate d
 	double dsum=0;
@@ -349,12 +724,12 @@ double intrinsicDimensionalityMLE(const Matrix2D<double> &X, DimRedDistance2 f)
 }
 
 // By correlation dimension
-double intrinsicDimensionalityCorrDim(const Matrix2D<double> &X, DimRedDistance2 f)
+double intrinsicDimensionalityCorrDim(const Matrix2D<double> &X, DimRedDistance2 f, int Ntrees, int Nthreads)
 {
 	int K=3;
 	Matrix2D<int> idx;
 	Matrix2D<double> distance;
-	kNearestNeighbours(X,K,idx,distance,f);
+	kNearestNeighbours(X,K,idx,distance,f,true,Ntrees,Nthreads);
 
 	// Compute median and maximum
 	size_t N=MAT_XSIZE(distance)*MAT_YSIZE(distance);
@@ -402,15 +777,16 @@ double intrinsicDimensionalityCorrDim(const Matrix2D<double> &X, DimRedDistance2
 	return 2*log(probLessMaxK/probLessMedianK)/log(maxVal/median);
 }
 
-double intrinsicDimensionality(Matrix2D<double> &X, const String &method, bool normalize, DimRedDistance2 f)
+double intrinsicDimensionality(Matrix2D<double> &X, const String &method, bool normalize, DimRedDistance2 f,
+                               int Ntrees, int Nthreads)
 {
 	if (normalize)
 		normalizeColumns(X);
 
 	if (method=="MLE")
-		return intrinsicDimensionalityMLE(X,f);
+		return intrinsicDimensionalityMLE(X,f,Ntrees,Nthreads);
 	else if (method=="CorrDim")
-		return intrinsicDimensionalityCorrDim(X,f);
+		return intrinsicDimensionalityCorrDim(X,f,Ntrees,Nthreads);
 	else
 		REPORT_ERROR(ERR_ARG_INCORRECT,"Unknown dimensionality estimate method");
 
@@ -435,6 +811,8 @@ DimRedAlgorithm::DimRedAlgorithm()
 {
 	X=NULL;
 	distance=NULL;
+	knnTrees=0;
+	knnThreads=1;
 }
 
 void DimRedAlgorithm::setInputData(Matrix2D<double> &X)
@@ -447,6 +825,12 @@ void DimRedAlgorithm::setOutputDimensionality(size_t outputDim)
 	this->outputDim=outputDim;
 }
 
+void DimRedAlgorithm::setNearestNeighboursSearch(int Ntrees, int Nthreads)
+{
+	knnTrees=XMIPP_MAX(Ntrees,0);
+	knnThreads=XMIPP_MAX(Nthreads,1);
+}
+
 const Matrix2D<double> &DimRedAlgorithm::getReducedData()
 {
 	return Y;
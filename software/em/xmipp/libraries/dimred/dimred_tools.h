@@ -27,6 +27,7 @@
 
 #include <data/matrix2d.h>
 #include <data/matrix1d.h>
+#include <vector>
 
 /**@defgroup DimRedTools Tools for dimensionality reduction
    @ingroup DimRedLibrary */
@@ -84,7 +85,8 @@ void computeRandomPointsDistance(const Matrix2D<double> &X, Matrix1D<double> &di
  * Each observation is a row of the matrix X.
  * If there are N observations, the size of distance is NxN.
  */
-void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<double> &distance, DimRedDistance2 f=NULL, bool computeSqrt=true);
+void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<double> &distance, DimRedDistance2 f=NULL, bool computeSqrt=true,
+                                 int Ntrees=0, int Nthreads=1);
 
 /** Compute a similarity matrix from a squared distance matrix.
  * dij=exp(-dij/(2*sigma^2))
@@ -92,6 +94,21 @@ void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<doub
  */
 void computeSimilarityMatrix(Matrix2D<double> &D2, double sigma, bool skipZeros=false, bool normalize=false);
 
+/** Sparse similarity matrix of the K nearest neighbours graph.
+ * Sparse counterpart of computeDistanceToNeighbours followed by
+ * computeSimilarityMatrix(D2,sigma,true,normalize): the graph is made symmetric,
+ * pairs at zero distance are not stored and the weights are
+ * wij=exp(-dij/(2*sigma^2)) with dij normalized by the largest neighbour
+ * distance if normalize is set. The elements are returned sorted by rows, without
+ * repetitions and without diagonal, so that they can be rescaled before building
+ * a SparseMatrix2D. The memory is proportional to N*K instead of N*N.
+ */
+void computeSparseSimilarityMatrix(const Matrix2D<double> &X, int K, double sigma, std::vector<SparseElement> &W,
+                                   DimRedDistance2 f=NULL, bool normalize=true, int Ntrees=0, int Nthreads=1);
+
+/** Row sums of a sparse matrix of size NxN given by its elements */
+void sparseRowSum(const std::vector<SparseElement> &W, size_t N, Matrix1D<double> &d);
+
 /** Compute graph laplacian.
  * L=D-G where D is a diagonal matrix with the row sums of G.
  */
@@ -111,7 +128,8 @@ void computeGraphLaplacian(const Matrix2D<double> &G, Matrix2D<double> &L);
  *
  * Original code by Laurens van der Maaten, Delft University of Technology
  */
-double intrinsicDimensionality(Matrix2D<double> &X, const String &method="MLE", bool normalize=true, DimRedDistance2 f=NULL);
+double intrinsicDimensionality(Matrix2D<double> &X, const String &method="MLE", bool normalize=true, DimRedDistance2 f=NULL,
+                               int Ntrees=0, int Nthreads=1);
 
 /** k-Nearest neighbours.
  * Given a data matrix (each row is a sample, each column a variable), this function
@@ -121,8 +139,40 @@ double intrinsicDimensionality(Matrix2D<double> &X, const String &method="MLE",
  * The element i,j of the output matrices is the index(distance) of the j-th nearest neighbor to the i-th sample.
  *
  * You can provide a distance function of your own. If not, Euclidean distance is used.
+ *
+ * If Ntrees>0 the approximate search is used with Ntrees random projection trees,
+ * otherwise the search is exhaustive. Nthreads is the number of threads of both searches.
+ * The functions that look for the neighbours of the samples take the same two parameters.
+ */
+void kNearestNeighbours(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f=NULL, bool computeSqrt=true,
+                        int Ntrees=0, int Nthreads=1);
+
+/** Exact k-nearest neighbours.
+ * Exhaustive search of the K nearest neighbours, see kNearestNeighbours.
+ * The distance of each pair of samples is computed once. The pairs are distributed
+ * among Nthreads threads, each of them with its own copy of idx and distance, f must
+ * be thread safe if Nthreads>1.
+ */
+void kNearestNeighboursExact(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance,
+                             DimRedDistance2 f=NULL, bool computeSqrt=true, int Nthreads=1);
+
+/** Approximate k-nearest neighbours.
+ * Same output as kNearestNeighbours. The candidate neighbours of each sample are
+ * the samples sharing a leaf with it in any of Ntrees random projection trees.
+ * The graph is then refined Nrefinements times looking for better neighbours
+ * among the neighbours of the neighbours. The trees split the samples with
+ * hyperplanes in the space of the rows of X; the distances are measured with f.
+ * The rows are distributed among Nthreads threads, f must be thread safe if Nthreads>1.
+ * The result does not depend on the number of threads.
  */
-void kNearestNeighbours(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f=NULL, bool computeSqrt=true);
+void kNearestNeighboursApproximate(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance,
+                                   DimRedDistance2 f=NULL, bool computeSqrt=true, int Ntrees=8, int Nrefinements=2,
+                                   int Nthreads=1);
+
+/** Fraction of the exact neighbours found by an approximate search.
+ * Both matrices are those returned by kNearestNeighbours for the same data.
+ */
+double nearestNeighboursRecall(const Matrix2D<int> &idxExact, const Matrix2D<int> &idxApprox);
 
 /** Extract k-nearest neighbours.
  * This function extracts from the matrix X, the neighbours given by idx for the i-th observation.
@@ -145,6 +195,12 @@ public:
 	/// Distance function
 	DimRedDistance2 distance;
 
+	/// Random projection trees of the nearest neighbours search (0=exhaustive search)
+	int knnTrees;
+
+	/// Threads of the nearest neighbours search
+	int knnThreads;
+
 	/// Save mapping
 	FileName fnMapping;
 public:
@@ -157,6 +213,9 @@ public:
 	/// Set output dimensionality
 	void setOutputDimensionality(size_t outputDim);
 
+	/** Set the nearest neighbours search, see kNearestNeighbours */
+	void setNearestNeighboursSearch(int Ntrees, int Nthreads=1);
+
 	/// Reduce dimensionality
 	virtual void reduceDimensionality()=0;
 
@@ -33,7 +33,7 @@ void HessianLLE::reduceDimensionality()
     Matrix2D<int> neighboursMatrix;
     Matrix2D<double> distanceNeighboursMatrix;
 
-    kNearestNeighbours(*X, kNeighbours, neighboursMatrix, distanceNeighboursMatrix);
+    kNearestNeighbours(*X, kNeighbours, neighboursMatrix, distanceNeighboursMatrix, NULL, true, knnTrees, knnThreads);
 
     size_t sizeY = MAT_YSIZE(*X);
     size_t dp = outputDim * (outputDim+1)/2;
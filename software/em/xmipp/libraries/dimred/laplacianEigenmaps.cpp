@@ -25,19 +25,58 @@
  ***************************************************************************/
 
 #include "laplacianEigenmaps.h"
+#include <data/sparse_matrix2d.h>
 
-void LaplacianEigenmap::setSpecificParameters(double sigma, size_t numberOfNeighbours)
+void LaplacianEigenmap::setSpecificParameters(double sigma, size_t numberOfNeighbours, bool useSparse)
 {
 	this->sigma=sigma;
 	this->numberOfNeighbours=numberOfNeighbours;
+	this->useSparse=useSparse;
+}
+
+// The generalized problem Ly=lambda*Dy is equivalent to D^-1/2 W D^-1/2 v=(1-lambda)v
+// with y=D^-1/2 v, so that the smallest eigenvalues of the first are the largest ones
+// of the normalized affinity.
+static void sparseLaplacianEigenmap(const Matrix2D<double> &X, size_t numberOfNeighbours, double sigma,
+                                    DimRedDistance2 distance, int Ntrees, int Nthreads, size_t outputDim, Matrix2D<double> &Y)
+{
+	size_t N=MAT_YSIZE(X);
+	std::vector<SparseElement> W;
+	computeSparseSimilarityMatrix(X,numberOfNeighbours,sigma,W,distance,true,Ntrees,Nthreads);
+
+	// Isolated samples (all their neighbours at distance 0) are left out of the graph
+	Matrix1D<double> isqrtD;
+	sparseRowSum(W,N,isqrtD);
+	FOR_ALL_ELEMENTS_IN_MATRIX1D(isqrtD)
+		if (VEC_ELEM(isqrtD,i)>0)
+			VEC_ELEM(isqrtD,i)=1/sqrt(VEC_ELEM(isqrtD,i));
+	for (size_t k=0; k<W.size(); ++k)
+		W[k].value*=VEC_ELEM(isqrtD,W[k].i)*VEC_ELEM(isqrtD,W[k].j);
+	SparseMatrix2D S(W,N);
+
+	Matrix1D<double> eigval;
+	Matrix2D<double> eigvec;
+	firstEigs(S,outputDim+1,eigval,eigvec);
+
+	// The first eigenvector is the trivial one
+	Y.resizeNoCopy(N,outputDim);
+	for (size_t i=0; i<N; ++i)
+		for (size_t j=0; j<outputDim; ++j)
+			MAT_ELEM(Y,i,j)=MAT_ELEM(eigvec,i,j+1)*VEC_ELEM(isqrtD,i);
 }
 
 void LaplacianEigenmap::reduceDimensionality()
 {
+	if (useSparse)
+	{
+		sparseLaplacianEigenmap(*X,numberOfNeighbours,sigma,distance,knnTrees,knnThreads,outputDim,Y);
+		return;
+	}
+
 	Matrix2D<double> G,L,D;
 	Matrix1D<double> mappedX;
 	//Construct neighborhood graph
-	computeDistanceToNeighbours(*X,numberOfNeighbours,G,distance,false);
+	computeDistanceToNeighbours(*X,numberOfNeighbours,G,distance,false,knnTrees,knnThreads);
 	//Compute Gaussian kernel(heat kernel based weights)
 	computeSimilarityMatrix(G,sigma,true,true);
 	//Compute Laplacian
@@ -39,9 +39,14 @@ class LaplacianEigenmap: public DimRedAlgorithm
 public:
 	double sigma;
 	size_t numberOfNeighbours;
+	bool useSparse;
 public:
-	/// Set specific parameters
-	void setSpecificParameters(double sigma=1.0, size_t numberOfNeighbours=7);
+	/** Set specific parameters.
+	 * If useSparse is set, the neighbourhood graph is kept as a sparse matrix and
+	 * the eigenvectors are computed with a Lanczos iteration. The memory is then
+	 * proportional to the number of samples instead of its square.
+	 */
+	void setSpecificParameters(double sigma=1.0, size_t numberOfNeighbours=7, bool useSparse=false);
 
 	/// Reduce dimensionality
 	void reduceDimensionality();
@@ -25,10 +25,50 @@
 
 #include "lpp.h"
 
-void LPP::setSpecificParameters(int k, double sigma)
+void LPP::setSpecificParameters(int k, double sigma, bool useSparse)
 {
 	this->k=k;
 	this->sigma=sigma;
+	this->useSparse=useSparse;
+}
+
+// DP=X^t W X and LP=X^t L X computed from the sparse similarity matrix W, with L=D-W
+static void sparseLPPMatrices(const Matrix2D<double> &X, int k, double sigma, DimRedDistance2 distance,
+                              int Ntrees, int Nthreads, Matrix2D<double> &DP, Matrix2D<double> &LP)
+{
+	size_t N=MAT_YSIZE(X);
+	size_t d=MAT_XSIZE(X);
+	std::vector<SparseElement> W;
+	computeSparseSimilarityMatrix(X,k,sigma,W,distance,true,Ntrees,Nthreads);
+	Matrix1D<double> degree;
+	sparseRowSum(W,N,degree);
+
+	Matrix2D<double> WX(N,d);
+	for (size_t n=0; n<W.size(); ++n)
+	{
+		const SparseElement &e=W[n];
+		double *ptrWX=&MAT_ELEM(WX,e.i,0);
+		const double *ptrX=&MAT_ELEM(X,e.j,0);
+		for (size_t j=0; j<d; ++j)
+			ptrWX[j]+=e.value*ptrX[j];
+	}
+
+	DP.resizeNoCopy(d,d);
+	LP.resizeNoCopy(d,d);
+	for (size_t i=0; i<d; ++i)
+		for (size_t j=i; j<d; ++j)
+		{
+			double auxD=0., auxL=0.;
+			for (size_t n=0; n<N; ++n)
+			{
+				double xni=MAT_ELEM(X,n,i);
+				double wxnj=MAT_ELEM(WX,n,j);
+				auxD+=xni*wxnj;
+				auxL+=xni*(VEC_ELEM(degree,n)*MAT_ELEM(X,n,j)-wxnj);
+			}
+			MAT_ELEM(DP,i,j)=MAT_ELEM(DP,j,i)=auxD;
+			MAT_ELEM(LP,i,j)=MAT_ELEM(LP,j,i)=auxL;
+		}
 }
 /** Reduce dimensionality method based on the Locality Preserving Projections (LPP) algorithm.
  *  These are linear projective maps that arise by solving a variational problem
@@ -36,20 +76,25 @@ void LPP::setSpecificParameters(int k, double sigma)
  */
 void LPP::reduceDimensionality()
 {
-	// Compute the distance to the k nearest neighbors
-	Matrix2D<double> D2;
-	computeDistanceToNeighbours(*X, k, D2, distance, false);
+	Matrix2D<double> DP, LP;
+	if (useSparse)
+		sparseLPPMatrices(*X, k, sigma, distance, knnTrees, knnThreads, DP, LP);
+	else
+	{
+		// Compute the distance to the k nearest neighbors
+		Matrix2D<double> D2;
+		computeDistanceToNeighbours(*X, k, D2, distance, false, knnTrees, knnThreads);
 
-	// Compute similarity matrix
-	computeSimilarityMatrix(D2,sigma,true,true);
+		// Compute similarity matrix
+		computeSimilarityMatrix(D2,sigma,true,true);
 
-	// Compute graph laplacian
-	Matrix2D<double> L;
-	computeGraphLaplacian(D2,L);
+		// Compute graph laplacian
+		Matrix2D<double> L;
+		computeGraphLaplacian(D2,L);
 
-	Matrix2D<double> DP, LP;
-	matrixOperation_XtAX_symmetric(*X,D2,DP);
-	matrixOperation_XtAX_symmetric(*X,L,LP);
+		matrixOperation_XtAX_symmetric(*X,D2,DP);
+		matrixOperation_XtAX_symmetric(*X,L,LP);
+	}
 
 	// Compute eigenvalues and eigenvectors resolving the generalized eigenvector problem
 	Matrix2D<double> Peigvec, eigvector;
@@ -39,9 +39,13 @@ class LPP: public DimRedAlgorithm
 public:
 	int k;
 	double sigma;
+	bool useSparse;
 public:
-	/// Set specific parameters
-	void setSpecificParameters(int k=12, double sigma=1.);
+	/** Set specific parameters.
+	 * If useSparse is set, the neighbourhood graph is kept as a sparse matrix
+	 * and the NxN matrices are never built.
+	 */
+	void setSpecificParameters(int k=12, double sigma=1., bool useSparse=false);
 
 	/// Reduce dimensionality
 	void reduceDimensionality();
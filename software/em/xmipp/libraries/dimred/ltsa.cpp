@@ -60,7 +60,7 @@ void LTSA::computeAlignmentMatrix(Matrix2D<double> &B)
 	size_t n = MAT_YSIZE(*X);
 	Matrix2D<int> ni;
 	Matrix2D<double> D;
-	kNearestNeighbours(*X, k, ni, D);
+	kNearestNeighbours(*X, k, ni, D, NULL, true, knnTrees, knnThreads);
 	Matrix2D<double> Xi(MAT_XSIZE(ni), MAT_XSIZE(*X)), W, Vi, Vi2, Si, Gi;
 
 	B.initIdentity(n);
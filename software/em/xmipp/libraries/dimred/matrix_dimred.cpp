@@ -53,6 +53,12 @@ void ProgDimRed::readParams()
     	Niter=getIntParam("-m",1);
     if (dimRefMethod=="SPE")
     	global=getIntParam("-m",2)==1;
+    Ntrees=0;
+    if (checkParam("--approxNeighbours"))
+    	Ntrees=getIntParam("--approxNeighbours");
+    Nthreads=getIntParam("--thr");
+    useSparse=checkParam("--sparse");
+    kSparse=getIntParam("--sparseK");
 }
 
 // Show ====================================================================
@@ -77,6 +83,13 @@ void ProgDimRed::show()
     	std::cout << "Niter=" << Niter << std::endl;
     if (dimRefMethod=="SPE")
     	std::cout << "Global=" << global << std::endl;
+    if (Ntrees>0)
+    	std::cout << "Approximate neighbours with " << Ntrees << " trees" << std::endl;
+    if (useSparse)
+    	std::cout << "Sparse eigensolver" << std::endl;
+    if (useSparse && dimRefMethod=="DM")
+    	std::cout << "Neighbours of the sparse kernel=" << kSparse << std::endl;
+    std::cout << "Threads=" << Nthreads << std::endl;
 }
 
 // usage ===================================================================
@@ -104,6 +117,14 @@ void ProgDimRed::defineParams()
     addParamsLine("  [--saveMapping <fn=\"\">] : Save mapping if available (PCA, LLTSA, LPP, pPCA, NPE) so that it can be reused later (Y=X*M)");
     addParamsLine("                            :+X is the input matrix with individuals as rows");
     addParamsLine("                            :+Y is the output matrix with individuals as rows");
+    addParamsLine("  [--approxNeighbours <trees=8>] : Approximate nearest neighbours search (LTSA, LLTSA, LPP, LE, HLLE, NPE)");
+    addParamsLine("                            :+The candidates are taken from this number of random projection trees.");
+    addParamsLine("                            :+By default, the search is exhaustive, which is quadratic in the number of individuals");
+    addParamsLine("  [--thr <N=1>]             : Number of threads for the nearest neighbours search");
+    addParamsLine("  [--sparse]                : Sparse neighbourhood graph and eigensolver (LPP, LE, DM)");
+    addParamsLine("                            :+The memory is proportional to the number of individuals instead of its square.");
+    addParamsLine("                            :+LPP and LE use the k nearest neighbours of their method parameters.");
+    addParamsLine("  [--sparseK <k=12>]        : Number of nearest neighbours of the sparse DM kernel (only with --sparse)");
 }
 
 // Produce Side info  ====================================================================
@@ -119,7 +140,7 @@ void ProgDimRed::produceSideInfo()
     } else if (dimRefMethod=="DM")
     {
     	algorithm=&algorithmDiffusionMaps;
-    	algorithmDiffusionMaps.setSpecificParameters(t,sigma);
+    	algorithmDiffusionMaps.setSpecificParameters(t,sigma,useSparse ? kSparse : 0);
     } else if (dimRefMethod=="LLTSA")
     {
     	algorithm=&algorithmLLTSA;
@@ -127,7 +148,7 @@ void ProgDimRed::produceSideInfo()
     } else if (dimRefMethod=="LPP")
     {
     	algorithm=&algorithmLPP;
-    	algorithmLPP.setSpecificParameters(kNN,sigma);
+    	algorithmLPP.setSpecificParameters(kNN,sigma,useSparse);
     } else if (dimRefMethod=="kPCA")
     {
     	algorithm=&algorithmKernelPCA;
@@ -139,7 +160,7 @@ void ProgDimRed::produceSideInfo()
     } else if (dimRefMethod=="LE")
     {
     	algorithm=&algorithmLaplacianEigenmap;
-    	algorithmLaplacianEigenmap.setSpecificParameters(sigma,kNN);
+    	algorithmLaplacianEigenmap.setSpecificParameters(sigma,kNN,useSparse);
     } else if (dimRefMethod=="HLLE")
     {
     	algorithm=&algorithmHessianLLE;
@@ -156,12 +177,13 @@ void ProgDimRed::produceSideInfo()
 
     algorithm->setOutputDimensionality(outputDim);
     algorithm->fnMapping=fnMapping;
+    algorithm->setNearestNeighboursSearch(Ntrees,Nthreads);
 }
 
 // Estimate dimension
 void ProgDimRed::estimateDimension()
 {
-	outputDim=intrinsicDimensionality(X, dimEstMethod, false, algorithm->distance);
+	outputDim=intrinsicDimensionality(X, dimEstMethod, false, algorithm->distance, algorithm->knnTrees, algorithm->knnThreads);
     algorithm->setOutputDimensionality(outputDim);
 	std::cout << "Estimated dimensionality: " << outputDim << std::endl;
 	if (outputDim<=0)
@@ -63,6 +63,14 @@ public:
     double t; // Markov random walk
     double sigma; // Sigma of kernel
     bool global; // Global for SPE
+    /** Number of random projection trees for the approximate nearest neighbours (0=exact search) */
+    int Ntrees;
+    /** Number of threads */
+    int Nthreads;
+    /** Sparse neighbourhood graph and eigensolver (LPP, LE, DM) */
+    bool useSparse;
+    /** Number of neighbours of the sparse DM kernel */
+    int kSparse;
 public:
     Matrix2D<double> X; // Input data
     DimRedAlgorithm*  algorithm;
@@ -96,7 +96,7 @@ void NeighbourhoodCA::reduceDimensionality()
 {
 	Matrix2D<double> D2;
 	subtractColumnMeans(*X);
-	kNearestNeighbours(*X, K, idx, D2, distance, false);
+	kNearestNeighbours(*X, K, idx, D2, distance, false, knnTrees, knnThreads);
 
 	size_t d=MAT_XSIZE(*X);
     A.initGaussian(d,outputDim,0,0.01);
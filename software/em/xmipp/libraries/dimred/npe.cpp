@@ -45,7 +45,7 @@ void NPE::reduceDimensionality()
 	//Find nearest neighbours
 	Matrix2D<double> D;
 	Matrix2D<int> idx;
-	kNearestNeighbours(*X,k,idx,D,distance,false);
+	kNearestNeighbours(*X,k,idx,D,distance,false,knnTrees,knnThreads);
 
 	Matrix2D<double> W(k,n), Xi, C, M;
 	Matrix1D<double> wi;
@@ -130,7 +130,11 @@ void ProgTransformDimRed::produceSideInfo()
     // Set distance
     prog=this;
     if (distance=="Correlation")
+    {
+    	// The alignment of the correlation distance is not thread safe
     	algorithm->distance=&correlationDistance;
+    	algorithm->setNearestNeighboursSearch(Ntrees,1);
+    }
     else
     	algorithm->distance=NULL;
 }
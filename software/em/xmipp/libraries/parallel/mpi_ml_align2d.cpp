@@ -132,49 +132,25 @@ void MpiProgML2D::produceSideInfo2()
 
 void MpiProgML2D::expectation()
 {
-    MultidimArray<double> Maux;
-    double aux;
-    Maux.resize(dim, dim);
-    Maux.setXmippOrigin();
-
     ProgML2D::expectation();
     //After expectation, collect data from all nodes
     // Here MPI_allreduce of all wsums,LL and sumfracweight !!!
-    MPI_Allreduce(&LL, &aux, 1, MPI_DOUBLE, MPI_SUM,
-                  MPI_COMM_WORLD);
-    LL = aux;
-    MPI_Allreduce(&sumfracweight, &aux, 1, MPI_DOUBLE, MPI_SUM,
-                  MPI_COMM_WORLD);
-    sumfracweight = aux;
-    MPI_Allreduce(&wsum_sigma_noise, &aux, 1, MPI_DOUBLE,
-                  MPI_SUM, MPI_COMM_WORLD);
-    wsum_sigma_noise = aux;
-    MPI_Allreduce(&wsum_sigma_offset, &aux, 1, MPI_DOUBLE,
-                  MPI_SUM, MPI_COMM_WORLD);
-    wsum_sigma_offset = aux;
+    // All of them are packed into a single buffer and reduced at once
+    reduction.clear();
+    reduction.add(LL);
+    reduction.add(sumfracweight);
+    reduction.add(wsum_sigma_noise);
+    reduction.add(wsum_sigma_offset);
     for (int refno = 0; refno < model.n_ref * factor_nref; refno++)
     {
-        MPI_Allreduce(MULTIDIM_ARRAY(wsum_Mref[refno]),
-                      MULTIDIM_ARRAY(Maux),
-                      MULTIDIM_SIZE(wsum_Mref[refno]), MPI_DOUBLE,
-                      MPI_SUM, MPI_COMM_WORLD);
-        wsum_Mref[refno] = Maux;
-        MPI_Allreduce(&sumw[refno], &aux, 1, MPI_DOUBLE,
-                      MPI_SUM, MPI_COMM_WORLD);
-        sumw[refno] = aux;
-        MPI_Allreduce(&sumwsc2[refno], &aux, 1, MPI_DOUBLE,
-                      MPI_SUM, MPI_COMM_WORLD);
-        sumwsc2[refno] = aux;
-        MPI_Allreduce(&sumw_mirror[refno], &aux, 1, MPI_DOUBLE,
-                      MPI_SUM, MPI_COMM_WORLD);
-        sumw_mirror[refno] = aux;
-        MPI_Allreduce(&sumw2[refno], &aux, 1, MPI_DOUBLE,
-                      MPI_SUM, MPI_COMM_WORLD);
-        sumw2[refno] = aux;
-        MPI_Allreduce(&sumwsc[refno], &aux, 1, MPI_DOUBLE,
-                      MPI_SUM, MPI_COMM_WORLD);
-        sumwsc[refno] = aux;
+        reduction.add(wsum_Mref[refno]);
+        reduction.add(sumw[refno]);
+        reduction.add(sumwsc2[refno]);
+        reduction.add(sumw_mirror[refno]);
+        reduction.add(sumw2[refno]);
+        reduction.add(sumwsc[refno]);
     }
+    reduction.allReduce();
 }//end of expectation
 
 void MpiProgML2D::endIteration()
@@ -182,6 +158,9 @@ void MpiProgML2D::endIteration()
     // Write output files
     sendDocfile(docfiledata);
     writeOutputFiles(model, OUT_ITER);
+    if (node->isMaster() && verbose)
+        std::cout << "  MPI reduction time: " << reduction.getCommunicationTime() << " s" << std::endl;
+    reduction.resetCommunicationTime();
 }
 
 void MpiProgML2D::writeOutputFiles(const ModelML2D &model, OutputType outputType)
@@ -321,69 +300,36 @@ MpiProgMLF2D::MpiProgMLF2D(MpiNode * node):MpiML2DBase(this, node)
 
 void MpiProgMLF2D::expectation()
 {
-    MultidimArray<double> Maux, Vaux;
-    double aux;
-    Maux.resize(dim, dim);
-    Maux.setXmippOrigin();
-
     ProgMLF2D::expectation();
-    MPI_Allreduce(&LL, &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    LL = aux;
-    MPI_Allreduce(&sumcorr, &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    sumcorr = aux;
-    MPI_Allreduce(&wsum_sigma_offset, &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    wsum_sigma_offset = aux;
+    // All accumulators are packed into a single buffer and reduced at once
+    reduction.clear();
+    reduction.add(LL);
+    reduction.add(sumcorr);
+    reduction.add(wsum_sigma_offset);
     if (do_kstest)
     {
-        Vaux.resize(sumhist);
-        MPI_Allreduce(MULTIDIM_ARRAY(sumhist), MULTIDIM_ARRAY(Vaux),
-                      MULTIDIM_SIZE(sumhist), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Vaux)
-        DIRECT_MULTIDIM_ELEM(sumhist, n) = DIRECT_MULTIDIM_ELEM(Vaux, n);
+        reduction.add(sumhist);
         for (size_t ires = 0; ires < hdim; ires++)
-        {
-            Vaux.resize(sumhist);
-            MPI_Allreduce(MULTIDIM_ARRAY(resolhist[ires]), MULTIDIM_ARRAY(Vaux),
-                          MULTIDIM_SIZE(resolhist[ires]), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-            FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Vaux)
-            DIRECT_MULTIDIM_ELEM(resolhist[ires], n) = DIRECT_MULTIDIM_ELEM(Vaux, n);
-        }
+            reduction.add(resolhist[ires]);
     }
     for (int refno = 0;refno < model.n_ref; refno++)
     {
-        MPI_Allreduce(MULTIDIM_ARRAY(wsum_Mref[refno]), MULTIDIM_ARRAY(Maux),
-                      MULTIDIM_SIZE(wsum_Mref[refno]), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        wsum_Mref[refno] = Maux;
+        reduction.add(wsum_Mref[refno]);
         if (do_ctf_correction)
-        {
-            MPI_Allreduce(MULTIDIM_ARRAY(wsum_ctfMref[refno]), MULTIDIM_ARRAY(Maux),
-                          MULTIDIM_SIZE(wsum_ctfMref[refno]), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-            wsum_ctfMref[refno] = Maux;
-        }
-        MPI_Allreduce(&sumw[refno], &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        sumw[refno] = aux;
-        MPI_Allreduce(&sumw2[refno], &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        sumw2[refno] = aux;
-        MPI_Allreduce(&sumwsc2[refno], &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        sumwsc2[refno] = aux;
-        MPI_Allreduce(&sumwsc[refno], &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        sumwsc[refno] = aux;
-        MPI_Allreduce(&sumw_mirror[refno], &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        sumw_mirror[refno] = aux;
+            reduction.add(wsum_ctfMref[refno]);
+        reduction.add(sumw[refno]);
+        reduction.add(sumw2[refno]);
+        reduction.add(sumwsc2[refno]);
+        reduction.add(sumwsc[refno]);
+        reduction.add(sumw_mirror[refno]);
     }
     for (size_t ifocus = 0;ifocus < nr_focus;ifocus++)
     {
-        for (size_t ii = 0; ii <  Mwsum_sigma2[ifocus].size(); ii++)
-        {
-            MPI_Allreduce(&Mwsum_sigma2[ifocus][ii], &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-            Mwsum_sigma2[ifocus][ii] = aux;
-        }
+        reduction.add(Mwsum_sigma2[ifocus]);
         if (do_student)
-        {
-            MPI_Allreduce(&sumw_defocus[ifocus], &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-            sumw_defocus[ifocus] = aux;
-        }
+            reduction.add(sumw_defocus[ifocus]);
     }
+    reduction.allReduce();
 }//end of expectation
 
 void MpiProgMLF2D::produceSideInfo2()
@@ -490,39 +436,21 @@ void MpiProgMLTomo::expectation(MetaData &MDimg, std::vector< Image<double> > &I
 {
     ProgMLTomo::expectation(MDimg,Iref,iter,LL,sumfracweight,wsumimgs,wsumweds,wsum_sigma_noise,wsum_sigma_offset,sumw);
 
-    double aux;
-    MultidimArray<double> Vaux; //1D
-    MultidimArray<double> Maux, Maux2; //3D
-
-    Maux.resize(dim, dim, dim);
-    Maux.setXmippOrigin();
-    Maux2.resize(dim, dim, hdim+1);
-
     // Here MPI_allreduce of all wsums,LL and sumcorr !!!
-    MPI_Allreduce(&LL, &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    LL = aux;
-    MPI_Allreduce(&sumfracweight, &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    sumfracweight = aux;
-    MPI_Allreduce(&wsum_sigma_noise, &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    wsum_sigma_noise = aux;
-    MPI_Allreduce(&wsum_sigma_offset, &aux, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    wsum_sigma_offset = aux;
-    Vaux.resize(nr_ref);
-    MPI_Allreduce(MULTIDIM_ARRAY(sumw), MULTIDIM_ARRAY(Vaux),
-                  MULTIDIM_SIZE(sumw), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    sumw = Vaux;
+    // All of them are packed into a single buffer and reduced at once
+    reduction.clear();
+    reduction.add(LL);
+    reduction.add(sumfracweight);
+    reduction.add(wsum_sigma_noise);
+    reduction.add(wsum_sigma_offset);
+    reduction.add(sumw);
     for (int refno = 0; refno < 2*nr_ref; ++refno)
     {
-        MPI_Allreduce(MULTIDIM_ARRAY(wsumimgs[refno]), MULTIDIM_ARRAY(Maux),
-                      MULTIDIM_SIZE(wsumimgs[refno]), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        wsumimgs[refno] = Maux;
+        reduction.add(wsumimgs[refno]);
         if (do_missing)
-        {
-            MPI_Allreduce(MULTIDIM_ARRAY(wsumweds[refno]), MULTIDIM_ARRAY(Maux2),
-                          MULTIDIM_SIZE(wsumweds[refno]), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-            wsumweds[refno] = Maux2;
-        }
+            reduction.add(wsumweds[refno]);
     }
+    reduction.allReduce();
 }
 
 ///Add info of some processed images to later write to files
@@ -44,6 +44,8 @@ protected:
     bool created_node;
     //Reference to the program to be parallelized
     XmippProgram * program;
+    //Packed reduction of the model accumulators
+    MpiPackedReduction reduction;
 
 public:
     /** Read arguments sequentially to avoid concurrency problems */
@@ -146,6 +148,8 @@ class MpiProgMLTomo: public ProgMLTomo
 {
 protected:
     MpiNode *node;
+    //Packed reduction of the model accumulators
+    MpiPackedReduction reduction;
 public:
     /** Constructor */
     MpiProgMLTomo();
@@ -229,6 +229,127 @@ void MpiNode::gatherMetadatas(MetaData &MD, const FileName &rootname)
     }
 }
 
+/* -------------------- MpiPackedReduction ---------------------- */
+MpiPackedReduction::MpiPackedReduction()
+{
+    pending = false;
+    commTime = 0;
+    t0 = 0;
+}
+
+MpiPackedReduction::~MpiPackedReduction()
+{
+    if (pending)
+        wait();
+}
+
+void MpiPackedReduction::clear()
+{
+    if (pending)
+        wait();
+    ptrs.clear();
+    sizes.clear();
+}
+
+void MpiPackedReduction::add(double &value)
+{
+    add(&value, 1);
+}
+
+void MpiPackedReduction::add(double *values, size_t n)
+{
+    if (pending)
+        REPORT_ERROR(ERR_UNCLASSIFIED, "MpiPackedReduction: cannot add variables while reducing");
+    if (n == 0)
+        return;
+    ptrs.push_back(values);
+    sizes.push_back(n);
+}
+
+void MpiPackedReduction::add(MultidimArray<double> &v)
+{
+    add(MULTIDIM_ARRAY(v), MULTIDIM_SIZE(v));
+}
+
+void MpiPackedReduction::add(std::vector<double> &v)
+{
+    if (!v.empty())
+        add(&(v[0]), v.size());
+}
+
+size_t MpiPackedReduction::size() const
+{
+    size_t n = 0;
+    for (size_t i = 0; i < sizes.size(); ++i)
+        n += sizes[i];
+    return n;
+}
+
+void MpiPackedReduction::pack()
+{
+    buffer.resize(size());
+    double *ptr = &(buffer[0]);
+    for (size_t i = 0; i < ptrs.size(); ++i)
+    {
+        memcpy(ptr, ptrs[i], sizes[i] * sizeof(double));
+        ptr += sizes[i];
+    }
+}
+
+void MpiPackedReduction::unpack()
+{
+    const double *ptr = &(buffer[0]);
+    for (size_t i = 0; i < ptrs.size(); ++i)
+    {
+        memcpy(ptrs[i], ptr, sizes[i] * sizeof(double));
+        ptr += sizes[i];
+    }
+}
+
+void MpiPackedReduction::allReduce(MPI_Op op, MPI_Comm comm)
+{
+    startAllReduce(op, comm);
+    wait();
+}
+
+void MpiPackedReduction::startAllReduce(MPI_Op op, MPI_Comm comm)
+{
+    if (pending)
+        wait();
+    if (ptrs.empty())
+        return;
+    pack();
+    t0 = MPI_Wtime();
+#if MPI_VERSION >= 3
+    MPI_Iallreduce(MPI_IN_PLACE, &(buffer[0]), buffer.size(), MPI_DOUBLE, op, comm, &request);
+#else
+    MPI_Allreduce(MPI_IN_PLACE, &(buffer[0]), buffer.size(), MPI_DOUBLE, op, comm);
+#endif
+    pending = true;
+}
+
+void MpiPackedReduction::wait()
+{
+    if (!pending)
+        return;
+#if MPI_VERSION >= 3
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+#endif
+    commTime += MPI_Wtime() - t0;
+    pending = false;
+    unpack();
+}
+
+double MpiPackedReduction::getCommunicationTime() const
+{
+    return commTime;
+}
+
+void MpiPackedReduction::resetCommunicationTime()
+{
+    commTime = 0;
+}
+
 /* -------------------- XmippMPIProgram ---------------------- */
 
 XmippMpiProgram::XmippMpiProgram()
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
+#include <vector>
 
 #include "data/xmipp_threads.h"
 #include "data/xmipp_program.h"
@@ -73,6 +74,96 @@ protected:
 
 };
 
+/** Packed reduction of model accumulators.
+ * Instead of reducing each accumulator with its own MPI call, all the
+ * scalars and arrays to reduce are registered in this object, copied into
+ * a single contiguous buffer and reduced with one collective call. This
+ * reduces the number of collectives per iteration from one per array to one,
+ * which makes a difference when there are many references and many nodes.
+ *
+ * The reduction can also be started without blocking (startAllReduce) so that
+ * other work is done while the data travels, and finished later with wait().
+ * Registered variables must not be modified between startAllReduce and wait.
+ * The time spent in communication is accumulated for reporting.
+ * @code
+ * MpiPackedReduction reduction;
+ * reduction.add(LL);
+ * for (int refno = 0; refno < nref; refno++)
+ *     reduction.add(wsum_Mref[refno]);
+ * reduction.allReduce();
+ * std::cout << "Communication time: " << reduction.getCommunicationTime() << std::endl;
+ * @endcode
+ */
+class MpiPackedReduction
+{
+protected:
+    // Registered variables
+    std::vector<double *> ptrs;
+    // Number of elements of each registered variable
+    std::vector<size_t> sizes;
+    // Contiguous buffer
+    std::vector<double> buffer;
+    // Request of the non-blocking reduction
+    MPI_Request request;
+    // There is a reduction in progress
+    bool pending;
+    // Accumulated communication time (seconds)
+    double commTime;
+    // Time at which the current reduction started
+    double t0;
+
+    /** Copy the registered variables into the buffer */
+    void pack();
+
+    /** Copy the buffer into the registered variables */
+    void unpack();
+
+public:
+    /** Empty constructor */
+    MpiPackedReduction();
+
+    /** Destructor. Waits for any pending reduction. */
+    ~MpiPackedReduction();
+
+    /** Unregister all variables */
+    void clear();
+
+    /** Register a scalar */
+    void add(double &value);
+
+    /** Register a C array */
+    void add(double *values, size_t n);
+
+    /** Register a multidimensional array */
+    void add(MultidimArray<double> &v);
+
+    /** Register a vector */
+    void add(std::vector<double> &v);
+
+    /** Total number of registered elements */
+    size_t size() const;
+
+    /** Reduce all registered variables in all nodes (blocking) */
+    void allReduce(MPI_Op op = MPI_SUM, MPI_Comm comm = MPI_COMM_WORLD);
+
+    /** Start the reduction without blocking.
+     * If the MPI library does not support non-blocking collectives,
+     * the reduction is performed here.
+     */
+    void startAllReduce(MPI_Op op = MPI_SUM, MPI_Comm comm = MPI_COMM_WORLD);
+
+    /** Wait for the reduction started with startAllReduce and copy the
+     * results into the registered variables */
+    void wait();
+
+    /** Accumulated communication time in seconds */
+    double getCommunicationTime() const;
+
+    /** Reset the accumulated communication time */
+    void resetCommunicationTime();
+}
+;//end of class MpiPackedReduction
+
 //mpi macros
 #define TAG_WORK   0
 #define TAG_STOP   1
@@ -34,15 +34,52 @@ ProgAngularContinuousAssign2::ProgAngularContinuousAssign2()
     produces_a_metadata = true;
     each_image_produces_an_output = true;
     projector = NULL;
-    ctfImage = NULL;
+    threadAux = NULL;
+    thMgr = NULL;
+    taskDistributor = NULL;
 }
 
 ProgAngularContinuousAssign2::~ProgAngularContinuousAssign2()
+{
+	delete thMgr;
+	delete taskDistributor;
+	delete [] threadAux;
+	delete projector;
+}
+
+ContinuousAssign2Aux::ContinuousAssign2Aux()
+{
+	prm = NULL;
+	projector = NULL;
+	ctfImage = NULL;
+}
+
+ContinuousAssign2Aux::~ContinuousAssign2Aux()
 {
 	delete projector;
 	delete ctfImage;
 }
 
+void ContinuousAssign2Aux::initialize(ProgAngularContinuousAssign2 *_prm)
+{
+	prm = _prm;
+	projector = new FourierProjector(prm->projector);
+
+	size_t Xdim = prm->Xdim;
+    Ip().initZeros(Xdim,Xdim);
+    E().initZeros(Xdim,Xdim);
+    Ifilteredp().initZeros(Xdim,Xdim);
+    Ifilteredp().setXmippOrigin();
+
+    // Low pass filter
+    filter.FilterBand=LOWPASS;
+    filter.w1=prm->Ts/prm->maxResol;
+    filter.raised_w=0.02;
+
+    // Transformation matrix
+    A.initIdentity(3);
+}
+
 // Read arguments ==========================================================
 void ProgAngularContinuousAssign2::readParams()
 {
@@ -68,6 +105,7 @@ void ProgAngularContinuousAssign2::readParams()
     penalization = getDoubleParam("--penalization");
     fnResiduals = getParam("--oresiduals");
     fnProjections = getParam("--oprojections");
+    Nthr = getIntParam("--thr");
 }
 
 // Show ====================================================================
@@ -98,6 +136,7 @@ void ProgAngularContinuousAssign2::show()
     << "Penalization:        " << penalization       << std::endl
     << "Output residuals:    " << fnResiduals        << std::endl
     << "Output projections:  " << fnProjections      << std::endl
+    << "Number of threads:   " << Nthr               << std::endl
     ;
 }
 
@@ -131,8 +170,11 @@ void ProgAngularContinuousAssign2::defineParams()
     addParamsLine("  [--penalization <l=100>]     : Penalization for the average term");
     addParamsLine("  [--oresiduals <stack=\"\">]  : Output stack for the residuals");
     addParamsLine("  [--oprojections <stack=\"\">] : Output stack for the projections");
+    addParamsLine("  [--thr <N=1>]                : Number of threads. The reference volume is shared by all of them");
     addExampleLine("A typical use is:",false);
     addExampleLine("xmipp_angular_continuous_assign2 -i anglesFromDiscreteAssignment.xmd --ref reference.vol -o assigned_angles.stk");
+    addExampleLine("Using 8 threads:",false);
+    addExampleLine("xmipp_angular_continuous_assign2 -i anglesFromDiscreteAssignment.xmd --ref reference.vol -o assigned_angles.stk --thr 8");
 }
 
 void ProgAngularContinuousAssign2::startProcessing()
@@ -152,11 +194,8 @@ void ProgAngularContinuousAssign2::preProcess()
     V.read(fnVol);
     V().setXmippOrigin();
     Xdim=XSIZE(V());
-
-    Ip().initZeros(Xdim,Xdim);
-    E().initZeros(Xdim,Xdim);
-    Ifilteredp().initZeros(Xdim,Xdim);
-    Ifilteredp().setXmippOrigin();
+    MultidimArray<double> mE;
+    mE.initZeros(Xdim,Xdim);
 
     // Construct mask
     if (Rmax<0)
@@ -172,8 +211,8 @@ void ProgAngularContinuousAssign2::preProcess()
     // Construct reference covariance
     FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mask2D)
     if (DIRECT_MULTIDIM_ELEM(mask2D,n))
-    	DIRECT_MULTIDIM_ELEM(E(),n)=rnd_gaus(0,1);
-    covarianceMatrix(E(),C0);
+    	DIRECT_MULTIDIM_ELEM(mE,n)=rnd_gaus(0,1);
+    covarianceMatrix(mE,C0);
     FOR_ALL_ELEMENTS_IN_MATRIX2D(C0)
     {
     	double val=MAT_ELEM(C0,i,j);
@@ -186,22 +225,21 @@ void ProgAngularContinuousAssign2::preProcess()
     // Construct projector
     projector = new FourierProjector(V(),pad,Ts/maxResol,BSPLINE3);
 
-    // Low pass filter
-    filter.FilterBand=LOWPASS;
-    filter.w1=Ts/maxResol;
-    filter.raised_w=0.02;
-
-    // Transformation matrix
-    A.initIdentity(3);
-
     // Continuous cost
     if (optimizeGrayValues)
     	contCost = CONTCOST_L1;
     else
     	contCost = CONTCOST_CORR;
+
+    // Working data of each thread, all of them share the projector coefficients
+    threadAux = new ContinuousAssign2Aux[Nthr];
+    for (int t=0; t<Nthr; t++)
+    	threadAux[t].initialize(this);
+    if (Nthr>1)
+    	thMgr = new ThreadManager(Nthr,this);
 }
 
-void ProgAngularContinuousAssign2::updateCTFImage(double defocusU, double defocusV, double angle)
+void ContinuousAssign2Aux::updateCTFImage(double defocusU, double defocusV, double angle)
 {
 	ctf.K=1; // get pure CTF with no envelope
 	currentDefocusU=ctf.DeltafU=defocusU;
@@ -214,38 +252,39 @@ void ProgAngularContinuousAssign2::updateCTFImage(double defocusU, double defocu
 		ctfImage->resizeNoCopy(projector->projection());
 		STARTINGY(*ctfImage)=STARTINGX(*ctfImage)=0;
 	}
-	ctf.generateCTF(YSIZE(projector->projection()),XSIZE(projector->projection()),*ctfImage,Ts);
-	if (phaseFlipped)
+	ctf.generateCTF(YSIZE(projector->projection()),XSIZE(projector->projection()),*ctfImage,prm->Ts);
+	if (prm->phaseFlipped)
 		FOR_ALL_ELEMENTS_IN_ARRAY2D(*ctfImage)
 			A2D_ELEM(*ctfImage,i,j)=fabs(A2D_ELEM(*ctfImage,i,j));
 }
 
 //#define DEBUG
-double tranformImage(ProgAngularContinuousAssign2 *prm, double rot, double tilt, double psi,
+double tranformImage(ContinuousAssign2Aux *aux, double rot, double tilt, double psi,
 		double a, double b, Matrix2D<double> &A, double deltaDefocusU, double deltaDefocusV, double deltaDefocusAngle, int degree)
 {
-    if (prm->hasCTF)
+	ProgAngularContinuousAssign2 *prm=aux->prm;
+    if (aux->hasCTF)
     {
-    	double defocusU=prm->old_defocusU+deltaDefocusU;
-    	double defocusV=prm->old_defocusV+deltaDefocusV;
-    	double angle=prm->old_defocusAngle+deltaDefocusAngle;
-    	if (defocusU!=prm->currentDefocusU || defocusV!=prm->currentDefocusV || angle!=prm->currentAngle)
-    		prm->updateCTFImage(defocusU,defocusV,angle);
+    	double defocusU=aux->old_defocusU+deltaDefocusU;
+    	double defocusV=aux->old_defocusV+deltaDefocusV;
+    	double angle=aux->old_defocusAngle+deltaDefocusAngle;
+    	if (defocusU!=aux->currentDefocusU || defocusV!=aux->currentDefocusV || angle!=aux->currentAngle)
+    		aux->updateCTFImage(defocusU,defocusV,angle);
     }
-	projectVolume(*(prm->projector), prm->P, (int)XSIZE(prm->I()), (int)XSIZE(prm->I()),  rot, tilt, psi, (const MultidimArray<double> *)prm->ctfImage);
+	projectVolume(*(aux->projector), aux->P, (int)XSIZE(aux->I()), (int)XSIZE(aux->I()),  rot, tilt, psi, (const MultidimArray<double> *)aux->ctfImage);
     double cost=0;
-	if (prm->old_flip)
+	if (aux->old_flip)
 	{
 		MAT_ELEM(A,0,0)*=-1;
 		MAT_ELEM(A,0,1)*=-1;
 		MAT_ELEM(A,0,2)*=-1;
 	}
 
-	applyGeometry(degree,prm->Ifilteredp(),prm->Ifiltered(),A,IS_NOT_INV,DONT_WRAP,0.);
-	const MultidimArray<double> &mP=prm->P();
+	applyGeometry(degree,aux->Ifilteredp(),aux->Ifiltered(),A,IS_NOT_INV,DONT_WRAP,0.);
+	const MultidimArray<double> &mP=aux->P();
 	const MultidimArray<int> &mMask2D=prm->mask2D;
-	MultidimArray<double> &mIfilteredp=prm->Ifilteredp();
-	MultidimArray<double> &mE=prm->E();
+	MultidimArray<double> &mIfilteredp=aux->Ifilteredp();
+	MultidimArray<double> &mE=aux->E();
 	mE.initZeros();
 	if (prm->contCost==CONTCOST_L1)
 	{
@@ -285,13 +324,13 @@ double tranformImage(ProgAngularContinuousAssign2 *prm, double rot, double tilt,
 #ifdef DEBUG
 	std::cout << "A=" << A << std::endl;
 	Image<double> save;
-	save()=prm->P();
+	save()=aux->P();
 	save.write("PPPtheo.xmp");
-	save()=prm->Ifilteredp();
+	save()=aux->Ifilteredp();
 	save.write("PPPfilteredp.xmp");
-	save()=prm->Ifiltered();
+	save()=aux->Ifiltered();
 	save.write("PPPfiltered.xmp");
-	save()=prm->E();
+	save()=aux->E();
 	save.write("PPPe.xmp");
 	//save()=prm->C;
 	//save.write("PPPc.xmp");
@@ -324,16 +363,17 @@ double continuous2cost(double *x, void *_prm)
 	double deltaDefocusU=x[11];
 	double deltaDefocusV=x[12];
 	double deltaDefocusAngle=x[13];
-	ProgAngularContinuousAssign2 *prm=(ProgAngularContinuousAssign2 *)_prm;
+	ContinuousAssign2Aux *aux=(ContinuousAssign2Aux *)_prm;
+	ProgAngularContinuousAssign2 *prm=aux->prm;
 	if (prm->maxShift>0 && deltax*deltax+deltay*deltay>prm->maxShift*prm->maxShift)
 		return 1e38;
 	if (fabs(scalex)>prm->maxScale || fabs(scaley)>prm->maxScale)
 		return 1e38;
 	if (fabs(deltaRot)>prm->maxAngularChange || fabs(deltaTilt)>prm->maxAngularChange || fabs(deltaPsi)>prm->maxAngularChange)
 		return 1e38;
-	if (fabs(a-prm->old_grayA)>prm->maxA)
+	if (fabs(a-aux->old_grayA)>prm->maxA)
 		return 1e38;
-	if (fabs(b)>prm->maxB*prm->Istddev)
+	if (fabs(b)>prm->maxB*aux->Istddev)
 		return 1e38;
 	if (fabs(deltaDefocusU)>prm->maxDefocusChange || fabs(deltaDefocusV)>prm->maxDefocusChange)
 		return 1e38;
@@ -348,19 +388,99 @@ double continuous2cost(double *x, void *_prm)
 //	[            -sin(2*t)*(sx/2 - sy/2), sy + sx*sin(t)^2 - sy*sin(t)^2 + 1]
 	double sin2_t=sin(scaleAngle)*sin(scaleAngle);
 	double sin_2t=sin(2*scaleAngle);
-	MAT_ELEM(prm->A,0,0)=1+scalex+(scaley-scalex)*sin2_t;
-	MAT_ELEM(prm->A,0,1)=0.5*(scaley-scalex)*sin_2t;
-	MAT_ELEM(prm->A,1,0)=MAT_ELEM(prm->A,0,1);
-	MAT_ELEM(prm->A,1,1)=1+scaley-(scaley-scalex)*sin2_t;
-	MAT_ELEM(prm->A,0,2)=prm->old_shiftX+deltax;
-	MAT_ELEM(prm->A,1,2)=prm->old_shiftY+deltay;
-	return tranformImage(prm,prm->old_rot+deltaRot, prm->old_tilt+deltaTilt, prm->old_psi+deltaPsi,
-			a, b, prm->A, deltaDefocusU, deltaDefocusV, deltaDefocusAngle, LINEAR);
+	MAT_ELEM(aux->A,0,0)=1+scalex+(scaley-scalex)*sin2_t;
+	MAT_ELEM(aux->A,0,1)=0.5*(scaley-scalex)*sin_2t;
+	MAT_ELEM(aux->A,1,0)=MAT_ELEM(aux->A,0,1);
+	MAT_ELEM(aux->A,1,1)=1+scaley-(scaley-scalex)*sin2_t;
+	MAT_ELEM(aux->A,0,2)=aux->old_shiftX+deltax;
+	MAT_ELEM(aux->A,1,2)=aux->old_shiftY+deltay;
+	return tranformImage(aux,aux->old_rot+deltaRot, aux->old_tilt+deltaTilt, aux->old_psi+deltaPsi,
+			a, b, aux->A, deltaDefocusU, deltaDefocusV, deltaDefocusAngle, LINEAR);
+}
+
+// Write an image holding the mutex. Several threads cannot write in the same stack at the same time
+void writeLocked(Mutex &mutex, Image<double> &I, const FileName &fn)
+{
+	mutex.lock();
+	try
+	{
+		I.write(fn);
+	}
+	catch (XmippError &XE)
+	{
+		mutex.unlock();
+		throw;
+	}
+	mutex.unlock();
+}
+
+// Queue or process an image ===============================================
+void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut)
+{
+	rowOut=rowIn;
+	if (Nthr==1)
+	{
+		assignImage(threadAux[0],fnImg,fnImgOut,rowIn,rowOut);
+		return;
+	}
+
+	// The row of the previous image has just been added to the output metadata
+	MetaData &mdOut=*getOutputMd();
+	if (!tasks.empty())
+		tasks.back().objId=mdOut.lastObject();
+	if (tasks.size()>=(size_t)(10*Nthr))
+		processTasks();
+
+	// The image is processed later by the threads, the output row is updated then
+	ContinuousAssign2Task task;
+	task.fnImg=fnImg;
+	task.fnImgOut=fnImgOut;
+	task.rowIn=rowIn;
+	task.rowOut=rowOut;
+	tasks.push_back(task);
+}
+
+void threadContinuousAssign2(ThreadArgument &thArg)
+{
+	ProgAngularContinuousAssign2 *prm=(ProgAngularContinuousAssign2 *)thArg.workClass;
+	ContinuousAssign2Aux &aux=prm->threadAux[thArg.thread_id];
+	size_t first, last;
+	while (prm->taskDistributor->getTasks(first, last))
+		for (size_t i=first; i<=last; i++)
+		{
+			ContinuousAssign2Task &task=prm->tasks[i];
+			prm->assignImage(aux,task.fnImg,task.fnImgOut,task.rowIn,task.rowOut);
+		}
+}
+
+void ProgAngularContinuousAssign2::processTasks()
+{
+	if (tasks.empty())
+		return;
+	taskDistributor=new ThreadTaskDistributor(tasks.size(),1);
+	thMgr->run(threadContinuousAssign2);
+	delete taskDistributor;
+	taskDistributor=NULL;
+
+	// Metadatas do not support threads, the rows are updated by the main thread
+	MetaData &mdOut=*getOutputMd();
+	for (size_t i=0; i<tasks.size(); i++)
+		mdOut.setRow(tasks[i].rowOut,tasks[i].objId);
+	tasks.clear();
+}
+
+void ProgAngularContinuousAssign2::processPendingImages()
+{
+	if (!tasks.empty())
+	{
+		tasks.back().objId=getOutputMd()->lastObject();
+		processTasks();
+	}
 }
 
 // Predict =================================================================
 //#define DEBUG
-void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut)
+void ProgAngularContinuousAssign2::assignImage(ContinuousAssign2Aux &aux, const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut)
 {
     rowOut=rowIn;
 
@@ -369,59 +489,69 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 //	geoParams.only_apply_shifts=false;
 //	geoParams.wrap=DONT_WRAP;
 
-	rowIn.getValue(MDL_ANGLE_ROT,old_rot);
-	rowIn.getValue(MDL_ANGLE_TILT,old_tilt);
-	rowIn.getValue(MDL_ANGLE_PSI,old_psi);
-	rowIn.getValue(MDL_SHIFT_X,old_shiftX);
-	rowIn.getValue(MDL_SHIFT_Y,old_shiftY);
-	rowIn.getValue(MDL_FLIP,old_flip);
+	rowIn.getValue(MDL_ANGLE_ROT,aux.old_rot);
+	rowIn.getValue(MDL_ANGLE_TILT,aux.old_tilt);
+	rowIn.getValue(MDL_ANGLE_PSI,aux.old_psi);
+	rowIn.getValue(MDL_SHIFT_X,aux.old_shiftX);
+	rowIn.getValue(MDL_SHIFT_Y,aux.old_shiftY);
+	rowIn.getValue(MDL_FLIP,aux.old_flip);
 	double old_scaleX=0, old_scaleY=0, old_scaleAngle=0;
-	old_grayA=1;
-	old_grayB=0;
+	aux.old_grayA=1;
+	aux.old_grayB=0;
 	if (rowIn.containsLabel(MDL_CONTINUOUS_SCALE_X))
 	{
 		rowIn.getValue(MDL_CONTINUOUS_SCALE_X,old_scaleX);
 		rowIn.getValue(MDL_CONTINUOUS_SCALE_Y,old_scaleY);
 		if (rowIn.containsLabel(MDL_CONTINUOUS_SCALE_ANGLE))
 			rowIn.getValue(MDL_CONTINUOUS_SCALE_ANGLE,old_scaleAngle);
-		rowIn.getValue(MDL_CONTINUOUS_X,old_shiftX);
-		rowIn.getValue(MDL_CONTINUOUS_Y,old_shiftY);
-		rowIn.getValue(MDL_CONTINUOUS_FLIP,old_flip);
+		rowIn.getValue(MDL_CONTINUOUS_X,aux.old_shiftX);
+		rowIn.getValue(MDL_CONTINUOUS_Y,aux.old_shiftY);
+		rowIn.getValue(MDL_CONTINUOUS_FLIP,aux.old_flip);
 	}
 
 	if (optimizeGrayValues && rowIn.containsLabel(MDL_CONTINUOUS_GRAY_A))
 	{
-		rowIn.getValue(MDL_CONTINUOUS_GRAY_A,old_grayA);
-		rowIn.getValue(MDL_CONTINUOUS_GRAY_B,old_grayB);
+		rowIn.getValue(MDL_CONTINUOUS_GRAY_A,aux.old_grayA);
+		rowIn.getValue(MDL_CONTINUOUS_GRAY_B,aux.old_grayB);
 	}
 
 	if (rowIn.containsLabel(MDL_CTF_DEFOCUSU) || rowIn.containsLabel(MDL_CTF_MODEL))
 	{
-		hasCTF=true;
-		ctf.readFromMdRow(rowIn);
-		ctf.produceSideInfo();
-		old_defocusU=ctf.DeltafU;
-		old_defocusV=ctf.DeltafV;
-		old_defocusAngle=ctf.azimuthal_angle;
+		aux.hasCTF=true;
+		mutexIO.lock();
+		try
+		{
+			aux.ctf.readFromMdRow(rowIn);
+		}
+		catch (XmippError &XE)
+		{
+			mutexIO.unlock();
+			throw;
+		}
+		mutexIO.unlock();
+		aux.ctf.produceSideInfo();
+		aux.old_defocusU=aux.ctf.DeltafU;
+		aux.old_defocusV=aux.ctf.DeltafV;
+		aux.old_defocusAngle=aux.ctf.azimuthal_angle;
 	}
 	else
-		hasCTF=false;
+		aux.hasCTF=false;
 
 	if (verbose>=2)
 		std::cout << "Processing " << fnImg << std::endl;
-	I.read(fnImg);
-	I().setXmippOrigin();
-	Istddev=I().computeStddev();
+	aux.I.read(fnImg);
+	aux.I().setXmippOrigin();
+	aux.Istddev=aux.I().computeStddev();
 
-    Ifiltered()=I();
-    filter.applyMaskSpace(Ifiltered());
+    aux.Ifiltered()=aux.I();
+    aux.filter.applyMaskSpace(aux.Ifiltered());
 
     Matrix1D<double> p(13), steps(13);
     // COSS: Gray values are optimized in transform_image_adjust_gray_values
     if (optimizeGrayValues)
     {
-		p(0)=old_grayA; // a in I'=a*I+b
-		p(1)=old_grayB; // b in I'=a*I+b
+		p(0)=aux.old_grayA; // a in I'=a*I+b
+		p(1)=aux.old_grayB; // b in I'=a*I+b
     }
     else
     {
@@ -453,15 +583,15 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 				steps(7)=steps(8)=steps(9)=1.;
 			if (optimizeDefocus)
 				steps(10)=steps(11)=steps(12)=1.;
-			powellOptimizer(p, 1, 13, &continuous2cost, this, 0.01, cost, iter, steps, verbose>=2);
+			powellOptimizer(p, 1, 13, &continuous2cost, &aux, 0.01, cost, iter, steps, verbose>=2);
 			if (cost>1e30 || (cost>0 && contCost==CONTCOST_CORR))
 			{
 				rowOut.setValue(MDL_ENABLED,-1);
 				p.initZeros();
 				if (optimizeGrayValues)
 				{
-					p(0)=old_grayA; // a in I'=a*I+b
-					p(1)=old_grayB; // b in I'=a*I+b
+					p(0)=aux.old_grayA; // a in I'=a*I+b
+					p(1)=aux.old_grayB; // b in I'=a*I+b
 				}
 				else
 				{
@@ -478,14 +608,14 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 				{
 					FileName fnResidual;
 					fnResidual.compose(fnImgOut.getPrefixNumber(),fnResiduals);
-					E.write(fnResidual);
+					writeLocked(mutexIO,aux.E,fnResidual);
 					rowOut.setValue(MDL_IMAGE_RESIDUAL,fnResidual);
 				}
 				if (fnProjections!="")
 				{
 					FileName fnProjection;
 					fnProjection.compose(fnImgOut.getPrefixNumber(),fnProjections);
-					P.write(fnProjection);
+					writeLocked(mutexIO,aux.P,fnProjection);
 					rowOut.setValue(MDL_IMAGE_REF,fnProjection);
 				}
 			}
@@ -498,36 +628,36 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 			// Apply
 			FileName fnOrig;
 			rowIn.getValue(MDL::str2Label(originalImageLabel),fnOrig);
-			I.read(fnImg);
-			if (XSIZE(Ip())!=XSIZE(I()))
+			aux.I.read(fnImg);
+			if (XSIZE(aux.Ip())!=XSIZE(aux.I()))
 			{
-				scaleToSize(BSPLINE3,Ip(),I(),XSIZE(Ip()),YSIZE(Ip()));
-				I()=Ip();
+				scaleToSize(BSPLINE3,aux.Ip(),aux.I(),XSIZE(aux.Ip()),YSIZE(aux.Ip()));
+				aux.I()=aux.Ip();
 			}
-			A(0,2)=p(2)+old_shiftX;
-			A(1,2)=p(3)+old_shiftY;
+			aux.A(0,2)=p(2)+aux.old_shiftX;
+			aux.A(1,2)=p(3)+aux.old_shiftY;
 			double scalex=p(4);
 			double scaley=p(5);
 			double scaleAngle=p(6);
 			double sin2_t=sin(scaleAngle)*sin(scaleAngle);
 			double sin_2t=sin(2*scaleAngle);
-			A(0,0)=1+scalex+(scaley-scalex)*sin2_t;
-			A(0,1)=0.5*(scaley-scalex)*sin_2t;
-			A(1,0)=A(0,1);
-			A(1,1)=1+scaley-(scaley-scalex)*sin2_t;
+			aux.A(0,0)=1+scalex+(scaley-scalex)*sin2_t;
+			aux.A(0,1)=0.5*(scaley-scalex)*sin_2t;
+			aux.A(1,0)=aux.A(0,1);
+			aux.A(1,1)=1+scaley-(scaley-scalex)*sin2_t;
 //			A(0,0)=1+p(4);
 //			A(1,1)=1+p(5);
 
-			if (old_flip)
+			if (aux.old_flip)
 			{
-				MAT_ELEM(A,0,0)*=-1;
-				MAT_ELEM(A,0,1)*=-1;
-				MAT_ELEM(A,0,2)*=-1;
+				MAT_ELEM(aux.A,0,0)*=-1;
+				MAT_ELEM(aux.A,0,1)*=-1;
+				MAT_ELEM(aux.A,0,2)*=-1;
 			}
-			applyGeometry(BSPLINE3,Ip(),I(),A,IS_NOT_INV,DONT_WRAP);
+			applyGeometry(BSPLINE3,aux.Ip(),aux.I(),aux.A,IS_NOT_INV,DONT_WRAP);
 			if (optimizeGrayValues)
 			{
-				MultidimArray<double> &mIp=Ip();
+				MultidimArray<double> &mIp=aux.Ip();
 				double ia=1.0/p(0);
 				double b=p(1);
 				FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mIp)
@@ -538,7 +668,7 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 						DIRECT_MULTIDIM_ELEM(mIp,n)=0.0;
 				}
 			}
-			Ip.write(fnImgOut);
+			writeLocked(mutexIO,aux.Ip,fnImgOut);
 		}
 		catch (XmippError XE)
 		{
@@ -549,9 +679,9 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 	}
     rowOut.setValue(MDL_IMAGE_ORIGINAL, fnImg);
     rowOut.setValue(MDL_IMAGE, fnImgOut);
-    rowOut.setValue(MDL_ANGLE_ROT,  old_rot+p(7));
-    rowOut.setValue(MDL_ANGLE_TILT, old_tilt+p(8));
-    rowOut.setValue(MDL_ANGLE_PSI,  old_psi+p(9));
+    rowOut.setValue(MDL_ANGLE_ROT,  aux.old_rot+p(7));
+    rowOut.setValue(MDL_ANGLE_TILT, aux.old_tilt+p(8));
+    rowOut.setValue(MDL_ANGLE_PSI,  aux.old_psi+p(9));
     rowOut.setValue(MDL_SHIFT_X,    0.);
     rowOut.setValue(MDL_SHIFT_Y,    0.);
     rowOut.setValue(MDL_FLIP,       false);
@@ -564,15 +694,15 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
     rowOut.setValue(MDL_CONTINUOUS_SCALE_X,p(4));
     rowOut.setValue(MDL_CONTINUOUS_SCALE_Y,p(5));
     rowOut.setValue(MDL_CONTINUOUS_SCALE_ANGLE,p(6));
-    rowOut.setValue(MDL_CONTINUOUS_X,p(2)+old_shiftX);
-    rowOut.setValue(MDL_CONTINUOUS_Y,p(3)+old_shiftY);
-    rowOut.setValue(MDL_CONTINUOUS_FLIP,old_flip);
-    if (hasCTF)
+    rowOut.setValue(MDL_CONTINUOUS_X,p(2)+aux.old_shiftX);
+    rowOut.setValue(MDL_CONTINUOUS_Y,p(3)+aux.old_shiftY);
+    rowOut.setValue(MDL_CONTINUOUS_FLIP,aux.old_flip);
+    if (aux.hasCTF)
     {
-    	rowOut.setValue(MDL_CTF_DEFOCUSU,old_defocusU+p(10));
-    	rowOut.setValue(MDL_CTF_DEFOCUSV,old_defocusV+p(11));
-    	rowOut.setValue(MDL_CTF_DEFOCUS_ANGLE,old_defocusAngle+p(12));
-    	if (old_defocusU+p(10)<0 || old_defocusU+p(11)<0)
+    	rowOut.setValue(MDL_CTF_DEFOCUSU,aux.old_defocusU+p(10));
+    	rowOut.setValue(MDL_CTF_DEFOCUSV,aux.old_defocusV+p(11));
+    	rowOut.setValue(MDL_CTF_DEFOCUS_ANGLE,aux.old_defocusAngle+p(12));
+    	if (aux.old_defocusU+p(10)<0 || aux.old_defocusU+p(11)<0)
     		rowOut.setValue(MDL_ENABLED,-1);
     }
 
@@ -582,17 +712,17 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
     MDaux.addRow(rowOut);
     MDaux.write("PPPmd.xmd");
     Image<double> save;
-    save()=P();
+    save()=aux.P();
     save.write("PPPprojection.xmp");
-    save()=I();
+    save()=aux.I();
     save.write("PPPexperimental.xmp");
     //save()=C;
     //save.write("PPPC.xmp");
-    Ip.write("PPPexperimentalp.xmp");
-    Ifiltered.write("PPPexperimentalFiltered.xmp");
-    Ifilteredp.write("PPPexperimentalFilteredp.xmp");
-    E.write("PPPresidual.xmp");
-    std::cout << A << std::endl;
+    aux.Ip.write("PPPexperimentalp.xmp");
+    aux.Ifiltered.write("PPPexperimentalFiltered.xmp");
+    aux.Ifilteredp.write("PPPexperimentalFilteredp.xmp");
+    aux.E.write("PPPresidual.xmp");
+    std::cout << aux.A << std::endl;
     std::cout << fnImgOut << " rewritten\n";
     std::cout << "Press any key" << std::endl;
     char c; std::cin >> c;
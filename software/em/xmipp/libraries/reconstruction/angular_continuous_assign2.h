@@ -28,6 +28,7 @@
 
 #include <data/xmipp_program.h>
 #include <data/ctf.h>
+#include <data/xmipp_threads.h>
 #include "fourier_projection.h"
 #include "fourier_filter.h"
 
@@ -38,6 +39,71 @@
 #define CONTCOST_CORR 0
 #define CONTCOST_L1 1
 
+class ProgAngularContinuousAssign2;
+
+/** Working data for the continuous assignment of a single image.
+ * Each thread has its own copy. All of them share the Fourier coefficients
+ * of the reference volume; the projection, CTF and image buffers are private.
+ */
+class ContinuousAssign2Aux
+{
+public:
+    // Program
+    ProgAngularContinuousAssign2 *prm;
+    // Fourier projector (sharing the reference volume)
+    FourierProjector *projector;
+    // Input image
+	Image<double> I, Ip, E, Ifiltered, Ifilteredp;
+	// Theoretical projection
+	Projection P;
+	// Filter
+    FourierFilter filter;
+    // Transformation matrix
+    Matrix2D<double> A;
+    // Original angles
+    double old_rot, old_tilt, old_psi;
+    // Original shift
+	double old_shiftX, old_shiftY;
+	// Original flip
+	bool old_flip;
+	// Original gray scale
+	double old_grayA, old_grayB;
+	// Has CTF
+	bool hasCTF;
+	// Original defocus
+	double old_defocusU, old_defocusV, old_defocusAngle;
+	// CTF
+	CTFDescription ctf;
+	// Image stddev
+	double Istddev;
+	// Current defoci
+	double currentDefocusU, currentDefocusV, currentAngle;
+	// CTF image
+	MultidimArray<double> *ctfImage;
+public:
+	/// Empty constructor
+	ContinuousAssign2Aux();
+
+	/// Destructor
+	~ContinuousAssign2Aux();
+
+	/// Prepare the buffers for a given program
+	void initialize(ProgAngularContinuousAssign2 *_prm);
+
+    /** Update CTF image */
+    void updateCTFImage(double defocusU, double defocusV, double angle);
+};
+
+/** Image waiting to be processed by the threads */
+class ContinuousAssign2Task
+{
+public:
+	FileName fnImg, fnImgOut;
+	MDRow rowIn, rowOut;
+	// Id of the row in the output metadata
+	size_t objId;
+};
+
 /** Predict Continuous Parameters. */
 class ProgAngularContinuousAssign2: public XmippMetadataProgram
 {
@@ -84,47 +150,31 @@ public:
     bool phaseFlipped;
     // Penalization for the average
     double penalization;
+    // Number of threads
+    int Nthr;
 public:
     // 2D mask in real space
     MultidimArray<int> mask2D;
     // Inverse of the sum of Mask2D
     double iMask2Dsum;
-    // Fourier projector
+    // Fourier projector, it holds the Fourier coefficients shared by all threads
     FourierProjector *projector;
     // Volume size
     size_t Xdim;
-    // Input image
-	Image<double> I, Ip, E, Ifiltered, Ifilteredp;
-	// Theoretical projection
-	Projection P;
-	// Filter
-    FourierFilter filter;
-    // Transformation matrix
-    Matrix2D<double> A;
-    // Original angles
-    double old_rot, old_tilt, old_psi;
-    // Original shift
-	double old_shiftX, old_shiftY;
-	// Original flip
-	bool old_flip;
-	// Original gray scale
-	double old_grayA, old_grayB;
-	// Has CTF
-	bool hasCTF;
-	// Original defocus
-	double old_defocusU, old_defocusV, old_defocusAngle;
-	// CTF
-	CTFDescription ctf;
 	// Covariance matrices
 	Matrix2D<double> C0, C;
-	// Image stddev
-	double Istddev;
 	// Continuous cost function
 	int contCost;
-	// Current defoci
-	double currentDefocusU, currentDefocusV, currentAngle;
-	// CTF image
-	MultidimArray<double> *ctfImage;
+	// Working data of each thread
+	ContinuousAssign2Aux *threadAux;
+	// Images waiting to be processed by the threads
+	std::vector<ContinuousAssign2Task> tasks;
+	// Thread manager
+	ThreadManager *thMgr;
+	// Task distributor for the threads
+	ThreadTaskDistributor *taskDistributor;
+	// Mutex for the operations that are not thread safe (writing the stacks, reading CTF metadatas)
+	Mutex mutexIO;
 public:
     /// Empty constructor
     ProgAngularContinuousAssign2();
@@ -150,11 +200,18 @@ public:
 
     /** Predict angles and shift.
         At the input the pose parameters must have an initial guess of the
-        parameters. At the output they have the estimated pose.*/
+        parameters. At the output they have the estimated pose.
+        With several threads the image is queued and processed later by processTasks.*/
     void processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut);
 
-    /** Update CTF image */
-    void updateCTFImage(double defocusU, double defocusV, double angle);
+    /** Predict angles and shift of a single image using the given working data. */
+    void assignImage(ContinuousAssign2Aux &aux, const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut);
+
+    /** Process all queued images with the threads and update the output metadata */
+    void processTasks();
+
+    /** Process the images still queued after the last one */
+    void processPendingImages();
 
     /** Post process */
     void postProcess();
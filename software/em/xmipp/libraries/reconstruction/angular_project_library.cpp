@@ -84,6 +84,8 @@ void ProgAngularProjectLibrary::readParams()
             REPORT_ERROR(ERR_ARG_BADCMDLINE, "The interpolation kernel can be : nearest, linear, bspline");
     }
 
+    Nthreads = getIntParam("--thr");
+
     //NOTE perturb in computed after the even sampling is computes
     //     and max tilt min tilt applied
     perturb_projection_vector=getDoubleParam("--perturb");
@@ -134,6 +136,7 @@ void ProgAngularProjectLibrary::defineParams()
     addParamsLine("                                              : nearest:          Nearest Neighborhood  ");
     addParamsLine("                                              : linear:           Linear  ");
     addParamsLine("                                              : bspline:          Cubic BSpline  ");
+    addParamsLine("  [--thr <N=1>]                 : Number of threads for real space projections");
     addParamsLine("  [--perturb <sigma=0.0>]       : gaussian noise projection unit vectors ");
     addParamsLine("                                : a value=sin(sampling_rate)/4  ");
     addParamsLine("                                : may be a good starting point ");
@@ -243,7 +246,7 @@ void ProgAngularProjectLibrary::project_angle_vector (int my_init, int my_end, b
             else if (projType == FOURIER)
                 projectVolume(*Vfourier, P, Ydim, Xdim,  rot, tilt, psi);
             else if (projType == REALSPACE)
-                projectVolume(inputVol(), P, Ydim, Xdim, rot, tilt, psi);
+                projectVolume(inputVol(), P, Ydim, Xdim, rot, tilt, psi, NULL, Nthreads);
 
 
             P.setEulerAngles(rot,tilt,psi);
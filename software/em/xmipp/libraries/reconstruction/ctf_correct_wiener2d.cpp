@@ -100,7 +100,6 @@ void ProgCorrectWiener2D::generateWienerFilter(MultidimArray<double> &Mwien, CTF
 	ctf.enable_CTFnoise = false;
 	ctf.produceSideInfo();
 
-	MultidimArray<std::complex<double> > ctfComplex;
 	MultidimArray<double> ctfIm;
 
 	Mwien.resize(paddimY,paddimX);
@@ -116,22 +115,14 @@ void ProgCorrectWiener2D::generateWienerFilter(MultidimArray<double> &Mwien, CTF
 	}
 
 
-	ctfIm.resize(1, 1, paddimY, paddimX,false);
 	//Esto puede estar mal. Cuidado con el sampling de la ctf!!!
+	if (ctfGenerator.Ydim!=paddimY || ctfGenerator.Xdim!=paddimX || ctfGenerator.Ts!=ctf.Tm)
+		ctfGenerator.initialize(paddimY, paddimX, ctf.Tm);
+	ctfGenerator.generateCTF(ctf, ctfIm, correct_envelope);
 
-	if (correct_envelope)
-		ctf.generateCTF(paddimY, paddimX, ctfComplex);
-
-	else
-		ctf.generateCTFWithoutDamping(paddimY, paddimX, ctfComplex);
-
-	FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(ctfIm)
-	{
-		if (phase_flipped)
-			dAij(ctfIm, i, j) = fabs(dAij(ctfComplex, i, j).real());
-		else
-			dAij(ctfIm, i, j) = dAij(ctfComplex, i, j).real();
-	}
+	if (phase_flipped)
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(ctfIm)
+			DIRECT_MULTIDIM_ELEM(ctfIm, n) = fabs(DIRECT_MULTIDIM_ELEM(ctfIm, n));
 
 //#define DEBUG
 #ifdef DEBUG
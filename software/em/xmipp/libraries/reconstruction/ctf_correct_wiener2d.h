@@ -76,6 +76,9 @@ public:
 
 	CTFDescription ctf;
 
+	// Precomputed frequencies to generate the CTF images
+	CTFImageGenerator ctfGenerator;
+
 	size_t Ydim, Xdim;
 
 	MultidimArray<double> Mwien;
@@ -775,6 +775,8 @@ void threadFastEstimateEnhancedPSD(ThreadArgument &thArg)
 
     FourierTransformer transformer;
     transformer.setReal(piece);
+    NormalizationBackground pieceBackground;
+    pieceBackground.initialize(pieceMask);
 
     int pieceNumber = 0;
     int Nprocessed = 0;
@@ -791,7 +793,7 @@ void threadFastEstimateEnhancedPSD(ThreadArgument &thArg)
                 for (size_t l = 0; l < XSIZE(piece); l++)
                     DIRECT_A2D_ELEM(piece, k, l)= mI(i+k, j+l);
             piece.statisticsAdjust(0, 1);
-            normalize_ramp(piece, &pieceMask);
+            normalize_ramp(piece, pieceBackground);
             piece *= pieceSmoother;
 
             // Estimate the power spectrum .......................................
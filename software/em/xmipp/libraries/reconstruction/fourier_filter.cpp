@@ -90,6 +90,8 @@ void FourierFilter::defineParams(XmippProgram *program)
     program->addParamsLine("         requires --fourier;");
     program->addParamsLine("  [--save <filename=\"\"> ]                  : Do not apply just save the mask");
     program->addParamsLine("         requires --fourier;");
+    program->addParamsLine("  [--float]                                  : Filter in single precision");
+    program->addParamsLine("         requires --fourier;");
 }
 
 /* Read parameters from command line. -------------------------------------- */
@@ -378,6 +380,29 @@ void FourierFilter::apply(MultidimArray<double> &img)
         applyMaskSpace(img);
 }
 
+void FourierFilter::apply(MultidimArray<float> &img)
+{
+    if (FilterShape==SPARSIFY || maskFn != "")
+    {
+        MultidimArray<double> imgd;
+        typeCast(img, imgd);
+        apply(imgd);
+        typeCast(imgd, img);
+        return;
+    }
+
+    static bool firstTime = true;
+    do_generate_3dmask = (img.zdim > 1);
+    if (firstTime)
+    {
+        MultidimArray<double> imgd;
+        typeCast(img, imgd);
+        generateMask(imgd);
+        firstTime = false;
+    }
+    applyMaskSpace(img);
+}
+
 /* Get mask value ---------------------------------------------------------- */
 double FourierFilter::maskValue(const Matrix1D<double> &w)
 {
@@ -656,6 +681,46 @@ void FourierFilter::applyMaskSpace(MultidimArray<double> &v)
     transformer.inverseFourierTransform();
 }
 
+void FourierFilter::applyMaskSpace(MultidimArray<float> &v)
+{
+    MultidimArray< std::complex<float> > V;
+    transformerFloat.FourierTransform(v, V, false);
+    if (XSIZE(maskFourier)!=0)
+    {
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(V)
+        DIRECT_MULTIDIM_ELEM(V,n)*=(float)DIRECT_MULTIDIM_ELEM(maskFourier,n);
+    }
+    else if (XSIZE(maskFourierd)!=0)
+    {
+        float *ptrV=(float*)&DIRECT_MULTIDIM_ELEM(V,0);
+        double *ptrMask=(double*)&DIRECT_MULTIDIM_ELEM(maskFourierd,0);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(V)
+        {
+            float mask=(float)*ptrMask++;
+            *ptrV++ *= mask;
+            *ptrV++ *= mask;
+        }
+    }
+    else
+    {
+        w.resizeNoCopy(3);
+        for (size_t k=0; k<ZSIZE(V); k++)
+        {
+            FFT_IDX2DIGFREQ(k,ZSIZE(v),ZZ(w));
+            for (size_t i=0; i<YSIZE(V); i++)
+            {
+                FFT_IDX2DIGFREQ(i,YSIZE(v),YY(w));
+                for (size_t j=0; j<XSIZE(V); j++)
+                {
+                    FFT_IDX2DIGFREQ(j,XSIZE(v),XX(w));
+                    DIRECT_A3D_ELEM(V,k,i,j)*=(float)maskValue(w);
+                }
+            }
+        }
+    }
+    transformerFloat.inverseFourierTransform();
+}
+
 void FourierFilter::applyMaskFourierSpace(const MultidimArray<double> &v, MultidimArray<std::complex<double> > &V)
 {
     if (XSIZE(maskFourier)!=0)
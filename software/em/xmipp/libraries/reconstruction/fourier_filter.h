@@ -149,6 +149,11 @@ public:
     /** Process one image */
     void apply(MultidimArray<double> &img);
 
+    /** Process one image in single precision.
+        The sparsify filter and the saving of the mask are done in double
+        precision. */
+    void apply(MultidimArray<float> &img);
+
     /** Empty constructor */
     FourierFilter();
 
@@ -169,6 +174,10 @@ public:
     /** Apply mask in real space. */
     void applyMaskSpace(MultidimArray<double> &v);
 
+    /** Apply mask in real space with single precision transforms.
+        The mask must have been generated for an image of the same size. */
+    void applyMaskSpace(MultidimArray<float> &v);
+
     /** Apply mask in Fourier space.
      * The image remains in Fourier space.
      */
@@ -192,6 +201,9 @@ public:
     // Transformer
     FourierTransformer transformer;
 
+    // Transformer in single precision
+    FourierTransformerFloat transformerFloat;
+
     // Auxiliary variables for sparsify
     MultidimArray<double> vMag, vMagSorted;
 
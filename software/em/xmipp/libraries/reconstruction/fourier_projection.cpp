@@ -36,6 +36,21 @@ FourierProjector::FourierProjector(MultidimArray<double> &V, double paddFactor,
     produceSideInfo();
 }
 
+FourierProjector::FourierProjector(const FourierProjector *sharedProjector)
+{
+    volume = sharedProjector->volume;
+    volumeSize = sharedProjector->volumeSize;
+    volumePaddedSize = sharedProjector->volumePaddedSize;
+    paddingFactor = sharedProjector->paddingFactor;
+    maxFrequency = sharedProjector->maxFrequency;
+    BSplineDeg = sharedProjector->BSplineDeg;
+    VfourierRealCoefs.alias(sharedProjector->VfourierRealCoefs);
+    VfourierImagCoefs.alias(sharedProjector->VfourierImagCoefs);
+    phaseShiftImgA.alias(sharedProjector->phaseShiftImgA);
+    phaseShiftImgB.alias(sharedProjector->phaseShiftImgB);
+    allocateProjection();
+}
+
 void FourierProjector::project(double rot, double tilt, double psi, const MultidimArray<double> *ctf)
 {
     double freqy, freqx;
@@ -239,9 +254,7 @@ void FourierProjector::produceSideInfo()
         Complex2RealImag(Vfourier, VfourierRealCoefs, VfourierImagCoefs);
 
     // Allocate memory for the 2D Fourier transform
-    projection().initZeros(volumeSize,volumeSize);
-    projection().setXmippOrigin();
-    transformer2D.FourierTransform(projection(),projectionFourier,false);
+    allocateProjection();
 
     // Calculate phase shift terms
     phaseShiftImgA.initZeros(projectionFourier);
@@ -260,6 +273,13 @@ void FourierProjector::produceSideInfo()
     }
 }
 
+void FourierProjector::allocateProjection()
+{
+    projection().initZeros(volumeSize,volumeSize);
+    projection().setXmippOrigin();
+    transformer2D.FourierTransform(projection(),projectionFourier,false);
+}
+
 void projectVolume(FourierProjector &projector, Projection &P, int Ydim, int Xdim,
                    double rot, double tilt, double psi, const MultidimArray<double> *ctf)
 {
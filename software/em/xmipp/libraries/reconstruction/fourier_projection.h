@@ -79,6 +79,15 @@ public:
      */
     FourierProjector(MultidimArray<double> &V, double paddFactor, double maxFreq, int BSplinedegree);
 
+    /*
+     * Constructor sharing the Fourier coefficients of another projector.
+     * No copy of the volume is made, only the projection buffers are private
+     * so that several threads can project the same volume at the same time,
+     * each one with its own projector. The shared projector must not be
+     * destroyed before this one.
+     */
+    explicit FourierProjector(const FourierProjector *sharedProjector);
+
     /**
      * This method gets the volume's Fourier and the Euler's angles as the inputs and interpolates the related projection
      */
@@ -88,6 +97,11 @@ private:
      * This is a private method which provides the values for the class variable
      */
     void produceSideInfo();
+
+    /*
+     * Allocate the projection buffers
+     */
+    void allocateProjection();
 };
 
 /*
@@ -113,6 +113,8 @@ ProgMLTomo::defineParams()
         " [ --maxres <float=0.5> ]       : Maximum resolution (in pixel^-1) to use ");
     addParamsLine(
         " [ --thr <int=1> ]              : Number of shared-memory threads to use in parallel ");
+    addParamsLine(
+        " [ --cache_mem <Mb=2048> ]      : Memory for the Fourier transforms of the rotated references ");
 
     addParamsLine("==+ Additional options: ==");
     addParamsLine(
@@ -382,6 +384,7 @@ ProgMLTomo::readParams()
 
     // Number of threads
     threads = getIntParam("--thr");
+    cache_mem = getDoubleParam("--cache_mem");
 
 }
 
@@ -855,6 +858,7 @@ ProgMLTomo::produceSideInfo()
 
     }
     readMissingInfo();////////////////////////////
+    calculateMeasuredRuns();
     // Get number of references
     if (do_only_average)
     {
@@ -1525,6 +1529,31 @@ ProgMLTomo::readMissingInfo()
     }
 }
 
+void
+ProgMLTomo::calculateMeasuredRuns()
+{
+    MultidimArray<unsigned char> Mmissing;
+    Matrix2D<double> I(4, 4);
+    I.initIdentity();
+    size_t N = dim * dim * (hdim + 1);
+    measured_runs.resize(nr_miss + 1);
+    for (int missno = 0; missno < nr_miss; ++missno)
+    {
+        std::vector< std::pair<size_t,size_t> > &runs = measured_runs[missno];
+        runs.clear();
+        getMissingRegion(Mmissing, I, missno);
+        for (size_t n = 0; n < N; ++n)
+            if (DIRECT_MULTIDIM_ELEM(Mmissing,n))
+            {
+                size_t n0 = n;
+                while (n < N && DIRECT_MULTIDIM_ELEM(Mmissing,n))
+                    ++n;
+                runs.push_back(std::make_pair(n0, n));
+            }
+    }
+    measured_runs[nr_miss].assign(1, std::make_pair((size_t)0, N));
+}
+
 void
 ProgMLTomo::getMissingRegion(MultidimArray<unsigned char> &Mmissing,
                              const Matrix2D<double> &A, const int missno)
@@ -1986,6 +2015,94 @@ ProgMLTomo::precalculateA2(std::vector<Image<double> > &Iref)
 #endif
 }
 
+// This structure is needed to pass parameters to threadPrecalculateRotatedReferences
+struct structThreadRotatedReferences
+{
+    ProgMLTomo *prm;
+    std::vector<Image<double> > *Iref;
+    ThreadTaskDistributor *distributor;
+};
+
+void threadPrecalculateRotatedReferences(ThreadArgument &thArg)
+{
+    structThreadRotatedReferences *data = (structThreadRotatedReferences *) thArg.workClass;
+    ProgMLTomo *prm = data->prm;
+    MultidimArray<double> Maux(prm->dim, prm->dim, prm->dim);
+    Matrix2D<double> A_rot_inv(4, 4);
+    FourierTransformer local_transformer;
+    size_t first, last;
+    Maux.setXmippOrigin();
+    while (data->distributor->getTasks(first, last))
+        for (size_t idx = first; idx <= last; ++idx)
+        {
+            int refno = idx / prm->nr_ang;
+            int angno = idx % prm->nr_ang;
+            MultidimArray<double> &Iref_refno = (*(data->Iref))[refno]();
+            A_rot_inv = ((prm->all_angle_info[angno]).A).inv();
+            // Same rotation as in expectationSingleImage
+            applyGeometry(LINEAR, Maux, Iref_refno, A_rot_inv, IS_NOT_INV,
+                          DONT_WRAP, DIRECT_MULTIDIM_ELEM(Iref_refno,0));
+            local_transformer.FourierTransform(Maux, prm->Fref_cache[idx], true);
+        }
+}
+
+void
+ProgMLTomo::precalculateRotatedReferences(std::vector<Image<double> > &Iref)
+{
+    Fref_cache.clear();
+    // With fixed orientations each image uses its own rotation
+    if (dont_align || dont_rotate || do_only_average)
+        return;
+
+    size_t Nrot = nr_ref * nr_ang;
+    double entry_mem = (double)dim * dim * (hdim + 1) * sizeof(std::complex<double>);
+    size_t Ncached = XMIPP_MIN(Nrot, (size_t)(cache_mem * 1024 * 1024 / entry_mem));
+    if (Ncached == 0)
+        return;
+    if (verbose && Ncached < Nrot)
+        std::cout << "  -> Only " << Ncached << " out of " << Nrot
+        << " rotated references fit in the cache, increase --cache_mem" << std::endl;
+    Fref_cache.resize(Ncached);
+
+    ThreadTaskDistributor distributor(Ncached, 1);
+    structThreadRotatedReferences data;
+    data.prm = this;
+    data.Iref = &Iref;
+    data.distributor = &distributor;
+    ThreadManager thMgr(threads, &data);
+    thMgr.run(threadPrecalculateRotatedReferences);
+}
+
+// Fout = Fimg * conj(Fref) * scale in the runs of measured coefficients and 0 outside them.
+// Fout may be the same array as Fimg or Fref
+static void wedgeMaskedCorrelation(MultidimArray<std::complex<double> > &Fout,
+                                   const MultidimArray<std::complex<double> > &Fimg,
+                                   const MultidimArray<std::complex<double> > &Fref, double scale,
+                                   const std::vector< std::pair<size_t,size_t> > &runs)
+{
+    double *ptrOut = (double *) MULTIDIM_ARRAY(Fout);
+    const double *ptrImg = (const double *) MULTIDIM_ARRAY(Fimg);
+    const double *ptrRef = (const double *) MULTIDIM_ARRAY(Fref);
+    size_t prev = 0;
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        size_t n0 = 2 * runs[r].first;
+        size_t nF = 2 * runs[r].second;
+        for (size_t n = prev; n < n0; ++n)
+            ptrOut[n] = 0.;
+        for (size_t n = n0; n < nF; n += 2)
+        {
+            double ar = ptrImg[n], ai = ptrImg[n + 1];
+            double br = ptrRef[n], bi = ptrRef[n + 1];
+            ptrOut[n] = scale * (ar * br + ai * bi);
+            ptrOut[n + 1] = scale * (ai * br - ar * bi);
+        }
+        prev = nF;
+    }
+    for (size_t n = prev, N = 2 * MULTIDIM_SIZE(Fout); n < N; ++n)
+        ptrOut[n] = 0.;
+}
+
 // Maximum Likelihood calculation for one image ============================================
 // Integration over all translation, given  model and in-plane rotation
 void
@@ -2091,6 +2208,7 @@ ProgMLTomo::expectationSingleImage(MultidimArray<double> &Mimg, int imgno,
     // BE CAREFUL: inverseFourierTransform messes up Faux!
     local_transformer.inverseFourierTransform();
     myXi2 = Maux.sum2();
+    const std::vector< std::pair<size_t,size_t> > &runs = measured_runs[do_missing ? missno : nr_miss];
 
     // To avoid numerical problems, subtract smallest difference from all differences.
     // That way: Pmax will be one and all other probabilities will be [0,1>
@@ -2187,23 +2305,27 @@ ProgMLTomo::expectationSingleImage(MultidimArray<double> &Mimg, int imgno,
                         refno -= nr_ref;
 
                     fracpdf = alpha_k(refno) * (1. / nr_ang);
-                    // Now (inverse) rotate the reference and calculate its Fourier transform
-                    // Use DONT_WRAP and assume map has been omasked
-                    applyGeometry(LINEAR, Maux2, Iref[refno](), A_rot_inv, IS_NOT_INV,
-                                  DONT_WRAP, DIRECT_MULTIDIM_ELEM(Iref[refno](),0));
+                    const MultidimArray<std::complex<double> > *Fref = &Faux;
+                    if (isReferenceCached(refno, angno))
+                        Fref = &(Fref_cache[refno * nr_ang + angno]);
+                    else
+                    {
+                        // Now (inverse) rotate the reference and calculate its Fourier transform
+                        // Use DONT_WRAP and assume map has been omasked
+                        applyGeometry(LINEAR, Maux2, Iref[refno](), A_rot_inv, IS_NOT_INV,
+                                      DONT_WRAP, DIRECT_MULTIDIM_ELEM(Iref[refno](),0));
+                        Maux = Maux2;
+                        local_transformer.FourierTransform();
+                    }
                     mycorrAA = corrA2[refno * nr_ang + angno];
-                    Maux = Maux2 * mycorrAA;
-                    local_transformer.FourierTransform();
                     if (do_missing)
                         myA2 = A2[refno * nr_ang * nr_miss + angno * nr_miss + missno];
                     else
                         myA2 = A2[refno * nr_ang + angno];
                     A2_plus_Xi2 = 0.5 * (myA2 + myXi2);
                     // A. Backward FFT to calculate weights in real-space
-                    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY3D(Faux)
-                    {
-                        dAkij(Faux,k,i,j) = dAkij(Fimg0,k,i,j) * conj(dAkij(Faux,k,i,j));
-                    }
+                    // (Fimg0 is zero outside the measured coefficients)
+                    wedgeMaskedCorrelation(Faux, Fimg0, *Fref, mycorrAA, runs);
                     local_transformer.inverseFourierTransform();
                     CenterFFT(Maux, true);
 
@@ -2292,11 +2414,7 @@ ProgMLTomo::expectationSingleImage(MultidimArray<double> &Mimg, int imgno,
                         // Use forward FFT in convolution theorem again
                         CenterFFT(Maux, false);
                         local_transformer.FourierTransform();
-                        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY3D(Faux)
-                        {
-                            dAkij(Faux, k, i, j) = conj(dAkij(Faux,k,i,j))
-                                                   * dAkij(Fimg0,k,i,j);
-                        }
+                        wedgeMaskedCorrelation(Faux, Fimg0, Faux, 1., runs);
                         local_transformer.inverseFourierTransform();
                         maskSphericalAverageOutside(Maux);
                         selfApplyGeometry(LINEAR, Maux, A_rot, IS_NOT_INV, DONT_WRAP,
@@ -2490,6 +2608,7 @@ ProgMLTomo::maxConstrainedCorrSingleImage(MultidimArray<double> &Mimg,
     else
         Fimg0 = Faux;
     Mimg0 = Maux;
+    const std::vector< std::pair<size_t,size_t> > &runs = measured_runs[do_missing ? missno : nr_miss];
 
     if (do_only_average)
     {
@@ -2570,11 +2689,17 @@ ProgMLTomo::maxConstrainedCorrSingleImage(MultidimArray<double> &Mimg,
                     if (refno >= nr_ref)
                         refno -= nr_ref;
 
-                    // Now (inverse) rotate the reference and calculate its Fourier transform
-                    // Use DONT_WRAP because the reference has been omasked
-                    applyGeometry(LINEAR, Maux, Iref[refno](), A_rot_inv, IS_NOT_INV,
-                                  DONT_WRAP, DIRECT_MULTIDIM_ELEM(Iref[refno](),0));
-                    local_transformer.FourierTransform();
+                    bool is_cached = isReferenceCached(refno, angno);
+                    if (is_cached)
+                        Faux = Fref_cache[refno * nr_ang + angno];
+                    else
+                    {
+                        // Now (inverse) rotate the reference and calculate its Fourier transform
+                        // Use DONT_WRAP because the reference has been omasked
+                        applyGeometry(LINEAR, Maux, Iref[refno](), A_rot_inv, IS_NOT_INV,
+                                      DONT_WRAP, DIRECT_MULTIDIM_ELEM(Iref[refno](),0));
+                        local_transformer.FourierTransform();
+                    }
                     if (do_missing)
                     {
                         // Enforce wedge on the reference
@@ -2587,16 +2712,18 @@ ProgMLTomo::maxConstrainedCorrSingleImage(MultidimArray<double> &Mimg,
                         local_transformer.inverseFourierTransform();
                     }
                     else
+                    {
                         Fref = Faux;
+                        // The rotated reference is needed in real space
+                        if (is_cached)
+                            local_transformer.inverseFourierTransform();
+                    }
                     // Calculate stddev of (wedge-inforced) reference
                     Mref = Maux;
                     ref_stddev = Mref.computeStddev();
 
                     // Calculate correlation matrix via backward FFT
-                    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY3D(Faux)
-                    {
-                        dAkij(Faux,k,i,j) = dAkij(Fimg0,k,i,j) * conj(dAkij(Fref,k,i,j));
-                    }
+                    wedgeMaskedCorrelation(Faux, Fimg0, Fref, 1., runs);
                     local_transformer.inverseFourierTransform();
                     CenterFFT(Maux, true);
                     //#define DEBUG_IMG
@@ -2856,6 +2983,9 @@ ProgMLTomo::expectation(MetaData &MDimg, std::vector<Image<double> > &Iref,
     if (do_perturb)
         perturbAngularSampling();
 
+    // Rotated references shared by all images
+    precalculateRotatedReferences(Iref);
+
     if (do_ml)
     {
         // Precalculate A2-values for all references
@@ -2913,6 +3043,7 @@ ProgMLTomo::expectation(MetaData &MDimg, std::vector<Image<double> > &Iref,
     }
     //Free some memory
     delete distributor;
+    Fref_cache.clear();
 
     //FIXME
     // Send back output in the form of a MetaData
@@ -242,6 +242,15 @@ public:
     /** Threads */
     int threads;
 
+    /** Memory (in Mb) for the Fourier transforms of the rotated references */
+    double cache_mem;
+    /** Fourier transforms of the rotated references, element refno*nr_ang+angno.
+     *  It is empty if the rotation did not fit in the cache */
+    std::vector< MultidimArray<std::complex<double> > > Fref_cache;
+    /** Runs [first,last) of measured Fourier coefficients for each missing region.
+     *  Element nr_miss is a single run with all coefficients */
+    std::vector< std::vector< std::pair<size_t,size_t> > > measured_runs;
+
     /** FFTW objects */
     FourierTransformer transformer;
 
@@ -306,6 +315,21 @@ public:
     /// Fill vector of matrices with all rotations of reference
     void precalculateA2(std::vector< Image<double> > &Iref);
 
+    /** Fourier transforms of the rotated references.
+     * They are computed once per iteration (in threads) and shared by all images,
+     * only the first ones fitting in cache_mem are kept. */
+    void precalculateRotatedReferences(std::vector< Image<double> > &Iref);
+
+    /// Rotation angno of reference refno has been precalculated
+    inline bool isReferenceCached(int refno, int angno) const
+    {
+        size_t idx = refno * nr_ang + angno;
+        return idx < Fref_cache.size() && MULTIDIM_SIZE(Fref_cache[idx]) > 0;
+    }
+
+    /// Runs of measured Fourier coefficients (with fourier_imask) of all missing regions
+    void calculateMeasuredRuns();
+
     /// ML-integration over all hidden parameters
     void expectationSingleImage(MultidimArray<double> &Mimg, int imgno, const int missno, double old_rot,
                                 std::vector<Image<double> > &Iref,
@@ -56,6 +56,8 @@ void ProgFilter::defineParams()
     addExampleLine("Apply a Fourier filter on a volume:", false);
     addExampleLine("xmipp_transform_filter -i volume.vol -o volumeFiltered.vol --fourier low_pass 0.05");
     addExampleLine("xmipp_transform_filter  -i volume.vol -o volumeFiltered.vol -f band_pass 0.1 0.3");
+    addExampleLine("Apply a Fourier filter on a large volume in single precision:", false);
+    addExampleLine("xmipp_transform_filter -i volume.vol -o volumeFiltered.vol --fourier low_pass 0.05 --float");
     addExampleLine("xmipp_transform_filter  -i image.ser  -o imageFiltered.xmp --background plane");
     addExampleLine("xmipp_transform_filter  -i smallStack.stk -o smallFiltered.stk -w DAUB12 difussion");
     addExampleLine("Filter a volume using a wedge mask rotated 10 degress",false);
@@ -69,6 +71,7 @@ void ProgFilter::defineParams()
 void ProgFilter::readParams()
 {
 	readCTF=false;
+    useFloat=false;
     XmippMetadataProgram::readParams();
 
     if (checkParam("--fourier"))
@@ -77,6 +80,9 @@ void ProgFilter::readParams()
         String filterType=getParam("--fourier");
         if (filterType=="astigmatism")
         	readCTF=true;
+        useFloat=checkParam("--float");
+        if (useFloat && readCTF)
+            REPORT_ERROR(ERR_ARG_INCORRECT, "The astigmatism filter cannot be applied in single precision");
     }
     else if (checkParam("--wavelet"))
         filter = new WaveletFilter();
@@ -108,6 +114,14 @@ void ProgFilter::preProcess()
 
 void ProgFilter::processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut)
 {
+    if (useFloat)
+    {
+        Image<float> img;
+        img.read(fnImg);
+        ((FourierFilter *)filter)->apply(img());
+        img.write(fnImgOut);
+        return;
+    }
     Image<double> img;
     img.read(fnImg);
     if (readCTF)
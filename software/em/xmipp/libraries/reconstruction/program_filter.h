@@ -36,6 +36,9 @@ private:
     // Read CTF
     bool readCTF;
 
+    // Fourier filter in single precision
+    bool useFloat;
+
 protected:
     void defineParams();
     void readParams();
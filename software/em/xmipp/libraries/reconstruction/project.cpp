@@ -36,6 +36,7 @@ void ProgProject::readParams()
     fnPhantom = getParam("-i");
     fnOut = getParam("-o");
     samplingRate  = getDoubleParam("--sampling_rate");
+    Nthreads = getIntParam("--thr");
     singleProjection = false;
     if (STR_EQUAL(getParam("--method"), "real_space"))
         projType = REALSPACE;
@@ -114,6 +115,7 @@ void ProgProject::defineParams()
     addParamsLine("                                              : linear:           Linear BSpline  ");
     addParamsLine("                                              :+++                        %BR% ");
     addParamsLine("                                              : bspline:          Cubic BSpline  ");
+    addParamsLine("  [--thr <N=1>]                               : Number of threads for real space projections");
     addParamsLine("== Generating a set of projections == ");
     addParamsLine("  [--params <parameters_file>]           : File containing projection parameters");
     addParamsLine("                                         : Check the manual for a description of the parameters");
@@ -212,6 +214,7 @@ ParametersProjection::ParametersProjection()
     psi_range.Ndev=0.;
     doPhaseFlip=false;
     applyShift=true;
+    Nthreads=1;
 }
 
 void ParametersProjection::read(const FileName &fn_proj_param)
@@ -1079,7 +1082,7 @@ int PROJECT_Effectively_project(const FileName &fnOut,
                               rot, tilt, psi);
             else if (projType == REALSPACE)
                 projectVolume(side.phantomVol(), proj, prm.proj_Ydim, prm.proj_Xdim,
-                              rot, tilt, psi);
+                              rot, tilt, psi, NULL, prm.Nthreads);
 
             if (hasCTF)
             	ctf.applyCTF(proj(),sampling_rate, prm.doPhaseFlip);
@@ -1169,6 +1172,7 @@ int ROUT_project(ProgProject &prm, Projection &proj, MetaData &SF)
     PROJECT_Side_Info side;
     if (!prm.singleProjection)
         proj_prm.from_prog_params(prm);
+    proj_prm.Nthreads=prm.Nthreads;
     side.produce_Side_Info(proj_prm, prm);
     Crystal_Projection_Parameters crystal_proj_prm;
 
@@ -83,6 +83,8 @@ public:
     double maxFrequency;
     /// The type of interpolation (NEAR
     int BSplineDeg;
+    /// Number of threads for real space projections
+    int Nthreads;
 
 public:
     /** Read parameters. */
@@ -191,6 +193,9 @@ public:
     double    Ncenter_avg;
     /// Standard deviation of the image center
     double    Ncenter_dev;
+
+    /// Number of threads for real space projections
+    int Nthreads;
 public:
 
     ParametersProjection();
@@ -33,6 +33,16 @@ ProgReconstructSignificant::ProgReconstructSignificant()
 	Nprocessors=1;
 	randomize_random_generator();
 	deltaAlpha2=0;
+	thMgr=NULL;
+	taskDistributor=NULL;
+	NgalleryTransforms=0;
+}
+
+ProgReconstructSignificant::~ProgReconstructSignificant()
+{
+	delete thMgr;
+	for (size_t n=0; n<galleryTransforms.size(); ++n)
+		delete [] galleryTransforms[n];
 }
 
 void ProgReconstructSignificant::defineParams()
@@ -62,6 +72,7 @@ void ProgReconstructSignificant::defineParams()
     addParamsLine("  [--dontReconstruct]          : Do not reconstruct");
     addParamsLine("  [--useForValidation <numOrientationsPerParticle=10>] : Use the program for validation. This number defines the number of possible orientations per particle");
     addParamsLine("  [--dontCheckMirrors]         : Don't check mirrors in the alignment process");
+    addParamsLine("  [--thr <N=1>]                : Number of threads");
 
 }
 
@@ -90,6 +101,7 @@ void ProgReconstructSignificant::readParams()
     useForValidation=checkParam("--useForValidation");
     numOrientationsPerParticle = getIntParam("--useForValidation");
     dontCheckMirrors = checkParam("--dontCheckMirrors");
+    Nthr = getIntParam("--thr");
 
     if (!doReconstruct)
     {
@@ -120,6 +132,7 @@ void ProgReconstructSignificant::show()
         std::cout << "Reconstruct                 : "  << doReconstruct << std::endl;
         std::cout << "useForValidation            : "  << useForValidation << std::endl;
         std::cout << "dontCheckMirrors            : "  << dontCheckMirrors << std::endl;
+        std::cout << "Number of threads           : "  << Nthr << std::endl;
 
 
         if (fnSym != "")
@@ -141,17 +154,180 @@ void ProgReconstructSignificant::show()
 
 // Image alignment ========================================================
 //#define DEBUG
-void ProgReconstructSignificant::alignImagesToGallery()
+void ProgReconstructSignificant::alignSingleImage(size_t idx, AlignmentAux &aux, CorrelationAux &aux2,
+		RotationalCorrelationAux &aux3)
 {
-    AlignmentAux aux;
-    CorrelationAux aux2;
-    RotationalCorrelationAux aux3;
+	size_t nImg=nodeImgIdx[idx];
+	const FileName &fnImg=nodeFnImg[idx];
+	SignificantImageAlignment &alignment=nodeAlignment[idx];
+	alignment.assignments.clear();
+
+	size_t Nvols=YSIZE(cc);
+	size_t Ndirs=XSIZE(cc);
+	double one_alpha=1-currentAlpha-deltaAlpha2;
 
 	Matrix2D<double> M;
 	std::vector< Matrix2D<double> > allM;
+	MultidimArray<double> imgcc(Nvols*Ndirs), imgimed(Nvols*Ndirs);
+	MultidimArray<double> cdfcc, cdfimed;
+	MultidimArray<double> mCurrentImageAligned, mGalleryProjection;
+	Image<double> I;
+
+#ifdef DEBUG
+	std::cout << "Processing: " << fnImg << std::endl;
+#endif
+	I.read(fnImg);
+	MultidimArray<double> &mCurrentImage=I();
+	mCurrentImage.setXmippOrigin();
+
+	double bestCorr=-2, bestRot, bestTilt, bestImed=1e38, worstImed=-1e38;
+	Matrix2D<double> bestM;
+	int bestVolume=-1;
+
+	// Compute all correlations
+	for (size_t nVolume=0; nVolume<Nvols; ++nVolume)
+	{
+		AlignmentTransforms *transforms=galleryTransforms[nVolume];
+		for (size_t nDir=0; nDir<Ndirs; ++nDir)
+		{
+			mCurrentImageAligned=mCurrentImage;
+			mGalleryProjection.aliasImageInStack(gallery[nVolume](),nDir);
+			mGalleryProjection.setXmippOrigin();
+			double corr;
+			if (! dontCheckMirrors)
+				corr=alignImagesConsideringMirrors(mGalleryProjection,transforms[nDir],
+						mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
+			else
+				corr = alignImages(mGalleryProjection, transforms[nDir], mCurrentImageAligned,
+				                   M, DONT_WRAP, aux, aux2, aux3);
+			M=M.inv();
+			double imed=imedDistance(mGalleryProjection, mCurrentImageAligned);
+
+			// Each image owns its slice of cc, so no lock is needed
+			DIRECT_A3D_ELEM(cc,nImg,nVolume,nDir)=corr;
+			size_t idx=nVolume*Ndirs+nDir;
+			DIRECT_A1D_ELEM(imgcc,idx)=corr;
+			DIRECT_A1D_ELEM(imgimed,idx)=imed;
+			allM.push_back(M);
+
+			if (corr>bestCorr)
+			{
+				bestM=M;
+				bestCorr=corr;
+				bestVolume=(int)nVolume;
+				bestRot=mdGallery[nVolume][nDir].rot;
+				bestTilt=mdGallery[nVolume][nDir].tilt;
+			}
+
+			if (imed<bestImed)
+				bestImed=imed;
+			else if (imed>worstImed)
+				worstImed=imed;
+		}
+	}
+
+	// Keep the best assignment for the projection matching
+	double scale, shiftX, shiftY, anglePsi;
+	bool flip;
+	transformationMatrix2Parameters2D(bestM,flip,scale,shiftX,shiftY,anglePsi);
+	if (useForValidation && dontCheckMirrors)
+		flip = false;
+	alignment.bestVolume=bestVolume;
+	alignment.bestCorr=bestCorr;
+	alignment.bestRot=bestRot;
+	alignment.bestTilt=bestTilt;
+	alignment.anglePsi=anglePsi;
+	alignment.shiftX=shiftX;
+	alignment.shiftY=shiftY;
+	alignment.flip=flip;
+	alignment.validShift=maxShift<0 || (maxShift>0 && fabs(shiftX)<maxShift && fabs(shiftY)<maxShift);
+
+	// Compute lower limit of correlation
+	double rl=bestCorr*one_alpha;
+	double z=0.5*log((1+rl)/(1-rl));
+	double zl=z-2.96*sqrt(1.0/MULTIDIM_SIZE(mCurrentImage));
+	double ccl=tanh(zl);
+
+	// Compute the cumulative distributions
+	imgcc.cumlativeDensityFunction(cdfcc);
+	imgimed.cumlativeDensityFunction(cdfimed);
+
+	// Get the best images
+	SignificantAssignment assignment;
+	for (size_t nVolume=0; nVolume<Nvols; ++nVolume)
+	{
+		for (size_t nDir=0; nDir<Ndirs; ++nDir)
+		{
+			size_t idx=nVolume*Ndirs+nDir;
+			double cdfccthis=DIRECT_A1D_ELEM(cdfcc,idx);
+			double cdfimedthis=DIRECT_A1D_ELEM(cdfimed,idx);
+			double cc=DIRECT_A1D_ELEM(imgcc,idx);
+			bool condition=true;
+			condition=condition && ((applyFisher && cc>=ccl) || !applyFisher);
+			condition=condition && cdfccthis>=one_alpha;
+			if (condition)
+			{
+				double imed=DIRECT_A1D_ELEM(imgimed,idx);
+				transformationMatrix2Parameters2D(allM[nVolume*Ndirs+nDir],flip,scale,shiftX,shiftY,anglePsi);
+				if (useForValidation && dontCheckMirrors)
+					flip = false;
+
+				if (maxShift>0)
+					if (fabs(shiftX)>maxShift || fabs(shiftY)>maxShift)
+						continue;
+				if (flip)
+					shiftX*=-1;
+
+				double thisWeight=cdfccthis*(cc/bestCorr);
+				// COSS: To promote sparsity in the volume assignment: sum_i(cc_i^p)/sum_i(cc_i)*cc_i^p/cc_i
+				if (useImed)
+					thisWeight*=(1-cdfimedthis)*(bestImed/imed);
+				DIRECT_A3D_ELEM(weight,nImg,nVolume,nDir)=thisWeight;
+#ifdef DEBUG
+				std::cout << "   Getting Gallery: " << mdGallery[nVolume][nDir].fnImg
+						  << " corr=" << cc << " imed=" << imed << " weight=" << thisWeight << std::endl
+						  << "Matrix=" << allM[nVolume*Ndirs+nDir] << std::endl
+						  << "shiftX=" << shiftX << " shiftY=" << shiftY << std::endl;
+#endif
 
+				assignment.nVolume=nVolume;
+				assignment.nDir=nDir;
+				assignment.cc=cc;
+				assignment.imed=imed;
+				assignment.weight=thisWeight;
+				assignment.anglePsi=anglePsi;
+				assignment.shiftX=shiftX;
+				assignment.shiftY=shiftY;
+				assignment.flip=flip;
+				alignment.assignments.push_back(assignment);
+			}
+		}
+	}
+}
+#undef DEBUG
+
+void threadAlignImagesToGallery(ThreadArgument &thArg)
+{
+	ProgReconstructSignificant &prm=*((ProgReconstructSignificant *)thArg.workClass);
+
+	// Each thread has its own alignment auxiliaries
+	AlignmentAux aux;
+	CorrelationAux aux2;
+	RotationalCorrelationAux aux3;
+
+	size_t first, last;
+	while (prm.taskDistributor->getTasks(first, last))
+	{
+		for (size_t idx=first; idx<=last; ++idx)
+			prm.alignSingleImage(idx, aux, aux2, aux3);
+		if (prm.rank==0 && thArg.thread_id==0)
+			progress_bar(prm.nodeImgIdx[last]+1);
+	}
+}
+
+void ProgReconstructSignificant::alignImagesToGallery()
+{
 	size_t Nvols=YSIZE(cc);
-	size_t Ndirs=XSIZE(cc);
 
 	// Clear the previous assignment
 	for (size_t nvol=0; nvol<Nvols; ++nvol)
@@ -160,14 +336,7 @@ void ProgReconstructSignificant::alignImagesToGallery()
 		mdReconstructionProjectionMatching[nvol].clear();
 	}
 
-	MultidimArray<double> imgcc(Nvols*Ndirs), imgimed(Nvols*Ndirs);
-	MultidimArray<double> cdfcc, cdfimed;
 	double one_alpha=1-currentAlpha-deltaAlpha2;
-
-	FileName fnImg;
-	size_t nImg=0;
-	Image<double> I;
-	MultidimArray<double> mCurrentImageAligned, mGalleryProjection;
 	if (rank==0)
 	{
 		std::cout << "Current significance: " << one_alpha << std::endl;
@@ -175,202 +344,80 @@ void ProgReconstructSignificant::alignImagesToGallery()
 		init_progress_bar(mdIn.size());
 	}
 
-	MultidimArray<double> ccVol(Nvols);
+	// Collect the images of this node, metadatas cannot be accessed from the threads
+	std::vector<MDRow> nodeRows;
+	nodeImgIdx.clear();
+	nodeFnImg.clear();
+	size_t nImg=0;
 	MDRow row;
+	FileName fnImg;
 	FOR_ALL_OBJECTS_IN_METADATA(mdIn)
 	{
 		if ((nImg+1)%Nprocessors==rank)
 		{
 			mdIn.getValue(MDL_IMAGE,fnImg,__iter.objId);
 			mdIn.getRow(row,__iter.objId);
-#ifdef DEBUG
-			std::cout << "Processing: " << fnImg << std::endl;
-#endif
-			I.read(fnImg);
-			MultidimArray<double> &mCurrentImage=I();
-			mCurrentImage.setXmippOrigin();
-			allM.clear();
-
-			double bestCorr=-2, bestRot, bestTilt, bestImed=1e38, worstImed=-1e38;
-			Matrix2D<double> bestM;
-			int bestVolume=-1;
-
-			// Compute all correlations
-	    	for (size_t nVolume=0; nVolume<Nvols; ++nVolume)
-	    	{
-	    		AlignmentTransforms *transforms=galleryTransforms[nVolume];
-		    	for (size_t nDir=0; nDir<Ndirs; ++nDir)
-				{
-					mCurrentImageAligned=mCurrentImage;
-					mGalleryProjection.aliasImageInStack(gallery[nVolume](),nDir);
-					mGalleryProjection.setXmippOrigin();
-					double corr;
-					if (! dontCheckMirrors)
-						corr=alignImagesConsideringMirrors(mGalleryProjection,transforms[nDir],
-								mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
-					else
-						corr = alignImages(mGalleryProjection, mCurrentImageAligned,
-						                   M, DONT_WRAP);
-
-//					double corr=alignImagesConsideringMirrors(mGalleryProjection,
-//							mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
-					M=M.inv();
-					double imed=imedDistance(mGalleryProjection, mCurrentImageAligned);
-
-//					//if (corr>0.99)
-//					//{
-//					//std::cout << prm.mdGallery[nVolume][nDir].fnImg << " corr= " << corr << " imed= " << imed << std::endl;
-//					//std::cout << "Matrix=" << M << std::endl;
-//					//Image<double> save;
-//					//save()=mGalleryProjection;
-//					//save.write("PPPgallery.xmp");
-//					//save()=mCurrentImage;
-//					//save.write("PPPcurrentImage.xmp");
-//					//save()=mCurrentImageAligned;
-//					//save.write("PPPcurrentImageAligned.xmp");
-//					//char c; std::cin >> c;
-//					//}
-
-					DIRECT_A3D_ELEM(cc,nImg,nVolume,nDir)=corr;
-					// For the paper plot: std::cout << corr << " " << imed << std::endl;
-					size_t idx=nVolume*Ndirs+nDir;
-					DIRECT_A1D_ELEM(imgcc,idx)=corr;
-					DIRECT_A1D_ELEM(imgimed,idx)=imed;
-					allM.push_back(M);
-
-					if (corr>bestCorr)
-					{
-						bestM=M;
-						bestCorr=corr;
-						bestVolume=(int)nVolume;
-						bestRot=mdGallery[nVolume][nDir].rot;
-						bestTilt=mdGallery[nVolume][nDir].tilt;
-					}
-
-					if (imed<bestImed)
-						bestImed=imed;
-					else if (imed>worstImed)
-						worstImed=imed;
-				}
-	    	}
-
-	    	// Keep the best assignment for the projection matching
-	    	// Each process keeps a list of the images for each volume
-			MetaData &mdProjectionMatching=mdReconstructionProjectionMatching[bestVolume];
-			double scale, shiftX, shiftY, anglePsi;
-			bool flip;
-			transformationMatrix2Parameters2D(bestM,flip,scale,shiftX,shiftY,anglePsi);
-			if (useForValidation && dontCheckMirrors)
-				flip = false;
-
-			if (maxShift<0 || (maxShift>0 && fabs(shiftX)<maxShift && fabs(shiftY)<maxShift))
-			{
-				size_t recId=mdProjectionMatching.addRow(row);
-				mdProjectionMatching.setValue(MDL_ENABLED,1,recId);
-				mdProjectionMatching.setValue(MDL_MAXCC,bestCorr,recId);
-				mdProjectionMatching.setValue(MDL_ANGLE_ROT,bestRot,recId);
-				mdProjectionMatching.setValue(MDL_ANGLE_TILT,bestTilt,recId);
-				mdProjectionMatching.setValue(MDL_ANGLE_PSI,anglePsi,recId);
-				mdProjectionMatching.setValue(MDL_SHIFT_X,-shiftX,recId);
-				mdProjectionMatching.setValue(MDL_SHIFT_Y,-shiftY,recId);
-				mdProjectionMatching.setValue(MDL_FLIP,flip,recId);
-			}
-
-			// Compute lower limit of correlation
-			double rl=bestCorr*one_alpha;
-			double z=0.5*log((1+rl)/(1-rl));
-			double zl=z-2.96*sqrt(1.0/MULTIDIM_SIZE(mCurrentImage));
-			double ccl=tanh(zl);
-
-			// Compute the cumulative distributions
-			imgcc.cumlativeDensityFunction(cdfcc);
-			imgimed.cumlativeDensityFunction(cdfimed);
+			nodeRows.push_back(row);
+			nodeImgIdx.push_back(nImg);
+			nodeFnImg.push_back(fnImg);
+		}
+		nImg++;
+	}
+	nodeAlignment.resize(nodeImgIdx.size());
 
-			// Check if force 1 volume
-			size_t firstVolume=0;
-			size_t lastVolume=Nvols-1;
+	// Align all images in parallel
+	if (nodeImgIdx.size()>0)
+	{
+		taskDistributor=new ThreadTaskDistributor(nodeImgIdx.size(), XMIPP_MAX(1,nodeImgIdx.size()/(10*Nthr)));
+		thMgr->run(threadAlignImagesToGallery);
+		delete taskDistributor;
+		taskDistributor=NULL;
+	}
 
-	    	// Get the best images
-			for (size_t nVolume=firstVolume; nVolume<=lastVolume; ++nVolume)
-			{
-				MetaData &mdPartial=mdReconstructionPartial[nVolume];
-				for (size_t nDir=0; nDir<Ndirs; ++nDir)
-				{
-					size_t idx=nVolume*Ndirs+nDir;
-					double cdfccthis=DIRECT_A1D_ELEM(cdfcc,idx);
-					double cdfimedthis=DIRECT_A1D_ELEM(cdfimed,idx);
-					double cc=DIRECT_A1D_ELEM(imgcc,idx);
-					// bool condition=!useImed || (useImed && cdfimedthis<=currentAlpha);
-//					if (cc>ccl)
-//						std::cout << "Image " << nImg << " " << fnImg << " qualifies by Fisher to dir=" << nDir << std::endl;
-//					if (!(cdfccthis>=one_alpha) && cc>ccl)
-//						std::cout << "Image " << nImg << " " << fnImg << " does not qualify by correlation percentile to " << nDir << " -> " << cdfccthis << " " << one_alpha << std::endl;
-//					if (!condition && cc>ccl)
-//						std::cout << "Image " << nImg << " " << fnImg << " does not qualify by imed percentile to " << nDir << " -> " << cdfimedthis << " " << currentAlpha<< std::endl;
-					bool condition=true;
-					condition=condition && ((applyFisher && cc>=ccl) || !applyFisher);
-					condition=condition && cdfccthis>=one_alpha;
-					if (condition)
-					{
-//						std::cout << fnImg << " is selected for dir=" << nDir << std::endl;
-						double imed=DIRECT_A1D_ELEM(imgimed,idx);
-						transformationMatrix2Parameters2D(allM[nVolume*Ndirs+nDir],flip,scale,shiftX,shiftY,anglePsi);
-						if (useForValidation && dontCheckMirrors)
-							flip = false;
-
-						if (maxShift>0)
-							if (fabs(shiftX)>maxShift || fabs(shiftY)>maxShift)
-								continue;
-						if (flip)
-							shiftX*=-1;
-
-						double thisWeight=cdfccthis*(cc/bestCorr);
-						// COSS: To promote sparsity in the volume assignment: sum_i(cc_i^p)/sum_i(cc_i)*cc_i^p/cc_i
-						if (useImed)
-							thisWeight*=(1-cdfimedthis)*(bestImed/imed);
-						DIRECT_A3D_ELEM(weight,nImg,nVolume,nDir)=thisWeight;
-						double angleRot=mdGallery[nVolume][nDir].rot;
-						double angleTilt=mdGallery[nVolume][nDir].tilt;
-			#ifdef DEBUG
-						std::cout << "   Getting Gallery: " << mdGallery[nVolume][nDir].fnImg
-								  << " corr=" << cc << " imed=" << imed << " weight=" << weight << " rot=" << angleRot
-								  << " tilt=" << angleTilt << std::endl
-						          << "Matrix=" << allM[nVolume*Ndirs+nDir] << std::endl
-						          << "shiftX=" << shiftX << " shiftY=" << shiftY << std::endl;
-			#endif
-
-						size_t recId=mdPartial.addRow(row);
-						mdPartial.setValue(MDL_ENABLED,1,recId);
-						mdPartial.setValue(MDL_MAXCC,cc,recId);
-						mdPartial.setValue(MDL_COST,imed,recId);
-						mdPartial.setValue(MDL_ANGLE_ROT,angleRot,recId);
-						mdPartial.setValue(MDL_ANGLE_TILT,angleTilt,recId);
-						mdPartial.setValue(MDL_ANGLE_PSI,anglePsi,recId);
-						mdPartial.setValue(MDL_SHIFT_X,-shiftX,recId);
-						mdPartial.setValue(MDL_SHIFT_Y,-shiftY,recId);
-						mdPartial.setValue(MDL_FLIP,flip,recId);
-						mdPartial.setValue(MDL_IMAGE_IDX,(size_t)nImg,recId);
-						mdPartial.setValue(MDL_REF,(int)nDir,recId);
-						mdPartial.setValue(MDL_REF3D,(int)nVolume,recId);
-						mdPartial.setValue(MDL_WEIGHT,thisWeight,recId);
-						mdPartial.setValue(MDL_WEIGHT_SIGNIFICANT,thisWeight,recId);
-					}
-				}
-			}
-#ifdef DEBUG
-			std::cout << "Press any key" << std::endl;
-			char c; std::cin >> c;
-#endif
+	// Write the alignments in the metadatas, always in the same order
+	for (size_t idx=0; idx<nodeImgIdx.size(); ++idx)
+	{
+		const SignificantImageAlignment &alignment=nodeAlignment[idx];
+		MDRow &row=nodeRows[idx];
+		if (alignment.validShift)
+		{
+			MetaData &mdProjectionMatching=mdReconstructionProjectionMatching[alignment.bestVolume];
+			size_t recId=mdProjectionMatching.addRow(row);
+			mdProjectionMatching.setValue(MDL_ENABLED,1,recId);
+			mdProjectionMatching.setValue(MDL_MAXCC,alignment.bestCorr,recId);
+			mdProjectionMatching.setValue(MDL_ANGLE_ROT,alignment.bestRot,recId);
+			mdProjectionMatching.setValue(MDL_ANGLE_TILT,alignment.bestTilt,recId);
+			mdProjectionMatching.setValue(MDL_ANGLE_PSI,alignment.anglePsi,recId);
+			mdProjectionMatching.setValue(MDL_SHIFT_X,-alignment.shiftX,recId);
+			mdProjectionMatching.setValue(MDL_SHIFT_Y,-alignment.shiftY,recId);
+			mdProjectionMatching.setValue(MDL_FLIP,alignment.flip,recId);
 		}
 
-		if (rank==0)
-			progress_bar(nImg+1);
-		nImg++;
+		for (size_t n=0; n<alignment.assignments.size(); ++n)
+		{
+			const SignificantAssignment &assignment=alignment.assignments[n];
+			const GalleryImage &g=mdGallery[assignment.nVolume][assignment.nDir];
+			MetaData &mdPartial=mdReconstructionPartial[assignment.nVolume];
+			size_t recId=mdPartial.addRow(row);
+			mdPartial.setValue(MDL_ENABLED,1,recId);
+			mdPartial.setValue(MDL_MAXCC,assignment.cc,recId);
+			mdPartial.setValue(MDL_COST,assignment.imed,recId);
+			mdPartial.setValue(MDL_ANGLE_ROT,g.rot,recId);
+			mdPartial.setValue(MDL_ANGLE_TILT,g.tilt,recId);
+			mdPartial.setValue(MDL_ANGLE_PSI,assignment.anglePsi,recId);
+			mdPartial.setValue(MDL_SHIFT_X,-assignment.shiftX,recId);
+			mdPartial.setValue(MDL_SHIFT_Y,-assignment.shiftY,recId);
+			mdPartial.setValue(MDL_FLIP,assignment.flip,recId);
+			mdPartial.setValue(MDL_IMAGE_IDX,nodeImgIdx[idx],recId);
+			mdPartial.setValue(MDL_REF,(int)assignment.nDir,recId);
+			mdPartial.setValue(MDL_REF3D,(int)assignment.nVolume,recId);
+			mdPartial.setValue(MDL_WEIGHT,assignment.weight,recId);
+			mdPartial.setValue(MDL_WEIGHT_SIGNIFICANT,assignment.weight,recId);
+		}
 	}
 	if (rank==0)
 		progress_bar(mdIn.size());
 }
-#undef DEBUG
 
 // Main routine ------------------------------------------------------------
 void ProgReconstructSignificant::run()
@@ -615,28 +662,71 @@ void ProgReconstructSignificant::reconstructCurrent()
 	}
 }
 
-void ProgReconstructSignificant::generateProjections()
+void threadGenerateProjections(ThreadArgument &thArg)
 {
-	FileName fnGallery, fnGalleryMetaData;
-	if (iter>1 || fnFirstGallery=="")
-	{
-		FileName fnVol, fnAngles;
-		// Generate projections
-		for (int n=0; n<Nvolumes; n++)
+	ProgReconstructSignificant &prm=*((ProgReconstructSignificant *)thArg.workClass);
+	const FileName &fnDir=prm.fnDir;
+	int iter=prm.iter;
+
+	size_t first, last;
+	while (prm.taskDistributor->getTasks(first, last))
+		for (size_t idx=first; idx<=last; ++idx)
 		{
-			if ((n+1)%Nprocessors!=rank)
-				continue;
-			fnVol=formatString("%s/volume_iter%03d_%02d.vol",fnDir.c_str(),iter-1,n);
-			fnGallery=formatString("%s/gallery_iter%03d_%02d.stk",fnDir.c_str(),iter,n);
-			fnAngles=formatString("%s/angles_iter%03d_%02d.xmd",fnDir.c_str(),iter-1,n);
-			fnGalleryMetaData=formatString("%s/gallery_iter%03d_%02d.doc",fnDir.c_str(),iter,n);
+			int n=prm.nodeVolumes[idx];
+			FileName fnVol=formatString("%s/volume_iter%03d_%02d.vol",fnDir.c_str(),iter-1,n);
+			FileName fnGallery=formatString("%s/gallery_iter%03d_%02d.stk",fnDir.c_str(),iter,n);
+			FileName fnAngles=formatString("%s/angles_iter%03d_%02d.xmd",fnDir.c_str(),iter-1,n);
 			String args=formatString("-i %s -o %s --sampling_rate %f --sym %s --compute_neighbors --angular_distance -1 --experimental_images %s --min_tilt_angle %f --max_tilt_angle %f -v 0",
-					fnVol.c_str(),fnGallery.c_str(),angularSampling,fnSym.c_str(),fnAngles.c_str(),tilt0,tiltF);
+					fnVol.c_str(),fnGallery.c_str(),prm.angularSampling,prm.fnSym.c_str(),fnAngles.c_str(),prm.tilt0,prm.tiltF);
 
 			String cmd=(String)"xmipp_angular_project_library "+args;
 			if (system(cmd.c_str())==-1)
 				REPORT_ERROR(ERR_UNCLASSIFIED,"Cannot open shell");
 		}
+}
+
+void threadComputeGalleryTransforms(ThreadArgument &thArg)
+{
+	ProgReconstructSignificant &prm=*((ProgReconstructSignificant *)thArg.workClass);
+
+	// Each thread has its own plans
+	CorrelationAux aux;
+	AlignmentAux aux2;
+	MultidimArray<double> mGalleryProjection;
+	size_t kmax=NSIZE(prm.gallery[0]());
+
+	size_t first, last;
+	while (prm.taskDistributor->getTasks(first, last))
+		for (size_t idx=first; idx<=last; ++idx)
+		{
+			size_t n=idx/kmax;
+			size_t k=idx%kmax;
+			AlignmentTransforms &transforms=prm.galleryTransforms[n][k];
+			mGalleryProjection.aliasImageInStack(prm.gallery[n](),k);
+			mGalleryProjection.setXmippOrigin();
+			aux.transformer1.FourierTransform((MultidimArray<double> &)mGalleryProjection, transforms.FFTI, true);
+			normalizedPolarFourierTransform(mGalleryProjection, transforms.polarFourierI, false,
+			                                XSIZE(mGalleryProjection) / 5, XSIZE(mGalleryProjection) / 2, aux2.plans, 1);
+		}
+}
+
+void ProgReconstructSignificant::generateProjections()
+{
+	FileName fnGallery, fnGalleryMetaData;
+	if (iter>1 || fnFirstGallery=="")
+	{
+		// Generate projections of the volumes of this node in parallel
+		nodeVolumes.clear();
+		for (int n=0; n<Nvolumes; n++)
+			if ((n+1)%Nprocessors==rank)
+				nodeVolumes.push_back(n);
+		if (nodeVolumes.size()>0)
+		{
+			taskDistributor=new ThreadTaskDistributor(nodeVolumes.size(),1);
+			thMgr->run(threadGenerateProjections);
+			delete taskDistributor;
+			taskDistributor=NULL;
+		}
 		synchronize();
 	}
 
@@ -644,9 +734,6 @@ void ProgReconstructSignificant::generateProjections()
 	std::vector<GalleryImage> galleryNames;
 	mdGallery.clear();
 
-	CorrelationAux aux;
-	AlignmentAux aux2;
-	MultidimArray<double> mGalleryProjection;
 	for (int n=0; n<Nvolumes; n++)
 	{
 		mdGallery.push_back(galleryNames);
@@ -671,24 +758,30 @@ void ProgReconstructSignificant::generateProjections()
 			mdGallery[n].push_back(I);
 		}
 		gallery[n].read(fnGallery);
+	}
 
-		// Calculate transforms of this gallery
-		size_t kmax=NSIZE(gallery[n]());
-		if (galleryTransforms[n]==NULL)
+	// All galleries are projected with the same sampling, so that the
+	// transforms are computed as a single set of Nvolumes*kmax tasks
+	size_t kmax=NSIZE(gallery[0]());
+	for (int n=1; n<Nvolumes; n++)
+		if (NSIZE(gallery[n]())!=kmax)
+			REPORT_ERROR(ERR_MULTIDIM_SIZE,formatString("Gallery %d has %lu images while gallery 0 has %lu",
+			             n,(unsigned long)NSIZE(gallery[n]()),(unsigned long)kmax));
+	if (kmax!=NgalleryTransforms)
+	{
+		for (int n=0; n<Nvolumes; n++)
 		{
-			delete galleryTransforms[n];
+			delete [] galleryTransforms[n];
 			galleryTransforms[n]=new AlignmentTransforms[kmax];
 		}
-		AlignmentTransforms *transforms=galleryTransforms[n];
-		for (size_t k=0; k<kmax; ++k)
-		{
-			mGalleryProjection.aliasImageInStack(gallery[n](),k);
-			mGalleryProjection.setXmippOrigin();
-			aux.transformer1.FourierTransform((MultidimArray<double> &)mGalleryProjection, transforms[k].FFTI, true);
-		    normalizedPolarFourierTransform(mGalleryProjection, transforms[k].polarFourierI, false,
-		                                    XSIZE(mGalleryProjection) / 5, XSIZE(mGalleryProjection) / 2, aux2.plans, 1);
-		}
+		NgalleryTransforms=kmax;
 	}
+
+	// Calculate transforms of all galleries in parallel
+	taskDistributor=new ThreadTaskDistributor(Nvolumes*kmax, XMIPP_MAX(1,Nvolumes*kmax/(10*Nthr)));
+	thMgr->run(threadComputeGalleryTransforms);
+	delete taskDistributor;
+	taskDistributor=NULL;
 }
 
 void ProgReconstructSignificant::numberOfProjections()
@@ -730,6 +823,7 @@ void ProgReconstructSignificant::numberOfProjections()
 
 void ProgReconstructSignificant::produceSideinfo()
 {
+	thMgr=new ThreadManager(Nthr,this);
 	mdIn.read(fnIn);
 	mdIn.removeDisabled();
 
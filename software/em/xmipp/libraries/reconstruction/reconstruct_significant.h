@@ -27,6 +27,7 @@
 #define __RECONSTRUCT_SIGNIFICANT_H
 
 #include <data/xmipp_program.h>
+#include <data/xmipp_threads.h>
 #include "angular_project_library.h"
 #include "volume_initial_simulated_annealing.h"
 
@@ -34,6 +35,31 @@
    @ingroup ReconsLibrary */
 //@{
 
+/** Significant assignment of an image to a gallery direction */
+class SignificantAssignment
+{
+public:
+	size_t nVolume, nDir;
+	double cc, imed, weight, anglePsi, shiftX, shiftY;
+	bool flip;
+};
+
+/** Alignment of a single image to all galleries.
+ * It is filled by the threads and written into the metadatas by the main thread,
+ * since metadatas do not support threads.
+ */
+class SignificantImageAlignment
+{
+public:
+	// Best assignment for projection matching
+	int bestVolume;
+	double bestCorr, bestRot, bestTilt, anglePsi, shiftX, shiftY;
+	bool flip, validShift;
+
+	// All significant assignments
+	std::vector<SignificantAssignment> assignments;
+};
+
 /** Significant reconstruction parameters. */
 class ProgReconstructSignificant: public XmippProgram
 {
@@ -93,6 +119,8 @@ public:
 
     bool dontCheckMirrors;
 
+    /** Number of threads */
+    int Nthr;
 
 public: // Internal members
     size_t rank, Nprocessors;
@@ -125,16 +153,37 @@ public: // Internal members
     // COSS Image<double> inputImages;
     std::vector< Image<double> > gallery;
     std::vector< AlignmentTransforms* > galleryTransforms;
+    // Number of gallery images for which galleryTransforms are allocated
+    size_t NgalleryTransforms;
 
 	// Current iteration
 	int iter;
 
 	// Current alpha
 	double currentAlpha;
+
+	// Thread manager
+	ThreadManager *thMgr;
+
+	// Task distributor for the threads
+	ThreadTaskDistributor *taskDistributor;
+
+	// Indexes (in mdIn) and filenames of the images processed by this node
+	std::vector<size_t> nodeImgIdx;
+	std::vector<FileName> nodeFnImg;
+
+	// Alignment results of the images processed by this node
+	std::vector<SignificantImageAlignment> nodeAlignment;
+
+	// Volumes to project by this node
+	std::vector<int> nodeVolumes;
 public:
 	/// Empty constructor
 	ProgReconstructSignificant();
 
+	/// Destructor
+	~ProgReconstructSignificant();
+
     /// Read arguments from command line
     virtual void readParams();
 
@@ -162,6 +211,9 @@ public:
     /// Align images to gallery projections
     void alignImagesToGallery();
 
+    /// Align a single image to all gallery projections
+    void alignSingleImage(size_t idx, AlignmentAux &aux, CorrelationAux &aux2, RotationalCorrelationAux &aux3);
+
     /// Gather alignment
     virtual void gatherAlignment() {}
 
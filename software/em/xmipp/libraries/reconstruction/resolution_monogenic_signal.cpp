@@ -25,6 +25,7 @@
  ***************************************************************************/
 
 #include "resolution_monogenic_signal.h"
+#include <data/xmipp_threads.h>
 //#define DEBUG
 //#define DEBUG_MASK
 
@@ -49,6 +50,7 @@ void ProgMonogenicSignalRes::readParams()
 	fnSpatial = getParam("--filtered_volume");
 	significance = getDoubleParam("--significance");
 	fnMd = getParam("--md_outputdata");
+	Nthr = getIntParam("--thr");
 }
 
 
@@ -83,11 +85,17 @@ void ProgMonogenicSignalRes::defineParams()
 	addParamsLine("                                  : Moreover, voxels inside the mask cannot be measured due to an unsignificant");
 	addParamsLine("                                  : SNR. Thus, a new mask is created. This metadata file, shows, the number of");
 	addParamsLine("                                  : voxels of the original mask, and the created mask");
+	addParamsLine("  [--thr <N=1>]                : Number of threads");
 }
 
 void ProgMonogenicSignalRes::produceSideInfo()
 {
 	std::cout << "Starting..." << std::endl;
+
+	// All the FFTW plans created from now on use Nthr threads
+	if (Nthr>1)
+		transformer_inv.setThreadsNumber(Nthr);
+
 	Image<double> V;
 	if ((fnVol !="") && (fnVol2 !=""))
 	{
@@ -115,22 +123,33 @@ void ProgMonogenicSignalRes::produceSideInfo()
 	transformer.FourierTransform(inputVol, fftV);
 	iu.initZeros(fftV);
 
-	// Calculate u and first component of Riesz vector
+	// Digital frequencies of the Fourier indexes
+	freq_fourier_z.initZeros(ZSIZE(fftV));
+	freq_fourier_y.initZeros(YSIZE(fftV));
+	freq_fourier_x.initZeros(XSIZE(fftV));
+	for(size_t k=0; k<ZSIZE(fftV); ++k)
+		FFT_IDX2DIGFREQ(k,ZSIZE(inputVol),VEC_ELEM(freq_fourier_z,k));
+	for(size_t i=0; i<YSIZE(fftV); ++i)
+		FFT_IDX2DIGFREQ(i,YSIZE(inputVol),VEC_ELEM(freq_fourier_y,i));
+	for(size_t j=0; j<XSIZE(fftV); ++j)
+		FFT_IDX2DIGFREQ(j,XSIZE(inputVol),VEC_ELEM(freq_fourier_x,j));
+
+	// Calculate the inverse of the frequency
 	double uz, uy, ux, uz2, u2, uz2y2;
 	long n=0;
 	for(size_t k=0; k<ZSIZE(fftV); ++k)
 	{
-		FFT_IDX2DIGFREQ(k,ZSIZE(inputVol),uz);
+		uz=VEC_ELEM(freq_fourier_z,k);
 		uz2=uz*uz;
 
 		for(size_t i=0; i<YSIZE(fftV); ++i)
 		{
-			FFT_IDX2DIGFREQ(i,YSIZE(inputVol),uy);
+			uy=VEC_ELEM(freq_fourier_y,i);
 			uz2y2=uz2+uy*uy;
 
 			for(size_t j=0; j<XSIZE(fftV); ++j)
 			{
-				FFT_IDX2DIGFREQ(j,XSIZE(inputVol),ux);
+				ux=VEC_ELEM(freq_fourier_x,j);
 				u2=uz2y2+ux*ux;
 				if ((k != 0) || (i != 0) || (j != 0))
 					DIRECT_MULTIDIM_ELEM(iu,n) = 1.0/sqrt(u2);
@@ -140,18 +159,13 @@ void ProgMonogenicSignalRes::produceSideInfo()
 			}
 		}
 	}
+	bandFilterFreq=-1;
 	#ifdef DEBUG
 	Image<double> saveiu;
 	saveiu = 1/iu;
 	saveiu.write("iu.vol");
 	#endif
 
-	// Prepare low pass filter
-	lowPassFilter.FilterShape = RAISED_COSINE;
-	lowPassFilter.raised_w = 0.01;
-	lowPassFilter.do_generate_3dmask = false;
-	lowPassFilter.FilterBand = LOWPASS;
-
 	// Prepare mask
 	MultidimArray<int> &pMask=mask();
 
@@ -202,193 +216,219 @@ void ProgMonogenicSignalRes::produceSideInfo()
 }
 
 
-void ProgMonogenicSignalRes::amplitudeMonogenicSignal3D(MultidimArray< std::complex<double> > &myfftV,
-		double w1, double w1h, double w1l, MultidimArray<double> &amplitude, int count, FileName fnDebug)
-{
-	fftVRiesz.initZeros(myfftV);
-	amplitude.resizeNoCopy(VRiesz);
-	std::complex<double> J(0,1);
-
-	// Filter the input volume and add it to amplitude
-	long n=0;
-	double iw=1.0/w1;
-	double iwl=1.0/w1l;
-	double ideltal=PI/(w1-w1l);
-
-	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(myfftV)
-	{
-		double iun=DIRECT_MULTIDIM_ELEM(iu,n);
-		double un=1.0/iun;
-		if (w1l<=un && un<=w1)
-		{
-			//double H=0.5*(1+cos((un-w1)*ideltal));
-			DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = DIRECT_MULTIDIM_ELEM(myfftV, n);
-			DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= 0.5*(1+cos((un-w1)*ideltal));//H;
-		} else if (un>w1)
-			DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = DIRECT_MULTIDIM_ELEM(myfftV, n);
-	}
-
-	transformer_inv.inverseFourierTransform(fftVRiesz, VRiesz);
-
-	#ifdef DEBUG
-	Image<double> filteredvolume;
-	filteredvolume = VRiesz;
-	filteredvolume.write(formatString("Volumen_filtrado_%i.vol", count));
-	#endif
-
-	if (fnSpatial!="")
-		Vfiltered()=VRiesz;
-
-	#ifdef DEBUG
-	FileName iternumber;
-	iternumber = formatString("_Volume_%i.vol", count);
-	Image<double> saveImg2;
-	saveImg2() = VRiesz;
-	  if (fnDebug.c_str() != "")
-	  {
-		saveImg2.write(fnDebug+iternumber);
-	  }
-	saveImg2.clear(); 
-	#endif
-
-
-	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(amplitude)
-	DIRECT_MULTIDIM_ELEM(amplitude,n)=DIRECT_MULTIDIM_ELEM(VRiesz,n)*DIRECT_MULTIDIM_ELEM(VRiesz,n);
+// Elementwise operations of the monogenic signal
+#define MONOGENIC_RIESZ     0
+#define MONOGENIC_SQUARE    1
+#define MONOGENIC_ADDSQUARE 2
+#define MONOGENIC_LOWPASS   3
 
-	// Calculate first component of Riesz vector
-	fftVRiesz.initZeros(myfftV);
-	double uz, uy, ux;
-	n=0;
+// Width of the raised cosine of the low pass filter of the amplitude
+#define MONOGENIC_RAISED_W 0.01
 
-	for(size_t j=0; j<XSIZE(myfftV); ++j)
+struct MonogenicThreadData
+{
+	ProgMonogenicSignalRes *parent;
+	int operation;
+	const MultidimArray< std::complex<double> > *myfftV;
+	int component;
+	MultidimArray<double> *amplitude;
+	double w1;
+};
+
+// Component of the monogenic signal in the Fourier planes k0 to kF. Component 0
+// is the bandpass filtered volume, components 1 to 3 are the Riesz components
+// along x, y and z
+static void monogenicRiesz(ProgMonogenicSignalRes &prm, const MultidimArray< std::complex<double> > &myfftV,
+		int component, size_t k0, size_t kF)
+{
+	const std::complex<double> J(0,1);
+	size_t XYsize=YXSIZE(myfftV);
+	for(size_t k=k0; k<=kF; ++k)
 	{
-		FFT_IDX2DIGFREQ(j,YSIZE(amplitude),ux);
-		for(size_t k=0; k<ZSIZE(myfftV); ++k)
+		double uz=VEC_ELEM(prm.freq_fourier_z,k);
+		size_t n=k*XYsize;
+		for(size_t i=0; i<YSIZE(myfftV); ++i)
 		{
-			for(size_t i=0; i<YSIZE(myfftV); ++i)
+			double uy=VEC_ELEM(prm.freq_fourier_y,i);
+			for(size_t j=0; j<XSIZE(myfftV); ++j, ++n)
 			{
-				double iun=DIRECT_MULTIDIM_ELEM(iu,n);
-				double un=1.0/iun;
-				if (w1l<=un && un<=w1)
-				{
-					//double H=0.5*(1+cos((un-w1)*ideltal));
-					//DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = (-J*ux*iun)*DIRECT_MULTIDIM_ELEM(myfftV, n);
-					//DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *=0.5*(1+cos((un-w1)*ideltal));//H;
-					//Next lines are an optimization of the commented ones
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = DIRECT_MULTIDIM_ELEM(myfftV, n);
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= J;
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= -ux*iun*0.5*(1+cos((un-w1)*ideltal));//H;
-				} else if (un>w1)
+				double H=DIRECT_MULTIDIM_ELEM(prm.bandFilter,n);
+				if (H==0)
+					DIRECT_MULTIDIM_ELEM(prm.fftVRiesz,n)=0;
+				else if (component==0)
+					DIRECT_MULTIDIM_ELEM(prm.fftVRiesz,n)=H*DIRECT_MULTIDIM_ELEM(myfftV,n);
+				else
 				{
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = (-ux*iun)*DIRECT_MULTIDIM_ELEM(myfftV, n);
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= J;
+					double uc;
+					if (component==1)
+						uc=VEC_ELEM(prm.freq_fourier_x,j);
+					else if (component==2)
+						uc=uy;
+					else
+						uc=uz;
+					DIRECT_MULTIDIM_ELEM(prm.fftVRiesz,n)=(-uc*DIRECT_MULTIDIM_ELEM(prm.iu,n)*H)*
+						(J*DIRECT_MULTIDIM_ELEM(myfftV,n));
 				}
-				++n;
 			}
 		}
 	}
-	transformer_inv.inverseFourierTransform(fftVRiesz, VRiesz);
-	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(amplitude)
-	DIRECT_MULTIDIM_ELEM(amplitude,n)+=DIRECT_MULTIDIM_ELEM(VRiesz,n)*DIRECT_MULTIDIM_ELEM(VRiesz,n);
-
-	// Calculate second component of Riesz vector
-	fftVRiesz.initZeros(myfftV);
-	n=0;
+}
 
-	for(size_t i=0; i<YSIZE(myfftV); ++i)
+// Part id (out of Nthr) of an elementwise operation
+static void monogenicOperation(MonogenicThreadData &data, size_t id, size_t Nthr)
+{
+	ProgMonogenicSignalRes &prm=*data.parent;
+	if (data.operation==MONOGENIC_RIESZ || data.operation==MONOGENIC_LOWPASS)
 	{
-		FFT_IDX2DIGFREQ(i,YSIZE(amplitude),uy);
-		for(size_t k=0; k<ZSIZE(myfftV); ++k)
+		// Each thread takes a slab of Fourier planes
+		size_t Zsize=ZSIZE(prm.iu);
+		size_t k0=(id*Zsize)/Nthr;
+		size_t kF=((id+1)*Zsize)/Nthr;
+		if (k0>=kF)
+			return;
+		if (data.operation==MONOGENIC_RIESZ)
+			monogenicRiesz(prm,*data.myfftV,data.component,k0,kF-1);
+		else
 		{
-			for(size_t j=0; j<XSIZE(myfftV); ++j)
+			// Raised cosine low pass at w1
+			size_t XYsize=YXSIZE(prm.iu);
+			double iRaised=PI/MONOGENIC_RAISED_W;
+			for (size_t n=k0*XYsize; n<kF*XYsize; ++n)
 			{
-				double iun=DIRECT_MULTIDIM_ELEM(iu,n);
-				double un=1.0/iun;
-				if (w1l<=un && un<=w1)
-				{
-					//double H=0.5*(1+cos((un-w1)*ideltal));
-					//DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = (-J*uy*iun)*DIRECT_MULTIDIM_ELEM(myfftV, n);
-					//DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *=0.5*(1+cos((un-w1)*ideltal));//H;
-					//Next lines are an optimization of the commented ones
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = DIRECT_MULTIDIM_ELEM(myfftV, n);
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= J;
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= -uy*iun*0.5*(1+cos((un-w1)*ideltal));//H;
-				} else if (un>w1)
-				{
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = (-uy*iun)*DIRECT_MULTIDIM_ELEM(myfftV, n);
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= J;
-				}
-				++n;
+				double un=1.0/DIRECT_MULTIDIM_ELEM(prm.iu,n);
+				if (un>=data.w1+MONOGENIC_RAISED_W)
+					DIRECT_MULTIDIM_ELEM(prm.fftAmplitude,n)=0;
+				else if (un>=data.w1)
+					DIRECT_MULTIDIM_ELEM(prm.fftAmplitude,n)*=(1+cos(iRaised*(un-data.w1)))/2;
 			}
 		}
 	}
-	transformer_inv.inverseFourierTransform(fftVRiesz, VRiesz);
-	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(amplitude)
-	DIRECT_MULTIDIM_ELEM(amplitude,n)+=DIRECT_MULTIDIM_ELEM(VRiesz,n)*DIRECT_MULTIDIM_ELEM(VRiesz,n);
+	else
+	{
+		// Each thread takes a chunk of voxels
+		MultidimArray<double> &amplitude=*data.amplitude;
+		size_t N=MULTIDIM_SIZE(amplitude);
+		size_t n0=(id*N)/Nthr;
+		size_t nF=((id+1)*N)/Nthr;
+		double *ptrA=MULTIDIM_ARRAY(amplitude);
+		const double *ptrV=MULTIDIM_ARRAY(prm.VRiesz);
+		if (data.operation==MONOGENIC_SQUARE)
+			for (size_t n=n0; n<nF; ++n)
+				ptrA[n]=ptrV[n]*ptrV[n];
+		else
+			for (size_t n=n0; n<nF; ++n)
+				ptrA[n]+=ptrV[n]*ptrV[n];
+	}
+}
+
+static void threadMonogenicOperation(ThreadArgument &thArg)
+{
+	MonogenicThreadData &data=*((MonogenicThreadData *)thArg.workClass);
+	monogenicOperation(data,thArg.thread_id,thArg.getNumberOfThreads());
+}
 
-	// Calculate third component of Riesz vector
-	fftVRiesz.initZeros(myfftV);
-	n=0;
-	for(size_t k=0; k<ZSIZE(myfftV); ++k)
+void ProgMonogenicSignalRes::runMonogenicOperation(int operation,
+		const MultidimArray< std::complex<double> > *myfftV, int component,
+		MultidimArray<double> *amplitude, double w1)
+{
+	MonogenicThreadData data;
+	data.parent=this;
+	data.operation=operation;
+	data.myfftV=myfftV;
+	data.component=component;
+	data.amplitude=amplitude;
+	data.w1=w1;
+	if (Nthr<=1)
+		monogenicOperation(data,0,1);
+	else
 	{
-		FFT_IDX2DIGFREQ(k,ZSIZE(amplitude),uz);
-		for(size_t i=0; i<YSIZE(myfftV); ++i)
+		ThreadManager thMgr(Nthr,&data);
+		thMgr.run(threadMonogenicOperation);
+	}
+}
+
+void ProgMonogenicSignalRes::computeBandFilter(double w1, double w1l)
+{
+	if (w1==bandFilterFreq)
+		return;
+	bandFilter.initZeros(iu);
+	double ideltal=PI/(w1-w1l);
+	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(iu)
+	{
+		double un=1.0/DIRECT_MULTIDIM_ELEM(iu,n);
+		if (w1l<=un && un<=w1)
+			DIRECT_MULTIDIM_ELEM(bandFilter,n)=0.5*(1+cos((un-w1)*ideltal));
+		else if (un>w1)
+			DIRECT_MULTIDIM_ELEM(bandFilter,n)=1;
+	}
+	bandFilterFreq=w1;
+}
+
+void ProgMonogenicSignalRes::amplitudeMonogenicSignal3D(MultidimArray< std::complex<double> > &myfftV,
+		double w1, double w1h, double w1l, MultidimArray<double> &amplitude, int count, FileName fnDebug)
+{
+	// The bandpass filter is shared by the signal and the noise at w1
+	computeBandFilter(w1,w1l);
+	fftVRiesz.resizeNoCopy(myfftV);
+	amplitude.resizeNoCopy(VRiesz);
+
+	// Filter the input volume and add it to amplitude, then add the three
+	// components of the Riesz vector
+	for (int component=0; component<4; ++component)
+	{
+		runMonogenicOperation(MONOGENIC_RIESZ,&myfftV,component,NULL,w1);
+		transformer_inv.inverseFourierTransform(fftVRiesz, VRiesz);
+		if (component==0)
 		{
-			for(size_t j=0; j<XSIZE(myfftV); ++j)
-			{
-				double iun=DIRECT_MULTIDIM_ELEM(iu,n);
-				double un=1.0/iun;
-				if (w1l<=un && un<=w1)
-				{
-					//double H=0.5*(1+cos((un-w1)*ideltal));
-					//DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = (-J*uz*iun)*DIRECT_MULTIDIM_ELEM(myfftV, n);
-					//DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= 0.5*(1+cos((un-w1)*ideltal));//H;
-					//Next lines are an optimization of the commented ones
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = DIRECT_MULTIDIM_ELEM(myfftV, n);
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= J;
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= -uz*iun*0.5*(1+cos((un-w1)*ideltal));//H;
-				} else if (un>w1)
-				{
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) = (-uz*iun)*DIRECT_MULTIDIM_ELEM(myfftV, n);
-					DIRECT_MULTIDIM_ELEM(fftVRiesz, n) *= J;
-				}
-				++n;
-			}
+			#ifdef DEBUG
+			Image<double> filteredvolume;
+			filteredvolume = VRiesz;
+			filteredvolume.write(formatString("Volumen_filtrado_%i.vol", count));
+			#endif
+
+			if (fnSpatial!="")
+				Vfiltered()=VRiesz;
+			runMonogenicOperation(MONOGENIC_SQUARE,NULL,0,&amplitude,w1);
 		}
+		else
+			runMonogenicOperation(MONOGENIC_ADDSQUARE,NULL,0,&amplitude,w1);
 	}
-	transformer_inv.inverseFourierTransform(fftVRiesz, VRiesz);
 	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(amplitude)
-	{
-		DIRECT_MULTIDIM_ELEM(amplitude,n)+=DIRECT_MULTIDIM_ELEM(VRiesz,n)*DIRECT_MULTIDIM_ELEM(VRiesz,n);
 		DIRECT_MULTIDIM_ELEM(amplitude,n)=sqrt(DIRECT_MULTIDIM_ELEM(amplitude,n));
-	}
+
 	#ifdef DEBUG
 	if (fnDebug.c_str() != "")
 	{
 	Image<double> saveImg;
 	saveImg = amplitude;
-	iternumber = formatString("_Amplitude_%i.vol", count);
+	FileName iternumber = formatString("_Amplitude_%i.vol", count);
 	saveImg.write(fnDebug+iternumber);
 	saveImg.clear();
 	}
 	#endif // DEBUG
-//
+
 	// Low pass filter the monogenic amplitude
-	lowPassFilter.w1 = w1;
 	amplitude.setXmippOrigin();
-	lowPassFilter.applyMaskSpace(amplitude);
+	transformer_amplitude.FourierTransform(amplitude, fftAmplitude, false);
+	runMonogenicOperation(MONOGENIC_LOWPASS,NULL,0,NULL,w1);
+	transformer_amplitude.inverseFourierTransform();
 
 	#ifdef DEBUG
+	Image<double> saveImg2;
 	saveImg2 = amplitude;
-	FileName fnSaveImg2;
 	if (fnDebug.c_str() != "")
 	{
-		iternumber = formatString("_Filtered_Amplitude_%i.vol", count);
+		FileName iternumber = formatString("_Filtered_Amplitude_%i.vol", count);
 		saveImg2.write(fnDebug+iternumber);
 	}
-	saveImg2.clear(); 
+	saveImg2.clear();
 	#endif // DEBUG
 }
+#undef MONOGENIC_RIESZ
+#undef MONOGENIC_SQUARE
+#undef MONOGENIC_ADDSQUARE
+#undef MONOGENIC_LOWPASS
+#undef MONOGENIC_RAISED_W
 
 
 void ProgMonogenicSignalRes::postProcessingLocalResolutions(MultidimArray<double> &resolutionVol,
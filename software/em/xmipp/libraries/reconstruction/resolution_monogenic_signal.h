@@ -64,6 +64,9 @@ public:
 	/** The search for resolutions is linear or inverse**/
 	bool exactres, noiseOnlyInHalves;
 
+	/** Number of threads */
+	int Nthr;
+
 public:
 
     void defineParams();
@@ -75,17 +78,27 @@ public:
     void amplitudeMonogenicSignal3D(MultidimArray< std::complex<double> > &myfftV,
     		double w1, double w1l, double w1h, MultidimArray<double> &amplitude,
     		int count, FileName fnDebug);
+
+    /* Bandpass filter of the monogenic signal at frequency w1 (computed only if w1 changes) */
+    void computeBandFilter(double w1, double w1l);
+
+    /* Run one of the elementwise operations of the monogenic signal in Nthr threads */
+    void runMonogenicOperation(int operation, const MultidimArray< std::complex<double> > *myfftV,
+    		int component, MultidimArray<double> *amplitude, double w1);
     void postProcessingLocalResolutions(MultidimArray<double> &resolutionVol,
     		std::vector<double> &list, MultidimArray<double> &resolutionChimera, double &cut_value, MultidimArray<int> &pMask);
     void run();
 
 public:
     Image<int> mask;
-    MultidimArray<double> iu, VRiesz; // Inverse of the frequency
+	MultidimArray<double> iu, VRiesz; // Inverse of the frequency
+	Matrix1D<double> freq_fourier_x, freq_fourier_y, freq_fourier_z; // Digital frequency of each Fourier index
+	MultidimArray<double> bandFilter; // Bandpass filter of the current frequency
+	double bandFilterFreq;
 	MultidimArray< std::complex<double> > fftV, *fftN; // Fourier transform of the input volume
-	FourierTransformer transformer_inv;
-	MultidimArray< std::complex<double> > fftVRiesz;
-	FourierFilter lowPassFilter, FilterBand;
+	FourierTransformer transformer_inv, transformer_amplitude;
+	MultidimArray< std::complex<double> > fftVRiesz, fftAmplitude;
+	FourierFilter FilterBand;
 	bool halfMapsGiven;
 	Image<double> Vfiltered, VresolutionFiltered;
 };
@@ -53,6 +53,7 @@ void ProgSymmetrize::readParams()
     sum = checkParam("--sum");
     heightFraction = getDoubleParam("--heightFraction");
     splineOrder = getIntParam("--spline");
+    Nthreads = getIntParam("--thr");
 }
 
 /* Usage ------------------------------------------------------------------- */
@@ -78,6 +79,7 @@ void ProgSymmetrize::defineParams()
     addParamsLine("   [--sum]               : compute the sum of the images/volumes instead of the average. This is useful for symmetrizing pieces");
     addParamsLine("   [--mask_in <fileName>]: symmetrize only in the masked area");
     addParamsLine("   [--spline <order=3>]  : Spline order for the interpolation (valid values are 1 and 3)");
+    addParamsLine("   [--thr <N=1>]         : Number of threads for symmetrizing volumes");
     addExampleLine("Symmetrize a list of images with 6 fold symmetry",false);
     addExampleLine("   xmipp_transform_symmetrize -i input.sel --sym 6");
     addExampleLine("Symmetrize with i3 symmetry and the volume is not wrapped",false);
@@ -95,7 +97,8 @@ void ProgSymmetrize::show()
     << "No group: " << do_not_generate_subgroup << std::endl
     << "Wrap:     " << wrap << std::endl
     << "Sum:      " << sum << std::endl
-	<< "Spline:   " << splineOrder << std::endl;
+	<< "Spline:   " << splineOrder << std::endl
+	<< "Threads:  " << Nthreads << std::endl;
     if (doMask)
         std::cout << "mask_in    " << fn_Maskin << std::endl;
     if (helical)
@@ -106,15 +109,172 @@ void ProgSymmetrize::show()
 }
 
 /* Symmetrize ------------------------------------------------------- */
+/* Data shared by the threads symmetrizing a volume */
+class SymmetrizeVolumeData
+{
+public:
+    const MultidimArray<double> *V_in;
+    const MultidimArray<double> *Bcoeffs;
+    const MultidimArray<double> *mask;
+    MultidimArray<double> *V_out;
+    // Matrices from output to input coordinates (one per operator)
+    std::vector< Matrix2D<double> > Ainv;
+    int spline;
+    bool wrap;
+    double outside;
+    ThreadTaskDistributor *td;
+};
+
+/* Value of V_in at the input coordinates (xp,yp,zp) (with respect to the
+   volume center), exactly as applyGeometry interpolates it. */
+inline double symmetrizeSample(const SymmetrizeVolumeData &data, double xp, double yp, double zp,
+                               double minxp, double maxxp, double minyp, double maxyp, double minzp, double maxzp,
+                               double cen_xp, double cen_yp, double cen_zp)
+{
+    const MultidimArray<double> &V1=*data.V_in;
+    bool x_isOut = XMIPP_RANGE_OUTSIDE(xp, minxp, maxxp);
+    bool y_isOut = XMIPP_RANGE_OUTSIDE(yp, minyp, maxyp);
+    bool z_isOut = XMIPP_RANGE_OUTSIDE(zp, minzp, maxzp);
+    if (data.wrap)
+    {
+        if (x_isOut)
+            xp = realWRAP(xp, minxp - 0.5, maxxp + 0.5);
+        if (y_isOut)
+            yp = realWRAP(yp, minyp - 0.5, maxyp + 0.5);
+        if (z_isOut)
+            zp = realWRAP(zp, minzp - 0.5, maxzp + 0.5);
+    }
+    else if (x_isOut || y_isOut || z_isOut)
+        return data.outside;
+
+    if (data.spline == 1)
+    {
+        double wx = xp + cen_xp;
+        size_t m1 = (int) wx;
+        wx -= m1;
+        size_t m2 = m1 + 1;
+        double wy = yp + cen_yp;
+        size_t n1 = (int) wy;
+        wy -= n1;
+        size_t n2 = n1 + 1;
+        double wz = zp + cen_zp;
+        size_t o1 = (int) wz;
+        wz -= o1;
+        size_t o2 = o1 + 1;
+
+        double wx_1=1-wx;
+        double wy_1=1-wy;
+        double wz_1=1-wz;
+        double aux1=wz_1 * wy_1;
+        double aux2=aux1*wx_1;
+        double tmp = aux2 * DIRECT_A3D_ELEM(V1, o1, n1, m1);
+        if (wx != 0 && m2 < V1.xdim)
+            tmp += (aux1-aux2)* DIRECT_A3D_ELEM(V1, o1, n1, m2);
+        if (wy != 0 && n2 < V1.ydim)
+        {
+            aux1=wz_1 * wy;
+            aux2=aux1*wx_1;
+            tmp += aux2 * DIRECT_A3D_ELEM(V1, o1, n2, m1);
+            if (wx != 0 && m2 < V1.xdim)
+                tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o1, n2, m2);
+        }
+        if (wz != 0 && o2 < V1.zdim)
+        {
+            aux1=wz * wy_1;
+            aux2=aux1*wx_1;
+            tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n1, m1);
+            if (wx != 0 && m2 < V1.xdim)
+                tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n1, m2);
+            if (wy != 0 && n2 < V1.ydim)
+            {
+                aux1=wz * wy;
+                aux2=aux1*wx_1;
+                tmp += aux2 * DIRECT_A3D_ELEM(V1, o2, n2, m1);
+                if (wx != 0 && m2 < V1.xdim)
+                    tmp += (aux1-aux2) * DIRECT_A3D_ELEM(V1, o2, n2, m2);
+            }
+        }
+        return tmp;
+    }
+    else if (data.spline == 0)
+        return A3D_ELEM(V1,(int)trunc(zp),(int)trunc(yp),(int)trunc(xp));
+    else
+        return data.Bcoeffs->interpolatedElementBSpline3D(xp, yp, zp, data.spline);
+}
+
+/* Symmetrize the slices k0 to kF of the output volume */
+void symmetrizeVolumeSlices(const SymmetrizeVolumeData &data, size_t k0, size_t kF)
+{
+    const MultidimArray<double> &V1=*data.V_in;
+    MultidimArray<double> &V2=*data.V_out;
+    double cen_z = (int)(V2.zdim / 2);
+    double cen_y = (int)(V2.ydim / 2);
+    double cen_x = (int)(V2.xdim / 2);
+    double cen_zp = (int)(V1.zdim / 2);
+    double cen_yp = (int)(V1.ydim / 2);
+    double cen_xp = (int)(V1.xdim / 2);
+    double minxp = -cen_xp;
+    double minyp = -cen_yp;
+    double minzp = -cen_zp;
+    double maxxp = V1.xdim - cen_xp - 1;
+    double maxyp = V1.ydim - cen_yp - 1;
+    double maxzp = V1.zdim - cen_zp - 1;
+
+    size_t Nops=data.Ainv.size();
+    std::vector<double> row(V2.xdim);
+    for (size_t k = k0; k <= kF; k++)
+        for (size_t i = 0; i < V2.ydim; i++)
+        {
+            // The output row starts with the input (identity operator)
+            double *ptrOut=&DIRECT_A3D_ELEM(V2, k, i, 0);
+            const double *ptrIn=&DIRECT_A3D_ELEM(V1, k, i, 0);
+            const double *ptrMask=(data.mask==NULL) ? NULL : &DIRECT_A3D_ELEM(*data.mask, k, i, 0);
+            for (size_t j = 0; j < V2.xdim; j++)
+                row[j]=ptrIn[j];
+
+            // Gather the samples of all operators
+            double x = -cen_x;
+            double y = i - cen_y;
+            double z = k - cen_z;
+            for (size_t op = 0; op < Nops; op++)
+            {
+                const Matrix2D<double> &Aref=data.Ainv[op];
+                double Aref00=MAT_ELEM(Aref,0,0);
+                double Aref10=MAT_ELEM(Aref,1,0);
+                double Aref20=MAT_ELEM(Aref,2,0);
+                double xp0 = x * Aref00 + y * MAT_ELEM(Aref, 0, 1) + z * MAT_ELEM(Aref, 0, 2) + MAT_ELEM(Aref, 0, 3);
+                double yp0 = x * Aref10 + y * MAT_ELEM(Aref, 1, 1) + z * MAT_ELEM(Aref, 1, 2) + MAT_ELEM(Aref, 1, 3);
+                double zp0 = x * Aref20 + y * MAT_ELEM(Aref, 2, 1) + z * MAT_ELEM(Aref, 2, 2) + MAT_ELEM(Aref, 2, 3);
+                for (size_t j = 0; j < V2.xdim; j++)
+                {
+                    if (ptrMask!=NULL && ptrMask[j]==0)
+                        row[j]+=ptrIn[j];
+                    else
+                        row[j]+=symmetrizeSample(data, xp0 + j*Aref00, yp0 + j*Aref10, zp0 + j*Aref20,
+                                                 minxp, maxxp, minyp, maxyp, minzp, maxzp,
+                                                 cen_xp, cen_yp, cen_zp);
+                }
+            }
+            for (size_t j = 0; j < V2.xdim; j++)
+                ptrOut[j]=row[j];
+        }
+}
+
+void threadSymmetrizeVolume(ThreadArgument &thArg)
+{
+    SymmetrizeVolumeData &data=*((SymmetrizeVolumeData *)thArg.workClass);
+    size_t first, last;
+    while (data.td->getTasks(first, last))
+        symmetrizeVolumeSlices(data, first, last);
+}
+
 void symmetrizeVolume(const SymList &SL, const MultidimArray<double> &V_in,
                       MultidimArray<double> &V_out, int spline,
                       bool wrap, bool do_outside_avg, bool sum, bool helical, bool dihedral, bool helicalDihedral,
                       double rotHelical, double rotPhaseHelical, double zHelical, double heightFraction,
-                      const MultidimArray<double> * mask)
+                      const MultidimArray<double> * mask, int Nthreads)
 {
     Matrix2D<double> L(4, 4), R(4, 4); // A matrix from the list
-    MultidimArray<double> V_aux;
-    Matrix1D<double> sh(3);
     double avg = 0.;
 
     if (do_outside_avg)
@@ -128,41 +288,69 @@ void symmetrizeVolume(const SymList &SL, const MultidimArray<double> &V_in,
         double dum;
         computeStats_within_binary_mask(mask1, V_in, dum, dum, avg, dum);
     }
-    V_out = V_in;
 
     if (!helical && !dihedral && !helicalDihedral)
     {
-    	MultidimArray<double> Bcoeffs;
-    	MultidimArray<double> *BcoeffsPtr=NULL;
-    	if (spline==3)
-    	{
-    		produceSplineCoefficients(BSPLINE3, Bcoeffs, V_in);
-    		BcoeffsPtr=&Bcoeffs;
-    	}
+        V_out.resizeNoCopy(V_in);
+        STARTINGX(V_out)=STARTINGX(V_in);
+        STARTINGY(V_out)=STARTINGY(V_in);
+        STARTINGZ(V_out)=STARTINGZ(V_in);
+        if (mask!=NULL && !mask->sameShape(V_in))
+            REPORT_ERROR(ERR_MULTIDIM_SIZE,"symmetrizeVolume: the mask and the volume have different shapes");
+
+        SymmetrizeVolumeData data;
+        data.V_in=&V_in;
+        data.V_out=&V_out;
+        data.mask=mask;
+        data.spline=spline;
+        data.wrap=wrap;
+        data.outside=avg;
+        data.td=NULL;
+
+        MultidimArray<double> Bcoeffs;
+        data.Bcoeffs=NULL;
+        if (spline>1)
+        {
+            produceSplineCoefficients(spline, Bcoeffs, V_in);
+            STARTINGX(Bcoeffs) = -(int)(XSIZE(V_in) / 2);
+            STARTINGY(Bcoeffs) = -(int)(YSIZE(V_in) / 2);
+            STARTINGZ(Bcoeffs) = -(int)(ZSIZE(V_in) / 2);
+            data.Bcoeffs=&Bcoeffs;
+        }
+        /*FIXME: I do not think this make sense since V_aux is empty. ROB
+           SL.getShift(i, sh);
+           R(3, 0) = sh(0) * XSIZE(V_aux);
+           R(3, 1) = sh(1) * YSIZE(V_aux);
+           R(3, 2) = sh(2) * ZSIZE(V_aux);
+        */
+        data.Ainv.resize(SL.symsNo());
         for (int i = 0; i < SL.symsNo(); i++)
         {
             SL.getMatrices(i, L, R);
-            /*FIXME: I do not think this make sense since V_aux is empty. ROB
-               SL.getShift(i, sh);
-               R(3, 0) = sh(0) * XSIZE(V_aux);
-               R(3, 1) = sh(1) * YSIZE(V_aux);
-               R(3, 2) = sh(2) * ZSIZE(V_aux);
-            */
-            applyGeometry(spline, V_aux, V_in, R.transpose(), IS_NOT_INV, wrap, avg, BcoeffsPtr);
+            data.Ainv[i]=R.transpose().inv();
+        }
 
-            if ( mask==NULL)
-                arrayByArray(V_out, V_aux, V_out, '+');
-            else               // op1, op2 ,  result
-                selfArrayByArrayMask(V_in, V_aux, V_out, '+', mask);
+        if (Nthreads<=1 || ZSIZE(V_out)<2)
+            symmetrizeVolumeSlices(data, 0, ZSIZE(V_out)-1);
+        else
+        {
+            ThreadTaskDistributor td(ZSIZE(V_out), 1);
+            data.td=&td;
+            ThreadManager thMgr(Nthreads, &data);
+            thMgr.run(threadSymmetrizeVolume);
         }
 
         if (!sum)
             arrayByScalar(V_out, 1.0/(SL.symsNo() + 1.0f), V_out, '*');
     }
     else if (helical)
+    {
+        V_out = V_in;
         symmetry_Helical(V_out,V_in,zHelical,rotHelical,rotPhaseHelical,NULL,false,heightFraction);
+    }
     else if (helicalDihedral)
     {
+        V_out = V_in;
         symmetry_Helical(V_out,V_in,zHelical,rotHelical,rotPhaseHelical,NULL,true,heightFraction);
         MultidimArray<double> Vrotated;
         rotate(spline,Vrotated,V_out,180.0,'X',WRAP);
@@ -171,6 +359,7 @@ void symmetrizeVolume(const SymList &SL, const MultidimArray<double> &V_in,
     }
     else if (dihedral)
     {
+        V_out = V_in;
     	int zmax=(int)(0.1*ZSIZE(V_in));
         symmetry_Dihedral(V_out,V_in,1,-zmax,zmax,0.5);
     }
@@ -253,7 +442,8 @@ void ProgSymmetrize::processImage(const FileName &fnImg, const FileName &fnImgOu
         if (SL.symsNo()>0 || helical || dihedral || helicalDihedral)
         {
             symmetrizeVolume(SL,Iin(),Iout(),splineOrder,wrap,!wrap,
-                             sum,helical,dihedral,helicalDihedral,rotHelical,rotPhaseHelical,zHelical,heightFraction,mmask);
+                             sum,helical,dihedral,helicalDihedral,rotHelical,rotPhaseHelical,zHelical,heightFraction,mmask,
+                             Nthreads);
         }
         else
             REPORT_ERROR(ERR_ARG_MISSING,"The symmetry description is not valid for volumes");
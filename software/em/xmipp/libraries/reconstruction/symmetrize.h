@@ -30,6 +30,7 @@
 #include <data/mask.h>
 #include <data/symmetries.h>
 #include <data/xmipp_program.h>
+#include <data/xmipp_threads.h>
 
 /**@defgroup SymmetrizeProgram symmetrize (Symmetrize a volume or image)
    @ingroup ReconsLibrary */
@@ -65,6 +66,8 @@ public:
     bool            sum;
     /// Spline order
     int splineOrder;
+    /// Number of threads
+    int Nthreads;
 public:
     /** Read parameters from command line. */
     void readParams();
@@ -93,13 +96,17 @@ public:
     bool helicalDihedral;
 };
 
-/** Symmetrize volume.*/
+/** Symmetrize volume.
+ * For point groups, all the symmetry operators are applied in a single pass over
+ * the output volume: each output row gathers the interpolated samples of all
+ * operators, instead of producing a full rotated volume per operator. The
+ * output slices are distributed among Nthreads threads. */
 void symmetrizeVolume(const SymList &SL, const MultidimArray<double> &V_in,
                       MultidimArray<double> &V_out, int spline=BSPLINE3,
                       bool wrap=true, bool do_outside_avg=false, bool sum=false, bool helical=false, bool dihedral=false,
                       bool helicalDihedral=false,
                       double rotHelical=0.0, double rotPhaseHelical=0.0, double zHelical=0.0, double heightFraction=0.95,
-                      const MultidimArray<double> * mask=NULL);
+                      const MultidimArray<double> * mask=NULL, int Nthreads=1);
 
 /** Symmetrize image.*/
 void symmetrizeImage(int symorder, const MultidimArray<double> &I_in,
@@ -36,6 +36,7 @@
 #include <iostream>
 
 #include "fourier_filter.h"
+#include <data/xmipp_threads.h>
 
 /* Generate mask ----------------------------------------------------------- */
 //#define DEBUG
@@ -343,7 +344,6 @@ void setupAffineFitness(AffineFitness &fitness, const MultidimArray<double> &I1,
     fitness.maxAllowed(4)=fitness.maxAllowed(5)= maxShift;
 }
 
-static pthread_mutex_t globalAffineMutex = PTHREAD_MUTEX_INITIALIZER;
 double computeAffineTransformation(const MultidimArray<unsigned char> &I1,
                                    const MultidimArray<unsigned char> &I2, int maxShift, int maxIterDE,
                                    Matrix2D<double> &A12, Matrix2D<double> &A21, bool show,
@@ -389,7 +389,6 @@ double computeAffineTransformation(const MultidimArray<unsigned char> &I1,
             {
                 // Initialize with cross correlation
                 double tx, ty;
-                pthread_mutex_lock( &globalAffineMutex );
                 CorrelationAux aux;
                 if (!isMirror)
                     bestShift(I1d,I2d,tx,ty,aux);
@@ -402,7 +401,6 @@ double computeAffineTransformation(const MultidimArray<unsigned char> &I1,
                     bestShift(I1d,auxI2d,tx,ty,aux);
                     ty=-ty;
                 }
-                pthread_mutex_unlock( &globalAffineMutex );
                 A(4)=-tx;
                 A(5)=-ty;
             }
@@ -2244,6 +2242,70 @@ void ProgTomographAlignment::writeTransformations(
 
 /* Align images ------------------------------------------------------------ */
 //#define DEBUG
+void ProgTomographAlignment::correctImage(Image<double> &I, const Alignment &alignment,
+        int n, double z0, double scale) const
+{
+    MultidimArray<double> mask;
+    MultidimArray<int> iMask;
+    Matrix2D<double> M, M1, M2, M3;
+    mask.initZeros(I());
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(I())
+    if (I(i,j)!=0)
+        mask(i,j)=1;
+    translation2DMatrix(vectorR2(-z0*sin(DEG2RAD(tiltList[n]))*scale,0),M1);
+    rotation2DMatrix(90-alignment.rot+alignment.psi(n),M2);
+    translation2DMatrix(-(alignment.di[n]+alignment.diaxis[n])*scale,M3);
+    M=M1*M2*M3;
+    selfApplyGeometry(BSPLINE3,I(),M,IS_NOT_INV,DONT_WRAP);
+    selfApplyGeometry(LINEAR,mask,M,IS_NOT_INV,DONT_WRAP);
+    mask.binarize(0.5);
+    typeCast(mask,iMask);
+    double minval, maxval, avg, stddev;
+    computeStats_within_binary_mask(iMask,I(),minval, maxval, avg, stddev);
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(iMask)
+    if (iMask(i,j)==0)
+        I(i,j)=0;
+    else if (!dontNormalize)
+        I(i,j)-=avg;
+    I.setEulerAngles(0, tiltList[n], 0);
+}
+
+struct ThreadAlignImagesParams
+{
+    ProgTomographAlignment *parent;
+    const Alignment *alignment;
+    double z0;
+    int n0;
+    const std::vector<FileName> *fnOrig;
+    std::vector< Image<double> > *I, *Iorig;
+    ThreadTaskDistributor *td;
+};
+
+void threadAlignImages(ThreadArgument &thArg)
+{
+    ThreadAlignImagesParams *data=(ThreadAlignImagesParams *) thArg.workClass;
+    ProgTomographAlignment *parent=data->parent;
+    size_t first, last;
+    while (data->td->getTasks(first,last))
+        for (size_t k=first; k<=last; k++)
+        {
+            int n=data->n0+k;
+            // Align the normal image
+            Image<double> &I=(*(data->I))[k];
+            I.read(parent->name_list[n]);
+            parent->correctImage(I,*(data->alignment),n,data->z0,1.0);
+
+            // Align the original image
+            if (!data->fnOrig->empty())
+            {
+                Image<double> &Iorig=(*(data->Iorig))[k];
+                Iorig.read((*(data->fnOrig))[n]);
+                parent->correctImage(Iorig,*(data->alignment),n,data->z0,
+                                     ((double)XSIZE(Iorig()))/XSIZE(I()));
+            }
+        }
+}
+
 void ProgTomographAlignment::alignImages(const Alignment &alignment)
 {
     // Correct all landmarks
@@ -2282,95 +2344,60 @@ void ProgTomographAlignment::alignImages(const Alignment &alignment)
     z0/=z0N;
     std::cout << "Average height of the landmarks at 0 degrees=" << z0 << std::endl;
     MetaData DF;
+    DF.setComment("First shift by -(shiftX,shiftY), then rotate by psi");
 
-    MDIterator * iter = NULL;
-
+    std::vector<FileName> fnOrig;
     if (!fnSelOrig.empty())
     {
-        iter = new MDIterator(SForig);
+        FileName auxFn;
+        FOR_ALL_OBJECTS_IN_METADATA(SForig)
+        {
+            SForig.getValue(MDL_IMAGE, auxFn, __iter.objId);
+            fnOrig.push_back(auxFn);
+        }
+        if (fnOrig.size()<(size_t)Nimg)
+            REPORT_ERROR(ERR_VALUE_INCORRECT,"There are less original images than images");
     }
-    DF.setComment("First shift by -(shiftX,shiftY), then rotate by psi");
 
-    MultidimArray<double> mask;
-    MultidimArray<int> iMask;
-    Image<double> I;
-    Matrix2D<double> M, M1, M2, M3;
+    // The images are corrected in blocks of numThreads images, each thread
+    // writes in its own slot and the block is written in order
+    std::vector< Image<double> > Iblock(numThreads), Iorigblock(numThreads);
+    ThreadAlignImagesParams data;
+    data.parent=this;
+    data.alignment=&alignment;
+    data.z0=z0;
+    data.fnOrig=&fnOrig;
+    data.I=&Iblock;
+    data.Iorig=&Iorigblock;
+    ThreadManager thMgr(numThreads,&data);
     FileName fn_corrected;
-
-    for (int n=0;n<Nimg; n++)
+    for (int n0=0; n0<Nimg; n0+=numThreads)
     {
-        // Align the normal image
-        I.read(name_list[n]);
-        mask.initZeros(I());
-        FOR_ALL_ELEMENTS_IN_ARRAY2D(I())
-        if (I(i,j)!=0)
-            mask(i,j)=1;
-        translation2DMatrix(vectorR2(-z0*sin(DEG2RAD(tiltList[n])),0),M1);
-        rotation2DMatrix(90-alignment.rot+alignment.psi(n),M2);
-        translation2DMatrix(-(alignment.di[n]+alignment.diaxis[n]),M3);
-        M=M1*M2*M3;
-        selfApplyGeometry(BSPLINE3,I(),M,IS_NOT_INV,DONT_WRAP);
-        selfApplyGeometry(LINEAR,mask,M,IS_NOT_INV,DONT_WRAP);
-        mask.binarize(0.5);
-        typeCast(mask,iMask);
-        double minval, maxval, avg, stddev;
-        computeStats_within_binary_mask(iMask,I(),minval, maxval, avg, stddev);
-        FOR_ALL_ELEMENTS_IN_ARRAY2D(iMask)
-        if (iMask(i,j)==0)
-            I(i,j)=0;
-        else if (!dontNormalize)
-            I(i,j)-=avg;
-        double rot=0;
-        double tilt=tiltList[n];
-        double psi=0;
-        I.setEulerAngles(rot, tilt, psi);
-        fn_corrected.compose(n+1, fnRoot+"_corrected_", "stk");
-        I.write(fn_corrected);
-
-        // Align the original image
-        if (fnSelOrig!="")
+        int nF=XMIPP_MIN(n0+numThreads,Nimg);
+        ThreadTaskDistributor td(nF-n0,1);
+        data.n0=n0;
+        data.td=&td;
+        thMgr.run(threadAlignImages);
+
+        for (int n=n0; n<nF; n++)
         {
-            FileName auxFn;
-            SForig.getValue( MDL_IMAGE, auxFn, iter->objId);
-            Image<double> Iorig;
-            Iorig.read( auxFn );
-            //SForig.nextObject();
-            iter->moveNext();
-            mask.initZeros(Iorig());
-            FOR_ALL_ELEMENTS_IN_ARRAY2D(Iorig())
-            if (Iorig(i,j)!=0)
-                mask(i,j)=1;
-            translation2DMatrix(vectorR2(-z0*sin(DEG2RAD(tiltList[n]))*
-                                         (((double)XSIZE(Iorig()))/XSIZE(I())),0),M1);
-            rotation2DMatrix(90-alignment.rot+alignment.psi(n),M2);
-            translation2DMatrix(-(alignment.di[n]+alignment.diaxis[n])*
-                                (((double)XSIZE(Iorig()))/XSIZE(I())),M3);
-            M=M1*M2*M3;
-            selfApplyGeometry(BSPLINE3,Iorig(),M,IS_NOT_INV,DONT_WRAP);
-            selfApplyGeometry(LINEAR,mask,M,IS_NOT_INV,DONT_WRAP);
-            mask.binarize(0.5);
-            typeCast(mask,iMask);
-            computeStats_within_binary_mask(iMask,Iorig(),minval, maxval,
-                                            avg, stddev);
-            FOR_ALL_ELEMENTS_IN_ARRAY2D(iMask)
-            if (iMask(i,j)==0)
-                Iorig(i,j)=0;
-            else if (!dontNormalize)
-                Iorig(i,j)-=avg;
-            Iorig.setEulerAngles(rot, tilt, psi);
-            fn_corrected.compose(n+1, fnRoot+"_corrected_originalsize_", "stk");
-            Iorig.write(fn_corrected);
-        }
+            fn_corrected.compose(n+1, fnRoot+"_corrected_", "stk");
+            Iblock[n-n0].write(fn_corrected);
+            if (!fnOrig.empty())
+            {
+                fn_corrected.compose(n+1, fnRoot+"_corrected_originalsize_", "stk");
+                Iorigblock[n-n0].write(fn_corrected);
+            }
 
-        // Prepare data for the docfile
-        size_t id = DF.addObject();
-        DF.setValue(MDL_IMAGE, fn_corrected, id);
-        DF.setValue(MDL_ANGLE_PSI, 90.-alignment.rot+alignment.psi(n), id);
-        DF.setValue(MDL_SHIFT_X, XX(alignment.di[n]+alignment.diaxis[n]), id);
-        DF.setValue(MDL_SHIFT_Y, YY(alignment.di[n]+alignment.diaxis[n]), id);
+            // Prepare data for the docfile
+            size_t id = DF.addObject();
+            DF.setValue(MDL_IMAGE, fn_corrected, id);
+            DF.setValue(MDL_ANGLE_PSI, 90.-alignment.rot+alignment.psi(n), id);
+            DF.setValue(MDL_SHIFT_X, XX(alignment.di[n]+alignment.diaxis[n]), id);
+            DF.setValue(MDL_SHIFT_Y, YY(alignment.di[n]+alignment.diaxis[n]), id);
+        }
     }
     DF.write(fnRoot+"_correction_parameters.txt");
-    delete iter;
 #ifdef DEBUG
 
     Image<double> save;
@@ -2517,6 +2544,29 @@ double wrapperError(double *p, void *prm)
     return alignment.optimizeGivenAxisDirection();
 }
 
+struct ThreadSearchRotParams
+{
+    ProgTomographAlignment *parent;
+    std::vector<double> rotList;
+    std::vector<Alignment *> alignments;
+    std::vector<double> errors;
+    ThreadTaskDistributor *td;
+};
+
+void threadSearchRot(ThreadArgument &thArg)
+{
+    ThreadSearchRotParams *data=(ThreadSearchRotParams *) thArg.workClass;
+    size_t first, last;
+    while (data->td->getTasks(first,last))
+        for (size_t k=first; k<=last; k++)
+        {
+            Alignment *alignment=new Alignment(data->parent);
+            alignment->rot=data->rotList[k];
+            data->errors[k]=alignment->optimizeGivenAxisDirection();
+            data->alignments[k]=alignment;
+        }
+}
+
 #define DEBUG
 void ProgTomographAlignment::run()
 {
@@ -2526,15 +2576,25 @@ void ProgTomographAlignment::run()
     std::cerr << "produceInformationFromLandmarks" << std::endl;
     produceInformationFromLandmarks();
     std::cerr << "alignment" << std::endl;
-    Alignment *alignment=new Alignment(this);
 
-    // Exhaustive search for rot
-    double bestError=0, bestRot=-1;
+    // Exhaustive search for rot, each rot is optimized in a different task
+    ThreadSearchRotParams data;
+    data.parent=this;
     for (double rot=0; rot<=180-deltaRot; rot+=deltaRot)
+        data.rotList.push_back(rot);
+    size_t Nrot=data.rotList.size();
+    data.alignments.resize(Nrot);
+    data.errors.resize(Nrot);
+    ThreadTaskDistributor td(Nrot,1);
+    data.td=&td;
+    ThreadManager thMgr(numThreads,&data);
+    thMgr.run(threadSearchRot);
+
+    double bestError=0, bestRot=-1;
+    for (size_t k=0; k<Nrot; k++)
     {
-        alignment->clear();
-        alignment->rot=rot;
-        double error=alignment->optimizeGivenAxisDirection();
+        double rot=data.rotList[k];
+        double error=data.errors[k];
 #ifdef DEBUG
 
         std::cout << "rot= " << rot
@@ -2545,10 +2605,10 @@ void ProgTomographAlignment::run()
         {
             bestRot=rot;
             bestError=error;
-            *bestPreviousAlignment=*alignment;
+            *bestPreviousAlignment=*(data.alignments[k]);
         }
+        delete data.alignments[k];
     }
-    delete alignment;
     std::cout << "Best rot=" << bestRot
     << " Best error=" << bestError << std::endl;
 
@@ -221,6 +221,13 @@ public:
     /// Remove Outliers
     void removeOutlierLandmarks(const Alignment &alignment);
 
+    /** Apply the alignment to image n.
+        The shifts of the alignment are multiplied by scale, so that the
+        alignment of the images in memory can be applied to the original images.
+        The image is masked and normalized as in alignImages. */
+    void correctImage(Image<double> &I, const Alignment &alignment, int n,
+                      double z0, double scale) const;
+
     /// Align images
     void alignImages(const Alignment &alignment);
 
@@ -27,8 +27,151 @@
 #include "volume_from_pdb.h"
 
 #include <data/args.h>
+#include <data/xmipp_threads.h>
 
 #include <fstream>
+#include <stdlib.h>
+#include <string.h>
+
+/* Atom splatting ---------------------------------------------------------- */
+// Samples per voxel of the radial profiles
+#define PROFILE_SAMPLING 100
+
+// Radial profile of an atom, as a function of the distance in voxels
+class RadialProfile
+{
+public:
+    // The atom updates the voxels within this distance in each direction
+    double support;
+
+    // Squared distance beyond which the atom does not contribute
+    double cutoff2;
+
+    // Profile sampled every 1/PROFILE_SAMPLING voxels
+    std::vector<double> values;
+
+    // Profile at a squared distance (linear interpolation)
+    inline double at(double r2) const
+    {
+        double r=sqrt(r2)*PROFILE_SAMPLING;
+        size_t i=(size_t)r;
+        if (i+1>=values.size())
+            return 0;
+        double a=r-i;
+        return values[i]+a*(values[i+1]-values[i]);
+    }
+};
+
+// Position (in voxels) and weight of an atom to splat
+struct AtomSplat
+{
+    double x, y, z, weight;
+    int profile;
+};
+
+static void splatAtom(const AtomSplat &a, const RadialProfile &p, MultidimArray<double> &V)
+{
+    int k0 = XMIPP_MAX(FLOOR(a.z - p.support), STARTINGZ(V));
+    int kF = XMIPP_MIN(CEIL(a.z + p.support), FINISHINGZ(V));
+    int i0 = XMIPP_MAX(FLOOR(a.y - p.support), STARTINGY(V));
+    int iF = XMIPP_MIN(CEIL(a.y + p.support), FINISHINGY(V));
+    int j0 = XMIPP_MAX(FLOOR(a.x - p.support), STARTINGX(V));
+    int jF = XMIPP_MIN(CEIL(a.x + p.support), FINISHINGX(V));
+    for (int k = k0; k <= kF; k++)
+    {
+        double zdiff=a.z - k;
+        double zdiff2=zdiff*zdiff;
+        for (int i = i0; i <= iF; i++)
+        {
+            double ydiff=a.y - i;
+            double zydiff2=zdiff2+ydiff*ydiff;
+            for (int j = j0; j <= jF; j++)
+            {
+                double xdiff=a.x - j;
+                double r2=zydiff2+xdiff*xdiff;
+                if (r2<p.cutoff2)
+                    A3D_ELEM(V, k, i, j) += a.weight*p.at(r2);
+            }
+        }
+    }
+}
+
+struct SplatThreadData
+{
+    const std::vector<AtomSplat> *splats;
+    const std::vector<RadialProfile> *profiles;
+    const std::vector< std::vector<size_t> > *slabs;
+    std::vector<int> slabsToProcess;
+    MultidimArray<double> *V;
+    ThreadTaskDistributor *td;
+};
+
+static void splatSlab(SplatThreadData &data, int slab)
+{
+    const std::vector<size_t> &slabAtoms=(*data.slabs)[slab];
+    for (size_t n=0; n<slabAtoms.size(); n++)
+    {
+        const AtomSplat &a=(*data.splats)[slabAtoms[n]];
+        splatAtom(a,(*data.profiles)[a.profile],*data.V);
+    }
+}
+
+static void threadSplatSlabs(ThreadArgument &thArg)
+{
+    SplatThreadData &data=*((SplatThreadData *)thArg.workClass);
+    size_t first, last;
+    while (data.td->getTasks(first, last))
+        for (size_t s=first; s<=last; s++)
+            splatSlab(data,data.slabsToProcess[s]);
+}
+
+/* Add all atoms to V.
+   The atoms are binned in slabs along Z, thicker than the region updated by
+   any atom. The even slabs are processed in parallel, and then the odd ones,
+   so that two threads never update the same voxel. The atoms of each slab are
+   added in the order of the file, and the result does not depend on the
+   number of threads. */
+static void splatAtoms(const std::vector<AtomSplat> &splats, const std::vector<RadialProfile> &profiles,
+                       MultidimArray<double> &V, int numThreads)
+{
+    double maxSupport=0;
+    for (size_t n=0; n<profiles.size(); n++)
+        maxSupport=XMIPP_MAX(maxSupport,profiles[n].support);
+    int thickness=CEIL(2*maxSupport)+3;
+    int Nslabs=XMIPP_MAX(1,(int)(ZSIZE(V)+thickness-1)/thickness);
+
+    std::vector< std::vector<size_t> > slabs(Nslabs);
+    for (size_t n=0; n<splats.size(); n++)
+    {
+        int slab=FLOOR((splats[n].z-STARTINGZ(V))/thickness);
+        slabs[XMIPP_MIN(XMIPP_MAX(slab,0),Nslabs-1)].push_back(n);
+    }
+
+    SplatThreadData data;
+    data.splats=&splats;
+    data.profiles=&profiles;
+    data.slabs=&slabs;
+    data.V=&V;
+    for (int parity=0; parity<2; parity++)
+    {
+        data.slabsToProcess.clear();
+        for (int slab=parity; slab<Nslabs; slab+=2)
+            if (!slabs[slab].empty())
+                data.slabsToProcess.push_back(slab);
+        if (data.slabsToProcess.empty())
+            continue;
+        if (numThreads<=1)
+            for (size_t s=0; s<data.slabsToProcess.size(); s++)
+                splatSlab(data,data.slabsToProcess[s]);
+        else
+        {
+            ThreadTaskDistributor td(data.slabsToProcess.size(),1);
+            data.td=&td;
+            ThreadManager thMgr(numThreads,&data);
+            thMgr.run(threadSplatSlabs);
+        }
+    }
+}
 
 /* Empty constructor ------------------------------------------------------- */
 ProgPdbConverter::ProgPdbConverter()
@@ -44,6 +187,7 @@ ProgPdbConverter::ProgPdbConverter()
     usePoorGaussian=false;
     useFixedGaussian=false;
     doCenter=false;
+    numThreads=1;
 
     // Periodic table for the blobs
     periodicTable.resize(7, 2);
@@ -110,6 +254,8 @@ void ProgPdbConverter::produceSideInfo()
         // Atom profiles for the electron scattering method
         atomProfiles.setup(M,highTs,false);
     }
+
+    atoms.read(fn_pdb);
 }
 
 /* Atom description ------------------------------------------------------- */
@@ -170,6 +316,7 @@ void ProgPdbConverter::defineParams()
     addParamsLine("                                     :  If not given, the standard deviation is taken from the PDB file");
     addParamsLine("  [--intensityColumn <intensity_type=occupancy>]   : Where to write the intensity in the PDB file");
     addParamsLine("     where <intensity_type> occupancy Bfactor     : Valid values: occupancy, Bfactor");
+    addParamsLine("  [--thr <N=1>]                      : Number of threads");
 }
 /* Read parameters --------------------------------------------------------- */
 void ProgPdbConverter::readParams()
@@ -186,6 +333,7 @@ void ProgPdbConverter::readParams()
         sigmaGaussian = getDoubleParam("--fixed_Gaussian");
     doCenter = checkParam("--centerPDB");
     intensityColumn = getParam("--intensityColumn");
+    numThreads = getIntParam("--thr");
 }
 
 /* Show -------------------------------------------------------------------- */
@@ -201,6 +349,7 @@ void ProgPdbConverter::show()
     << "Use blobs:          " << useBlobs         << std::endl
     << "Use poor Gaussian:  " << usePoorGaussian  << std::endl
     << "Use fixed Gaussian: " << useFixedGaussian << std::endl
+    << "Threads:            " << numThreads       << std::endl
     ;
     if (useFixedGaussian)
         std::cout << "Intensity Col:      " << intensityColumn  << std::endl
@@ -211,7 +360,7 @@ void ProgPdbConverter::show()
 void ProgPdbConverter::computeProteinGeometry()
 {
     Matrix1D<double> limit0(3), limitF(3);
-    computePDBgeometry(fn_pdb, centerOfMass, limit0, limitF, intensityColumn);
+    computePDBgeometry(atoms, centerOfMass, limit0, limitF, intensityColumn);
     if (doCenter)
     {
         limit0-=centerOfMass;
@@ -249,94 +398,89 @@ void ProgPdbConverter::createProteinAtHighSamplingRate()
     	std::cout << "The highly sampled volume is of size " << XSIZE(Vhigh())
     	<< std::endl;
 
-    // Fill the volume with the different atoms
-    std::ifstream fh_pdb;
-    fh_pdb.open(fn_pdb.c_str());
-    if (!fh_pdb)
-        REPORT_ERROR(ERR_IO_NOTEXIST, fn_pdb);
-
-    // Process all lines of the file
-    int col=1;
-    if (intensityColumn=="Bfactor")
-        col=2;
-    while (!fh_pdb.eof())
+    // Radial profiles. For the fixed Gaussian there is a single profile and the
+    // weight is taken from the PDB, otherwise there is one profile per element.
+    // The region of each atom extends radius voxels around it, while the
+    // profile is evaluated at the distance in Angstroms
+    std::vector<RadialProfile> profiles;
+    std::vector<double> profileWeight;
+    int profileOf[256];
+    for (int c=0; c<256; c++)
+        profileOf[c]=-1;
+    const std::vector<double> &weightColumn=(intensityColumn=="Bfactor") ? atoms.bfactor : atoms.occupancy;
+    struct blobtype atomBlob=blob;
+
+    std::vector<AtomSplat> splats;
+    splats.reserve(atoms.size());
+    AtomSplat a;
+    for (size_t n=0; n<atoms.size(); n++)
     {
-        // Read an ATOM line
-        std::string line;
-        getline(fh_pdb, line);
-        if (line == "")
-            continue;
-        std::string kind = line.substr(0,4);
-        if (kind != "ATOM" && kind !="HETA")
+        // Characterize atom
+        int key=useFixedGaussian ? 0 : (unsigned char)atoms.type0[n];
+        if (profileOf[key]==-1)
+        {
+            double weight, radius;
+            if (!useFixedGaussian)
+            {
+                char atomType[3]={atoms.type0[n],atoms.type1[n],'\0'};
+                atomBlobDescription(atomType, weight, radius);
+            }
+            else
+            {
+                radius=4.5*sigmaGaussian;
+                weight=1;
+            }
+            atomBlob.radius = radius;
+            if (usePoorGaussian)
+                radius=XMIPP_MAX(radius/Ts,4.5);
+            double GaussianSigma2=(radius/(3*sqrt(2.0)));
+            if (useFixedGaussian)
+                GaussianSigma2=sigmaGaussian;
+            GaussianSigma2*=GaussianSigma2;
+            double GaussianNormalization = 1.0/pow(2*PI*GaussianSigma2,1.5);
+
+            RadialProfile profile;
+            profile.support=radius;
+            double maxDistance=(radius+1)*sqrt(3.0);
+            profile.cutoff2=maxDistance*maxDistance;
+            profile.values.resize(CEIL(maxDistance*PROFILE_SAMPLING)+2);
+            for (size_t i=0; i<profile.values.size(); i++)
+            {
+                double rdiff=i*highTs/PROFILE_SAMPLING;
+                if (useBlobs)
+                    profile.values[i]=blob_val(rdiff, atomBlob);
+                else if (usePoorGaussian || useFixedGaussian)
+                    profile.values[i]=exp(-rdiff*rdiff/(2*GaussianSigma2))*GaussianNormalization;
+                else
+                    profile.values[i]=0;
+            }
+            profileOf[key]=profiles.size();
+            profiles.push_back(profile);
+            profileWeight.push_back(weight);
+        }
+        a.profile=profileOf[key];
+        a.weight=useFixedGaussian ? weightColumn[n] : profileWeight[a.profile];
+        if (a.weight==0)
             continue;
 
-        // Extract atom type and position
-        // Typical line:
-        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
-        std::string atom_type = line.substr(13,2);
-        double x = textToFloat(line.substr(30,8));
-        double y = textToFloat(line.substr(38,8));
-        double z = textToFloat(line.substr(46,8));
-
         // Correct position
-        Matrix1D<double> r(3);
-        VECTOR_R3(r, x, y, z);
+        a.x=atoms.x[n];
+        a.y=atoms.y[n];
+        a.z=atoms.z[n];
         if (doCenter)
-            r -= centerOfMass;
-        r /= highTs;
-
-        // Characterize atom
-        double weight, radius;
-        if (!useFixedGaussian)
-        {
-            if (atom_type=="HETA")
-                continue;
-            atomBlobDescription(atom_type, weight, radius);
-        }
-        else
         {
-            radius=4.5*sigmaGaussian;
-            if (col==1)
-                weight=textToFloat(line.substr(54,6));
-            else
-                weight=textToFloat(line.substr(60,6));
+            a.x-=XX(centerOfMass);
+            a.y-=YY(centerOfMass);
+            a.z-=ZZ(centerOfMass);
         }
-        blob.radius = radius;
-        if (usePoorGaussian)
-            radius=XMIPP_MAX(radius/Ts,4.5);
-        double GaussianSigma2=(radius/(3*sqrt(2.0)));
-        if (useFixedGaussian)
-            GaussianSigma2=sigmaGaussian;
-        GaussianSigma2*=GaussianSigma2;
-        double GaussianNormalization = 1.0/pow(2*PI*GaussianSigma2,1.5);
-
-        // Find the part of the volume that must be updated
-        int k0 = XMIPP_MAX(FLOOR(ZZ(r) - radius), STARTINGZ(Vhigh()));
-        int kF = XMIPP_MIN(CEIL(ZZ(r) + radius), FINISHINGZ(Vhigh()));
-        int i0 = XMIPP_MAX(FLOOR(YY(r) - radius), STARTINGY(Vhigh()));
-        int iF = XMIPP_MIN(CEIL(YY(r) + radius), FINISHINGY(Vhigh()));
-        int j0 = XMIPP_MAX(FLOOR(XX(r) - radius), STARTINGX(Vhigh()));
-        int jF = XMIPP_MIN(CEIL(XX(r) + radius), FINISHINGX(Vhigh()));
-
-        // Fill the volume with this atom
-        Matrix1D<double> rdiff(3);
-        for (int k = k0; k <= kF; k++)
-            for (int i = i0; i <= iF; i++)
-                for (int j = j0; j <= jF; j++)
-                {
-                    VECTOR_R3(rdiff, XX(r) - j, YY(r) - i, ZZ(r) - k);
-                    rdiff*=highTs;
-                    if (useBlobs)
-                        Vhigh(k, i, j) += weight * blob_val(rdiff.module(), blob);
-                    else if (usePoorGaussian || useFixedGaussian)
-                        Vhigh(k, i, j) += weight *
-                                          exp(-rdiff.module()*rdiff.module()/(2*GaussianSigma2))*
-                                          GaussianNormalization;
-                }
+        a.x/=highTs;
+        a.y/=highTs;
+        a.z/=highTs;
+        splats.push_back(a);
     }
 
-    // Close file
-    fh_pdb.close();
+    // Fill the volume with the different atoms
+    splatAtoms(splats,profiles,Vhigh(),numThreads);
 }
 
 /* Create protein at a low sampling rate ----------------------------------- */
@@ -389,88 +533,70 @@ void ProgPdbConverter::createProteinUsingScatteringProfiles()
     Vlow().initZeros(output_dim,output_dim,output_dim);
     Vlow().setXmippOrigin();
 
-    // Fill the volume with the different atoms
-    std::ifstream fh_pdb;
-    fh_pdb.open(fn_pdb.c_str());
-    if (!fh_pdb)
-        REPORT_ERROR(ERR_IO_NOTEXIST, fn_pdb);
+    // Radial profiles of the elements, sampled from the B-spline coefficients
+    std::vector<RadialProfile> profiles;
+    int profileOf[256];
+    for (int c=0; c<256; c++)
+        profileOf[c]=-1;
 
-    // Process all lines of the file
-    std::string line, kind, atom_type;
+    std::vector<AtomSplat> splats;
+    splats.reserve(atoms.size());
     double iTs=1.0/Ts;
-    Matrix1D<double> r(3), rdiff(3);
-    while (!fh_pdb.eof())
+    AtomSplat a;
+    a.weight=1;
+    for (size_t n=0; n<atoms.size(); n++)
     {
-        // Read an ATOM line
-        getline(fh_pdb, line);
-        if (line == "")
+        if (atoms.hetero[n])
             continue;
-        kind =line.substr(0,4);
-        if (kind != "ATOM")
-            continue;
-
-        // Extract atom type and position
-        // Typical line:
-        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
-        atom_type = line.substr(13,2);
-        char atom_type0=atom_type[0];
-        double x = textToFloat(line.substr(30,8));
-        double y = textToFloat(line.substr(38,8));
-        double z = textToFloat(line.substr(46,8));
-
-        // Correct position
-        VECTOR_R3(r, x, y, z);
-        if (doCenter)
-            r -= centerOfMass;
-        r *= iTs;
 
         // Characterize atom
-        try
+        char atomType0=atoms.type0[n];
+        int key=(unsigned char)atomType0;
+        if (profileOf[key]==-1)
         {
-            double radius=atomProfiles.atomRadius(atom_type[0]);
-            double radius2=radius*radius;
-
-            // Find the part of the volume that must be updated
-            const MultidimArray<double> &mVlow=Vlow();
-            int k0 = XMIPP_MAX(FLOOR(ZZ(r) - radius), STARTINGZ(mVlow));
-            int kF = XMIPP_MIN(CEIL(ZZ(r) + radius), FINISHINGZ(mVlow));
-            int i0 = XMIPP_MAX(FLOOR(YY(r) - radius), STARTINGY(mVlow));
-            int iF = XMIPP_MIN(CEIL(YY(r) + radius), FINISHINGY(mVlow));
-            int j0 = XMIPP_MAX(FLOOR(XX(r) - radius), STARTINGX(mVlow));
-            int jF = XMIPP_MIN(CEIL(XX(r) + radius), FINISHINGX(mVlow));
-
-            // Fill the volume with this atom
-            for (int k = k0; k <= kF; k++)
+            try
             {
-                double zdiff=ZZ(r) - k;
-                double zdiff2=zdiff*zdiff;
-                for (int i = i0; i <= iF; i++)
-                {
-                    double ydiff=YY(r) - i;
-                    double zydiff2=zdiff2+ydiff*ydiff;
-                    for (int j = j0; j <= jF; j++)
-                    {
-                        double xdiff=XX(r) - j;
-                        double rdiffModule2=zydiff2+xdiff*xdiff;
-                        if (rdiffModule2<radius2)
-                        {
-                            double rdiffModule=sqrt(rdiffModule2);
-                            A3D_ELEM(mVlow,k, i, j) += atomProfiles.volumeAtDistance(
-                                                 atom_type0,rdiffModule);
-                        }
-                    }
-                }
+                RadialProfile profile;
+                profile.support=atomProfiles.atomRadius(atomType0);
+                profile.cutoff2=profile.support*profile.support;
+                profile.values.resize(CEIL(profile.support*PROFILE_SAMPLING)+2);
+                for (size_t i=0; i<profile.values.size(); i++)
+                    profile.values[i]=atomProfiles.volumeAtDistance(atomType0,
+                                      (double)i/PROFILE_SAMPLING);
+                profileOf[key]=profiles.size();
+                profiles.push_back(profile);
+            }
+            catch (XmippError XE)
+            {
+                profileOf[key]=-2;
             }
         }
-        catch (XmippError XE)
+        if (profileOf[key]==-2)
         {
-        	if (verbose)
-        		std::cerr << "Ignoring atom of type *" << atom_type << "*" << std::endl;
+            if (verbose)
+                std::cerr << "Ignoring atom of type *" << atomType0 << atoms.type1[n] << "*" << std::endl;
+            continue;
         }
+        a.profile=profileOf[key];
+
+        // Correct position
+        a.x=atoms.x[n];
+        a.y=atoms.y[n];
+        a.z=atoms.z[n];
+        if (doCenter)
+        {
+            a.x-=XX(centerOfMass);
+            a.y-=YY(centerOfMass);
+            a.z-=ZZ(centerOfMass);
+        }
+        a.x*=iTs;
+        a.y*=iTs;
+        a.z*=iTs;
+        splats.push_back(a);
     }
 
-    // Close file
-    fh_pdb.close();
+    // Fill the volume with the different atoms
+    splatAtoms(splats,profiles,Vlow(),numThreads);
 }
 
 /* Run --------------------------------------------------------------------- */
@@ -499,3 +625,4 @@ void ProgPdbConverter::run()
     if (fn_out!="")
         Vlow.write(fn_out + ".vol");
 }
+#undef PROFILE_SAMPLING
@@ -69,6 +69,9 @@ public:
 
     /// Column for the intensity (if any). Only valid for fixed_gaussians
     std::string intensityColumn;
+
+    /** Number of threads */
+    int numThreads;
 public:
     /** Empty constructor */
     ProgPdbConverter();
@@ -104,6 +107,9 @@ public:
     /* Atom interpolator. */
     AtomInterpolator atomProfiles;
 
+    /* Atoms of the PDB file */
+    PDBAtomTable atoms;
+
     // Protein geometry
     Matrix1D<double> centerOfMass, limit;
 
@@ -40,6 +40,10 @@ void ProgVolumePCA::readParams()
     	getListParam("--generatePCAVolumes",listOfPercentiles);
     if (checkParam("--mask"))
     	mask.readParams(this);
+    streaming = checkParam("--streaming");
+    if (streaming)
+    	streamingMemory = getDoubleParam("--streaming");
+    Nthreads = getIntParam("--thr");
 }
 
 // Show ====================================================================
@@ -53,6 +57,9 @@ void ProgVolumePCA::show() const
     		  << "Basis:          " << fnBasis    << std::endl
     		  << "Avg. volume:    " << fnAvgVol   << std::endl
     		  << "Output PCA vols:" << fnOutStack << std::endl;
+    if (streaming)
+    	std::cout << "Streaming:      " << streamingMemory << " Mb per chunk" << std::endl
+    	          << "Threads:        " << Nthreads   << std::endl;
     std::cout << "Percentiles:    ";
     for (size_t i=0; i<listOfPercentiles.size(); i++)
     	std::cout << listOfPercentiles[i] << " ";
@@ -72,6 +79,9 @@ void ProgVolumePCA::defineParams()
     addParamsLine("  [--generatePCAVolumes <...>]: List of percentiles (typically, \"10 90\"), to generate volumes along the 1st PCA basis");
     addParamsLine("  [--avgVolume <volume=\"\">] : Volume on which to add the PCA basis");
     addParamsLine("  [--opca <stack=\"\">]     : Stack of generated volumes");
+    addParamsLine("  [--streaming <memory=256>]: Do not load all volumes in memory, read them in chunks of this size (in Mb).");
+    addParamsLine("                            : The basis is computed with a randomized PCA that makes a few passes over the volumes");
+    addParamsLine("  [--thr <N=1>]             : Number of threads (only with --streaming)");
     mask.defineParams(this,INT_MASK);
 }
 
@@ -90,6 +100,15 @@ void ProgVolumePCA::produce_side_info()
 		mask.imask.resizeNoCopy(Zdim,Ydim,Xdim);
 		mask.imask.initConstant(1);
 	}
+
+	if (streaming)
+	{
+		// Each volume of the chunk keeps the voxels within the mask
+		double bytesPerVolume=XMIPP_MAX(mask.imask.sum(),1)*sizeof(double);
+		chunkSize=(size_t)XMIPP_MAX(streamingMemory*1024*1024/bytesPerVolume,1.0);
+		if (verbose)
+			std::cout << "Streaming:      " << chunkSize << " volumes per chunk" << std::endl;
+	}
 }
 
 void ProgVolumePCA::run()
@@ -98,36 +117,52 @@ void ProgVolumePCA::run()
     produce_side_info();
 
     const MultidimArray<int> &imask=mask.imask;
-    size_t Nvoxels=imask.sum();
-    MultidimArray<float> v;
-    v.initZeros(Nvoxels);
-
-    // Add all volumes to the analyzer
-    FileName fnVol;
-    FOR_ALL_OBJECTS_IN_METADATA(mdVols)
+    Matrix2D<double> proj;
+    std::vector< MultidimArray<double> > *PCAbasis;
+    if (streaming)
     {
-    	mdVols.getValue(MDL_IMAGE,fnVol,__iter.objId);
-    	V.read(fnVol);
-
-    	// Construct vector
-    	const MultidimArray<double> &mV=V();
-    	size_t idx=0;
-    	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mV)
-    	{
-    		if (DIRECT_MULTIDIM_ELEM(imask,n))
-    			DIRECT_MULTIDIM_ELEM(v,idx++)=DIRECT_MULTIDIM_ELEM(mV,n);
-    	}
-
-    	analyzer.addVector(v);
+    	// The volumes are read a chunk at a time
+    	streamingAnalyzer.chunkSize=chunkSize;
+    	streamingAnalyzer.Nthreads=Nthreads;
+    	streamingAnalyzer.learnPCABasis(mdVols,imask,NPCA,2);
+    	streamingAnalyzer.projectOnPCABasis(mdVols,imask,proj);
+    	PCAbasis=&streamingAnalyzer.PCAbasis;
+    	V().resizeNoCopy(imask);
     }
-
-    // Construct PCA basis
-    analyzer.subtractAvg();
-    analyzer.learnPCABasis(NPCA,100);
-
-    // Project onto the PCA basis
-    Matrix2D<double> proj;
-    analyzer.projectOnPCABasis(proj);
+    else
+    {
+        size_t Nvoxels=imask.sum();
+        MultidimArray<float> v;
+        v.initZeros(Nvoxels);
+
+        // Add all volumes to the analyzer
+        FileName fnVol;
+        FOR_ALL_OBJECTS_IN_METADATA(mdVols)
+        {
+        	mdVols.getValue(MDL_IMAGE,fnVol,__iter.objId);
+        	V.read(fnVol);
+
+        	// Construct vector
+        	const MultidimArray<double> &mV=V();
+        	size_t idx=0;
+        	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mV)
+        	{
+        		if (DIRECT_MULTIDIM_ELEM(imask,n))
+        			DIRECT_MULTIDIM_ELEM(v,idx++)=DIRECT_MULTIDIM_ELEM(mV,n);
+        	}
+
+        	analyzer.addVector(v);
+        }
+
+        // Construct PCA basis
+        analyzer.subtractAvg();
+        analyzer.learnPCABasis(NPCA,100);
+
+        // Project onto the PCA basis
+        analyzer.projectOnPCABasis(proj);
+        PCAbasis=&analyzer.PCAbasis;
+    }
+    NPCA=(int)PCAbasis->size();
     std::vector<double> dimredProj;
     dimredProj.resize(NPCA);
     int i=0;
@@ -148,7 +183,7 @@ void ProgVolumePCA::run()
 	{
 	    V().initZeros();
     	size_t idx=0;
-    	const MultidimArray<double> &mPCA=analyzer.PCAbasis[i];
+    	const MultidimArray<double> &mPCA=(*PCAbasis)[i];
     	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mV)
     	{
     		if (DIRECT_MULTIDIM_ELEM(imask,n))
@@ -54,6 +54,14 @@ public:
     FileName fnAvgVol;
     /// Output PCA stack
     FileName fnOutStack;
+    /// Do not load all volumes in memory
+    bool streaming;
+    /// Memory (in Mb) for the volumes read at once in streaming mode
+    double streamingMemory;
+    /// Number of volumes read at once in streaming mode (computed from streamingMemory)
+    size_t chunkSize;
+    /// Number of threads in streaming mode
+    int Nthreads;
 public:
     // Metadata with volumes
     MetaData mdVols;
@@ -63,6 +71,9 @@ public:
 
     // PCA analyzer
     PCAMahalanobisAnalyzer analyzer;
+
+    // PCA analyzer in streaming mode
+    StreamingPCA streamingAnalyzer;
 public:
     /// Read arguments
     void readParams();
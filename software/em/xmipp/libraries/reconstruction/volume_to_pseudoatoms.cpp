@@ -47,6 +47,51 @@ std::ostream& operator << (std::ostream &o, const PseudoAtom &a)
     return o;
 }
 
+/* Cells of pseudo atoms --------------------------------------------------- */
+void PseudoAtomCells::build(const std::vector<PseudoAtom> &atoms,
+                            const MultidimArray<double> &V, double _cellSize)
+{
+    cellSize=_cellSize;
+    k0=STARTINGZ(V);
+    i0=STARTINGY(V);
+    j0=STARTINGX(V);
+    Zcells=XMIPP_MAX(1,CEIL(ZSIZE(V)/cellSize));
+    Ycells=XMIPP_MAX(1,CEIL(YSIZE(V)/cellSize));
+    Xcells=XMIPP_MAX(1,CEIL(XSIZE(V)/cellSize));
+
+    atomsInCell.clear();
+    atomsInCell.resize(Zcells*Ycells*Xcells);
+    int nmax=atoms.size();
+    int kc, ic, jc;
+    for (int n=0; n<nmax; n++)
+    {
+        cellOf(atoms[n].location,kc,ic,jc);
+        atomsInCell[cellIndex(kc,ic,jc)].push_back(n);
+    }
+
+    for (int color=0; color<8; color++)
+        cellsOfColor[color].clear();
+    for (kc=0; kc<Zcells; kc++)
+        for (ic=0; ic<Ycells; ic++)
+            for (jc=0; jc<Xcells; jc++)
+            {
+                int idx=cellIndex(kc,ic,jc);
+                if (!atomsInCell[idx].empty())
+                    cellsOfColor[4*(kc%2)+2*(ic%2)+jc%2].push_back(idx);
+            }
+}
+
+void PseudoAtomCells::cellOf(const Matrix1D<double> &location,
+                             int &kc, int &ic, int &jc) const
+{
+    kc=FLOOR((VEC_ELEM(location,0)-k0)/cellSize);
+    ic=FLOOR((VEC_ELEM(location,1)-i0)/cellSize);
+    jc=FLOOR((VEC_ELEM(location,2)-j0)/cellSize);
+    kc=XMIPP_MIN(XMIPP_MAX(kc,0),Zcells-1);
+    ic=XMIPP_MIN(XMIPP_MAX(ic,0),Ycells-1);
+    jc=XMIPP_MIN(XMIPP_MAX(jc,0),Xcells-1);
+}
+
 /* I/O --------------------------------------------------------------------- */
 void ProgVolumeToPseudoatoms::readParams()
 {
@@ -225,6 +270,7 @@ void ProgVolumeToPseudoatoms::produceSideInfo()
 
     // Create threads
     barrier_init(&barrier,numThreads+1);
+    barrier_init(&colorBarrier,numThreads);
     threadIds=(pthread_t *)malloc(numThreads*sizeof(pthread_t));
     threadArgs=(Prog_Convert_Vol2Pseudo_ThreadParams *)
                malloc(numThreads*sizeof(Prog_Convert_Vol2Pseudo_ThreadParams));
@@ -491,42 +537,42 @@ void ProgVolumeToPseudoatoms::removeTooCloseSeeds()
     // Remove atoms that are too close to each other
     if (minDistance>0 && allowIntensity)
     {
-        std::vector<int> toRemove;
         int nmax=atoms.size();
+        if (nmax==0)
+            return;
+
+        // Only the atoms in the neighbour cells can be too close. The cells hold
+        // about one atom each, and are never smaller than minDistance
+        PseudoAtomCells closeCells;
+        double cellSize=XMIPP_MAX(minDistance,pow(MULTIDIM_SIZE(Vin())/(double)nmax,1.0/3.0));
+        closeCells.build(atoms,Vin(),cellSize);
+
+        // The atoms are visited in the same order as in an exhaustive search,
+        // so that the same atoms are removed
+        std::vector<bool> removed(nmax,false);
+        std::vector<int> candidates;
         double minDistance2=minDistance*minDistance;
         for (int n1=0; n1<nmax; n1++)
         {
-            bool found=false;
-            int nn=0, nnmax=toRemove.size();
-            while (nn<nnmax)
-            {
-                if (toRemove[nn]==n1)
-                {
-                    found=true;
-                    break;
-                }
-                else if (toRemove[nn]>n1)
-                    break;
-                nn++;
-            }
-            if (found)
+            if (removed[n1])
                 continue;
-            for (int n2=n1+1; n2<nmax; n2++)
-            {
-                nn=0;
-                found=false;
-                while (nn<nnmax)
-                {
-                    if (toRemove[nn]==n2)
+            int kc, ic, jc;
+            closeCells.cellOf(atoms[n1].location,kc,ic,jc);
+            candidates.clear();
+            for (int kk=XMIPP_MAX(kc-1,0); kk<=XMIPP_MIN(kc+1,closeCells.Zcells-1); kk++)
+                for (int ii=XMIPP_MAX(ic-1,0); ii<=XMIPP_MIN(ic+1,closeCells.Ycells-1); ii++)
+                    for (int jj=XMIPP_MAX(jc-1,0); jj<=XMIPP_MIN(jc+1,closeCells.Xcells-1); jj++)
                     {
-                        found=true;
-                        break;
+                        const std::vector<int> &cellAtoms=closeCells.atomsInCell[closeCells.cellIndex(kk,ii,jj)];
+                        for (size_t m=0; m<cellAtoms.size(); m++)
+                            if (cellAtoms[m]>n1)
+                                candidates.push_back(cellAtoms[m]);
                     }
-                    else if (toRemove[nn]>n2)
-                        break;
-                    nn++;
-                }
-                if (found)
+            std::sort(candidates.begin(),candidates.end());
+            for (size_t m=0; m<candidates.size(); m++)
+            {
+                int n2=candidates[m];
+                if (removed[n2])
                     continue;
                 double diffZ=atoms[n1].location(0)-atoms[n2].location(0);
                 double diffY=atoms[n1].location(1)-atoms[n2].location(1);
@@ -536,28 +582,34 @@ void ProgVolumeToPseudoatoms::removeTooCloseSeeds()
                 {
                     if (atoms[n1].intensity<atoms[n2].intensity)
                     {
-                        toRemove.push_back(n1);
+                        removed[n1]=true;
                         break;
                     }
                     else
-                        toRemove.push_back(n2);
-                    std::sort(toRemove.begin(),toRemove.end());
+                        removed[n2]=true;
                 }
             }
         }
-        for (int n=toRemove.size()-1; n>=0; n--)
-            atoms.erase(atoms.begin()+toRemove[n]);
+        for (int n=nmax-1; n>=0; n--)
+            if (removed[n])
+                atoms.erase(atoms.begin()+n);
     }
 }
 
 /* Draw approximation ------------------------------------------------------ */
+// Size of the cells processed in parallel. The regions of the atoms extend
+// sigma3+1.5 voxels around them, and the atoms may move by half a voxel
+// while the cells are processed.
+#define THREAD_CELL_SIZE (2*(sigma3+1.5)+2)
+
 void ProgVolumeToPseudoatoms::drawApproximation()
 {
+    // The Gaussians are drawn by the threads, cell by cell
     Vcurrent().initZeros(Vin());
-    int nmax=atoms.size();
-    for (int n=0; n<nmax; n++)
-        drawGaussian(atoms[n].location(0),atoms[n].location(1),
-                     atoms[n].location(2),Vcurrent(),atoms[n].intensity);
+    cells.build(atoms,Vin(),THREAD_CELL_SIZE);
+    threadOpCode=DRAWTHREAD;
+    barrier_wait(&barrier);
+    barrier_wait(&barrier);
 
     energyDiff=0;
     double N=0;
@@ -707,9 +759,101 @@ void ProgVolumeToPseudoatoms::insertRegion(const MultidimArray<double> &region)
 }
 
 /* Optimize ---------------------------------------------------------------- */
-static pthread_mutex_t mutexUpdateVolume=PTHREAD_MUTEX_INITIALIZER;
-
 //#define DEBUG
+void ProgVolumeToPseudoatoms::optimizeAtom(int n, MultidimArray<double> &region,
+        MultidimArray<double> &regionBackup, int &Nintensity, int &Nmovement)
+{
+    extractRegion(n,region,true);
+    double currentRegionEval=evaluateRegion(region);
+    drawGaussian(atoms[n].location(0), atoms[n].location(1),
+                 atoms[n].location(2),region,-atoms[n].intensity);
+    regionBackup=region;
+
+#ifdef DEBUG
+    std::cout << "Atom n=" << n << " current intensity=" << atoms[n].intensity << " -> " << currentRegionEval << std::endl;
+#endif
+    // Change intensity
+    if (allowIntensity)
+    {
+        // Try with a Gaussian that is of different intensity
+        double tryCoeffs[8]={0, 0.1, 0.2, 0.5, 0.9, 0.99, 1.01, 1.1};
+        double bestRed=0;
+        int bestT=-1;
+        for (int t=0; t<8; t++)
+        {
+            region=regionBackup;
+            drawGaussian(atoms[n].location(0),
+                                 atoms[n].location(1), atoms[n].location(2),region,
+                                 tryCoeffs[t]*atoms[n].intensity);
+            double trialRegionEval=evaluateRegion(region);
+            double reduction=trialRegionEval-currentRegionEval;
+            if (reduction<bestRed)
+            {
+                bestRed=reduction;
+                bestT=t;
+#ifdef DEBUG
+                std::cout << "    better -> " << trialRegionEval << " (factor=" << tryCoeffs[t]  << ")" << std::endl;
+#endif
+            }
+        }
+        if (bestT!=-1)
+        {
+            atoms[n].intensity*=tryCoeffs[bestT];
+            region=regionBackup;
+            drawGaussian(atoms[n].location(0), atoms[n].location(1),
+                                 atoms[n].location(2),region,atoms[n].intensity);
+            insertRegion(region);
+            currentRegionEval=evaluateRegion(region);
+            drawGaussian(atoms[n].location(0),
+                                 atoms[n].location(1), atoms[n].location(2),region,
+                                 -atoms[n].intensity);
+            regionBackup=region;
+#ifdef DEBUG
+            std::cout << "    finally -> " << currentRegionEval << " (intensity=" << atoms[n].intensity  << ")" << std::endl;
+#endif
+            Nintensity++;
+        }
+    }
+
+    // Change location
+    if (allowMovement && atoms[n].intensity>0)
+    {
+        double tryX[6]={-0.45,0.5, 0.0 ,0.0, 0.0 ,0.0};
+        double tryY[6]={ 0.0 ,0.0,-0.45,0.5, 0.0 ,0.0};
+        double tryZ[6]={ 0.0 ,0.0, 0.0 ,0.0,-0.45,0.5};
+        double bestRed=0;
+        int bestT=-1;
+        for (int t=0; t<6; t++)
+        {
+            region=regionBackup;
+            drawGaussian(atoms[n].location(0)+tryZ[t],
+                                 atoms[n].location(1)+tryY[t],
+                                 atoms[n].location(2)+tryX[t],
+                                 region,atoms[n].intensity);
+            double trialRegionEval=evaluateRegion(region);
+            double reduction=trialRegionEval-currentRegionEval;
+            if (reduction<bestRed)
+            {
+                bestRed=reduction;
+                bestT=t;
+            }
+        }
+        if (bestT!=-1)
+        {
+            atoms[n].location(0)+=tryZ[bestT];
+            atoms[n].location(1)+=tryY[bestT];
+            atoms[n].location(2)+=tryX[bestT];
+            region=regionBackup;
+            drawGaussian(atoms[n].location(0),
+                                 atoms[n].location(1), atoms[n].location(2),region,
+                                 atoms[n].intensity);
+            insertRegion(region);
+            Nmovement++;
+        }
+    }
+}
+#undef DEBUG
+
 void* ProgVolumeToPseudoatoms::optimizeCurrentAtomsThread(
     void * threadArgs)
 {
@@ -717,8 +861,7 @@ void* ProgVolumeToPseudoatoms::optimizeCurrentAtomsThread(
         (Prog_Convert_Vol2Pseudo_ThreadParams *) threadArgs;
     ProgVolumeToPseudoatoms *parent=myArgs->parent;
     std::vector< PseudoAtom > &atoms=parent->atoms;
-    bool allowIntensity=parent->allowIntensity;
-    bool allowMovement=parent->allowMovement;
+    const PseudoAtomCells &cells=parent->cells;
     MultidimArray<double> region, regionBackup;
 
     barrier_t *barrier=&(parent->barrier);
@@ -728,106 +871,28 @@ void* ProgVolumeToPseudoatoms::optimizeCurrentAtomsThread(
         if (parent->threadOpCode==KILLTHREAD)
             return NULL;
 
+        // The cells of one color do not overlap, and they are distributed
+        // among the threads. The atoms of each cell are visited in order, so
+        // that the result does not depend on the number of threads.
         myArgs->Nintensity=0;
         myArgs->Nmovement=0;
-        int nmax=atoms.size();
-        for (int n=0; n<nmax; n++)
+        for (int color=0; color<8; color++)
         {
-            if ((n+1)%parent->numThreads!=myArgs->myThreadID)
-                continue;
-
-            parent->extractRegion(n,region,true);
-            double currentRegionEval=parent->evaluateRegion(region);
-            parent->drawGaussian(atoms[n].location(0), atoms[n].location(1),
-                                 atoms[n].location(2),region,-atoms[n].intensity);
-            regionBackup=region;
-
-#ifdef DEBUG
-            std::cout << "Atom n=" << n << " current intensity=" << atoms[n].intensity << " -> " << currentRegionEval << std::endl;
-#endif
-            // Change intensity
-            if (allowIntensity)
-            {
-                // Try with a Gaussian that is of different intensity
-                double tryCoeffs[8]={0, 0.1, 0.2, 0.5, 0.9, 0.99, 1.01, 1.1};
-                double bestRed=0;
-                int bestT=-1;
-                for (int t=0; t<8; t++)
-                {
-                    region=regionBackup;
-                    parent->drawGaussian(atoms[n].location(0),
-                                         atoms[n].location(1), atoms[n].location(2),region,
-                                         tryCoeffs[t]*atoms[n].intensity);
-                    double trialRegionEval=parent->evaluateRegion(region);
-                    double reduction=trialRegionEval-currentRegionEval;
-                    if (reduction<bestRed)
-                    {
-                        bestRed=reduction;
-                        bestT=t;
-#ifdef DEBUG
-                        std::cout << "    better -> " << trialRegionEval << " (factor=" << tryCoeffs[t]  << ")" << std::endl;
-#endif
-                    }
-                }
-                if (bestT!=-1)
-                {
-                    atoms[n].intensity*=tryCoeffs[bestT];
-                    region=regionBackup;
-                    parent->drawGaussian(atoms[n].location(0), atoms[n].location(1),
-                                         atoms[n].location(2),region,atoms[n].intensity);
-                    pthread_mutex_lock(&mutexUpdateVolume);
-                    parent->insertRegion(region);
-                    pthread_mutex_unlock(&mutexUpdateVolume);
-                    currentRegionEval=parent->evaluateRegion(region);
-                    parent->drawGaussian(atoms[n].location(0),
-                                         atoms[n].location(1), atoms[n].location(2),region,
-                                         -atoms[n].intensity);
-                    regionBackup=region;
-#ifdef DEBUG
-                    std::cout << "    finally -> " << currentRegionEval << " (intensity=" << atoms[n].intensity  << ")" << std::endl;
-#endif
-                    myArgs->Nintensity++;
-                }
-            }
-
-            // Change location
-            if (allowMovement && atoms[n].intensity>0)
+            const std::vector<int> &cellList=cells.cellsOfColor[color];
+            for (size_t m=myArgs->myThreadID; m<cellList.size(); m+=parent->numThreads)
             {
-                double tryX[6]={-0.45,0.5, 0.0 ,0.0, 0.0 ,0.0};
-                double tryY[6]={ 0.0 ,0.0,-0.45,0.5, 0.0 ,0.0};
-                double tryZ[6]={ 0.0 ,0.0, 0.0 ,0.0,-0.45,0.5};
-                double bestRed=0;
-                int bestT=-1;
-                for (int t=0; t<6; t++)
+                const std::vector<int> &cellAtoms=cells.atomsInCell[cellList[m]];
+                for (size_t a=0; a<cellAtoms.size(); a++)
                 {
-                    region=regionBackup;
-                    parent->drawGaussian(atoms[n].location(0)+tryZ[t],
-                                         atoms[n].location(1)+tryY[t],
-                                         atoms[n].location(2)+tryX[t],
-                                         region,atoms[n].intensity);
-                    double trialRegionEval=parent->evaluateRegion(region);
-                    double reduction=trialRegionEval-currentRegionEval;
-                    if (reduction<bestRed)
-                    {
-                        bestRed=reduction;
-                        bestT=t;
-                    }
-                }
-                if (bestT!=-1)
-                {
-                    atoms[n].location(0)+=tryZ[bestT];
-                    atoms[n].location(1)+=tryY[bestT];
-                    atoms[n].location(2)+=tryX[bestT];
-                    region=regionBackup;
-                    parent->drawGaussian(atoms[n].location(0),
-                                         atoms[n].location(1), atoms[n].location(2),region,
-                                         atoms[n].intensity);
-                    pthread_mutex_lock(&mutexUpdateVolume);
-                    parent->insertRegion(region);
-                    pthread_mutex_unlock(&mutexUpdateVolume);
-                    myArgs->Nmovement++;
+                    int n=cellAtoms[a];
+                    if (parent->threadOpCode==DRAWTHREAD)
+                        parent->drawGaussian(atoms[n].location(0),atoms[n].location(1),
+                                             atoms[n].location(2),parent->Vcurrent(),atoms[n].intensity);
+                    else
+                        parent->optimizeAtom(n,region,regionBackup,myArgs->Nintensity,myArgs->Nmovement);
                 }
             }
+            barrier_wait(&(parent->colorBarrier));
         }
 
         barrier_wait( barrier );
@@ -845,6 +910,7 @@ void ProgVolumeToPseudoatoms::optimizeCurrentAtoms()
     {
         double oldError=percentageDiff;
 
+        cells.build(atoms,Vin(),THREAD_CELL_SIZE);
         threadOpCode=WORKTHREAD;
         // Launch workers
         barrier_wait(&barrier);
@@ -882,6 +948,8 @@ void ProgVolumeToPseudoatoms::optimizeCurrentAtoms()
     while (!finished);
 }
 
+#undef THREAD_CELL_SIZE
+
 /* Write ------------------------------------------------------------------- */
 void ProgVolumeToPseudoatoms::writeResults()
 {
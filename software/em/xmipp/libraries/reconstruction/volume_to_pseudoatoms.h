@@ -57,6 +57,44 @@ public:
 /// Comparison between pseudo atoms
 bool operator <(const PseudoAtom &a, const PseudoAtom &b);
 
+/** Spatial bins of pseudoatoms.
+ * The volume is divided in cubic cells and each atom is assigned to the cell
+ * that contains its location. Two different cells of the same color (the
+ * parity of the cell indexes in Z, Y and X) are separated by at least one
+ * cell, so that if the cell size is larger than twice the support of an atom,
+ * the atoms of different cells of the same color never touch the same voxels.
+ */
+class PseudoAtomCells
+{
+public:
+    /// Cell size (in voxels)
+    double cellSize;
+
+    /// Number of cells in each direction
+    int Zcells, Ycells, Xcells;
+
+    /// Logical coordinates of the first voxel of the first cell
+    int k0, i0, j0;
+
+    /// Atoms (indexes) in each cell, sorted in increasing order
+    std::vector< std::vector<int> > atomsInCell;
+
+    /// Non-empty cells of each color
+    std::vector<int> cellsOfColor[8];
+public:
+    /// Assign the atoms to cells of the given size covering the volume V
+    void build(const std::vector<PseudoAtom> &atoms, const MultidimArray<double> &V, double _cellSize);
+
+    /// Cell of a location (locations outside the volume go to the closest cell)
+    void cellOf(const Matrix1D<double> &location, int &kc, int &ic, int &jc) const;
+
+    /// Index of a cell
+    inline int cellIndex(int kc, int ic, int jc) const
+    {
+        return (kc*Ycells+ic)*Xcells+jc;
+    }
+};
+
 // Forward declaration
 class ProgVolumeToPseudoatoms;
 
@@ -184,7 +222,13 @@ public:
 
     /// Optimize current atoms
     void optimizeCurrentAtoms();
-    
+
+    /** Optimize the intensity and location of atom n.
+        The regions are work space. Nintensity and Nmovement are increased
+        if the atom changes. */
+    void optimizeAtom(int n, MultidimArray<double> &region, MultidimArray<double> &regionBackup,
+                      int &Nintensity, int &Nmovement);
+
     /// Optimize current atoms (thread)
     static void* optimizeCurrentAtomsThread(void * threadArgs);
     
@@ -226,9 +270,16 @@ public:
     
     // Barrier
     barrier_t barrier;
-    
+
+    // Barrier between the colors of the cells (only worker threads)
+    barrier_t colorBarrier;
+
+    // Spatial bins of the atoms processed by the threads
+    PseudoAtomCells cells;
+
 #define KILLTHREAD -1
 #define WORKTHREAD  0
+#define DRAWTHREAD  1
     // Thread operation code
     int threadOpCode;
     